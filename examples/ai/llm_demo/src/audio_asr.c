@@ -17,7 +17,7 @@
 #include "http_client_interface.h"
 #include "iotdns.h"
 #include "llm_config.h"
-#include "mix_method.h"
+#include "uni_codec.h"
 #include "tal_log.h"
 #include "tal_memory.h"
 #include "tal_system.h"
@@ -140,13 +140,13 @@ int asr_request_baidu(ASR_format_e format, int rate, int channel, void *data, in
     TUYA_CALL_ERR_GOTO(__asr_baidu_get_token(token), err_exit);
 
     /* data base64 encode*/
-    base64_data = tal_malloc(len / 3 * 4 + 5);
+    size_t base64_len = 0;
+    base64_data = tal_malloc(UNI_BASE64_ENCODE_LEN(len));
     TUYA_CHECK_NULL_GOTO(base64_data, err_exit);
-    memset(base64_data, 0, len / 3 * 4 + 5);
-    tuya_base64_encode(data, base64_data, len);
+    TUYA_CALL_ERR_GOTO(uni_base64_encode(data, len, base64_data, UNI_BASE64_ENCODE_LEN(len), &base64_len), err_exit);
 
     /* make HTTP body */
-    size_t body_buf_length = len / 3 * 4 + 5 + 512;
+    size_t body_buf_length = base64_len + 512;
     body_buf = tal_malloc(body_buf_length);
     TUYA_CHECK_NULL_GOTO(body_buf, err_exit);
     memset(body_buf, 0, body_buf_length);
@@ -56,4 +56,15 @@ unsigned int hash_crc32i_finish(unsigned int hash);
  */
 unsigned int hash_crc32i_total(const void* data, unsigned int size);
 
+#if defined(CRC_BENCHMARK) && (CRC_BENCHMARK == 1)
+/**
+ * @brief Self test and throughput log of the CRC32I kernels.
+ *
+ * @param size The buffer size used for the throughput runs.
+ * @param rounds The number of runs.
+ * @return OPRT_OK on success, otherwise an error code.
+ */
+int hash_crc32i_benchmark(unsigned int size, unsigned int rounds);
+#endif
+
 #endif
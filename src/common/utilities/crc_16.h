@@ -28,6 +28,18 @@ extern "C" {
 __CRC_16_MODULE_EXT
 unsigned short get_crc_16(unsigned char *data, unsigned short size);
 
+#if defined(CRC_BENCHMARK) && (CRC_BENCHMARK == 1)
+/**
+ * @brief Self test and throughput log of get_crc_16().
+ *
+ * @param size The buffer size used for the throughput runs.
+ * @param rounds The number of runs.
+ * @return OPRT_OK on success, otherwise an error code.
+ */
+__CRC_16_MODULE_EXT
+int get_crc_16_benchmark(unsigned short size, unsigned int rounds);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
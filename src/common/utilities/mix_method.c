@@ -16,13 +16,12 @@
 #define __MIX_METHOD_GLOBALS
 #include "mix_method.h"
 #include "tal_memory.h"
-#include "mbedtls/base64.h"
+#include "uni_codec.h"
 
 /***********************************************************
 *************************micro define***********************
 ***********************************************************/
 #define __tolower(c)                 ((('A' <= (c)) && ((c) <= 'Z')) ? ((c) - 'A' + 'a') : (c))
-#define TY_BASE64_BUF_LEN_CALC(slen) (((slen) / 3 + ((slen) % 3 != 0)) * 4 + 1) // 1 for '\0'
 
 /***********************************************************
 *************************variable define********************
@@ -125,23 +124,7 @@ void ascs2hex(unsigned char *hex, unsigned char *ascs, int srclen)
  */
 void hex2str(unsigned char *pbDest, unsigned char *pbSrc, int nLen)
 {
-    char ddl, ddh;
-    int i;
-
-    for (i = 0; i < nLen; i++) {
-        ddh = 48 + pbSrc[i] / 16;
-        ddl = 48 + pbSrc[i] % 16;
-        if (ddh > 57) {
-            ddh = ddh + 7;
-        }
-        if (ddl > 57) {
-            ddl = ddl + 7;
-        }
-        pbDest[i * 2] = ddh;
-        pbDest[i * 2 + 1] = ddl;
-    }
-
-    pbDest[nLen * 2] = '\0';
+    uni_hex_encode(pbSrc, nLen, (char *)pbDest, true);
 }
 
 /**
@@ -168,19 +151,7 @@ void hex2str(unsigned char *pbDest, unsigned char *pbSrc, int nLen)
  */
 void byte2str(unsigned char *pbDest, unsigned char *pbSrc, int nLen, bool_t upper)
 {
-    char to_lower[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-    char to_upper[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
-    char *tmp = upper ? to_upper : to_lower;
-
-    int i;
-    for (i = 0; i < nLen; i++) {
-        pbDest[i * 2] = tmp[((pbSrc[i] & 0xF0) >> 4)];
-        pbDest[i * 2 + 1] = tmp[(pbSrc[i] & 0x0F)];
-    }
-
-    pbDest[nLen * 2] = '\0';
-    return;
+    uni_hex_encode(pbSrc, nLen, (char *)pbDest, upper ? true : false);
 }
 
 /**
@@ -466,9 +437,8 @@ int tuya_toupper(int c)
  */
 char *tuya_base64_encode(const unsigned char *bindata, char *base64, int binlength)
 {
-    size_t dlen, olen;
-    dlen = TY_BASE64_BUF_LEN_CALC(binlength);
-    mbedtls_base64_encode((unsigned char *)base64, dlen, &olen, bindata, binlength);
+    size_t olen;
+    uni_base64_encode(bindata, binlength, base64, UNI_BASE64_ENCODE_LEN(binlength), &olen);
     return base64;
 }
 
@@ -484,9 +454,12 @@ char *tuya_base64_encode(const unsigned char *bindata, char *base64, int binleng
  */
 int tuya_base64_decode(const char *base64, unsigned char *bindata)
 {
+    size_t len = strlen(base64);
     size_t olen = 0;
 
-    mbedtls_base64_decode(bindata, strlen(base64), &olen, (unsigned char *)base64, strlen(base64));
+    if (OPRT_OK != uni_base64_decode(base64, len, bindata, UNI_BASE64_DECODE_LEN(len), &olen)) {
+        return 0;
+    }
 
     return olen;
 }
@@ -0,0 +1,625 @@
+/**
+ * @file uni_codec.c
+ * @brief Hex and base64 encoders and decoders.
+ *
+ * The scalar paths are table-driven and used on every target, for the tails
+ * and for input the vector paths refuse (e.g. base64 with whitespace). The
+ * vector paths are picked at compile time: SSE2 hex and NEON hex/base64 when
+ * the compiler targets them, SSSE3 base64 on x86 after a runtime CPU check.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+#include "uni_codec.h"
+#include "tuya_cloud_types.h"
+
+#if defined(UNI_CODEC_BENCHMARK) && (UNI_CODEC_BENCHMARK == 1)
+#include <stdio.h>
+#include "tal_log.h"
+#include "tal_memory.h"
+#include "tal_system.h"
+#include "mbedtls/base64.h"
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define UNI_CODEC_SSE 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define UNI_CODEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define B64_INVALID 0xFF
+#define B64_SPACE   0xFE
+#define B64_PAD     0xFD
+
+static const char s_hex_upper[] = "0123456789ABCDEF";
+static const char s_hex_lower[] = "0123456789abcdef";
+
+static const char s_b64_enc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// clang-format off
+/* hex digit value, 0xFF for everything else */
+static const uint8_t s_hex_dec[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/* base64 sextet value, B64_SPACE for " \t\r\n", B64_PAD for '=', B64_INVALID for the rest */
+static const uint8_t s_b64_dec[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xFE, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFD, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+// clang-format on
+
+/* -------------------------------------------------------------------------- */
+/*                               vector blocks                                */
+/* -------------------------------------------------------------------------- */
+/*
+ * Each block function converts as many whole blocks as it can and returns
+ * the number of input bytes it consumed, the scalar code does the rest.
+ */
+
+#if defined(UNI_CODEC_SSE)
+static inline __m128i __sse_hex_chars(__m128i nibbles, __m128i alpha)
+{
+    __m128i over9 = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), _mm_and_si128(over9, alpha));
+}
+
+static size_t __hex_encode_blocks(const uint8_t *src, size_t len, char *dst, bool upper)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i alpha = _mm_set1_epi8(upper ? 'A' - '9' - 1 : 'a' - '9' - 1);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+        __m128i lo = _mm_and_si128(in, mask);
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), __sse_hex_chars(_mm_unpacklo_epi8(hi, lo), alpha));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), __sse_hex_chars(_mm_unpackhi_epi8(hi, lo), alpha));
+    }
+
+    return i;
+}
+
+/* unsigned x <= limit, per byte */
+static inline __m128i __sse_le_epu8(__m128i x, char limit)
+{
+    return _mm_cmpeq_epi8(_mm_subs_epu8(x, _mm_set1_epi8(limit)), _mm_setzero_si128());
+}
+
+/* hex character values in the low byte of each 16-bit pair, valid mask in *ok */
+static inline __m128i __sse_hex_values(__m128i c, __m128i *ok)
+{
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_digit = __sse_le_epu8(digit, 9);
+    __m128i is_alpha = __sse_le_epu8(alpha, 5);
+
+    *ok = _mm_and_si128(*ok, _mm_or_si128(is_digit, is_alpha));
+    alpha = _mm_add_epi8(alpha, _mm_set1_epi8(10));
+    __m128i v = _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_andnot_si128(is_digit, alpha));
+
+    /* high nibble char first: pair (h, l) becomes h << 4 | l */
+    __m128i h = _mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 4);
+    return _mm_or_si128(h, _mm_srli_epi16(v, 8));
+}
+
+static size_t __hex_decode_blocks(const char *src, size_t len, uint8_t *dst)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m128i ok = _mm_set1_epi8(-1);
+        __m128i a = __sse_hex_values(_mm_loadu_si128((const __m128i *)(src + i)), &ok);
+        __m128i b = __sse_hex_values(_mm_loadu_si128((const __m128i *)(src + i + 16)), &ok);
+        if (_mm_movemask_epi8(ok) != 0xFFFF) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(dst + i / 2), _mm_packus_epi16(a, b));
+    }
+
+    return i;
+}
+
+/*
+ * base64 needs pshufb, SSSE3 is checked at runtime unless the build
+ * already targets it.
+ * http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+ * http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html
+ */
+static bool __has_ssse3(void)
+{
+#if defined(__SSSE3__)
+    return true;
+#else
+    static int s_ssse3 = -1;
+    if (s_ssse3 < 0) {
+        s_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return s_ssse3 == 1;
+#endif
+}
+
+__attribute__((target("ssse3"))) static size_t __b64_encode_ssse3(const uint8_t *src, size_t len, char *dst)
+{
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i, o = 0;
+
+    /* 12 bytes per round, the load reads 16 */
+    for (i = 0; i + 16 <= len; i += 12, o += 16) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), shuf);
+
+        /* split each 3 bytes into 4 sextets, one per byte */
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(t1, t3);
+
+        /* sextet to character: add the offset of its range */
+        __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+        range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+        __m128i out = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, range), idx);
+
+        _mm_storeu_si128((__m128i *)(dst + o), out);
+    }
+
+    return i;
+}
+
+__attribute__((target("ssse3"))) static size_t __b64_decode_ssse3(const char *src, size_t len, uint8_t *dst,
+                                                                  size_t dst_size, size_t *olen)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B,
+                                         0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i, o = 0;
+
+    /* 16 characters to 12 bytes per round, the store writes 16 */
+    for (i = 0; i + 16 <= len && o + 16 <= dst_size; i += 16, o += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi_nib = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+        __m128i lo_nib = _mm_and_si128(in, mask);
+
+        /* padding, whitespace or garbage: leave the block to the scalar code */
+        __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo_nib), _mm_shuffle_epi8(lut_hi, hi_nib));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF) {
+            break;
+        }
+
+        __m128i eq_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi_nib));
+        __m128i v = _mm_add_epi8(in, roll);
+
+        /* 4 sextets to 3 bytes in each 32-bit lane, then squeeze out the gaps */
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)(dst + o), _mm_shuffle_epi8(v, pack));
+    }
+
+    *olen = o;
+    return i;
+}
+
+static size_t __b64_encode_blocks(const uint8_t *src, size_t len, char *dst)
+{
+    return __has_ssse3() ? __b64_encode_ssse3(src, len, dst) : 0;
+}
+
+static size_t __b64_decode_blocks(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen)
+{
+    *olen = 0;
+    return __has_ssse3() ? __b64_decode_ssse3(src, len, dst, dst_size, olen) : 0;
+}
+
+#elif defined(UNI_CODEC_NEON)
+static inline uint8x16_t __neon_hex_chars(uint8x16_t nibbles, uint8x16_t alpha)
+{
+    uint8x16_t over9 = vcgtq_u8(nibbles, vdupq_n_u8(9));
+    return vaddq_u8(vaddq_u8(nibbles, vdupq_n_u8('0')), vandq_u8(over9, alpha));
+}
+
+static inline bool __neon_all_set(uint8x16_t v)
+{
+#if defined(__aarch64__)
+    return vminvq_u8(v) == 0xFF;
+#else
+    uint8x8_t m = vand_u8(vget_low_u8(v), vget_high_u8(v));
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    return vget_lane_u8(m, 0) == 0xFF;
+#endif
+}
+
+static size_t __hex_encode_blocks(const uint8_t *src, size_t len, char *dst, bool upper)
+{
+    const uint8x16_t alpha = vdupq_n_u8(upper ? 'A' - '9' - 1 : 'a' - '9' - 1);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        uint8x16_t in = vld1q_u8(src + i);
+        uint8x16x2_t out;
+        out.val[0] = __neon_hex_chars(vshrq_n_u8(in, 4), alpha);
+        out.val[1] = __neon_hex_chars(vandq_u8(in, vdupq_n_u8(0x0F)), alpha);
+        vst2q_u8((uint8_t *)dst + 2 * i, out);
+    }
+
+    return i;
+}
+
+static inline uint8x16_t __neon_hex_values(uint8x16_t c, uint8x16_t *ok)
+{
+    uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+    uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+
+    *ok = vandq_u8(*ok, vorrq_u8(is_digit, is_alpha));
+    return vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+static size_t __hex_decode_blocks(const char *src, size_t len, uint8_t *dst)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        uint8x16x2_t in = vld2q_u8((const uint8_t *)src + i);
+        uint8x16_t ok = vdupq_n_u8(0xFF);
+        uint8x16_t hi = __neon_hex_values(in.val[0], &ok);
+        uint8x16_t lo = __neon_hex_values(in.val[1], &ok);
+        if (!__neon_all_set(ok)) {
+            break;
+        }
+        vst1q_u8(dst + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+
+    return i;
+}
+
+#if defined(__aarch64__)
+/* 64-entry table lookups need the AArch64 vqtbl4q */
+static size_t __b64_encode_blocks(const uint8_t *src, size_t len, char *dst)
+{
+    uint8x16x4_t lut;
+    size_t i, o = 0;
+
+    lut.val[0] = vld1q_u8((const uint8_t *)s_b64_enc);
+    lut.val[1] = vld1q_u8((const uint8_t *)s_b64_enc + 16);
+    lut.val[2] = vld1q_u8((const uint8_t *)s_b64_enc + 32);
+    lut.val[3] = vld1q_u8((const uint8_t *)s_b64_enc + 48);
+
+    for (i = 0; i + 48 <= len; i += 48, o += 64) {
+        uint8x16x3_t in = vld3q_u8(src + i);
+        uint8x16x4_t out;
+        const uint8x16_t m = vdupq_n_u8(0x3F);
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), m);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), m);
+        out.val[3] = vandq_u8(in.val[2], m);
+
+        out.val[0] = vqtbl4q_u8(lut, out.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, out.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, out.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, out.val[3]);
+        vst4q_u8((uint8_t *)dst + o, out);
+    }
+
+    return i;
+}
+
+static size_t __b64_decode_blocks(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen)
+{
+    uint8x16x4_t lut_lo, lut_hi;
+    size_t i, o = 0;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+        lut_lo.val[k] = vld1q_u8(s_b64_dec + 16 * k);
+        lut_hi.val[k] = vld1q_u8(s_b64_dec + 64 + 16 * k);
+    }
+
+    for (i = 0; i + 64 <= len && o + 48 <= dst_size; i += 64, o += 48) {
+        uint8x16x4_t in = vld4q_u8((const uint8_t *)src + i);
+        uint8x16_t v[4];
+        uint8x16_t err = vdupq_n_u8(0);
+
+        for (k = 0; k < 4; k++) {
+            /* characters >= 64 miss the first table, >= 128 miss both and keep bit 7 */
+            v[k] = vqtbl4q_u8(lut_lo, in.val[k]);
+            v[k] = vqtbx4q_u8(v[k], lut_hi, vsubq_u8(in.val[k], vdupq_n_u8(64)));
+            err = vorrq_u8(err, vorrq_u8(v[k], in.val[k]));
+        }
+        if (vmaxvq_u8(err) & 0x80) {
+            break;
+        }
+
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(v[0], 2), vshrq_n_u8(v[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(v[1], 4), vshrq_n_u8(v[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(v[2], 6), v[3]);
+        vst3q_u8(dst + o, out);
+    }
+
+    *olen = o;
+    return i;
+}
+#else
+static size_t __b64_encode_blocks(const uint8_t *src, size_t len, char *dst)
+{
+    return 0;
+}
+
+static size_t __b64_decode_blocks(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen)
+{
+    *olen = 0;
+    return 0;
+}
+#endif
+
+#else
+static size_t __hex_encode_blocks(const uint8_t *src, size_t len, char *dst, bool upper)
+{
+    return 0;
+}
+
+static size_t __hex_decode_blocks(const char *src, size_t len, uint8_t *dst)
+{
+    return 0;
+}
+
+static size_t __b64_encode_blocks(const uint8_t *src, size_t len, char *dst)
+{
+    return 0;
+}
+
+static size_t __b64_decode_blocks(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen)
+{
+    *olen = 0;
+    return 0;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                    hex                                     */
+/* -------------------------------------------------------------------------- */
+
+size_t uni_hex_encode(const uint8_t *src, size_t len, char *dst, bool upper)
+{
+    const char *digits = upper ? s_hex_upper : s_hex_lower;
+    size_t i = __hex_encode_blocks(src, len, dst, upper);
+
+    for (; i < len; i++) {
+        dst[2 * i] = digits[src[i] >> 4];
+        dst[2 * i + 1] = digits[src[i] & 0x0F];
+    }
+    dst[2 * len] = '\0';
+
+    return 2 * len;
+}
+
+int uni_hex_decode(const char *src, size_t len, uint8_t *dst)
+{
+    if (len % 2) {
+        return OPRT_INVALID_PARM;
+    }
+
+    size_t i = __hex_decode_blocks(src, len, dst);
+
+    for (; i < len; i += 2) {
+        uint8_t h = s_hex_dec[(uint8_t)src[i]];
+        uint8_t l = s_hex_dec[(uint8_t)src[i + 1]];
+        if ((h | l) & 0xF0) {
+            return OPRT_INVALID_PARM;
+        }
+        dst[i / 2] = (h << 4) | l;
+    }
+
+    return (int)(len / 2);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   base64                                   */
+/* -------------------------------------------------------------------------- */
+
+int uni_base64_encode(const uint8_t *src, size_t len, char *dst, size_t dst_size, size_t *olen)
+{
+    if (dst_size < UNI_BASE64_ENCODE_LEN(len)) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    size_t i = __b64_encode_blocks(src, len, dst);
+    size_t o = i / 3 * 4;
+
+    for (; i + 3 <= len; i += 3, o += 4) {
+        uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+        dst[o] = s_b64_enc[v >> 18];
+        dst[o + 1] = s_b64_enc[(v >> 12) & 0x3F];
+        dst[o + 2] = s_b64_enc[(v >> 6) & 0x3F];
+        dst[o + 3] = s_b64_enc[v & 0x3F];
+    }
+
+    if (i < len) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < len) {
+            v |= (uint32_t)src[i + 1] << 8;
+        }
+        dst[o] = s_b64_enc[v >> 18];
+        dst[o + 1] = s_b64_enc[(v >> 12) & 0x3F];
+        dst[o + 2] = (i + 1 < len) ? s_b64_enc[(v >> 6) & 0x3F] : '=';
+        dst[o + 3] = '=';
+        o += 4;
+    }
+    dst[o] = '\0';
+
+    if (olen) {
+        *olen = o;
+    }
+    return OPRT_OK;
+}
+
+int uni_base64_decode(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen)
+{
+    size_t o = 0;
+    size_t i = __b64_decode_blocks(src, len, dst, dst_size, &o);
+    uint32_t acc = 0;
+    int n = 0, pad = 0;
+
+    for (; i < len; i++) {
+        uint8_t v = s_b64_dec[(uint8_t)src[i]];
+
+        if (v == B64_SPACE) {
+            continue;
+        }
+        if (v == B64_PAD) {
+            /* "xx==" or "xxx=" only */
+            if (n < 2 || ++pad > 2) {
+                return OPRT_INVALID_PARM;
+            }
+            continue;
+        }
+        if (v == B64_INVALID || pad) {
+            return OPRT_INVALID_PARM;
+        }
+
+        acc = (acc << 6) | v;
+        if (++n == 4) {
+            if (o + 3 > dst_size) {
+                return OPRT_BUFFER_NOT_ENOUGH;
+            }
+            dst[o++] = acc >> 16;
+            dst[o++] = acc >> 8;
+            dst[o++] = acc;
+            acc = 0;
+            n = 0;
+        }
+    }
+
+    /* a partial group: 2 or 3 sextets make 1 or 2 bytes */
+    if (n == 1 || (pad && n + pad != 4)) {
+        return OPRT_INVALID_PARM;
+    }
+    if (n > 1) {
+        if (o + n - 1 > dst_size) {
+            return OPRT_BUFFER_NOT_ENOUGH;
+        }
+        acc <<= 6 * (4 - n);
+        dst[o++] = acc >> 16;
+        if (n == 3) {
+            dst[o++] = acc >> 8;
+        }
+    }
+
+    if (olen) {
+        *olen = o;
+    }
+    return OPRT_OK;
+}
+
+#if defined(UNI_CODEC_BENCHMARK) && (UNI_CODEC_BENCHMARK == 1)
+int uni_codec_benchmark(size_t len, uint32_t rounds)
+{
+    size_t b64_size = UNI_BASE64_ENCODE_LEN(len);
+    size_t olen = 0;
+    uint32_t r;
+    size_t i;
+
+    if (len == 0 || rounds == 0) {
+        return OPRT_INVALID_PARM;
+    }
+
+    uint8_t *bin = tal_malloc(len);
+    char *txt = tal_malloc(UNI_HEX_ENCODE_LEN(len) > b64_size ? UNI_HEX_ENCODE_LEN(len) : b64_size);
+    if (bin == NULL || txt == NULL) {
+        tal_free(bin);
+        tal_free(txt);
+        return OPRT_MALLOC_FAILED;
+    }
+    for (i = 0; i < len; i++) {
+        bin[i] = (uint8_t)(i * 167 + 13);
+    }
+
+    /* the per byte sprintf that atop_request_data_encode() used */
+    SYS_TIME_T t0 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < len; i++) {
+            sprintf(txt + 2 * i, "%02X", bin[i]);
+        }
+    }
+    SYS_TIME_T t1 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        uni_hex_encode(bin, len, txt, true);
+    }
+    SYS_TIME_T t2 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        uni_hex_decode(txt, 2 * len, bin);
+    }
+    SYS_TIME_T t3 = tal_system_get_millisecond();
+    PR_NOTICE("hex %d x %d bytes, sprintf enc:%d ms, enc:%d ms, dec:%d ms", rounds, len, (int)(t1 - t0),
+              (int)(t2 - t1), (int)(t3 - t2));
+
+    t0 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        mbedtls_base64_encode((unsigned char *)txt, b64_size, &olen, bin, len);
+    }
+    t1 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        uni_base64_encode(bin, len, txt, b64_size, &olen);
+    }
+    t2 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        mbedtls_base64_decode(bin, len, &i, (const unsigned char *)txt, olen);
+    }
+    t3 = tal_system_get_millisecond();
+    for (r = 0; r < rounds; r++) {
+        uni_base64_decode(txt, olen, bin, len, &i);
+    }
+    SYS_TIME_T t4 = tal_system_get_millisecond();
+    PR_NOTICE("base64 %d x %d bytes, mbedtls enc:%d ms dec:%d ms, enc:%d ms dec:%d ms", rounds, len, (int)(t1 - t0),
+              (int)(t3 - t2), (int)(t2 - t1), (int)(t4 - t3));
+
+    tal_free(bin);
+    tal_free(txt);
+    return OPRT_OK;
+}
+#endif
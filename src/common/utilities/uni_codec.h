@@ -0,0 +1,104 @@
+/**
+ * @file uni_codec.h
+ * @brief Hex and base64 encoders and decoders.
+ *
+ * Table-driven codecs shared by the cloud request path (ATOP payloads, OTA
+ * HMACs, MQTT passwords, raw dps, audio uploads). On Linux hosts with SSE2/
+ * SSSE3 and on ARM with NEON the bulk of the data is converted 16 to 64 bytes
+ * at a time, MCUs use the scalar tables.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __UNI_CODEC_H__
+#define __UNI_CODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Buffer size uni_hex_encode() needs for n bytes, terminator included.
+ */
+#define UNI_HEX_ENCODE_LEN(n) ((n) * 2 + 1)
+
+/**
+ * @brief Buffer size uni_base64_encode() needs for n bytes, terminator included.
+ */
+#define UNI_BASE64_ENCODE_LEN(n) ((((n) + 2) / 3) * 4 + 1)
+
+/**
+ * @brief Largest output of uni_base64_decode() for n input characters.
+ */
+#define UNI_BASE64_DECODE_LEN(n) ((((n) + 3) / 4) * 3)
+
+/**
+ * @brief Encodes bytes as hex characters.
+ *
+ * @param src The bytes to encode.
+ * @param len The number of bytes.
+ * @param dst The output, at least UNI_HEX_ENCODE_LEN(len) bytes. It is zero
+ * terminated.
+ * @param upper true for "0-9A-F", false for "0-9a-f".
+ * @return The number of characters written, terminator excluded.
+ */
+size_t uni_hex_encode(const uint8_t *src, size_t len, char *dst, bool upper);
+
+/**
+ * @brief Decodes hex characters, either case.
+ *
+ * @param src The hex characters.
+ * @param len The number of characters, must be even.
+ * @param dst The output, at least len / 2 bytes. May alias src.
+ * @return The number of bytes written, OPRT_INVALID_PARM on an odd length or
+ * a character that is not hex.
+ */
+int uni_hex_decode(const char *src, size_t len, uint8_t *dst);
+
+/**
+ * @brief Encodes bytes as padded base64 (RFC 4648).
+ *
+ * @param src The bytes to encode.
+ * @param len The number of bytes.
+ * @param dst The output. It is zero terminated.
+ * @param dst_size The size of dst, at least UNI_BASE64_ENCODE_LEN(len).
+ * @param olen The number of characters written, terminator excluded.
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if dst is too small.
+ */
+int uni_base64_encode(const uint8_t *src, size_t len, char *dst, size_t dst_size, size_t *olen);
+
+/**
+ * @brief Decodes base64 (RFC 4648).
+ *
+ * Whitespace is skipped, as in PEM data, and the padding may be left out.
+ *
+ * @param src The base64 characters.
+ * @param len The number of characters.
+ * @param dst The output. May alias src.
+ * @param dst_size The size of dst, UNI_BASE64_DECODE_LEN(len) is always enough.
+ * @param olen The number of bytes written.
+ * @return OPRT_OK on success, OPRT_INVALID_PARM on malformed input,
+ * OPRT_BUFFER_NOT_ENOUGH if dst is too small.
+ */
+int uni_base64_decode(const char *src, size_t len, uint8_t *dst, size_t dst_size, size_t *olen);
+
+#if defined(UNI_CODEC_BENCHMARK) && (UNI_CODEC_BENCHMARK == 1)
+/**
+ * @brief Logs the throughput of the codecs against sprintf("%02X") and the
+ * mbedtls base64 functions, converting rounds buffers of len bytes with each.
+ *
+ * @return OPRT_OK on success, otherwise an error code.
+ */
+int uni_codec_benchmark(size_t len, uint32_t rounds);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UNI_CODEC_H__ */
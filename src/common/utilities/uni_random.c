@@ -15,7 +15,39 @@
  */
 
 #include "tuya_tls.h"
+#include "tal_mutex.h"
 #include "stdlib.h"
+#include "string.h"
+
+/**
+ * Small requests (nonces, sequence numbers, single integers) are served from
+ * a pool that is refilled from the CTR_DRBG in one call, instead of paying a
+ * DRBG invocation for every few bytes. Bytes are wiped once handed out.
+ */
+#ifndef UNI_RANDOM_POOL_SIZE
+#define UNI_RANDOM_POOL_SIZE 128
+#endif
+
+static MUTEX_HANDLE s_pool_mutex = NULL;
+static unsigned char s_pool[UNI_RANDOM_POOL_SIZE];
+static size_t s_pool_pos = UNI_RANDOM_POOL_SIZE;
+
+/**
+ * @brief Creates the lock of the random pool.
+ *
+ * Called once from tuya_tls_init(), after the DRBG is seeded. Until then
+ * every request goes to the DRBG directly, the pool is never touched
+ * without its lock.
+ *
+ * @return 0 on success, otherwise an error code.
+ */
+int uni_random_init(void)
+{
+    if (s_pool_mutex != NULL) {
+        return 0;
+    }
+    return tal_mutex_create_init(&s_pool_mutex);
+}
 
 /**
  * @brief Generates a random sequence of bytes.
@@ -30,7 +62,34 @@
  */
 int uni_random_bytes(unsigned char *output, size_t output_len)
 {
-    return tuya_tls_random(output, output_len);
+    if (output_len >= UNI_RANDOM_POOL_SIZE / 2 || s_pool_mutex == NULL) {
+        return tuya_tls_random(output, output_len);
+    }
+
+    int ret = 0;
+    tal_mutex_lock(s_pool_mutex);
+    while (output_len > 0) {
+        if (s_pool_pos == UNI_RANDOM_POOL_SIZE) {
+            ret = tuya_tls_random(s_pool, UNI_RANDOM_POOL_SIZE);
+            if (ret != 0) {
+                break;
+            }
+            s_pool_pos = 0;
+        }
+
+        size_t n = UNI_RANDOM_POOL_SIZE - s_pool_pos;
+        if (n > output_len) {
+            n = output_len;
+        }
+        memcpy(output, s_pool + s_pool_pos, n);
+        memset(s_pool + s_pool_pos, 0, n);
+        s_pool_pos += n;
+        output += n;
+        output_len -= n;
+    }
+    tal_mutex_unlock(s_pool_mutex);
+
+    return ret;
 }
 
 /**
@@ -85,12 +144,31 @@ uint32_t uni_random(void)
  */
 int uni_random_string(char *dst, int size)
 {
+    static const char seed[] = "0123456789abcdef";
+    unsigned char rand[16];
     int i = 0;
-    char const *seed = "0123456789abcdef";
 
-    for (i = 0; i < size; ++i) {
-        dst[i] = seed[uni_random_range(16)];
+    /* one pool read per 32 characters, two characters per random byte */
+    while (i < size) {
+        int n = (size - i + 1) / 2;
+        if (n > (int)sizeof(rand)) {
+            n = sizeof(rand);
+        }
+
+        int ret = uni_random_bytes(rand, n);
+        if (ret != 0) {
+            return ret;
+        }
+
+        int j;
+        for (j = 0; j < n && i < size; j++) {
+            dst[i++] = seed[rand[j] >> 4];
+            if (i < size) {
+                dst[i++] = seed[rand[j] & 0x0f];
+            }
+        }
     }
+    memset(rand, 0, sizeof(rand));
 
     return 0;
 }
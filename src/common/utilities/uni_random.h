@@ -35,16 +35,20 @@ extern "C" {
 uint32_t uni_random(void);
 
 /**
- * @brief Generates a random integer using the uni_random_bytes function.
+ * @brief Creates the lock of the random byte pool.
  *
- * @return The generated random integer.
+ * Called once by tuya_tls_init(). Before that, requests bypass the pool and
+ * read the DRBG directly.
+ *
+ * @return 0 on success, otherwise an error code.
  */
 int uni_random_init(void);
 
 /**
  * @brief Generates a random string of characters.
  *
- * This function generates a random string of characters by selecting characters from a seed string.
+ * This function generates a random string of lowercase hex characters, two
+ * characters per random byte, e.g. for protocol nonces. dst is not terminated.
  *
  * @param dst The destination buffer to store the generated string.
  * @param size The size of the destination buffer.
@@ -2880,10 +2880,12 @@ __exit:
 
     if (pResponse->pBuffer) {
         HTTP_FREE(pResponse->pBuffer);
+        pResponse->pBuffer = NULL;
     }
 
     if (pResponse->pBody) {
         HTTP_FREE(pResponse->pBody);
+        pResponse->pBody = NULL;
     }
 
     return returnStatus;
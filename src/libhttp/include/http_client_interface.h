@@ -31,6 +31,7 @@ typedef struct http_client_request {
     const uint8_t *body;
     size_t body_length;
     uint32_t timeout_ms;
+    bool keep_alive; /**< Reuse a pooled connection to host:port, see ENABLE_HTTP_KEEPALIVE. */
 } http_client_request_t;
 
 typedef struct http_client_response {
@@ -60,8 +61,23 @@ typedef struct http_client_response {
     uint16_t status_code;
 } http_client_response_t;
 
+/**
+ * @brief Initializes the HTTP client, call it once before the first request.
+ *
+ * Requests made without it work but do not reuse keep-alive connections.
+ */
+int http_client_init(void);
+
 http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response);
 
 int http_client_free(http_client_response_t *response);
 
+/**
+ * @brief Close all idle keep-alive connections.
+ *
+ * Call it when the server endpoint or its certificate changes. Connections
+ * in use are closed as soon as their request completes.
+ */
+int http_client_keepalive_flush(void);
+
 #endif /* ifndef HTTP_CLIENT_INTERFACE_H */
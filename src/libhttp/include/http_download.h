@@ -8,13 +8,23 @@ extern "C" {
 #include "tuya_cloud_types.h"
 #include "http_client_interface.h"
 
+//! range_length used when the config leaves it 0
+#define HTTP_DOWNLOAD_RANGE_LENGTH_DEFAULT (8 * 1024)
+
 typedef enum {
     DL_EVENT_CONNECTED,
     DL_EVENT_START,
     DL_EVENT_ON_FILESIZE,
+    /* the handler may keep data and put another tal_malloc buffer of
+       range_length + 1 bytes in its place, remain_len is then ignored */
     DL_EVENT_ON_DATA,
     DL_EVENT_FINISH,
     DL_EVENT_FAULT,
+    /* offset: resume offset, clear it to refuse and start from 0 */
+    DL_EVENT_ON_RESUME,
+    /* offset: all data below it is consumed and about to be persisted,
+       lower it to what the handler could persist */
+    DL_EVENT_CHECKPOINT,
 } http_download_event_id_t;
 
 typedef struct {
@@ -35,6 +45,8 @@ typedef struct {
     uint32_t timeout_ms;
     size_t range_length;
     size_t file_size;
+    /* tal_kv key of the progress record, NULL to never resume */
+    const char *resume_key;
     void *user_data;
     http_download_event_cb_t event_handler;
 } http_download_config_t;
@@ -4,6 +4,8 @@
 #include "core_http_client.h"
 #include "tuya_tls.h"
 #include "tal_log.h"
+#include "tal_mutex.h"
+#include "tal_system.h"
 
 #define log_debug PR_DEBUG
 #define log_error PR_ERR
@@ -11,6 +13,32 @@
 #define HEADER_BUFFER_LENGTH (255)
 #define DEFAULT_HTTP_PORT    (80)
 #define DEFAULT_HTTPS_PORT   (443)
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+#ifndef HTTP_KEEPALIVE_POOL_NUM
+#define HTTP_KEEPALIVE_POOL_NUM (1)
+#endif
+
+#ifndef HTTP_KEEPALIVE_IDLE_MS
+#define HTTP_KEEPALIVE_IDLE_MS (30 * 1000)
+#endif
+
+#define HTTP_KEEPALIVE_HOST_LEN (64)
+
+/* One idle or in-use keep-alive connection, keyed by transport:host:port */
+typedef struct {
+    NetworkContext_t network;
+    TUYA_TRANSPORT_TYPE_E type;
+    uint16_t port;
+    bool busy;
+    bool stale;
+    SYS_TIME_T idle_since;
+    char host[HTTP_KEEPALIVE_HOST_LEN];
+} http_keepalive_conn_t;
+
+static http_keepalive_conn_t s_keepalive_pool[HTTP_KEEPALIVE_POOL_NUM];
+static MUTEX_HANDLE s_keepalive_mutex = NULL;
+#endif
 static http_client_status_t core_http_request_send(const TransportInterface_t *pTransportInterface,
                                                    const HTTPRequestInfo_t *requestInfo, http_client_header_t *headers,
                                                    uint8_t headers_count, const uint8_t *pRequestBodyBuf,
@@ -27,15 +55,19 @@ static http_client_status_t core_http_request_send(const TransportInterface_t *p
     }
     /* Initialize all HTTP Client library API structs to 0. */
     (void)memset(&requestHeaders, 0, sizeof(requestHeaders));
-    /* Set the buffer used for storing request headers. */
-    requestHeaders.bufferLen = HEADER_BUFFER_LENGTH + headers_count * 32;
+    /* Set the buffer used for storing request headers: request line, Host and
+     * the caller headers are variable, the rest fits in HEADER_BUFFER_LENGTH. */
+    requestHeaders.bufferLen = HEADER_BUFFER_LENGTH + requestInfo->pathLen + requestInfo->hostLen;
+    int i;
+    for (i = 0; i < headers_count; i++) {
+        requestHeaders.bufferLen += strlen(headers[i].key) + strlen(headers[i].value) + 4;
+    }
     requestHeaders.pBuffer = tal_malloc(requestHeaders.bufferLen);
     if (requestHeaders.pBuffer == NULL) {
         return HTTP_CLIENT_MALLOC_FAULT;
     }
 
     httpStatus = HTTPClient_InitializeRequestHeaders(&requestHeaders, requestInfo);
-    int i;
     for (i = 0; i < headers_count; i++) {
         log_debug("HTTP header add key:value\r\nkey=%s : value=%s", headers[i].key, headers[i].value);
         httpStatus |= HTTPClient_AddHeader(&requestHeaders, headers[i].key, strlen(headers[i].key), headers[i].value,
@@ -74,17 +106,21 @@ static http_client_status_t core_http_request_send(const TransportInterface_t *p
     return HTTP_CLIENT_SUCCESS;
 }
 
-http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+static void __http_network_destroy(NetworkContext_t network)
+{
+    tuya_transporter_close(network);
+    tuya_transporter_destroy(network);
+}
+
+static NetworkContext_t __http_network_connect(const http_client_request_t *request,
+                                               TUYA_TRANSPORT_TYPE_E transport_type, uint16_t port)
 {
-    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
     int ret = OPRT_OK;
 
     /* TLS pre init */
-    NetworkContext_t network;
-    TUYA_TRANSPORT_TYPE_E transport_type = (request->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
-    network = tuya_transporter_create(transport_type, NULL);
+    NetworkContext_t network = tuya_transporter_create(transport_type, NULL);
     if (NULL == network) {
-        return HTTP_CLIENT_MALLOC_FAULT;
+        return NULL;
     }
 
     if (transport_type == TRANSPORT_TYPE_TLS) {
@@ -92,7 +128,7 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
             .ca_cert = (char *)request->cacert,
             .ca_cert_size = request->cacert_len,
             .hostname = (char *)request->host,
-            .port = (request->port == 0) ? DEFAULT_HTTPS_PORT : request->port,
+            .port = port,
             .timeout = request->timeout_ms,
             .mode = TUYA_TLS_SERVER_CERT_MODE,
             .verify = true,
@@ -101,30 +137,284 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
         ret = tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
         if (OPRT_OK != ret) {
             log_error("network_tls_init fail:%d", ret);
-            return ret;
+            tuya_transporter_destroy(network);
+            return NULL;
         }
+    }
 
-        ret = tuya_transporter_connect(network, tls_config.hostname, tls_config.port, tls_config.timeout);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
-            return HTTP_CLIENT_SEND_FAULT;
+    ret = tuya_transporter_connect(network, request->host, port, request->timeout_ms);
+    if (OPRT_OK != ret) {
+        __http_network_destroy(network);
+        return NULL;
+    }
+
+    log_debug("%s connencted!", (transport_type == TRANSPORT_TYPE_TLS) ? "tls" : "tcp");
+
+    return network;
+}
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+static bool __keepalive_match(const http_keepalive_conn_t *conn, const char *host, uint16_t port,
+                              TUYA_TRANSPORT_TYPE_E type)
+{
+    return conn->type == type && conn->port == port && strcmp(conn->host, host) == 0;
+}
+
+/**
+ * @brief Takes an idle pooled connection to host:port, if a healthy one exists.
+ *
+ * Connections idle longer than HTTP_KEEPALIVE_IDLE_MS are dropped, servers
+ * close them on their side anyway. An idle connection must not be readable:
+ * pending data means the peer sent a FIN, an alert or garbage, so it is
+ * dropped too.
+ *
+ * @return The connection, NULL when a new one must be established.
+ */
+static NetworkContext_t __keepalive_checkout(const char *host, uint16_t port, TUYA_TRANSPORT_TYPE_E type)
+{
+    NetworkContext_t network = NULL;
+    SYS_TIME_T now = tal_system_get_millisecond();
+    int i;
+
+    /* no pool before http_client_init */
+    if (NULL == s_keepalive_mutex) {
+        return NULL;
+    }
+
+    tal_mutex_lock(s_keepalive_mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_NUM; i++) {
+        http_keepalive_conn_t *conn = &s_keepalive_pool[i];
+        if (NULL == conn->network || conn->busy) {
+            continue;
         }
 
-        log_debug("tls connencted!");
-    } else {
-        ret = tuya_transporter_connect(network, request->host, (request->port == 0) ? DEFAULT_HTTP_PORT : request->port,
-                                       request->timeout_ms);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
+        if (now - conn->idle_since >= HTTP_KEEPALIVE_IDLE_MS) {
+            log_debug("keepalive idle timeout %s:%d", conn->host, conn->port);
+            __http_network_destroy(conn->network);
+            conn->network = NULL;
+            continue;
+        }
+
+        if (NULL != network || !__keepalive_match(conn, host, port, type)) {
+            continue;
+        }
+
+        if (0 != tuya_transporter_poll_read(conn->network, 0)) {
+            log_debug("keepalive closed by peer %s:%d", conn->host, conn->port);
+            __http_network_destroy(conn->network);
+            conn->network = NULL;
+            continue;
+        }
+
+        conn->busy = true;
+        network = conn->network;
+    }
+    tal_mutex_unlock(s_keepalive_mutex);
+
+    return network;
+}
+
+/**
+ * @brief Returns a connection to the pool, or closes it.
+ *
+ * @param reuse false if the connection failed or the server asked to close it
+ */
+static void __keepalive_checkin(NetworkContext_t network, const char *host, uint16_t port,
+                                TUYA_TRANSPORT_TYPE_E type, bool reuse)
+{
+    http_keepalive_conn_t *slot = NULL;
+    int i;
+
+    if (NULL == s_keepalive_mutex) {
+        __http_network_destroy(network);
+        return;
+    }
+
+    if (reuse && strlen(host) >= HTTP_KEEPALIVE_HOST_LEN) {
+        reuse = false;
+    }
+
+    tal_mutex_lock(s_keepalive_mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_NUM; i++) {
+        http_keepalive_conn_t *conn = &s_keepalive_pool[i];
+        if (conn->network == network) {
+            slot = conn;
+            break;
+        }
+        if (NULL == conn->network && NULL == slot) {
+            slot = conn;
+        }
+    }
+
+    if (NULL != slot && slot->network == network && (!reuse || slot->stale)) {
+        /* pooled connection that must not be used again */
+        slot->network = NULL;
+        slot->busy = false;
+        slot->stale = false;
+        slot = NULL;
+    }
+
+    if (reuse && NULL != slot) {
+        if (NULL == slot->network) {
+            slot->network = network;
+            slot->type = type;
+            slot->port = port;
+            strcpy(slot->host, host);
+        }
+        slot->busy = false;
+        slot->stale = false;
+        slot->idle_since = tal_system_get_millisecond();
+        network = NULL;
+    }
+    tal_mutex_unlock(s_keepalive_mutex);
+
+    if (NULL != network) {
+        __http_network_destroy(network);
+    }
+}
+
+/**
+ * @brief Creates the keep-alive pool lock, once before the first request.
+ *
+ * @return OPRT_OK on success, or an error code on failure
+ */
+int http_client_init(void)
+{
+    if (NULL != s_keepalive_mutex) {
+        return OPRT_OK;
+    }
+
+    return tal_mutex_create_init(&s_keepalive_mutex);
+}
+
+/**
+ * @brief Closes every pooled keep-alive connection.
+ *
+ * Connections in use are closed when their request completes.
+ *
+ * @return OPRT_OK
+ */
+int http_client_keepalive_flush(void)
+{
+    int i;
+
+    if (NULL == s_keepalive_mutex) {
+        return OPRT_OK;
+    }
+
+    tal_mutex_lock(s_keepalive_mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_NUM; i++) {
+        http_keepalive_conn_t *conn = &s_keepalive_pool[i];
+        if (NULL == conn->network) {
+            continue;
+        }
+        if (conn->busy) {
+            conn->stale = true;
+            continue;
+        }
+        __http_network_destroy(conn->network);
+        conn->network = NULL;
+    }
+    tal_mutex_unlock(s_keepalive_mutex);
+
+    return OPRT_OK;
+}
+#else
+int http_client_init(void)
+{
+    return OPRT_OK;
+}
+
+int http_client_keepalive_flush(void)
+{
+    return OPRT_OK;
+}
+#endif
+
+/* The transport context of one request. coreHTTP hands &network to the
+ * transport callbacks, so it must stay the first member. */
+typedef struct {
+    NetworkContext_t network;
+    bool send_failed;
+    size_t received;
+} http_request_link_t;
+
+static int __http_link_send(NetworkContext_t *pNetwork, const unsigned char *pMsg, size_t len)
+{
+    int rt = NetworkTransportSend(pNetwork, pMsg, len);
+
+    if (rt <= 0) {
+        ((http_request_link_t *)pNetwork)->send_failed = true;
+    }
+    return rt;
+}
+
+static int __http_link_recv(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len)
+{
+    int rt = NetworkTransportRecv(pNetwork, pMsg, len);
+
+    if (rt > 0) {
+        ((http_request_link_t *)pNetwork)->received += rt;
+    }
+    return rt;
+}
+
+static void __http_response_reset(HTTPResponse_t *http_response)
+{
+    /* coreHTTP returns some receive errors without freeing what it allocated */
+    if (http_response->pBody) {
+        tal_free((void *)http_response->pBody);
+    }
+    if (http_response->pBuffer) {
+        tal_free(http_response->pBuffer);
+    }
+    memset(http_response, 0, sizeof(HTTPResponse_t));
+}
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+/**
+ * @brief A request that failed on a reused connection may be sent again only
+ * if the server cannot have acted on it: it was not fully sent, or it is
+ * idempotent and nothing came back. ATOP POSTs are not idempotent.
+ */
+static bool __http_request_retryable(const http_client_request_t *request, const http_request_link_t *link)
+{
+    if (link->received) {
+        return false;
+    }
+    return link->send_failed || 0 == strcmp(request->method, "GET") || 0 == strcmp(request->method, "HEAD");
+}
+#endif
+
+http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+{
+    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
+    bool reused = false;
+
+    TUYA_TRANSPORT_TYPE_E transport_type = (request->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
+    uint16_t port = request->port;
+    if (port == 0) {
+        port = (transport_type == TRANSPORT_TYPE_TLS) ? DEFAULT_HTTPS_PORT : DEFAULT_HTTP_PORT;
+    }
+
+    http_request_link_t link = {0};
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+    if (request->keep_alive) {
+        link.network = __keepalive_checkout(request->host, port, transport_type);
+        reused = (link.network != NULL);
+    }
+#endif
+    if (NULL == link.network) {
+        link.network = __http_network_connect(request, transport_type, port);
+        if (NULL == link.network) {
             return HTTP_CLIENT_SEND_FAULT;
         }
     }
+
     /* http client TransportInterface */
-    TransportInterface_t pTransportInterface = {.pNetworkContext = (NetworkContext_t *)&network,
-                                                .recv = (TransportRecv_t)NetworkTransportRecv,
-                                                .send = (TransportSend_t)NetworkTransportSend};
+    TransportInterface_t pTransportInterface = {.pNetworkContext = &link.network,
+                                                .recv = (TransportRecv_t)__http_link_recv,
+                                                .send = (TransportSend_t)__http_link_send};
 
     /* http client request object make */
     HTTPRequestInfo_t requestInfo = {
@@ -134,6 +424,7 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
         .hostLen = strlen(request->host),
         .pPath = request->path,
         .pathLen = strlen(request->path),
+        .reqFlags = request->keep_alive ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0,
     };
 
     HTTPResponse_t http_response = {0};
@@ -144,12 +435,36 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
                                 (const HTTPRequestInfo_t *)&requestInfo, request->headers, request->headers_count,
                                 (const uint8_t *)request->body, request->body_length, &http_response);
 
-    /* tls disconnect */
-    tuya_transporter_close(network);
-    tuya_transporter_destroy(network);
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+    if (request->keep_alive) {
+        if (HTTP_CLIENT_SEND_FAULT == rt && reused && __http_request_retryable(request, &link)) {
+            /* The server may close an idle connection just as it is reused,
+             * retry once on a fresh one. */
+            log_debug("keepalive connection lost, reconnect");
+            __http_response_reset(&http_response);
+            __keepalive_checkin(link.network, request->host, port, transport_type, false);
+            memset(&link, 0, sizeof(link));
+            link.network = __http_network_connect(request, transport_type, port);
+            if (NULL == link.network) {
+                return HTTP_CLIENT_SEND_FAULT;
+            }
+            rt = core_http_request_send((const TransportInterface_t *)&pTransportInterface,
+                                        (const HTTPRequestInfo_t *)&requestInfo, request->headers,
+                                        request->headers_count, (const uint8_t *)request->body, request->body_length,
+                                        &http_response);
+        }
+        __keepalive_checkin(link.network, request->host, port, transport_type,
+                            (HTTP_CLIENT_SUCCESS == rt) && !(http_response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG));
+    } else
+#endif
+    {
+        /* tls disconnect */
+        __http_network_destroy(link.network);
+    }
 
     if (OPRT_OK != rt) {
         log_error("http_request_send error:%d", rt);
+        __http_response_reset(&http_response);
         return rt;
     }
 
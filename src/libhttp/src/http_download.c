@@ -5,6 +5,9 @@
 #include "transport_interface.h"
 #include "http_download.h"
 #include "http_parser.h"
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+#include "tal_kv.h"
+#endif
 
 typedef enum {
     DL_STATE_IDLE,
@@ -17,13 +20,61 @@ typedef enum {
     DL_STATE_COMPLETE,
 } http_download_state_t;
 
+/**
+ * @brief Number of connections a download runs in parallel.
+ *
+ * @note With 1 the remaining file is streamed by one range request on one
+ * connection. Above 1 the file is cut into HTTP_DOWNLOAD_BLOCK_SIZE blocks
+ * that are fetched by that many connections and handed to the event handler
+ * in file order.
+ */
+#ifndef HTTP_DOWNLOAD_CONN_NUM
+#define HTTP_DOWNLOAD_CONN_NUM (1)
+#endif
+
+/**
+ * @brief Size of one parallel block, also the distance between two progress
+ * records when resume is enabled.
+ */
+#ifndef HTTP_DOWNLOAD_BLOCK_SIZE
+#define HTTP_DOWNLOAD_BLOCK_SIZE (64 * 1024)
+#endif
+
 typedef struct {
-    http_download_config_t config;
-    http_download_event_t event;
+    void *ctx;
+    NetworkContext_t network;
     TransportInterface_t transport;
     HTTPRequestHeaders_t requestHeaders;
-    HTTPRequestInfo_t requestInfo;
     HTTPResponse_t response;
+    THREAD_HANDLE thread;
+    uint8_t connected;
+    uint8_t retry;
+} http_download_conn_t;
+
+#if (HTTP_DOWNLOAD_CONN_NUM > 1)
+//! one block more than connections, so the head block can be consumed while all connections keep fetching
+#define HTTP_DOWNLOAD_SLOT_NUM (HTTP_DOWNLOAD_CONN_NUM + 1)
+
+typedef enum {
+    DL_SLOT_FREE,
+    DL_SLOT_BUSY,
+    DL_SLOT_DONE,
+} http_download_slot_state_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t start;
+    size_t len;
+    size_t got;
+    uint8_t state;
+} http_download_slot_t;
+#endif
+
+typedef struct {
+    http_download_config_t config;
+    http_download_event_t event;
+    HTTPRequestInfo_t requestInfo;
+    http_download_conn_t conn[HTTP_DOWNLOAD_CONN_NUM];
     char *host;
     char *path;
     uint16_t port;
@@ -31,11 +82,33 @@ typedef struct {
     size_t received_size;
     size_t remain_len;
     size_t offset;
+    size_t checkpoint;
+    TIME_T active_time;
     uint8_t state;
+    uint8_t started;
     uint8_t *buffer;
+#if (HTTP_DOWNLOAD_CONN_NUM > 1)
+    MUTEX_HANDLE mutex;
+    SEM_HANDLE slot_sem;
+    SEM_HANDLE data_sem;
+    SEM_HANDLE exit_sem;
+    http_download_slot_t slot[HTTP_DOWNLOAD_SLOT_NUM];
+    size_t fetch_pos;
+    volatile uint8_t abort;
+#endif
 } http_download_t;
 
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+typedef struct {
+    uint32_t file_size;
+    uint32_t offset;
+} http_download_resume_t;
+#endif
+
 #define MAX_RETRY_TIMES (8u)
+
+//! first reconnect delay, doubled on each failure up to 16 times of it
+#define HTTP_DOWNLOAD_RETRY_MS (500)
 /*-----------------------------------------------------------*/
 /**
  * @brief The size of the range of the file to download, with each request.
@@ -44,7 +117,7 @@ typedef struct {
  * in the user buffer. We don't expect S3 to send more than 1024 bytes of
  * headers.
  */
-#define RANGE_REQUEST_LENGTH_DEFAULT (8 * 1024)
+#define RANGE_REQUEST_LENGTH_DEFAULT HTTP_DOWNLOAD_RANGE_LENGTH_DEFAULT
 
 /**
  * @brief The length of the HTTP GET method.
@@ -70,7 +143,94 @@ typedef struct {
 #define HTTP_DOWNLOAD_TIMEOUT 180
 
 /*-----------------------------------------------------------*/
-static int http_download_filesize_get(http_download_t *ctx)
+static void http_download_response_free(HTTPResponse_t *response)
+{
+    if (response->pBuffer) {
+        tal_free(response->pBuffer);
+    }
+    if (response->pBody) {
+        tal_free((void *)response->pBody);
+    }
+    memset(response, 0, sizeof(HTTPResponse_t));
+}
+
+static int http_download_conn_open(http_download_t *ctx, http_download_conn_t *conn)
+{
+    int rt = OPRT_OK;
+
+    if (NULL == conn->network) {
+        /* TLS pre init */
+        TUYA_TRANSPORT_TYPE_E transport_type =
+            (ctx->config.cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
+        conn->network = tuya_transporter_create(transport_type, NULL);
+        TUYA_CHECK_NULL_RETURN(conn->network, OPRT_MALLOC_FAILED);
+        if (transport_type == TRANSPORT_TYPE_TLS) {
+            tuya_tls_config_t tls_config = {
+                .ca_cert = (char *)ctx->config.cacert,
+                .ca_cert_size = ctx->config.cacert_len,
+                .hostname = (char *)ctx->host,
+                .port = ctx->port,
+                .mode = TUYA_TLS_SERVER_CERT_MODE,
+                .verify = true,
+            };
+
+            rt = tuya_transporter_ctrl(conn->network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
+            if (OPRT_OK != rt) {
+                tuya_transporter_destroy(conn->network);
+                conn->network = NULL;
+                return rt;
+            }
+        }
+        /* http client TransportInterface */
+        conn->transport.pNetworkContext = &conn->network;
+        conn->transport.send = (TransportSend_t)NetworkTransportSend;
+        conn->transport.recv = (TransportRecv_t)NetworkTransportRecv;
+    }
+
+    if (NULL == conn->requestHeaders.pBuffer) {
+        conn->requestHeaders.bufferLen = 512;
+        conn->requestHeaders.pBuffer = tal_malloc(conn->requestHeaders.bufferLen);
+        TUYA_CHECK_NULL_RETURN(conn->requestHeaders.pBuffer, OPRT_MALLOC_FAILED);
+    }
+
+    rt = tuya_transporter_connect(conn->network, ctx->host, ctx->port, ctx->config.timeout_ms);
+    conn->connected = (OPRT_OK == rt);
+    return rt;
+}
+
+static void http_download_conn_close(http_download_conn_t *conn)
+{
+    if (conn->network) {
+        tuya_transporter_close(conn->network);
+    }
+    conn->connected = 0;
+    http_download_response_free(&conn->response);
+}
+
+static void http_download_conn_deinit(http_download_conn_t *conn)
+{
+    http_download_conn_close(conn);
+    if (conn->network) {
+        tuya_transporter_destroy(conn->network);
+        conn->network = NULL;
+    }
+    if (conn->requestHeaders.pBuffer) {
+        tal_free(conn->requestHeaders.pBuffer);
+        conn->requestHeaders.pBuffer = NULL;
+    }
+}
+
+static uint32_t http_download_backoff(http_download_conn_t *conn)
+{
+    uint32_t delay = HTTP_DOWNLOAD_RETRY_MS << (conn->retry < 4 ? conn->retry : 4);
+
+    if (conn->retry < MAX_RETRY_TIMES) {
+        conn->retry++;
+    }
+    return delay;
+}
+
+static int http_download_filesize_get(http_download_t *ctx, http_download_conn_t *conn)
 {
     int rt = 0;
     /* The location of the file size in contentRangeValStr. */
@@ -80,19 +240,21 @@ static int http_download_filesize_get(http_download_t *ctx)
     size_t contentRangeValStrLength = 0;
 
     PR_DEBUG("Getting file object size from host...");
-    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&ctx->requestHeaders, &ctx->requestInfo), __exit);
-    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&ctx->requestHeaders, 0, 0), __exit);
-    TUYA_CALL_ERR_GOTO(HTTPClient_Request(&ctx->transport, &ctx->requestHeaders, NULL, 0, &ctx->response, 0), __exit);
+    http_download_response_free(&conn->response);
+    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&conn->requestHeaders, &ctx->requestInfo), __exit);
+    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&conn->requestHeaders, 0, 0), __exit);
+    TUYA_CALL_ERR_GOTO(HTTPClient_Request(&conn->transport, &conn->requestHeaders, NULL, 0, &conn->response, 0),
+                       __exit);
     PR_DEBUG("Received HTTP response from %s%s...", ctx->host, ctx->path);
-    PR_DEBUG("Response Headers:\n%.*s", (int32_t)ctx->response.headersLen, ctx->response.pHeaders);
-    if (ctx->response.statusCode != HTTP_STATUS_CODE_PARTIAL_CONTENT) {
+    PR_DEBUG("Response Headers:\n%.*s", (int32_t)conn->response.headersLen, conn->response.pHeaders);
+    if (conn->response.statusCode != HTTP_STATUS_CODE_PARTIAL_CONTENT) {
         PR_ERR("Received an invalid response from the server "
                "(Status Code: %u).",
-               ctx->response.statusCode);
+               conn->response.statusCode);
         rt = OPRT_NOT_SUPPORTED;
         goto __exit;
     }
-    TUYA_CALL_ERR_GOTO(HTTPClient_ReadHeader(&ctx->response, (char *)HTTP_CONTENT_RANGE_HEADER_FIELD,
+    TUYA_CALL_ERR_GOTO(HTTPClient_ReadHeader(&conn->response, (char *)HTTP_CONTENT_RANGE_HEADER_FIELD,
                                              (size_t)HTTP_CONTENT_RANGE_HEADER_FIELD_LENGTH,
                                              (const char **)&contentRangeValStr, &contentRangeValStrLength),
                        __exit);
@@ -105,31 +267,350 @@ static int http_download_filesize_get(http_download_t *ctx)
     pFileSizeStr += sizeof(char);
     ctx->file_size = (size_t)strtoul(pFileSizeStr, NULL, 10);
     PR_INFO("The file is %d bytes long.", (int32_t)ctx->file_size);
-    if (ctx->response.pBuffer) {
-        tal_free(ctx->response.pBuffer);
-    }
-    memset(&ctx->response, 0, sizeof(ctx->response));
+    http_download_response_free(&conn->response);
 __exit:
     return rt;
 }
 
-static int http_download_range_request(http_download_t *ctx, uint32_t range_start, uint32_t range_end)
+static int http_download_range_request(http_download_t *ctx, http_download_conn_t *conn, uint32_t range_start,
+                                       uint32_t range_end)
 {
     int rt = OPRT_OK;
 
     PR_DEBUG("Downloading bytes %d-%d, from %s...: ", range_start, range_end, ctx->host);
-    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&ctx->requestHeaders, &ctx->requestInfo), __exit);
-    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&ctx->requestHeaders, range_start, range_end), __exit);
-    PR_TRACE("Request Headers:\n%.*s", (int32_t)ctx->requestHeaders.headersLen, (char *)ctx->requestHeaders.pBuffer);
-    TUYA_CALL_ERR_GOTO(HTTPClient_Request(&ctx->transport, &ctx->requestHeaders, NULL, 0, &ctx->response,
+    //! the previous response of a kept-alive connection
+    http_download_response_free(&conn->response);
+    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&conn->requestHeaders, &ctx->requestInfo), __exit);
+    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&conn->requestHeaders, range_start, range_end), __exit);
+    PR_TRACE("Request Headers:\n%.*s", (int32_t)conn->requestHeaders.headersLen,
+             (char *)conn->requestHeaders.pBuffer);
+    TUYA_CALL_ERR_GOTO(HTTPClient_Request(&conn->transport, &conn->requestHeaders, NULL, 0, &conn->response,
                                           HTTP_SEND_DISABLE_RECV_BODY_FLAG),
                        __exit);
     PR_TRACE("Received HTTP response from %s%s...", ctx->host, ctx->path);
-    PR_TRACE("Response Headers:\n%.*s", (int32_t)ctx->response.headersLen, ctx->response.pHeaders);
+    PR_TRACE("Response Headers:\n%.*s", (int32_t)conn->response.headersLen, conn->response.pHeaders);
 __exit:
     return rt;
 }
 
+/*-----------------------------------------------------------*/
+/**
+ * @brief Pass read_size new bytes behind the remain_len bytes at the head of
+ * ctx->buffer to the event handler, and keep what it leaves unconsumed.
+ */
+static void http_download_deliver(http_download_t *ctx, size_t read_size)
+{
+    if (ctx->config.event_handler) {
+        ctx->event.data = (uint8_t *)ctx->buffer;
+        ctx->event.data_len = read_size + ctx->remain_len;
+        ctx->event.offset = ctx->received_size - ctx->remain_len;
+        ctx->event.remain_len = ctx->remain_len;
+        ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
+        if (ctx->event.data != ctx->buffer) {
+            //! the handler took the buffer and gave another, all data is its
+            ctx->buffer = ctx->event.data;
+            ctx->event.remain_len = 0;
+        }
+        if (ctx->event.remain_len) {
+            memmove(ctx->buffer, ctx->buffer + (ctx->event.data_len - ctx->event.remain_len), ctx->event.remain_len);
+        }
+        ctx->remain_len = ctx->event.remain_len;
+    }
+    ctx->received_size += read_size;
+}
+
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+static void http_download_resume_load(http_download_t *ctx)
+{
+    http_download_resume_t *record = NULL;
+    size_t length = 0;
+
+    if (NULL == ctx->config.resume_key || NULL == ctx->config.event_handler) {
+        return;
+    }
+    if (OPRT_OK != tal_kv_get(ctx->config.resume_key, (uint8_t **)&record, &length)) {
+        return;
+    }
+    if (length == sizeof(http_download_resume_t) && record->file_size == ctx->file_size &&
+        record->offset < ctx->file_size) {
+        ctx->event.offset = record->offset;
+        ctx->config.event_handler(DL_EVENT_ON_RESUME, &ctx->event);
+        if (ctx->event.offset == record->offset) {
+            ctx->received_size = record->offset;
+            PR_NOTICE("download resume at %d/%d", (int32_t)ctx->received_size, (int32_t)ctx->file_size);
+        }
+    }
+    tal_kv_free((uint8_t *)record);
+    ctx->checkpoint = ctx->received_size;
+}
+
+static void http_download_resume_save(http_download_t *ctx)
+{
+    http_download_resume_t record;
+    size_t committed = ctx->received_size - ctx->remain_len;
+
+    if (NULL == ctx->config.resume_key || NULL == ctx->config.event_handler) {
+        return;
+    }
+    if (committed - ctx->checkpoint < HTTP_DOWNLOAD_BLOCK_SIZE || committed >= ctx->file_size) {
+        return;
+    }
+    //! the handler persists its own state first, a record newer than it is never written
+    ctx->event.offset = committed;
+    ctx->config.event_handler(DL_EVENT_CHECKPOINT, &ctx->event);
+
+    record.file_size = ctx->file_size;
+    record.offset = (ctx->event.offset < committed) ? ctx->event.offset : committed;
+    if (OPRT_OK == tal_kv_set(ctx->config.resume_key, (const uint8_t *)&record, sizeof(record))) {
+        ctx->checkpoint = committed;
+    }
+}
+
+static void http_download_resume_clear(http_download_t *ctx)
+{
+    if (ctx->config.resume_key) {
+        tal_kv_del(ctx->config.resume_key);
+    }
+}
+#endif
+
+#if (HTTP_DOWNLOAD_CONN_NUM > 1)
+static http_download_slot_t *http_download_slot_take(http_download_t *ctx)
+{
+    http_download_slot_t *slot = NULL;
+    uint8_t i = 0;
+
+    tal_mutex_lock(ctx->mutex);
+    if (ctx->fetch_pos < ctx->file_size) {
+        for (i = 0; i < HTTP_DOWNLOAD_SLOT_NUM; i++) {
+            if (DL_SLOT_FREE == ctx->slot[i].state) {
+                slot = &ctx->slot[i];
+                slot->start = ctx->fetch_pos;
+                slot->len = ctx->file_size - ctx->fetch_pos;
+                if (slot->len > HTTP_DOWNLOAD_BLOCK_SIZE) {
+                    slot->len = HTTP_DOWNLOAD_BLOCK_SIZE;
+                }
+                slot->got = 0;
+                slot->state = DL_SLOT_BUSY;
+                ctx->fetch_pos += slot->len;
+                break;
+            }
+        }
+    }
+    tal_mutex_unlock(ctx->mutex);
+
+    return slot;
+}
+
+static http_download_slot_t *http_download_slot_ready(http_download_t *ctx)
+{
+    http_download_slot_t *slot = NULL;
+    uint8_t i = 0;
+
+    tal_mutex_lock(ctx->mutex);
+    for (i = 0; i < HTTP_DOWNLOAD_SLOT_NUM; i++) {
+        if (DL_SLOT_DONE == ctx->slot[i].state && ctx->slot[i].start == ctx->received_size) {
+            slot = &ctx->slot[i];
+            break;
+        }
+    }
+    tal_mutex_unlock(ctx->mutex);
+
+    return slot;
+}
+
+static int http_download_block_fetch(http_download_t *ctx, http_download_conn_t *conn, http_download_slot_t *slot)
+{
+    int rt = OPRT_OK;
+    int32_t read_size = 0;
+
+    if (!conn->connected) {
+        TUYA_CALL_ERR_RETURN(http_download_conn_open(ctx, conn));
+    }
+    //! a broken block goes on from what it already has
+    TUYA_CALL_ERR_RETURN(
+        http_download_range_request(ctx, conn, slot->start + slot->got, slot->start + slot->len - 1));
+    if (conn->response.statusCode != HTTP_STATUS_CODE_PARTIAL_CONTENT ||
+        conn->response.bodyLen > slot->len - slot->got) {
+        PR_ERR("block %d invalid response, status code: %u", (int32_t)slot->start, conn->response.statusCode);
+        return OPRT_COM_ERROR;
+    }
+
+    while (slot->got < slot->len) {
+        read_size =
+            HTTPClient_Recv(&conn->transport, &conn->response, slot->data + slot->got, slot->len - slot->got);
+        if (read_size <= 0) {
+            PR_WARN("block %d recv error:%d, goto retry", (int32_t)slot->start, read_size);
+            return OPRT_RECV_ERR;
+        }
+        slot->got += read_size;
+
+        tal_mutex_lock(ctx->mutex);
+        ctx->active_time = tal_time_get_posix();
+        tal_mutex_unlock(ctx->mutex);
+    }
+
+    return OPRT_OK;
+}
+
+static void http_download_worker(void *arg)
+{
+    http_download_conn_t *conn = (http_download_conn_t *)arg;
+    http_download_t *ctx = (http_download_t *)conn->ctx;
+    http_download_slot_t *slot = NULL;
+
+    while (!ctx->abort) {
+        if (NULL == slot) {
+            if (OPRT_OK != tal_semaphore_wait(ctx->slot_sem, 1000)) {
+                continue;
+            }
+            slot = http_download_slot_take(ctx);
+            if (NULL == slot) {
+                //! all blocks handed out, let the other workers see it too
+                tal_semaphore_post(ctx->slot_sem);
+                break;
+            }
+        }
+
+        if (OPRT_OK != http_download_block_fetch(ctx, conn, slot)) {
+            http_download_conn_close(conn);
+            tal_system_sleep(http_download_backoff(conn));
+            continue;
+        }
+        conn->retry = 0;
+
+        tal_mutex_lock(ctx->mutex);
+        slot->state = DL_SLOT_DONE;
+        tal_mutex_unlock(ctx->mutex);
+        tal_semaphore_post(ctx->data_sem);
+        slot = NULL;
+    }
+
+    http_download_conn_close(conn);
+    tal_semaphore_post(ctx->exit_sem);
+}
+
+/**
+ * @brief Fetch the rest of the file from received_size with all connections,
+ * and hand the blocks to the event handler in file order.
+ */
+static int http_download_parallel(http_download_t *ctx)
+{
+    int rt = OPRT_OK;
+    uint8_t i = 0;
+    uint8_t started = 0;
+    size_t off = 0;
+    size_t n = 0;
+    http_download_slot_t *slot = NULL;
+    THREAD_CFG_T thrd_param;
+
+    TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&ctx->mutex), __exit);
+    TUYA_CALL_ERR_GOTO(
+        tal_semaphore_create_init(&ctx->slot_sem, HTTP_DOWNLOAD_SLOT_NUM, HTTP_DOWNLOAD_SLOT_NUM), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ctx->data_sem, 0, HTTP_DOWNLOAD_SLOT_NUM), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ctx->exit_sem, 0, HTTP_DOWNLOAD_CONN_NUM), __exit);
+    for (i = 0; i < HTTP_DOWNLOAD_SLOT_NUM; i++) {
+        ctx->slot[i].data = tal_malloc(HTTP_DOWNLOAD_BLOCK_SIZE);
+        TUYA_CHECK_NULL_GOTO(ctx->slot[i].data, __exit);
+    }
+
+    ctx->abort = 0;
+    ctx->fetch_pos = ctx->received_size;
+    thrd_param.priority = THREAD_PRIO_3;
+    thrd_param.stackDepth = 4096;
+    thrd_param.thrdname = "http_download";
+    for (i = 0; i < HTTP_DOWNLOAD_CONN_NUM; i++) {
+        ctx->conn[i].ctx = ctx;
+        if (OPRT_OK != tal_thread_create_and_start(&ctx->conn[i].thread, NULL, NULL, http_download_worker,
+                                                   &ctx->conn[i], &thrd_param)) {
+            break;
+        }
+        started++;
+    }
+    if (0 == started) {
+        rt = OPRT_COM_ERROR;
+        goto __exit;
+    }
+    PR_DEBUG("download %d-%d with %d connections", (int32_t)ctx->received_size, (int32_t)ctx->file_size, started);
+
+    while (ctx->received_size < ctx->file_size) {
+        slot = http_download_slot_ready(ctx);
+        if (NULL == slot) {
+            tal_semaphore_wait(ctx->data_sem, 1000);
+            tal_mutex_lock(ctx->mutex);
+            rt = ((tal_time_get_posix() - ctx->active_time) < HTTP_DOWNLOAD_TIMEOUT) ? OPRT_OK : OPRT_TIMEOUT;
+            tal_mutex_unlock(ctx->mutex);
+            if (OPRT_OK != rt) {
+                break;
+            }
+            continue;
+        }
+
+        for (off = 0; off < slot->len; off += n) {
+            n = ctx->config.range_length - ctx->remain_len;
+            if (0 == n) {
+                PR_ERR("event handler keeps the whole buffer");
+                rt = OPRT_EXCEED_UPPER_LIMIT;
+                break;
+            }
+            if (n > slot->len - off) {
+                n = slot->len - off;
+            }
+            memcpy(ctx->buffer + ctx->remain_len, slot->data + off, n);
+            http_download_deliver(ctx, n);
+        }
+        if (OPRT_OK != rt) {
+            break;
+        }
+
+        tal_mutex_lock(ctx->mutex);
+        slot->state = DL_SLOT_FREE;
+        ctx->active_time = tal_time_get_posix();
+        tal_mutex_unlock(ctx->mutex);
+        tal_semaphore_post(ctx->slot_sem);
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+        http_download_resume_save(ctx);
+#endif
+    }
+
+    ctx->abort = 1;
+    for (i = 0; i < started; i++) {
+        tal_semaphore_wait(ctx->exit_sem, SEM_WAIT_FOREVER);
+    }
+    //! all workers have returned, the thread wrapper waits for the delete
+    for (i = 0; i < started; i++) {
+        tal_thread_delete(ctx->conn[i].thread);
+        ctx->conn[i].thread = NULL;
+    }
+
+__exit:
+    if (ctx->mutex) {
+        tal_mutex_release(ctx->mutex);
+        ctx->mutex = NULL;
+    }
+    if (ctx->slot_sem) {
+        tal_semaphore_release(ctx->slot_sem);
+        ctx->slot_sem = NULL;
+    }
+    if (ctx->data_sem) {
+        tal_semaphore_release(ctx->data_sem);
+        ctx->data_sem = NULL;
+    }
+    if (ctx->exit_sem) {
+        tal_semaphore_release(ctx->exit_sem);
+        ctx->exit_sem = NULL;
+    }
+    for (i = 0; i < HTTP_DOWNLOAD_SLOT_NUM; i++) {
+        if (ctx->slot[i].data) {
+            tal_free(ctx->slot[i].data);
+            ctx->slot[i].data = NULL;
+        }
+    }
+
+    return rt;
+}
+#endif
+
 /*-----------------------------------------------------------*/
 static int http_file_download_init(http_download_t *ctx, http_download_config_t *config)
 {
@@ -195,12 +676,6 @@ static int http_file_download_init(http_download_t *ctx, http_download_config_t
     requestInfo->pPath = ctx->path;
     requestInfo->pathLen = strlen(ctx->path);
     requestInfo->reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
-    /* Set the buffer used for storing request headers. */
-
-    HTTPRequestHeaders_t *requestHeaders = &ctx->requestHeaders;
-    requestHeaders->bufferLen = 512;
-    requestHeaders->pBuffer = tal_malloc(requestHeaders->bufferLen);
-    TUYA_CHECK_NULL_RETURN(requestHeaders->pBuffer, OPRT_MALLOC_FAILED);
 
     return rt;
 }
@@ -208,33 +683,17 @@ static int http_file_download_init(http_download_t *ctx, http_download_config_t
 int http_file_download(http_download_config_t *config)
 {
     int rt = OPRT_OK;
+    uint8_t i = 0;
 
     http_download_t *ctx = tal_calloc(1, sizeof(http_download_t));
     TUYA_CHECK_NULL_GOTO(ctx, __exit);
     TUYA_CALL_ERR_GOTO(http_file_download_init(ctx, config), __exit);
-    /* TLS pre init */
-    TUYA_TRANSPORT_TYPE_E transport_type = (config->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
-    NetworkContext_t network;
-    TUYA_CHECK_NULL_GOTO(network = tuya_transporter_create(transport_type, NULL), __exit);
-    if (transport_type == TRANSPORT_TYPE_TLS) {
-        tuya_tls_config_t tls_config = {
-            .ca_cert = (char *)config->cacert,
-            .ca_cert_size = config->cacert_len,
-            .hostname = (char *)ctx->host,
-            .port = ctx->port,
-            .mode = TUYA_TLS_SERVER_CERT_MODE,
-            .verify = true,
-        };
-
-        TUYA_CALL_ERR_GOTO(tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config), __exit);
-    }
-    /* http client TransportInterface */
-    ctx->transport.pNetworkContext = (NetworkContext_t *)&network;
-    ctx->transport.send = NetworkTransportSend;
-    ctx->transport.recv = NetworkTransportRecv;
+
+    //! the first connection gets the file size, then streams the file or becomes worker 0
+    http_download_conn_t *conn = &ctx->conn[0];
 
     ctx->state = DL_STATE_NETWORK_CONNECT;
-    TIME_T download_time = tal_time_get_posix();
+    ctx->active_time = tal_time_get_posix();
 
     bool is_completed = false;
 
@@ -249,7 +708,7 @@ int http_file_download(http_download_config_t *config)
         switch (ctx->state) {
 
         case DL_STATE_NETWORK_CONNECT:
-            rt = tuya_transporter_connect(network, ctx->host, ctx->port, config->timeout_ms);
+            rt = http_download_conn_open(ctx, conn);
             if (OPRT_OK == rt) {
                 ctx->state = DL_STATE_FILESIZE_GET;
             } else {
@@ -258,8 +717,12 @@ int http_file_download(http_download_config_t *config)
             break;
 
         case DL_STATE_FILESIZE_GET:
+            if (ctx->started) {
+                ctx->state = DL_STATE_RANGE_REQUEST;
+                break;
+            }
             if (0 == ctx->file_size) {
-                rt = http_download_filesize_get(ctx);
+                rt = http_download_filesize_get(ctx, conn);
             }
             if (OPRT_OK != rt) {
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
@@ -269,41 +732,47 @@ int http_file_download(http_download_config_t *config)
                 ctx->event.file_size = ctx->file_size;
                 ctx->config.event_handler(DL_EVENT_ON_FILESIZE, &ctx->event);
             }
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+            http_download_resume_load(ctx);
+#endif
+            ctx->started = 1;
             ctx->state = DL_STATE_RANGE_REQUEST;
             break;
 
         case DL_STATE_RANGE_REQUEST:
-            rt = http_download_range_request(ctx, ctx->received_size, ctx->file_size);
+#if (HTTP_DOWNLOAD_CONN_NUM > 1)
+            rt = http_download_parallel(ctx);
+            if (OPRT_OK == rt) {
+                ctx->state = DL_STATE_COMPLETE;
+            } else {
+                goto __fault;
+            }
+            break;
+#else
+            rt = http_download_range_request(ctx, conn, ctx->received_size, ctx->file_size);
             if (OPRT_OK != rt) {
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
             }
             ctx->state = DL_STATE_DATE_GET;
+#endif
 
         case DL_STATE_DATE_GET: {
-            read_size = HTTPClient_Recv(&ctx->transport, &ctx->response, ctx->buffer + ctx->remain_len,
+            read_size = HTTPClient_Recv(&conn->transport, &conn->response, ctx->buffer + ctx->remain_len,
                                         ctx->config.range_length - ctx->remain_len);
 
             if (read_size <= 0) {
-                PR_WARN("file download range get error:%d, goto retry", rt);
+                PR_WARN("file download range get error:%d, goto retry", read_size);
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
             }
-            if (ctx->config.event_handler) {
-                ctx->event.data = (uint8_t *)ctx->buffer;
-                ctx->event.data_len = read_size + ctx->remain_len;
-                ctx->event.offset = ctx->received_size - ctx->remain_len;
-                ctx->event.remain_len = ctx->remain_len;
-                ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
-                if (ctx->event.remain_len) {
-                    memmove(ctx->buffer, ctx->buffer + (ctx->event.data_len - ctx->event.remain_len),
-                            ctx->event.remain_len);
-                }
-                ctx->remain_len = ctx->event.remain_len;
-                ctx->received_size += read_size;
-            }
+            conn->retry = 0;
+            http_download_deliver(ctx, read_size);
             //! reset time
-            download_time = tal_time_get_posix();
+            ctx->active_time = tal_time_get_posix();
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+            http_download_resume_save(ctx);
+#endif
             /* File download complete? */
             if (ctx->received_size >= ctx->file_size) {
                 ctx->state = DL_STATE_COMPLETE;
@@ -312,24 +781,27 @@ int http_file_download(http_download_config_t *config)
         }
 
         case DL_STATE_NETWORK_RECONNECT:
-            tuya_transporter_close(network);
-            tal_system_sleep(3000);
+            http_download_conn_close(conn);
+            tal_system_sleep(http_download_backoff(conn));
             ctx->state = DL_STATE_NETWORK_CONNECT;
             break;
 
         case DL_STATE_COMPLETE:
             PR_INFO("Download Complete!");
             is_completed = true;
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+            http_download_resume_clear(ctx);
+#endif
             if (ctx->config.event_handler) {
                 ctx->config.event_handler(DL_EVENT_FINISH, &ctx->event);
             }
             break;
         }
-    } while (((tal_time_get_posix() - download_time) < HTTP_DOWNLOAD_TIMEOUT) && !is_completed);
-
-    tuya_transporter_close(network);
-    tuya_transporter_destroy(network);
+    } while (((tal_time_get_posix() - ctx->active_time) < HTTP_DOWNLOAD_TIMEOUT) && !is_completed);
 
+#if (HTTP_DOWNLOAD_CONN_NUM > 1)
+__fault:
+#endif
     if (!is_completed) {
         if (ctx->config.event_handler) {
             ctx->config.event_handler(DL_EVENT_FAULT, &ctx->event);
@@ -338,17 +810,17 @@ int http_file_download(http_download_config_t *config)
 
 __exit:
     if (ctx) {
+        for (i = 0; i < HTTP_DOWNLOAD_CONN_NUM; i++) {
+            http_download_conn_deinit(&ctx->conn[i]);
+        }
         if (ctx->host) {
             tal_free(ctx->host);
         }
         if (ctx->path) {
             tal_free(ctx->path);
         }
-        if (ctx->requestHeaders.pBuffer) {
-            tal_free(ctx->requestHeaders.pBuffer);
-        }
-        if (ctx->response.pBuffer) {
-            tal_free(ctx->response.pBuffer);
+        if (ctx->buffer) {
+            tal_free(ctx->buffer);
         }
 
         tal_free(ctx);
@@ -1290,6 +1290,9 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
     }
     else
     {
+        /* Let the port provide a buffer large enough for this packet. */
+        MQTT_RECV_BUFFER_GROW( pContext, incomingPacket.remainingLength );
+
         /* Receive packet. Remaining time is recalculated before calling this
          * function. */
         status = receivePacket( pContext, incomingPacket, remainingTimeMs );
@@ -1312,6 +1315,9 @@ static MQTTStatus_t receiveSingleIteration( MQTTContext_t * pContext,
         }
     }
 
+    /* Give back a buffer provided by MQTT_RECV_BUFFER_GROW, if any. */
+    MQTT_RECV_BUFFER_RELEASE( pContext );
+
     if( status == MQTTNoDataAvailable )
     {
         /* No data available is not an error. Reset to MQTTSuccess so the
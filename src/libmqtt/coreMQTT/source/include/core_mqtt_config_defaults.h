@@ -108,6 +108,33 @@
     #define MQTT_PINGRESP_TIMEOUT_MS    ( 500U )
 #endif
 
+/**
+ * @brief Hook called before an incoming packet is read into the network
+ * buffer, with the remaining length of that packet.
+ *
+ * A port may replace pContext->networkBuffer with a buffer of at least
+ * length bytes here, so that packets larger than the buffer given to
+ * #MQTT_Init are received instead of being dumped. If the buffer is left
+ * unchanged, a packet that does not fit is dumped as before.
+ *
+ * <b>Default value:</b> Does nothing.
+ */
+#ifndef MQTT_RECV_BUFFER_GROW
+    #define MQTT_RECV_BUFFER_GROW( pContext, length )
+#endif
+
+/**
+ * @brief Hook called after a packet received with #MQTT_RECV_BUFFER_GROW
+ * has been handled, including the application callback and the ack.
+ *
+ * A port that replaced pContext->networkBuffer restores it here.
+ *
+ * <b>Default value:</b> Does nothing.
+ */
+#ifndef MQTT_RECV_BUFFER_RELEASE
+    #define MQTT_RECV_BUFFER_RELEASE( pContext )
+#endif
+
 /**
  * @brief Macro that is called in the MQTT library for logging "Error" level
  * messages.
@@ -1,6 +1,9 @@
 #ifndef _CORE_MQTT_CONFIG_H_
 #define _CORE_MQTT_CONFIG_H_
 
+#include <stddef.h>
+#include "tuya_iot_config.h"
+
 /**************************************************/
 /******* DO NOT CHANGE the following order ********/
 /**************************************************/
@@ -23,7 +26,11 @@
  * and incoming PUBLISHes, and thus, 2 * MQTT_STATE_ARRAY_MAX_COUNT amount
  * of memory is statically allocated for the state records.
  */
+#if defined(MQTT_PUBLISH_INFLIGHT_NUM) && (MQTT_PUBLISH_INFLIGHT_NUM > 10)
+#define MQTT_STATE_ARRAY_MAX_COUNT (MQTT_PUBLISH_INFLIGHT_NUM)
+#else
 #define MQTT_STATE_ARRAY_MAX_COUNT (10U)
+#endif
 
 /**
  * @brief Number of milliseconds to wait for a ping response to a ping
@@ -36,7 +43,32 @@
 
 /**
  * @brief CORE_MQTT_BUFFER_SIZE
+ *
+ * Size of the network buffer kept for the whole connection. With
+ * ENABLE_MQTT_LARGE_MSG, incoming packets that do not fit are received
+ * into a buffer allocated for that packet only.
  */
+#ifndef CORE_MQTT_BUFFER_SIZE
 #define CORE_MQTT_BUFFER_SIZE (2048U)
+#endif
+
+#if defined(ENABLE_MQTT_LARGE_MSG) && (ENABLE_MQTT_LARGE_MSG == 1)
+/**
+ * @brief Largest incoming packet received into an allocated buffer,
+ * larger packets are dumped.
+ */
+#ifndef MQTT_LARGE_MSG_MAX_SIZE
+#define MQTT_LARGE_MSG_MAX_SIZE (64 * 1024U)
+#endif
+
+struct MQTTContext;
+
+/* Implemented in mqtt_client_wrapper.c */
+void mqtt_client_recv_buffer_grow(struct MQTTContext *pContext, size_t length);
+void mqtt_client_recv_buffer_release(struct MQTTContext *pContext);
+
+#define MQTT_RECV_BUFFER_GROW(pContext, length) mqtt_client_recv_buffer_grow(pContext, length)
+#define MQTT_RECV_BUFFER_RELEASE(pContext)      mqtt_client_recv_buffer_release(pContext)
+#endif
 
 #endif /* ifndef CORE_MQTT_CONFIG_H_ */
@@ -9,6 +9,7 @@
 #include "tal_log.h"
 #include "tal_system.h"
 #include "tal_memory.h"
+#include "tal_mutex.h"
 
 #define log_debug PR_DEBUG
 #define log_error PR_ERR
@@ -17,9 +18,64 @@ typedef struct {
     mqtt_client_config_t config;
     MQTTContext_t mqclient;
     tuya_transporter_t network;
+    /* serializes every coreMQTT call, which share networkBuffer and the state records */
+    MUTEX_HANDLE mutex;
+    /* set while the loop thread runs MQTT_ProcessLoop */
+    bool yielding;
     uint8_t mqttbuffer[CORE_MQTT_BUFFER_SIZE];
 } mqtt_client_context_t;
 
+#if defined(ENABLE_MQTT_LARGE_MSG) && (ENABLE_MQTT_LARGE_MSG == 1)
+/**
+ * @brief Receive a packet larger than mqttbuffer into a buffer sized for it
+ *
+ * Called by coreMQTT with the remaining length of every incoming packet.
+ * The buffer lives until the packet has been dispatched and acked, and
+ * mqtt_client_recv_buffer_release() puts mqttbuffer back. When the packet
+ * is too large or the allocation fails the buffer is left unchanged and
+ * coreMQTT dumps the packet.
+ *
+ * Both run inside MQTT_ProcessLoop with the client mutex held, so no
+ * publish can serialize into the buffer while it is swapped.
+ */
+void mqtt_client_recv_buffer_grow(struct MQTTContext *pContext, size_t length)
+{
+    mqtt_client_context_t *context = (mqtt_client_context_t *)pContext->userData;
+
+    if (length <= sizeof(context->mqttbuffer)) {
+        return;
+    }
+
+    if (length > MQTT_LARGE_MSG_MAX_SIZE) {
+        log_error("mqtt packet too large:%u, max:%u", (unsigned)length, (unsigned)MQTT_LARGE_MSG_MAX_SIZE);
+        return;
+    }
+
+    uint8_t *buffer = tal_malloc(length);
+    if (NULL == buffer) {
+        log_error("mqtt packet malloc fail:%u", (unsigned)length);
+        return;
+    }
+
+    log_debug("mqtt large packet:%u", (unsigned)length);
+    pContext->networkBuffer.pBuffer = buffer;
+    pContext->networkBuffer.size = length;
+}
+
+void mqtt_client_recv_buffer_release(struct MQTTContext *pContext)
+{
+    mqtt_client_context_t *context = (mqtt_client_context_t *)pContext->userData;
+
+    if (pContext->networkBuffer.pBuffer == context->mqttbuffer) {
+        return;
+    }
+
+    tal_free(pContext->networkBuffer.pBuffer);
+    pContext->networkBuffer.pBuffer = context->mqttbuffer;
+    pContext->networkBuffer.size = sizeof(context->mqttbuffer);
+}
+#endif
+
 static void core_mqtt_library_callback(struct MQTTContext *pContext, struct MQTTPacketInfo *pPacketInfo,
                                        struct MQTTDeserializedInfo *pDeserializedInfo)
 {
@@ -35,24 +91,49 @@ static void core_mqtt_library_callback(struct MQTTContext *pContext, struct MQTT
             return;
         }
 
-        char *topic = tal_malloc(pDeserializedInfo->pPublishInfo->topicNameLength + 1);
+        /* The callback runs unlocked and may publish, which serializes into
+         * networkBuffer, so the payload must not stay there. */
+        const MQTTPublishInfo_t *info = pDeserializedInfo->pPublishInfo;
+        const uint8_t *payload = info->pPayload;
+        size_t copy_len = info->payloadLength;
+        uint8_t *detached = NULL;
+#if defined(ENABLE_MQTT_LARGE_MSG) && (ENABLE_MQTT_LARGE_MSG == 1)
+        if (pContext->networkBuffer.pBuffer != context->mqttbuffer) {
+            /* take the packet's own buffer rather than copy it */
+            detached = pContext->networkBuffer.pBuffer;
+            pContext->networkBuffer.pBuffer = context->mqttbuffer;
+            pContext->networkBuffer.size = sizeof(context->mqttbuffer);
+            copy_len = 0;
+        }
+#endif
+
+        char *topic = tal_malloc(info->topicNameLength + 1 + copy_len);
         if (topic == NULL) {
+            tal_free(detached);
             return;
         }
-        memcpy(topic, pDeserializedInfo->pPublishInfo->pTopicName, pDeserializedInfo->pPublishInfo->topicNameLength);
-        topic[pDeserializedInfo->pPublishInfo->topicNameLength] = '\0';
-
-        context->config.on_message(context, msgid,
-                                   &(const mqtt_client_message_t){
-                                       .topic = topic,
-                                       .payload = pDeserializedInfo->pPublishInfo->pPayload,
-                                       .length = pDeserializedInfo->pPublishInfo->payloadLength,
-                                       .qos = pDeserializedInfo->pPublishInfo->qos,
-                                   },
-                                   context->config.userdata);
+        memcpy(topic, info->pTopicName, info->topicNameLength);
+        topic[info->topicNameLength] = '\0';
+        if (copy_len) {
+            memcpy(topic + info->topicNameLength + 1, payload, copy_len);
+            payload = (const uint8_t *)topic + info->topicNameLength + 1;
+        }
+
+        mqtt_client_message_t message = {
+            .topic = topic,
+            .payload = payload,
+            .length = info->payloadLength,
+            .qos = info->qos,
+        };
+        tal_mutex_unlock(context->mutex);
+        context->config.on_message(context, msgid, &message, context->config.userdata);
+        tal_mutex_lock(context->mutex);
         tal_free(topic);
+        tal_free(detached);
 
     } else {
+        /* acks carry nothing in networkBuffer, run the callbacks unlocked */
+        tal_mutex_unlock(context->mutex);
         switch (pPacketInfo->type) {
         case MQTT_PACKET_TYPE_SUBACK:
             log_debug("MQTT_PACKET_TYPE_SUBACK id:%d", msgid);
@@ -78,6 +159,7 @@ static void core_mqtt_library_callback(struct MQTTContext *pContext, struct MQTT
         default:
             log_debug("type:0x%02x, id:%d", pPacketInfo->type, msgid);
         }
+        tal_mutex_lock(context->mutex);
     }
 }
 
@@ -101,6 +183,9 @@ static int network_write(NetworkContext_t *pNetwork, const unsigned char *pMsg,
 static int network_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len)
 {
     tuya_transporter_t transporter = *pNetwork;
+    mqtt_client_context_t *context =
+        (mqtt_client_context_t *)((uint8_t *)pNetwork - offsetof(mqtt_client_context_t, network));
+    MQTTFixedBuffer_t *buffer = &context->mqclient.networkBuffer;
 
     tuya_tls_config_t *tls_config = NULL;
 
@@ -108,7 +193,16 @@ static int network_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t
 
     int timeout = tls_config ? tls_config->timeout : 5000;
 
+    /* The loop blocks here waiting for the next packet header, which is read
+     * into coreMQTT's stack, so let the publishers in meanwhile. */
+    bool unlock = context->yielding && (pMsg < buffer->pBuffer || pMsg >= buffer->pBuffer + buffer->size);
+    if (unlock) {
+        tal_mutex_unlock(context->mutex);
+    }
     int result = tuya_transporter_read(transporter, (uint8_t *)pMsg, len, timeout);
+    if (unlock) {
+        tal_mutex_lock(context->mutex);
+    }
 
     if (result == OPRT_RESOURCE_NOT_READY) {
         return 0;
@@ -125,11 +219,16 @@ mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *
     /* Clean memory */
     memset(context, 0, sizeof(mqtt_client_context_t));
 
+    if (OPRT_OK != tal_mutex_create_init(&context->mutex)) {
+        return MQTT_STATUS_NETWORK_INIT_FAILED;
+    }
+
     /* Setting data */
     TUYA_TRANSPORT_TYPE_E transport_type = (config->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
     context->config = *config;
     context->network = tuya_transporter_create(transport_type, NULL);
     if (NULL == context->network) {
+        tal_mutex_release(context->mutex);
         return MQTT_STATUS_NETWORK_INIT_FAILED;
     }
     if (transport_type == TRANSPORT_TYPE_TLS) {
@@ -146,6 +245,8 @@ mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *
         int ret = tuya_transporter_ctrl(context->network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
         if (OPRT_OK != ret) {
             log_error("network_tls_init fail:%d", ret);
+            tuya_transporter_destroy(context->network);
+            tal_mutex_release(context->mutex);
             return MQTT_STATUS_NETWORK_INIT_FAILED;
         }
     }
@@ -171,6 +272,7 @@ mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *
         log_error("MQTT init failed: Status = %s.", MQTT_Status_strerror(mqtt_status));
         tuya_transporter_close(context->network);
         tuya_transporter_destroy(context->network);
+        tal_mutex_release(context->mutex);
         return OPRT_COM_ERROR;
     }
 
@@ -183,6 +285,8 @@ mqtt_client_status_t mqtt_client_deinit(void *client)
 
     tuya_transporter_close(context->network);
     tuya_transporter_destroy(context->network);
+    tal_mutex_release(context->mutex);
+    context->mutex = NULL;
     return MQTT_STATUS_SUCCESS;
 }
 
@@ -201,6 +305,7 @@ mqtt_client_status_t mqtt_client_connect(void *client)
     bool pSessionPresent = false;
 
     /* Send MQTT CONNECT packet to broker. */
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_Connect(&context->mqclient,
                                &(const MQTTConnectInfo_t){.cleanSession = true,
                                                           .keepAliveSeconds = context->config.keepalive,
@@ -211,6 +316,7 @@ mqtt_client_status_t mqtt_client_connect(void *client)
                                                           .pPassword = context->config.password,
                                                           .passwordLength = strlen(context->config.password)},
                                NULL, context->config.timeout_ms, &pSessionPresent);
+    tal_mutex_unlock(context->mutex);
     if (MQTTSuccess != mqtt_status) {
         log_error("mqtt connect err: %s(%d)", MQTT_Status_strerror(mqtt_status), mqtt_status);
         tuya_transporter_close(context->network);
@@ -232,7 +338,9 @@ mqtt_client_status_t mqtt_client_disconnect(void *client)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_Disconnect(&context->mqclient);
+    tal_mutex_unlock(context->mutex);
     if (MQTTSuccess != mqtt_status) {
         log_error("mqtt disconnect err: %s(%d)", MQTT_Status_strerror(mqtt_status), mqtt_status);
     }
@@ -251,11 +359,13 @@ uint16_t mqtt_client_subscribe(void *client, const char *topic, uint8_t qos)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
 
     mqtt_status = MQTT_Subscribe(
         &context->mqclient,
         &(const MQTTSubscribeInfo_t){.qos = qos, .pTopicFilter = topic, .topicFilterLength = strlen(topic)}, 1, msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (mqtt_status != MQTTSuccess) {
         log_error("Failed to send SUBSCRIBE packet to broker with error = %s.", MQTT_Status_strerror(mqtt_status));
@@ -270,11 +380,13 @@ uint16_t mqtt_client_unsubscribe(void *client, const char *topic, uint8_t qos)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
 
     mqtt_status = MQTT_Unsubscribe(
         &context->mqclient,
         &(const MQTTSubscribeInfo_t){.qos = qos, .pTopicFilter = topic, .topicFilterLength = strlen(topic)}, 1, msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (mqtt_status != MQTTSuccess) {
         log_error("Failed to send SUBSCRIBE packet to broker with error = %s.", MQTT_Status_strerror(mqtt_status));
@@ -289,6 +401,7 @@ uint16_t mqtt_client_publish(void *client, const char *topic, const uint8_t *pay
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
 
     mqtt_status = MQTT_Publish(&context->mqclient,
@@ -298,6 +411,7 @@ uint16_t mqtt_client_publish(void *client, const char *topic, const uint8_t *pay
                                                           .pPayload = payload,
                                                           .payloadLength = length},
                                msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (MQTTSuccess != mqtt_status) {
         return 0;
@@ -310,7 +424,11 @@ mqtt_client_status_t mqtt_client_yield(void *client)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
+    context->yielding = true;
     mqtt_status = MQTT_ProcessLoop(&context->mqclient, context->config.timeout_ms);
+    context->yielding = false;
+    tal_mutex_unlock(context->mutex);
     if (mqtt_status != MQTTSuccess) {
         log_error("MQTT_ProcessLoop returned with status = %s.", MQTT_Status_strerror(mqtt_status));
         mqtt_client_disconnect(context);
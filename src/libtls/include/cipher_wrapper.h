@@ -9,6 +9,7 @@ extern "C" {
 #include "mbedtls/platform.h"
 #include "mbedtls/cipher.h"
 #include "mbedtls/md.h"
+#include "mbedtls/gcm.h"
 
 typedef struct {
     unsigned char *key;
@@ -22,6 +23,68 @@ typedef struct {
     mbedtls_cipher_type_t cipher_type;
 } cipher_params_t;
 
+/**
+ * @brief Keyed AEAD context. The key schedule is expanded once by
+ * cipher_aead_setkey() and reused by every encrypt/decrypt until the key
+ * changes. Only the GCM ciphers are supported.
+ *
+ * A context is not reentrant, the owner serializes the calls on it.
+ */
+typedef struct {
+    mbedtls_gcm_context gcm;
+    mbedtls_cipher_type_t cipher_type;
+    size_t key_len;
+    unsigned char key[32];
+} cipher_aead_ctx_t;
+
+void cipher_aead_init(cipher_aead_ctx_t *ctx);
+
+void cipher_aead_free(cipher_aead_ctx_t *ctx);
+
+/**
+ * @brief Set the key of an AEAD context. Nothing is done when the context
+ * already holds the same cipher and key, so it is cheap to call before every
+ * operation with the current key.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED for non GCM ciphers,
+ * others on error.
+ */
+int cipher_aead_setkey(cipher_aead_ctx_t *ctx, mbedtls_cipher_type_t cipher_type, const unsigned char *key,
+                       size_t key_len);
+
+/**
+ * @brief Encrypt len bytes and compute the tag. output may equal input for
+ * in place encryption, tag may be anywhere. No memory is allocated.
+ */
+int cipher_aead_encrypt(cipher_aead_ctx_t *ctx, const unsigned char *nonce, size_t nonce_len, const unsigned char *ad,
+                        size_t ad_len, const unsigned char *input, unsigned char *output, size_t len,
+                        unsigned char *tag, size_t tag_len);
+
+/**
+ * @brief Check the tag and decrypt len bytes. output may equal input for in
+ * place decryption, tag may be anywhere. No memory is allocated.
+ */
+int cipher_aead_decrypt(cipher_aead_ctx_t *ctx, const unsigned char *nonce, size_t nonce_len, const unsigned char *ad,
+                        size_t ad_len, const unsigned char *input, unsigned char *output, size_t len,
+                        const unsigned char *tag, size_t tag_len);
+
+/**
+ * @brief The wrappers below take the raw key. For GCM they go through a small
+ * cache of keyed contexts, so the callers that keep using the same few keys
+ * (local key, session key, cipher key) don't expand the key on every call.
+ */
+/**
+ * @brief Create the lock of the keyed context cache. Called once by
+ * tuya_tls_init(), until then the wrappers key a context on the stack.
+ */
+int cipher_aead_cache_init(void);
+
+/**
+ * @brief Wipe the cached contexts holding key, or every context when key is
+ * NULL. Call it when a session key or the device keys are dropped.
+ */
+void cipher_aead_cache_clear(const unsigned char *key, size_t key_len);
+
 int mbedtls_cipher_auth_encrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
                                         unsigned char *tag, size_t tag_len);
 
@@ -33,6 +96,14 @@ int mbedtls_message_digest(mbedtls_md_type_t md_type, const uint8_t *input, size
 int mbedtls_message_digest_hmac(mbedtls_md_type_t md_type, const uint8_t *key, size_t keylen, const uint8_t *input,
                                 size_t ilen, uint8_t *digest);
 
+#if defined(CIPHER_AEAD_BENCHMARK) && (CIPHER_AEAD_BENCHMARK == 1)
+/**
+ * @brief Log the AES-128-GCM throughput of the per-call setup path against a
+ * keyed context, encrypting rounds buffers of len bytes with each.
+ */
+int cipher_aead_benchmark(size_t len, uint32_t rounds);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
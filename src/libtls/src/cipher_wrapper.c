@@ -1,15 +1,233 @@
 // https://tls.mbed.org/module-level-design-cipher
 #include "cipher_wrapper.h"
+#include "mbedtls/platform_util.h"
 #include "tal_log.h"
 #include "tal_memory.h"
+#include "tal_mutex.h"
+#include "tal_system.h"
 
-int mbedtls_cipher_auth_encrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
-                                        unsigned char *tag, size_t tag_len)
+/* keyed GCM contexts kept by the raw key wrappers, 0 disables the cache */
+#ifndef CIPHER_AEAD_CACHE_NUM
+#define CIPHER_AEAD_CACHE_NUM 4
+#endif
+
+typedef struct {
+    cipher_aead_ctx_t ctx;
+    uint32_t used;
+} cipher_aead_cache_t;
+
+#if CIPHER_AEAD_CACHE_NUM > 0
+static MUTEX_HANDLE s_aead_mutex = NULL;
+static cipher_aead_cache_t s_aead_cache[CIPHER_AEAD_CACHE_NUM];
+static uint32_t s_aead_stamp = 0;
+#endif
+
+static mbedtls_cipher_id_t __aead_cipher_id(mbedtls_cipher_type_t cipher_type)
+{
+    switch (cipher_type) {
+    case MBEDTLS_CIPHER_AES_128_GCM:
+    case MBEDTLS_CIPHER_AES_192_GCM:
+    case MBEDTLS_CIPHER_AES_256_GCM:
+        return MBEDTLS_CIPHER_ID_AES;
+    default:
+        return MBEDTLS_CIPHER_ID_NONE;
+    }
+}
+
+void cipher_aead_init(cipher_aead_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(cipher_aead_ctx_t));
+    mbedtls_gcm_init(&ctx->gcm);
+    ctx->cipher_type = MBEDTLS_CIPHER_NONE;
+}
+
+void cipher_aead_free(cipher_aead_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    mbedtls_gcm_free(&ctx->gcm);
+    mbedtls_platform_zeroize(ctx->key, sizeof(ctx->key));
+    ctx->cipher_type = MBEDTLS_CIPHER_NONE;
+    ctx->key_len = 0;
+}
+
+int cipher_aead_setkey(cipher_aead_ctx_t *ctx, mbedtls_cipher_type_t cipher_type, const unsigned char *key,
+                       size_t key_len)
+{
+    if (ctx == NULL || key == NULL || key_len > sizeof(ctx->key)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (ctx->cipher_type == cipher_type && ctx->key_len == key_len && memcmp(ctx->key, key, key_len) == 0) {
+        return OPRT_OK;
+    }
+
+    mbedtls_cipher_id_t cipher_id = __aead_cipher_id(cipher_type);
+    if (cipher_id == MBEDTLS_CIPHER_ID_NONE) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    const mbedtls_cipher_info_t *cipher_info = mbedtls_cipher_info_from_type(cipher_type);
+    if (cipher_info == NULL || (key_len * 8) != mbedtls_cipher_info_get_key_bitlen(cipher_info)) {
+        PR_ERR("key_len:%d cipher:%d", key_len * 8, cipher_type);
+        return OPRT_INVALID_PARM;
+    }
+
+    /* a failed setkey leaves the context keyless */
+    ctx->cipher_type = MBEDTLS_CIPHER_NONE;
+    int ret = mbedtls_gcm_setkey(&ctx->gcm, cipher_id, key, key_len * 8);
+    if (ret != 0) {
+        PR_ERR("mbedtls_gcm_setkey() returned -0x%04x", -ret);
+        return ret;
+    }
+
+    ctx->cipher_type = cipher_type;
+    ctx->key_len = key_len;
+    memcpy(ctx->key, key, key_len);
+    return OPRT_OK;
+}
+
+int cipher_aead_encrypt(cipher_aead_ctx_t *ctx, const unsigned char *nonce, size_t nonce_len, const unsigned char *ad,
+                        size_t ad_len, const unsigned char *input, unsigned char *output, size_t len,
+                        unsigned char *tag, size_t tag_len)
 {
-    if (input == NULL || output == NULL || olen == NULL) {
+    if (ctx == NULL || ctx->cipher_type == MBEDTLS_CIPHER_NONE || tag == NULL) {
         return OPRT_INVALID_PARM;
     }
 
+    return mbedtls_gcm_crypt_and_tag(&ctx->gcm, MBEDTLS_GCM_ENCRYPT, len, nonce, nonce_len, ad, ad_len, input, output,
+                                     tag_len, tag);
+}
+
+int cipher_aead_decrypt(cipher_aead_ctx_t *ctx, const unsigned char *nonce, size_t nonce_len, const unsigned char *ad,
+                        size_t ad_len, const unsigned char *input, unsigned char *output, size_t len,
+                        const unsigned char *tag, size_t tag_len)
+{
+    if (ctx == NULL || ctx->cipher_type == MBEDTLS_CIPHER_NONE || tag == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    return mbedtls_gcm_auth_decrypt(&ctx->gcm, len, nonce, nonce_len, ad, ad_len, tag, tag_len, input, output);
+}
+
+int cipher_aead_cache_init(void)
+{
+#if CIPHER_AEAD_CACHE_NUM > 0
+    if (s_aead_mutex == NULL) {
+        return tal_mutex_create_init(&s_aead_mutex);
+    }
+#endif
+    return OPRT_OK;
+}
+
+void cipher_aead_cache_clear(const unsigned char *key, size_t key_len)
+{
+#if CIPHER_AEAD_CACHE_NUM > 0
+    if (s_aead_mutex == NULL) {
+        return;
+    }
+
+    tal_mutex_lock(s_aead_mutex);
+    int i;
+    for (i = 0; i < CIPHER_AEAD_CACHE_NUM; i++) {
+        cipher_aead_cache_t *it = &s_aead_cache[i];
+        if (it->used == 0) {
+            continue;
+        }
+        if (key == NULL || (it->ctx.key_len == key_len && memcmp(it->ctx.key, key, key_len) == 0)) {
+            cipher_aead_free(&it->ctx);
+            it->used = 0;
+        }
+    }
+    tal_mutex_unlock(s_aead_mutex);
+#else
+    (void)key;
+    (void)key_len;
+#endif
+}
+
+/**
+ * @brief Lock the cache and return the entry keyed with input->key, or else
+ * the least recently used one. NULL when the cache is disabled or
+ * cipher_aead_cache_init() has not run, the lock is not taken then.
+ */
+static cipher_aead_ctx_t *__aead_cache_take(const cipher_params_t *input)
+{
+#if CIPHER_AEAD_CACHE_NUM > 0
+    if (s_aead_mutex == NULL) {
+        return NULL;
+    }
+
+    tal_mutex_lock(s_aead_mutex);
+
+    /* same key, or else the least recently used entry */
+    cipher_aead_cache_t *entry = &s_aead_cache[0];
+    int i;
+    for (i = 0; i < CIPHER_AEAD_CACHE_NUM; i++) {
+        cipher_aead_cache_t *it = &s_aead_cache[i];
+        if (it->used && it->ctx.cipher_type == input->cipher_type && it->ctx.key_len == input->key_len &&
+            memcmp(it->ctx.key, input->key, input->key_len) == 0) {
+            entry = it;
+            break;
+        }
+        if (it->used < entry->used) {
+            entry = it;
+        }
+    }
+    if (entry->used == 0) {
+        cipher_aead_init(&entry->ctx);
+    }
+    entry->used = ++s_aead_stamp;
+    return &entry->ctx;
+#else
+    (void)input;
+    return NULL;
+#endif
+}
+
+/**
+ * @brief Run one GCM operation of the raw key wrappers on a keyed context,
+ * taken from the cache when available, on the stack otherwise.
+ */
+static int __aead_gcm_crypt(int mode, const cipher_params_t *input, unsigned char *output, size_t *olen,
+                            unsigned char *tag, size_t tag_len)
+{
+    int ret;
+    cipher_aead_ctx_t stack_ctx;
+    cipher_aead_ctx_t *ctx = __aead_cache_take(input);
+
+    if (ctx == NULL) {
+        cipher_aead_init(&stack_ctx);
+        ctx = &stack_ctx;
+    }
+
+    ret = cipher_aead_setkey(ctx, input->cipher_type, input->key, input->key_len);
+    if (ret == OPRT_OK) {
+        if (mode == MBEDTLS_GCM_ENCRYPT) {
+            ret = cipher_aead_encrypt(ctx, input->nonce, input->nonce_len, input->ad, input->ad_len, input->data,
+                                      output, input->data_len, tag, tag_len);
+        } else {
+            ret = cipher_aead_decrypt(ctx, input->nonce, input->nonce_len, input->ad, input->ad_len, input->data,
+                                      output, input->data_len, tag, tag_len);
+        }
+    }
+    *olen = (ret == OPRT_OK) ? input->data_len : 0;
+
+    if (ctx == &stack_ctx) {
+        cipher_aead_free(&stack_ctx);
+    } else {
+#if CIPHER_AEAD_CACHE_NUM > 0
+        tal_mutex_unlock(s_aead_mutex);
+#endif
+    }
+    return ret;
+}
+
+static int __cipher_auth_encrypt(const cipher_params_t *input, unsigned char *output, size_t *olen,
+                                 unsigned char *tag, size_t tag_len)
+{
+
     int ret = OPRT_OK;
     unsigned char *enc_tmpbuf = NULL;
     mbedtls_cipher_info_t *cipher_info;
@@ -44,7 +262,26 @@ int mbedtls_cipher_auth_encrypt_wrapper(const cipher_params_t *input, unsigned c
         goto EXIT;
     }
 
+    /*
+     * The AEAD modes write ciphertext and tag back to back. When the caller
+     * already laid them out that way, encrypt straight into output, in place
+     * if output aliases the input, and skip the bounce buffer.
+     */
+    if (tag == output + input->data_len) {
+        ret = mbedtls_cipher_auth_encrypt_ext(&cipher_ctx, input->nonce, input->nonce_len, input->ad, input->ad_len,
+                                              input->data, input->data_len, output, input->data_len + tag_len, olen,
+                                              tag_len);
+        if (ret == 0) {
+            *olen -= tag_len;
+        }
+        goto EXIT;
+    }
+
     enc_tmpbuf = tal_malloc(input->data_len + tag_len);
+    if (NULL == enc_tmpbuf) {
+        ret = OPRT_MALLOC_FAILED;
+        goto EXIT;
+    }
 
     /*
      * Encrypt and write the ciphertext.
@@ -67,13 +304,9 @@ EXIT:
     return (ret);
 }
 
-int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
-                                        unsigned char *tag, size_t tag_len)
+static int __cipher_auth_decrypt(const cipher_params_t *input, unsigned char *output, size_t *olen,
+                                 unsigned char *tag, size_t tag_len)
 {
-    if (input == NULL || output == NULL || olen == NULL) {
-        return OPRT_INVALID_PARM;
-    }
-
     int ret = OPRT_OK;
     unsigned char *dec_tmpbuf = NULL;
     const mbedtls_cipher_info_t *cipher_info;
@@ -87,6 +320,7 @@ int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned c
     cipher_info = mbedtls_cipher_info_from_type(input->cipher_type);
     if (cipher_info == NULL) {
         PR_ERR("Cipher '%s' not found\n", "mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CBC)");
+        ret = OPRT_INVALID_PARM;
         goto EXIT;
     }
 
@@ -118,6 +352,10 @@ int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned c
 
     /* https://github.com/Mbed-TLS/mbedtls/issues/3665 */
     dec_tmpbuf = tal_malloc(input->data_len + tag_len);
+    if (NULL == dec_tmpbuf) {
+        ret = OPRT_MALLOC_FAILED;
+        goto EXIT;
+    }
     memcpy(dec_tmpbuf, input->data, input->data_len);
     memcpy(dec_tmpbuf + input->data_len, tag, tag_len);
 
@@ -136,6 +374,34 @@ EXIT:
     return (ret);
 }
 
+int mbedtls_cipher_auth_encrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
+                                        unsigned char *tag, size_t tag_len)
+{
+    if (input == NULL || output == NULL || olen == NULL || tag == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (__aead_cipher_id(input->cipher_type) != MBEDTLS_CIPHER_ID_NONE) {
+        return __aead_gcm_crypt(MBEDTLS_GCM_ENCRYPT, input, output, olen, tag, tag_len);
+    }
+
+    return __cipher_auth_encrypt(input, output, olen, tag, tag_len);
+}
+
+int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
+                                        unsigned char *tag, size_t tag_len)
+{
+    if (input == NULL || output == NULL || olen == NULL || tag == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (__aead_cipher_id(input->cipher_type) != MBEDTLS_CIPHER_ID_NONE) {
+        return __aead_gcm_crypt(MBEDTLS_GCM_DECRYPT, input, output, olen, tag, tag_len);
+    }
+
+    return __cipher_auth_decrypt(input, output, olen, tag, tag_len);
+}
+
 int mbedtls_message_digest(mbedtls_md_type_t md_type, const uint8_t *input, size_t ilen, uint8_t *digest)
 {
     if (input == NULL || ilen == 0 || digest == NULL) {
@@ -181,4 +447,72 @@ int mbedtls_message_digest_hmac(mbedtls_md_type_t md_type, const uint8_t *key, s
 exit:
     mbedtls_md_free(&md_ctx);
     return ret;
-}
\ No newline at end of file
+}
+
+#if defined(CIPHER_AEAD_BENCHMARK) && (CIPHER_AEAD_BENCHMARK == 1)
+int cipher_aead_benchmark(size_t len, uint32_t rounds)
+{
+    static const unsigned char key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                          0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    unsigned char nonce[12] = {0};
+    unsigned char ad[14] = {0};
+    unsigned char tag[16];
+    size_t olen = 0;
+    uint32_t i;
+    int ret = OPRT_OK;
+
+    if (len == 0 || rounds == 0) {
+        return OPRT_INVALID_PARM;
+    }
+
+    unsigned char *buf = tal_malloc(len);
+    if (buf == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(buf, 0x5a, len);
+
+    cipher_params_t params = {.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
+                              .key = (unsigned char *)key,
+                              .key_len = sizeof(key),
+                              .nonce = nonce,
+                              .nonce_len = sizeof(nonce),
+                              .ad = ad,
+                              .ad_len = sizeof(ad),
+                              .data = buf,
+                              .data_len = len};
+
+    /* what the wrappers did on every call: setup, setkey, bounce buffer */
+    SYS_TIME_T start = tal_system_get_millisecond();
+    for (i = 0; i < rounds && ret == OPRT_OK; i++) {
+        nonce[0] = (unsigned char)i;
+        ret = __cipher_auth_encrypt(&params, buf, &olen, tag, sizeof(tag));
+    }
+    SYS_TIME_T per_call = tal_system_get_millisecond() - start;
+
+    cipher_aead_ctx_t ctx;
+    cipher_aead_init(&ctx);
+    if (ret == OPRT_OK) {
+        ret = cipher_aead_setkey(&ctx, MBEDTLS_CIPHER_AES_128_GCM, key, sizeof(key));
+    }
+    start = tal_system_get_millisecond();
+    for (i = 0; i < rounds && ret == OPRT_OK; i++) {
+        nonce[0] = (unsigned char)i;
+        ret = cipher_aead_encrypt(&ctx, nonce, sizeof(nonce), ad, sizeof(ad), buf, buf, len, tag, sizeof(tag));
+    }
+    SYS_TIME_T keyed = tal_system_get_millisecond() - start;
+    cipher_aead_free(&ctx);
+    tal_free(buf);
+
+    if (ret != OPRT_OK) {
+        PR_ERR("aead benchmark failed:-0x%04x", -ret);
+        return ret;
+    }
+
+    PR_NOTICE("aes-128-gcm %d x %d bytes, per call:%d ms, keyed ctx:%d ms", rounds, len, (int)per_call, (int)keyed);
+    if (per_call && keyed) {
+        PR_NOTICE("per call:%d KB/s, keyed ctx:%d KB/s", (int)((uint64_t)len * rounds / per_call),
+                  (int)((uint64_t)len * rounds / keyed));
+    }
+    return OPRT_OK;
+}
+#endif
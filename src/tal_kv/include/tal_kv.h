@@ -153,6 +153,26 @@ int tal_kv_serialize_set(const char *key, kv_db_t *db, size_t dbcnt);
  */
 int tal_kv_serialize_get(const char *key, kv_db_t *db, size_t dbcnt);
 
+/**
+ * @brief Begins a transaction of the TAL Key-Value store.
+ *
+ * The keys set or deleted until the paired tal_kv_txn_commit are kept in RAM
+ * and written in one flash commit. Transactions can be nested.
+ *
+ * Needs ENABLE_KV_CACHE, without it this is a no-op and each set or delete
+ * writes flash by itself.
+ *
+ * @return OPRT_OK on success.
+ */
+int tal_kv_txn_begin(void);
+
+/**
+ * @brief Commits the transaction begun by tal_kv_txn_begin.
+ *
+ * @return OPRT_OK on success, or an error code if writing flash fails.
+ */
+int tal_kv_txn_commit(void);
+
 /**
  * @brief Executes the TAL KV command.
  *
@@ -171,6 +191,18 @@ void tal_kv_cmd(int argc, char *argv[]);
  */
 lfs_t *tal_lfs_get();
 
+#if defined(KV_BENCHMARK) && (KV_BENCHMARK == 1)
+/**
+ * @brief Rewrites keys values of value_len bytes rounds times, reads them
+ * back and logs the time taken, the bytes programmed and blocks erased per
+ * byte set, for the engine selected at build time. The keys are deleted
+ * afterwards.
+ *
+ * @return OPRT_OK on success, OPRT_COM_ERROR when a value reads back wrong.
+ */
+int tal_kv_benchmark(uint32_t keys, uint32_t value_len, uint32_t rounds);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
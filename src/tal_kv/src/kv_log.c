@@ -0,0 +1,559 @@
+/**
+ * @file kv_log.c
+ * @brief Implements an append-only, single-file key-value log on LittleFS.
+ *
+ * All key-value pairs are appended as records to one LittleFS file instead of
+ * one file per key. An in-RAM hash index maps every live key to the offset of
+ * its latest value in the log, so a get is a single seek and read, and a set
+ * or delete is a single append plus one file sync.
+ *
+ * Every record carries a CRC32 over its header, key and value. A record with
+ * the commit flag closes a group of records; on boot the log is replayed and
+ * only committed groups are applied, a torn tail left by a power loss is
+ * truncated. When most of the log is garbage, the live records are copied to a
+ * new file which atomically replaces the old one by LittleFS rename.
+ *
+ * The caller (tal_kv.c) encrypts the values and serializes the access by its
+ * mutex, this module never takes any lock.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+#include "tal_kv.h"
+#include "tal_api.h"
+#include "crc32i.h"
+
+#ifndef KV_LOG_FILE
+#define KV_LOG_FILE "tal_kv.log"
+#endif
+
+#ifndef KV_LOG_TMP_FILE
+#define KV_LOG_TMP_FILE "tal_kv.tmp"
+#endif
+
+// compact when log is larger than this and more than half of it is garbage
+#ifndef KV_LOG_COMPACT_SIZE
+#define KV_LOG_COMPACT_SIZE (16 * 1024)
+#endif
+
+// bucket number of the index hash table, must be power of 2
+#ifndef KV_LOG_HASH_SIZE
+#define KV_LOG_HASH_SIZE (64)
+#endif
+
+#define KV_LOG_MAGIC       0xA5
+#define KV_LOG_FLAG_DEL    0x01 // the record deletes the key
+#define KV_LOG_FLAG_COMMIT 0x02 // the record closes a group of records
+#define KV_LOG_KEY_MAX     255
+
+typedef struct {
+    uint8_t magic;    // KV_LOG_MAGIC
+    uint8_t flag;     // KV_LOG_FLAG_xxx
+    uint8_t key_len;  // key length, without '\0'
+    uint8_t reserved; // always 0
+    uint32_t val_len; // value length
+    uint32_t crc;     // crc32 over header (crc is 0), key and value
+} KV_LOG_HDR_T;
+
+typedef struct kv_log_node {
+    struct kv_log_node *next; // next node in the same bucket, or in the pending list
+    uint32_t offset;          // value offset in log file
+    uint32_t len;             // value length
+    BOOL_T del;               // pending delete, only used in the pending list
+    char key[0];              // key, '\0' terminated
+} KV_LOG_NODE_T;
+
+typedef struct {
+    lfs_t *lfs;
+    lfs_file_t file;
+    BOOL_T opened;
+    uint32_t end;                             // log file size
+    uint32_t commit_end;                      // log file size at the last commit
+    uint32_t live;                            // bytes of the records referred by index
+    KV_LOG_NODE_T *bucket[KV_LOG_HASH_SIZE];  // key index
+    KV_LOG_NODE_T *pending;                   // written but not committed records
+    KV_LOG_NODE_T **pending_tail;             // tail of the pending list, keep the write order
+} KV_LOG_T;
+
+static KV_LOG_T s_kv_log;
+
+#define KV_LOG_REC_LEN(key_len, val_len) (sizeof(KV_LOG_HDR_T) + (key_len) + (val_len))
+
+static uint32_t __kv_log_hash(const char *key)
+{
+    uint32_t hash = 5381;
+
+    while (*key) {
+        hash = ((hash << 5) + hash) + (uint8_t)(*key++);
+    }
+
+    return hash & (KV_LOG_HASH_SIZE - 1);
+}
+
+static KV_LOG_NODE_T *__kv_log_node_new(const char *key, uint32_t offset, uint32_t len, BOOL_T del)
+{
+    size_t key_len = strlen(key);
+    KV_LOG_NODE_T *node = (KV_LOG_NODE_T *)tal_malloc(sizeof(KV_LOG_NODE_T) + key_len + 1);
+    if (NULL == node) {
+        return NULL;
+    }
+
+    node->next = NULL;
+    node->offset = offset;
+    node->len = len;
+    node->del = del;
+    memcpy(node->key, key, key_len + 1);
+
+    return node;
+}
+
+static KV_LOG_NODE_T **__kv_log_index_find(const char *key)
+{
+    KV_LOG_NODE_T **pp = &s_kv_log.bucket[__kv_log_hash(key)];
+
+    while (*pp) {
+        if (0 == strcmp((*pp)->key, key)) {
+            return pp;
+        }
+        pp = &(*pp)->next;
+    }
+
+    return pp;
+}
+
+/**
+ * @brief apply a committed record to index, the node is taken by index or freed
+ */
+static void __kv_log_index_apply(KV_LOG_NODE_T *node)
+{
+    KV_LOG_NODE_T **pp = __kv_log_index_find(node->key);
+    KV_LOG_NODE_T *old = *pp;
+    size_t key_len = strlen(node->key);
+
+    if (old) {
+        *pp = old->next;
+        s_kv_log.live -= KV_LOG_REC_LEN(key_len, old->len);
+        tal_free(old);
+    }
+
+    if (node->del) {
+        tal_free(node);
+        return;
+    }
+
+    node->next = s_kv_log.bucket[__kv_log_hash(node->key)];
+    s_kv_log.bucket[__kv_log_hash(node->key)] = node;
+    s_kv_log.live += KV_LOG_REC_LEN(key_len, node->len);
+}
+
+static void __kv_log_pending_add(KV_LOG_NODE_T *node)
+{
+    node->next = NULL;
+    *s_kv_log.pending_tail = node;
+    s_kv_log.pending_tail = &node->next;
+}
+
+static void __kv_log_pending_apply(BOOL_T commit)
+{
+    KV_LOG_NODE_T *node = s_kv_log.pending;
+    KV_LOG_NODE_T *next = NULL;
+
+    while (node) {
+        next = node->next;
+        if (commit) {
+            __kv_log_index_apply(node);
+        } else {
+            tal_free(node);
+        }
+        node = next;
+    }
+
+    s_kv_log.pending = NULL;
+    s_kv_log.pending_tail = &s_kv_log.pending;
+}
+
+static void __kv_log_index_free(void)
+{
+    int i = 0;
+    KV_LOG_NODE_T *node = NULL;
+
+    for (i = 0; i < KV_LOG_HASH_SIZE; i++) {
+        while (s_kv_log.bucket[i]) {
+            node = s_kv_log.bucket[i];
+            s_kv_log.bucket[i] = node->next;
+            tal_free(node);
+        }
+    }
+
+    __kv_log_pending_apply(FALSE);
+    s_kv_log.live = 0;
+}
+
+static int __kv_log_record_write(lfs_file_t *file, const char *key, const uint8_t *data, uint32_t len, uint8_t flag)
+{
+    KV_LOG_HDR_T hdr;
+    uint32_t crc = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = KV_LOG_MAGIC;
+    hdr.flag = flag;
+    hdr.key_len = strlen(key);
+    hdr.val_len = len;
+
+    crc = hash_crc32i_init();
+    crc = hash_crc32i_update(crc, &hdr, sizeof(hdr));
+    crc = hash_crc32i_update(crc, key, hdr.key_len);
+    if (len) {
+        crc = hash_crc32i_update(crc, data, len);
+    }
+    hdr.crc = hash_crc32i_finish(crc);
+
+    if (lfs_file_write(s_kv_log.lfs, file, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        lfs_file_write(s_kv_log.lfs, file, key, hdr.key_len) != hdr.key_len ||
+        (len && lfs_file_write(s_kv_log.lfs, file, data, len) != len)) {
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief drop the uncommitted records, so the later records will not be
+ * appended after a broken one
+ */
+static void __kv_log_abort(void)
+{
+    __kv_log_pending_apply(FALSE);
+    lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, s_kv_log.commit_end);
+    s_kv_log.end = s_kv_log.commit_end;
+}
+
+/**
+ * @brief replay the log and build index, truncate the uncommitted tail
+ */
+static int __kv_log_replay(void)
+{
+    KV_LOG_HDR_T hdr;
+    char key[KV_LOG_KEY_MAX + 1];
+    uint8_t buf[64];
+    uint32_t pos = 0;
+    uint32_t committed = 0;
+    uint32_t size = lfs_file_size(s_kv_log.lfs, &s_kv_log.file);
+    uint32_t crc = 0, hdr_crc = 0, left = 0, n = 0;
+    KV_LOG_NODE_T *node = NULL;
+
+    lfs_file_rewind(s_kv_log.lfs, &s_kv_log.file);
+
+    while (pos + sizeof(hdr) <= size) {
+        if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+            break;
+        }
+        if (hdr.magic != KV_LOG_MAGIC || 0 == hdr.key_len || hdr.key_len > size - pos - sizeof(hdr) ||
+            hdr.val_len > size - pos - sizeof(hdr) - hdr.key_len) {
+            break;
+        }
+        if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, key, hdr.key_len) != hdr.key_len) {
+            break;
+        }
+        key[hdr.key_len] = '\0';
+
+        hdr_crc = hdr.crc;
+        hdr.crc = 0;
+        crc = hash_crc32i_init();
+        crc = hash_crc32i_update(crc, &hdr, sizeof(hdr));
+        crc = hash_crc32i_update(crc, key, hdr.key_len);
+        for (left = hdr.val_len; left; left -= n) {
+            n = left > sizeof(buf) ? sizeof(buf) : left;
+            if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, buf, n) != n) {
+                break;
+            }
+            crc = hash_crc32i_update(crc, buf, n);
+        }
+        if (left || hash_crc32i_finish(crc) != hdr_crc) {
+            PR_WARN("kv log bad record at %d", pos);
+            break;
+        }
+
+        node = __kv_log_node_new(key, pos + sizeof(hdr) + hdr.key_len, hdr.val_len, hdr.flag & KV_LOG_FLAG_DEL);
+        if (NULL == node) {
+            __kv_log_index_free();
+            return OPRT_MALLOC_FAILED;
+        }
+        __kv_log_pending_add(node);
+
+        pos += KV_LOG_REC_LEN(hdr.key_len, hdr.val_len);
+        if (hdr.flag & KV_LOG_FLAG_COMMIT) {
+            __kv_log_pending_apply(TRUE);
+            committed = pos;
+        }
+    }
+
+    // records after the last commit were interrupted by power loss
+    __kv_log_pending_apply(FALSE);
+    if (committed < size) {
+        PR_WARN("kv log truncate %d -> %d", size, committed);
+        if (LFS_ERR_OK != lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, committed) ||
+            LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+            __kv_log_index_free();
+            return OPRT_KVS_WR_FAIL;
+        }
+    }
+    s_kv_log.end = committed;
+    s_kv_log.commit_end = committed;
+
+    PR_DEBUG("kv log replay size %d live %d", s_kv_log.end, s_kv_log.live);
+
+    return OPRT_OK;
+}
+
+static int __kv_log_open(void)
+{
+    int result = lfs_file_open(s_kv_log.lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT | LFS_O_APPEND);
+    if (LFS_ERR_OK != result) {
+        PR_ERR("kv log open err %d", result);
+        return result;
+    }
+    s_kv_log.opened = TRUE;
+
+    result = __kv_log_replay();
+    if (OPRT_OK != result) {
+        lfs_file_close(s_kv_log.lfs, &s_kv_log.file);
+        s_kv_log.opened = FALSE;
+    }
+
+    return result;
+}
+
+/**
+ * @brief copy live records to a new log, then replace the old one
+ */
+static int __kv_log_compact(void)
+{
+    lfs_file_t tmp;
+    int i = 0;
+    int result = OPRT_OK;
+    uint32_t end = 0;
+    uint8_t *data = NULL;
+    KV_LOG_NODE_T *node = NULL;
+
+    PR_DEBUG("kv log compact size %d live %d", s_kv_log.end, s_kv_log.live);
+
+    lfs_remove(s_kv_log.lfs, KV_LOG_TMP_FILE);
+    result = lfs_file_open(s_kv_log.lfs, &tmp, KV_LOG_TMP_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != result) {
+        return result;
+    }
+
+    for (i = 0; i < KV_LOG_HASH_SIZE && OPRT_OK == result; i++) {
+        for (node = s_kv_log.bucket[i]; node && OPRT_OK == result; node = node->next) {
+            data = tal_malloc(node->len + 1);
+            if (NULL == data) {
+                result = OPRT_MALLOC_FAILED;
+                break;
+            }
+            lfs_file_seek(s_kv_log.lfs, &s_kv_log.file, node->offset, LFS_SEEK_SET);
+            if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, data, node->len) != node->len) {
+                result = OPRT_KVS_RD_FAIL;
+            } else {
+                result = __kv_log_record_write(&tmp, node->key, data, node->len, KV_LOG_FLAG_COMMIT);
+            }
+            tal_free(data);
+
+            // offset in the new log, index will be rebuilt from file if failed
+            node->offset = end + sizeof(KV_LOG_HDR_T) + strlen(node->key);
+            end += KV_LOG_REC_LEN(strlen(node->key), node->len);
+        }
+    }
+
+    if (LFS_ERR_OK != lfs_file_close(s_kv_log.lfs, &tmp) && OPRT_OK == result) {
+        result = OPRT_KVS_WR_FAIL;
+    }
+    lfs_file_close(s_kv_log.lfs, &s_kv_log.file);
+    s_kv_log.opened = FALSE;
+
+    // rename is atomic, either the old or the new log survives a power loss
+    if (OPRT_OK == result) {
+        result = lfs_rename(s_kv_log.lfs, KV_LOG_TMP_FILE, KV_LOG_FILE);
+    }
+
+    if (OPRT_OK != result) {
+        PR_ERR("kv log compact err %d", result);
+        lfs_remove(s_kv_log.lfs, KV_LOG_TMP_FILE);
+        __kv_log_index_free();
+        return __kv_log_open();
+    }
+
+    result = lfs_file_open(s_kv_log.lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_APPEND);
+    if (LFS_ERR_OK != result) {
+        __kv_log_index_free();
+        return result;
+    }
+    s_kv_log.opened = TRUE;
+    s_kv_log.end = end;
+    s_kv_log.commit_end = end;
+    s_kv_log.live = end;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Opens the kv log and builds the index.
+ *
+ * @param lfs The mounted LittleFS handle.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int kv_log_init(lfs_t *lfs)
+{
+    if (s_kv_log.opened) {
+        return OPRT_OK;
+    }
+
+    memset(&s_kv_log, 0, sizeof(s_kv_log));
+    s_kv_log.lfs = lfs;
+    s_kv_log.pending_tail = &s_kv_log.pending;
+
+    // left by an interrupted compaction, the log itself is intact
+    lfs_remove(lfs, KV_LOG_TMP_FILE);
+
+    return __kv_log_open();
+}
+
+/**
+ * @brief Drops the records written since the last commit.
+ *
+ * Used by the callers that write a group of records and fail before the
+ * record with commit, so the next commit does not make the partial group
+ * visible.
+ */
+void kv_log_abort(void)
+{
+    if (!s_kv_log.opened || s_kv_log.end == s_kv_log.commit_end) {
+        return;
+    }
+    __kv_log_abort();
+}
+
+/**
+ * @brief Appends a set or delete record to the kv log.
+ *
+ * The record becomes visible only after a record with commit is written, all
+ * records since the last commit are made durable by one file sync.
+ *
+ * @param key The key.
+ * @param data The value, NULL means delete the key.
+ * @param len The value length.
+ * @param commit TRUE to commit all records since the last commit.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int kv_log_write(const char *key, const uint8_t *data, uint32_t len, BOOL_T commit)
+{
+    int result = OPRT_OK;
+    uint32_t key_len = strlen(key);
+    uint8_t flag = 0;
+    KV_LOG_NODE_T *node = NULL;
+
+    if (!s_kv_log.opened) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+    if (0 == key_len || key_len > KV_LOG_KEY_MAX) {
+        return OPRT_INVALID_PARM;
+    }
+
+    // no need to write a tombstone for a key never written
+    if (NULL == data && NULL == *__kv_log_index_find(key)) {
+        for (node = s_kv_log.pending; node && strcmp(node->key, key); node = node->next) {
+        }
+        // a commit record is still needed to close the pending records
+        if (NULL == node && (!commit || NULL == s_kv_log.pending)) {
+            return OPRT_NOT_FOUND;
+        }
+    }
+
+    flag = (NULL == data ? KV_LOG_FLAG_DEL : 0) | (commit ? KV_LOG_FLAG_COMMIT : 0);
+    node = __kv_log_node_new(key, s_kv_log.end + sizeof(KV_LOG_HDR_T) + key_len, data ? len : 0, NULL == data);
+    TUYA_CHECK_NULL_RETURN(node, OPRT_MALLOC_FAILED);
+
+    result = __kv_log_record_write(&s_kv_log.file, key, data, data ? len : 0, flag);
+    if (OPRT_OK != result) {
+        tal_free(node);
+        __kv_log_abort();
+        return result;
+    }
+    s_kv_log.end += KV_LOG_REC_LEN(key_len, node->len);
+    __kv_log_pending_add(node);
+
+    if (!commit) {
+        return OPRT_OK;
+    }
+
+    if (LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+        __kv_log_abort();
+        return OPRT_KVS_WR_FAIL;
+    }
+    __kv_log_pending_apply(TRUE);
+    s_kv_log.commit_end = s_kv_log.end;
+
+    if (s_kv_log.end > KV_LOG_COMPACT_SIZE && s_kv_log.live * 2 < s_kv_log.end) {
+        result = __kv_log_compact();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Reads the latest committed value of the key from the kv log.
+ *
+ * @param key The key.
+ * @param data The value, allocated by this function with one more byte
+ * reserved, should be freed by tal_free.
+ * @param len The value length.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the key does not exist, or an
+ * error code on failure.
+ */
+int kv_log_read(const char *key, uint8_t **data, uint32_t *len)
+{
+    KV_LOG_NODE_T *node = NULL;
+    uint8_t *buf = NULL;
+
+    if (!s_kv_log.opened) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    node = *__kv_log_index_find(key);
+    if (NULL == node) {
+        return OPRT_NOT_FOUND;
+    }
+
+    buf = tal_malloc(node->len + 1);
+    TUYA_CHECK_NULL_RETURN(buf, OPRT_MALLOC_FAILED);
+
+    lfs_file_seek(s_kv_log.lfs, &s_kv_log.file, node->offset, LFS_SEEK_SET);
+    if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, buf, node->len) != node->len) {
+        tal_free(buf);
+        return OPRT_KVS_RD_FAIL;
+    }
+
+    *data = buf;
+    *len = node->len;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Prints the keys and the log usage.
+ */
+void kv_log_dump(void)
+{
+    int i = 0;
+    KV_LOG_NODE_T *node = NULL;
+
+    for (i = 0; i < KV_LOG_HASH_SIZE; i++) {
+        for (node = s_kv_log.bucket[i]; node; node = node->next) {
+            PR_DEBUG_RAW("%s  ", node->key);
+        }
+    }
+    PR_DEBUG_RAW("\r\n");
+    PR_DEBUG("kv log size %d live %d", s_kv_log.end, s_kv_log.live);
+}
@@ -29,6 +29,11 @@
 #include "tkl_flash.h"
 #include "tal_api.h"
 #include "tal_security.h"
+#include "tuya_list.h"
+
+#if defined(KV_BENCHMARK) && (KV_BENCHMARK == 1)
+#include <stdio.h>
+#endif
 
 // variables used by the filesystem
 static lfs_t lfs;
@@ -39,6 +44,44 @@ static MUTEX_HANDLE lfs_mutex;
 extern int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len);
 extern int kv_deserialize(const char *in, kv_db_t *db, const uint32_t dbcnt);
 
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+extern int kv_log_init(lfs_t *lfs);
+extern int kv_log_write(const char *key, const uint8_t *data, uint32_t len, BOOL_T commit);
+extern int kv_log_read(const char *key, uint8_t **data, uint32_t *len);
+extern void kv_log_abort(void);
+extern void kv_log_dump(void);
+#endif
+
+// bytes programmed to flash and bytes of value set by user, for write amplification
+static uint32_t lfs_prog_bytes;
+static uint32_t lfs_erase_blocks;
+static uint32_t kv_set_bytes;
+
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+#ifndef KV_CACHE_NUM
+#define KV_CACHE_NUM 16
+#endif
+
+#ifndef KV_CACHE_SIZE
+#define KV_CACHE_SIZE 4096
+#endif
+
+typedef struct {
+    LIST_HEAD node;  // in kv_cache, the most recently used first
+    BOOL_T dirty;    // set or deleted in transaction, not written yet
+    uint8_t *value;  // plain value, NULL means deleted
+    size_t length;   // value length
+    char key[0];     // key, '\0' terminated
+} KV_CACHE_T;
+
+static LIST_HEAD(kv_cache);
+static uint32_t kv_cache_num;
+static uint32_t kv_cache_bytes;
+static uint32_t kv_cache_hit;
+static uint32_t kv_cache_miss;
+static uint32_t kv_txn_depth;
+#endif
+
 /**
  * Reads data from a user-provided block device.
  *
@@ -87,6 +130,7 @@ int user_provided_block_device_prog(const struct lfs_config *c, lfs_block_t bloc
     if (OPRT_OK != ret) {
         return LFS_ERR_IO;
     }
+    lfs_prog_bytes += size;
     return LFS_ERR_OK;
 }
 
@@ -108,6 +152,7 @@ int user_provided_block_device_erase(const struct lfs_config *c, lfs_block_t blo
     if (OPRT_OK != ret) {
         return LFS_ERR_IO;
     }
+    lfs_erase_blocks++;
     return LFS_ERR_OK;
 }
 
@@ -178,9 +223,332 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
         err = lfs_mount(&lfs, &lfs_cfg);
     }
 
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+    if (LFS_ERR_OK == err) {
+        err = kv_log_init(&lfs);
+    }
+#endif
+
     return err;
 }
 
+/**
+ * @brief Writes the encrypted value to the file named by the key, the storage
+ * layout used before the kv log engine.
+ */
+static int __kv_file_write(const char *key, const uint8_t *ec_data, uint32_t ec_len)
+{
+    int result;
+    lfs_file_t file;
+
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != result) {
+        PR_ERR("lfs open %s err", key);
+        return result;
+    }
+    result = lfs_file_write(&lfs, &file, ec_data, ec_len);
+    lfs_file_close(&lfs, &file);
+    if (result != ec_len) {
+        PR_ERR("kv write fail %d", result);
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reads the encrypted value from the file named by the key, the buffer
+ * should be freed by tal_free.
+ */
+static int __kv_file_read(const char *key, uint8_t **ec_data, uint32_t *ec_len)
+{
+    int result;
+    lfs_file_t file;
+    uint8_t *buf = NULL;
+    uint32_t len = 0;
+
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
+    if (LFS_ERR_OK != result) {
+        return result;
+    }
+    len = lfs_file_size(&lfs, &file);
+    buf = tal_malloc(len + 1);
+    if (NULL == buf) {
+        lfs_file_close(&lfs, &file);
+        return OPRT_MALLOC_FAILED;
+    }
+    result = lfs_file_read(&lfs, &file, buf, len);
+    lfs_file_close(&lfs, &file);
+    if (result <= 0) {
+        tal_free(buf);
+        PR_ERR("kv read error %d", result);
+        return OPRT_KVS_RD_FAIL;
+    }
+    *ec_data = buf;
+    *ec_len = len;
+
+    return OPRT_OK;
+}
+
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+/**
+ * @brief Reads the encrypted value from kv log, the key still kept in its own
+ * file by the old firmware is moved to kv log on the first read.
+ */
+static int __kv_log_get(const char *key, uint8_t **ec_data, uint32_t *ec_len)
+{
+    int result = kv_log_read(key, ec_data, ec_len);
+    if (OPRT_NOT_FOUND != result) {
+        return result;
+    }
+
+    result = __kv_file_read(key, ec_data, ec_len);
+    if (OPRT_OK != result) {
+        return result;
+    }
+    if (OPRT_OK == kv_log_write(key, *ec_data, *ec_len, TRUE)) {
+        PR_DEBUG("key %s migrate to kv log", key);
+        lfs_remove(&lfs, key);
+    }
+
+    return OPRT_OK;
+}
+#endif
+
+/**
+ * @brief Encrypts the value and writes it to the storage, NULL value deletes
+ * the key. With the kv log engine, the records are not visible until one with
+ * commit is written.
+ */
+static int __kv_write(const char *key, const uint8_t *value, size_t length, BOOL_T commit)
+{
+    int result;
+
+    if (NULL == value) {
+        // OPRT_NOT_FOUND only when neither the file nor the log has the key
+        result = lfs_remove(&lfs, key);
+        result = (LFS_ERR_OK == result)       ? OPRT_OK
+                 : (LFS_ERR_NOENT == result) ? OPRT_NOT_FOUND
+                                             : OPRT_KVS_WR_FAIL;
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+        int log_result = kv_log_write(key, NULL, 0, commit);
+        if (OPRT_NOT_FOUND != log_result) {
+            // a failed commit drops the whole transaction, it must be reported
+            result = (OPRT_OK != log_result || OPRT_NOT_FOUND == result) ? log_result : result;
+        }
+#endif
+        return result;
+    }
+
+    uint8_t *ec_data = NULL;
+    uint32_t ec_len = 0;
+    uint8_t iv[16];
+
+    memcpy(iv, lfs_kv_cfg.seed, 16);
+    result =
+        tal_aes128_cbc_encode((uint8_t *)value, length, (uint8_t *)lfs_kv_cfg.key, iv, &ec_data, (uint32_t *)&ec_len);
+    if (OPRT_OK != result) {
+        PR_DEBUG("key %s encrypt failed", key);
+        return result;
+    }
+
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+    result = kv_log_write(key, ec_data, ec_len, commit);
+    if (OPRT_OK == result) {
+        // drop the stale file left by the old firmware, no flash write if not exist
+        lfs_remove(&lfs, key);
+    }
+#else
+    result = __kv_file_write(key, ec_data, ec_len);
+#endif
+    tal_aes_free_data(ec_data);
+    if (OPRT_OK == result) {
+        kv_set_bytes += length;
+    }
+
+    return result;
+}
+
+/**
+ * @brief Reads the value from the storage and decrypts it, the value should be
+ * freed by tal_free.
+ */
+static int __kv_read(const char *key, uint8_t **value, size_t *length)
+{
+    int result;
+    uint8_t *ec_data = NULL;
+    uint32_t ec_len = 0;
+
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+    result = __kv_log_get(key, &ec_data, &ec_len);
+#else
+    result = __kv_file_read(key, &ec_data, &ec_len);
+#endif
+    if (OPRT_OK != result) {
+        PR_ERR("kv get %s err %d", key, result);
+        return result;
+    }
+    PR_DEBUG("key:%s, len:%d", key, ec_len);
+
+    uint8_t *dec_data = NULL;
+    uint32_t dec_len = 0;
+    uint8_t iv[16];
+
+    memcpy(iv, lfs_kv_cfg.seed, 16);
+    result = tal_aes128_cbc_decode(ec_data, ec_len, (uint8_t *)lfs_kv_cfg.key, iv, &dec_data, (uint32_t *)&dec_len);
+    dec_len = tal_aes_get_actual_length(dec_data, dec_len);
+    tal_free(ec_data);
+    if (OPRT_OK != result || dec_len > ec_len) {
+        PR_ERR("key %s decrypt failed %d, %d-%d", key, result, dec_len, ec_len);
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    *value = dec_data;
+    *length = (size_t)dec_len;
+    dec_data[dec_len] = 0;
+
+    return OPRT_OK;
+}
+
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+static KV_CACHE_T *__kv_cache_find(const char *key)
+{
+    struct tuya_list_head *p = NULL;
+    KV_CACHE_T *entry = NULL;
+
+    tuya_list_for_each(p, &kv_cache)
+    {
+        entry = tuya_list_entry(p, KV_CACHE_T, node);
+        if (0 == strcmp(entry->key, key)) {
+            // keep the most recently used at head
+            tuya_list_del(&entry->node);
+            tuya_list_add(&entry->node, &kv_cache);
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void __kv_cache_drop(KV_CACHE_T *entry)
+{
+    tuya_list_del(&entry->node);
+    kv_cache_num--;
+    kv_cache_bytes -= entry->length;
+    if (entry->value) {
+        // the values are decrypted, do not leave them in the heap
+        memset(entry->value, 0, entry->length);
+        tal_free(entry->value);
+    }
+    tal_free(entry);
+}
+
+/**
+ * @brief Puts a copy of the value to cache, the least recently used clean
+ * entries are evicted for room. NULL value marks the key deleted.
+ *
+ * @return OPRT_OK on success, OPRT_EXCEED_UPPER_LIMIT if no room. The old entry
+ * of the key is dropped either way.
+ */
+static int __kv_cache_put(const char *key, const uint8_t *value, size_t length, BOOL_T dirty)
+{
+    KV_CACHE_T *entry = __kv_cache_find(key);
+    struct tuya_list_head *p = NULL;
+    struct tuya_list_head *n = NULL;
+
+    if (entry) {
+        __kv_cache_drop(entry);
+    }
+    if (NULL == value) {
+        length = 0;
+    }
+    if (length > KV_CACHE_SIZE) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    // evict from the tail, the dirty ones are kept until commit
+    for (p = kv_cache.prev; p != &kv_cache && (kv_cache_num >= KV_CACHE_NUM || kv_cache_bytes + length > KV_CACHE_SIZE);
+         p = n) {
+        n = p->prev;
+        entry = tuya_list_entry(p, KV_CACHE_T, node);
+        if (!entry->dirty) {
+            __kv_cache_drop(entry);
+        }
+    }
+    if (kv_cache_num >= KV_CACHE_NUM || kv_cache_bytes + length > KV_CACHE_SIZE) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    entry = tal_malloc(sizeof(KV_CACHE_T) + strlen(key) + 1);
+    TUYA_CHECK_NULL_RETURN(entry, OPRT_MALLOC_FAILED);
+    memset(entry, 0, sizeof(KV_CACHE_T));
+    if (value) {
+        entry->value = tal_malloc(length + 1);
+        if (NULL == entry->value) {
+            tal_free(entry);
+            return OPRT_MALLOC_FAILED;
+        }
+        memcpy(entry->value, value, length);
+        entry->value[length] = 0;
+    }
+    entry->length = length;
+    entry->dirty = dirty;
+    strcpy(entry->key, key);
+    tuya_list_add(&entry->node, &kv_cache);
+    kv_cache_num++;
+    kv_cache_bytes += length;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Writes all dirty entries to the storage in one commit.
+ */
+static int __kv_cache_flush(void)
+{
+    struct tuya_list_head *p = NULL;
+    struct tuya_list_head *n = NULL;
+    KV_CACHE_T *entry = NULL;
+    uint32_t dirty = 0;
+    int result = OPRT_OK;
+
+    tuya_list_for_each(p, &kv_cache)
+    {
+        dirty += tuya_list_entry(p, KV_CACHE_T, node)->dirty ? 1 : 0;
+    }
+
+    // write in the reverse order of use, the last one commits all
+    for (p = kv_cache.prev; p != &kv_cache && dirty; p = p->prev) {
+        entry = tuya_list_entry(p, KV_CACHE_T, node);
+        if (!entry->dirty) {
+            continue;
+        }
+        result = __kv_write(entry->key, entry->value, entry->length, (1 == dirty--) ? TRUE : FALSE);
+        if (OPRT_OK != result && !(NULL == entry->value && OPRT_NOT_FOUND == result)) {
+            break;
+        }
+        result = OPRT_OK;
+        entry->dirty = FALSE;
+    }
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+    // the records written before the failure must not ride on the next commit
+    if (OPRT_OK != result) {
+        kv_log_abort();
+    }
+#endif
+
+    // the deleted keys are not cached, and the failed transaction is dropped
+    tuya_list_for_each_safe(p, n, &kv_cache)
+    {
+        entry = tuya_list_entry(p, KV_CACHE_T, node);
+        if (entry->dirty || NULL == entry->value) {
+            __kv_cache_drop(entry);
+        }
+    }
+
+    return result;
+}
+#endif
+
 /**
  * @brief Sets a key-value pair in the key-value store.
  *
@@ -197,7 +565,6 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
 int tal_kv_set(const char *key, const uint8_t *value, size_t length)
 {
     int result;
-    lfs_file_t file;
 
     PR_DEBUG("key:%s, len %d", key, length);
 
@@ -206,36 +573,25 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
     }
 
     tal_mutex_lock(lfs_mutex);
-    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
-    if (LFS_ERR_OK != result) {
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    // written by tal_kv_txn_commit
+    if (kv_txn_depth && OPRT_OK == __kv_cache_put(key, value, length, TRUE)) {
         tal_mutex_unlock(lfs_mutex);
-        PR_ERR("lfs open %s err", key);
-        return result;
+        return OPRT_OK;
     }
-    uint8_t *ec_data = NULL;
-    uint32_t ec_len = 0;
-    uint8_t iv[16];
-
-    memcpy(iv, lfs_kv_cfg.seed, 16);
-    result =
-        tal_aes128_cbc_encode((uint8_t *)value, length, (uint8_t *)lfs_kv_cfg.key, iv, &ec_data, (uint32_t *)&ec_len);
-    if (OPRT_OK != result) {
-        lfs_file_close(&lfs, &file);
-        tal_mutex_unlock(lfs_mutex);
-        PR_DEBUG("key %s encrypt failed", key);
-        return result;
+#endif
+    result = __kv_write(key, value, length, TRUE);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (OPRT_OK == result) {
+        __kv_cache_put(key, value, length, FALSE);
     }
-    lfs_file_rewind(&lfs, &file);
-    result = lfs_file_write(&lfs, &file, ec_data, ec_len);
-    lfs_file_close(&lfs, &file);
-    tal_aes_free_data(ec_data);
+#endif
     tal_mutex_unlock(lfs_mutex);
-    if (result != ec_len) {
+    if (OPRT_OK != result) {
         PR_ERR("kv write fail %d", result);
-        return OPRT_KVS_WR_FAIL;
     }
 
-    return OPRT_OK;
+    return result;
 }
 
 /**
@@ -257,55 +613,41 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
 int tal_kv_get(const char *key, uint8_t **value, size_t *length)
 {
     int result;
-    lfs_file_t file;
 
     if (NULL == key || NULL == value || NULL == length) {
         return OPRT_INVALID_PARM;
     }
 
+    *length = 0;
     tal_mutex_lock(lfs_mutex);
-    result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
-    if (LFS_ERR_OK != result) {
-        PR_ERR("lfs open %s %d err", key, result);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    KV_CACHE_T *entry = __kv_cache_find(key);
+    if (entry) {
+        kv_cache_hit++;
+        result = OPRT_NOT_FOUND;
+        if (entry->value) {
+            result = OPRT_MALLOC_FAILED;
+            *value = tal_malloc(entry->length + 1);
+            if (*value) {
+                memcpy(*value, entry->value, entry->length + 1);
+                *length = entry->length;
+                result = OPRT_OK;
+            }
+        }
         tal_mutex_unlock(lfs_mutex);
         return result;
     }
-    uint8_t *ec_data = NULL;
-    uint32_t ec_len = lfs_file_size(&lfs, &file);
-
-    ec_data = tal_malloc(ec_len + 1);
-    if (NULL == ec_data) {
-        result = OPRT_MALLOC_FAILED;
-        tal_mutex_unlock(lfs_mutex);
-        return result;
+    kv_cache_miss++;
+#endif
+    result = __kv_read(key, value, length);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (OPRT_OK == result) {
+        __kv_cache_put(key, *value, *length, FALSE);
     }
-    PR_DEBUG("key:%s, len:%d", key, ec_len);
-    result = lfs_file_read(&lfs, &file, ec_data, ec_len);
-    lfs_file_close(&lfs, &file);
+#endif
     tal_mutex_unlock(lfs_mutex);
-    if (result <= 0) {
-        *length = 0;
-        tal_free(ec_data);
-        PR_ERR("kv read error %d", result);
-        return OPRT_KVS_RD_FAIL;
-    }
-    uint8_t *dec_data = NULL;
-    uint32_t dec_len = 0;
-    uint8_t iv[16];
 
-    memcpy(iv, lfs_kv_cfg.seed, 16);
-    result = tal_aes128_cbc_decode(ec_data, ec_len, (uint8_t *)lfs_kv_cfg.key, iv, &dec_data, (uint32_t *)&dec_len);
-    dec_len = tal_aes_get_actual_length(dec_data, dec_len);
-    tal_free(ec_data);
-    if (OPRT_OK != result || dec_len > ec_len) {
-        PR_ERR("key %s decrypt failed %d, %d-%d", key, result, dec_len, ec_len);
-        return OPRT_BUFFER_NOT_ENOUGH;
-    }
-    *value = dec_data;
-    *length = (size_t)dec_len;
-    dec_data[dec_len] = 0;
-
-    return OPRT_OK;
+    return result;
 }
 
 /**
@@ -322,9 +664,19 @@ int tal_kv_del(const char *key)
     PR_DEBUG("key:%s", key);
 
     tal_mutex_lock(lfs_mutex);
-    int result = lfs_remove(&lfs, key);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (kv_txn_depth && OPRT_OK == __kv_cache_put(key, NULL, 0, TRUE)) {
+        tal_mutex_unlock(lfs_mutex);
+        return OPRT_OK;
+    }
+    KV_CACHE_T *entry = __kv_cache_find(key);
+    if (entry) {
+        __kv_cache_drop(entry);
+    }
+#endif
+    int result = __kv_write(key, NULL, 0, TRUE);
     tal_mutex_unlock(lfs_mutex);
-    if (LFS_ERR_OK == result) {
+    if (OPRT_OK == result) {
         PR_DEBUG("Deleted successfully");
         return OPRT_OK;
     }
@@ -334,6 +686,58 @@ int tal_kv_del(const char *key)
     return OPRT_COM_ERROR;
 }
 
+/**
+ * @brief Begins a transaction of the TAL Key-Value store.
+ *
+ * The keys set or deleted until the paired tal_kv_txn_commit are kept in RAM
+ * and written in one flash commit. Reads see the new values at once. The
+ * transactions can be nested, only the outermost commit writes flash.
+ *
+ * Transactions need ENABLE_KV_CACHE. Without it this does nothing and every
+ * tal_kv_set and tal_kv_del inside writes flash on its own, as outside.
+ *
+ * @return OPRT_OK on success.
+ */
+int tal_kv_txn_begin(void)
+{
+    tal_mutex_lock(lfs_mutex);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    kv_txn_depth++;
+#endif
+    tal_mutex_unlock(lfs_mutex);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Commits the transaction begun by tal_kv_txn_begin.
+ *
+ * @return OPRT_OK on success, or an error code if the writing fails, in which
+ * case none of the keys in the transaction is stored by the kv log engine.
+ * Always OPRT_OK without ENABLE_KV_CACHE, the keys are already written.
+ */
+int tal_kv_txn_commit(void)
+{
+    int result = OPRT_OK;
+
+    tal_mutex_lock(lfs_mutex);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (0 == kv_txn_depth) {
+        tal_mutex_unlock(lfs_mutex);
+        return OPRT_COM_ERROR;
+    }
+    if (0 == --kv_txn_depth) {
+        result = __kv_cache_flush();
+    }
+#endif
+    tal_mutex_unlock(lfs_mutex);
+    if (OPRT_OK != result) {
+        PR_ERR("kv txn commit fail %d", result);
+    }
+
+    return result;
+}
+
 /**
  * @brief Frees the memory allocated for a value in the TAL Key-Value store.
  *
@@ -365,6 +769,18 @@ int tal_kv_free(uint8_t *value)
  */
 void tal_kv_cmd(int argc, char *argv[])
 {
+    if (argc == 2 && 0 == strcmp("stat", argv[1])) {
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+        kv_log_dump();
+#endif
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+        PR_DEBUG("kv cache %d keys %d bytes, hit %d miss %d", kv_cache_num, kv_cache_bytes, kv_cache_hit,
+                 kv_cache_miss);
+#endif
+        PR_DEBUG("kv set %d bytes, flash prog %d bytes, erase %d blocks", kv_set_bytes, lfs_prog_bytes,
+                 lfs_erase_blocks);
+        return;
+    }
     if (argc < 3) {
         return;
     }
@@ -475,4 +891,89 @@ int tal_kv_serialize_get(const char *key, kv_db_t *db, size_t dbcnt)
 lfs_t *tal_lfs_get()
 {
     return &lfs;
-}
\ No newline at end of file
+}
+
+#if defined(KV_BENCHMARK) && (KV_BENCHMARK == 1)
+int tal_kv_benchmark(uint32_t keys, uint32_t value_len, uint32_t rounds)
+{
+    int rt = OPRT_OK;
+    char key[16];
+    uint32_t i = 0, k = 0, r = 0;
+    SYS_TIME_T t0, t_set, t_get;
+
+    if (0 == keys || 0 == value_len || 0 == rounds) {
+        return OPRT_INVALID_PARM;
+    }
+
+    uint8_t *buf = tal_malloc(value_len);
+    if (NULL == buf) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    uint32_t set_bytes = kv_set_bytes;
+    uint32_t prog_bytes = lfs_prog_bytes;
+    uint32_t erase_blocks = lfs_erase_blocks;
+
+    /* every round rewrites every key, as hot config values do */
+    t0 = tal_system_get_millisecond();
+    for (r = 0; r < rounds && OPRT_OK == rt; r++) {
+        for (k = 0; k < keys && OPRT_OK == rt; k++) {
+            snprintf(key, sizeof(key), "kvb%u", k);
+            for (i = 0; i < value_len; i++) {
+                buf[i] = (uint8_t)(r * 31 + k * 7 + i);
+            }
+            rt = tal_kv_set(key, buf, value_len);
+        }
+    }
+    t_set = tal_system_get_millisecond() - t0;
+
+    set_bytes = kv_set_bytes - set_bytes;
+    prog_bytes = lfs_prog_bytes - prog_bytes;
+    erase_blocks = lfs_erase_blocks - erase_blocks;
+
+    t0 = tal_system_get_millisecond();
+    for (k = 0; k < keys && OPRT_OK == rt; k++) {
+        uint8_t *value = NULL;
+        size_t length = 0;
+        snprintf(key, sizeof(key), "kvb%u", k);
+        rt = tal_kv_get(key, &value, &length);
+        if (OPRT_OK != rt) {
+            break;
+        }
+        if (length != value_len) {
+            rt = OPRT_COM_ERROR;
+        }
+        for (i = 0; i < length && OPRT_OK == rt; i++) {
+            if (value[i] != (uint8_t)((rounds - 1) * 31 + k * 7 + i)) {
+                rt = OPRT_COM_ERROR;
+            }
+        }
+        tal_kv_free(value);
+    }
+    t_get = tal_system_get_millisecond() - t0;
+
+    for (k = 0; k < keys; k++) {
+        snprintf(key, sizeof(key), "kvb%u", k);
+        tal_kv_del(key);
+    }
+    tal_free(buf);
+
+    if (OPRT_OK != rt) {
+        PR_ERR("kv benchmark failed %d", rt);
+        return rt;
+    }
+
+#if defined(ENABLE_KV_LOG_ENGINE) && (ENABLE_KV_LOG_ENGINE == 1)
+    PR_NOTICE("kv engine: log");
+#else
+    PR_NOTICE("kv engine: file per key");
+#endif
+    PR_NOTICE("kv %u keys x %u bytes x %u rounds, set:%ums get:%ums", keys, value_len, rounds, (uint32_t)t_set,
+              (uint32_t)t_get);
+    PR_NOTICE("kv set %u bytes, flash prog %u bytes, erase %u blocks, write amplification x%u.%02u", set_bytes,
+              prog_bytes, erase_blocks, set_bytes ? prog_bytes / set_bytes : 0,
+              set_bytes ? (uint32_t)(((uint64_t)prog_bytes * 100 / set_bytes) % 100) : 0);
+
+    return OPRT_OK;
+}
+#endif
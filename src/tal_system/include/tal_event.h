@@ -50,6 +50,29 @@ extern "C" {
  */
 #define EVENT_DESC_MAX_LEN (32)
 
+/**
+ * @brief max number of interned event id, id 0 is invalid
+ *
+ */
+#ifndef EVENT_ID_MAX_NUM
+#define EVENT_ID_MAX_NUM (64)
+#endif
+
+/**
+ * @brief bucket number of the event name hash table, must be power of 2
+ *
+ */
+#ifndef EVENT_HASH_SIZE
+#define EVENT_HASH_SIZE (32)
+#endif
+
+/**
+ * @brief interned event id, got from tal_event_register_id
+ *
+ */
+typedef uint16_t EVENT_ID;
+#define EVENT_ID_INVALID 0
+
 /**
  * @brief subscriber type
  *
@@ -85,20 +108,32 @@ typedef struct {
     char name[EVENT_NAME_MAX_LEN + 1]; // name, used to record the the event info
     char desc[EVENT_DESC_MAX_LEN + 1]; // description, used to record the subscribe info
     SUBSCRIBE_TYPE_E type;             // the subscribe type
+    int fired;                         // one time subscriber has been dispatched
     EVENT_SUBSCRIBE_CB cb;             // the subscribe callback function
     struct tuya_list_head node;        // list node, used to attch to the event node
 } SUBSCRIBE_NODE_T;
 
 /**
- * @brief the event node
+ * @brief the read-only copy of the subscriber list used by publisher
  *
  */
 typedef struct {
-    MUTEX_HANDLE mutex; // mutex, protection the event publish and subscribe
+    struct tuya_list_head node; // list node, used to attach to the retire list
+    int cnt;                    // subscriber number
+    SUBSCRIBE_NODE_T *sub[0];   // subscribers in dispatch order
+} SUBSCRIBE_SNAPSHOT_T;
 
+/**
+ * @brief the event node
+ *
+ */
+typedef struct event_node {
+    EVENT_ID id;                          // interned id, EVENT_ID_INVALID if out of id table
     char name[EVENT_NAME_MAX_LEN + 1];    // name, the event name
     struct tuya_list_head node;           // list node, used to attach to the event manage module
-    struct tuya_list_head subscribe_root; // subscibe root, used to manage the subscriber
+    struct tuya_list_head subscribe_root; // subscibe root, modified under the manage mutex
+    struct event_node *hash_next;         // next event node in the same hash bucket
+    SUBSCRIBE_SNAPSHOT_T *snapshot;       // copy-on-write subscriber list, read by publish without lock
 } EVENT_NODE_T;
 
 /**
@@ -107,11 +142,16 @@ typedef struct {
  */
 typedef struct {
     int inited;
-    MUTEX_HANDLE mutex;                        // mutex, used to protection event manage node
-    int event_cnt;                             // current event number
-    struct tuya_list_head event_root;          // event root, used to manage the event
-    struct tuya_list_head free_subscribe_root; // free subscriber list, used to manage the
-                                               // subscribe which not found the event
+    MUTEX_HANDLE mutex;                          // mutex, used to protection event manage node
+    int event_cnt;                               // current event number
+    int publishing;                              // publish in progress, retired nodes are freed when 0
+    struct tuya_list_head event_root;            // event root, used to manage the event
+    struct tuya_list_head free_subscribe_root;   // free subscriber list, used to manage the
+                                                 // subscribe which not found the event
+    struct tuya_list_head retire_subscribe_root; // unsubscribed nodes maybe still used by publisher
+    struct tuya_list_head retire_snapshot_root;  // replaced snapshots maybe still used by publisher
+    EVENT_NODE_T *hash_tbl[EVENT_HASH_SIZE];     // event name hash table
+    EVENT_NODE_T *id_tbl[EVENT_ID_MAX_NUM];      // event id table
 } EVENT_MANAGE_T;
 
 /**
@@ -132,6 +172,26 @@ OPERATE_RET tal_event_init(void);
  */
 OPERATE_RET tal_event_publish(const char *name, void *data);
 
+/**
+ * @brief: intern the event name, create the event if not existed
+ *
+ * @param[in] name: event name
+ * @param[out] id: event id, used by tal_event_publish_id
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_register_id(const char *name, EVENT_ID *id);
+
+/**
+ * @brief: publish event by the interned id
+ *
+ * @param[in] id: event id, got from tal_event_register_id
+ * @param[in] data: event data
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_publish_id(EVENT_ID id, void *data);
+
 /**
  * @brief: subscribe event
  *
@@ -350,6 +350,18 @@ void tal_log_color_set(const TAL_LOG_LEVEL_E level, TAL_LOG_DISPLAY_MODE_E displ
 OPERATE_RET tal_log_color_print_raw(TAL_LOG_DISPLAY_MODE_E display_mode, TAL_LOG_FONT_COLOR_E font_color,
                                     TAL_LOG_BACKGROUND_COLOR_E background_color, const char *pFmt, ...);
 
+/**
+ * @brief get the counters of the asynchronous log ring.
+ *
+ * @param[out] dropped, lines dropped because the ring was full
+ * @param[out] truncated, lines cut to LOG_ASYNC_REC_SIZE
+ *
+ * @note This API is only supported when ENABLE_LOG_ASYNC is enabled.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED when the log is synchronous.
+ */
+OPERATE_RET tal_log_async_stat(uint32_t *dropped, uint32_t *truncated);
+
 #ifdef __cplusplus
 }
 #endif /* __TAL_LOG_H__ */
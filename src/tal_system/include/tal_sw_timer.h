@@ -180,6 +180,20 @@ OPERATE_RET tal_sw_timer_release(void);
  */
 int tal_sw_timer_get_num(void);
 
+#if defined(SW_TIMER_BENCHMARK) && (SW_TIMER_BENCHMARK == 1)
+/**
+ * @brief Log the cost of starting and stopping num timers, then start them
+ * again to fire within a second and log when the last one fired and how late
+ * the latest one was. tal_sw_timer_init() must have been called.
+ *
+ * @param[in] num: the number of timers, e.g. 10000
+ *
+ * @return OPRT_OK on success, OPRT_COM_ERROR when not every timer fired
+ * within 10s. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_benchmark(uint32_t num);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -78,6 +78,20 @@ OPERATE_RET tal_workq_schedule(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *d
  */
 OPERATE_RET tal_workq_schedule_instant(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *data);
 
+/**
+ * @brief put work task in workqueue, works with the same tag run one by one
+ * in order, even when the service is served by several workers
+ *
+ * @param[in] service the workqueue service
+ * @param[in] tag the affinity tag, 0 means no affinity
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_affinity(WORKQ_SERVICE_E service, uint32_t tag, WORKQUEUE_CB cb, void *data);
+
 /**
  * @brief cancel work task in workqueue
  *
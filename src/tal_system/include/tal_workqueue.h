@@ -39,6 +39,18 @@ typedef struct {
 } WORK_ITEM_T;
 typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
 
+// wait and run times are only measured with ENABLE_WORKQ_POOL
+typedef struct {
+    uint8_t worker_num;      // number of worker threads
+    uint16_t depth;          // items waiting now
+    uint16_t depth_max;      // most items a worker found waiting
+    uint32_t exec_cnt;       // works executed
+    uint32_t wait_avg_ms;    // average time from schedule to the start of the callback
+    uint32_t wait_max_ms;    // longest time from schedule to the start of the callback
+    uint32_t run_max_ms;     // longest callback
+    WORKQUEUE_CB run_max_cb; // the longest callback
+} WORKQUEUE_STAT_T;
+
 /**
  * @brief create and initialize a workqueue which runs in thread context
  *
@@ -52,6 +64,24 @@ typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
  */
 OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_cfg, WORKQUEUE_HANDLE *handle);
 
+/**
+ * @brief create a workqueue served by several threads
+ *
+ * @param[in] queue_len the maximum number of items of each worker
+ * @param[in] worker_num the number of worker threads
+ * @param[in] thread_cfg thread param, the worker index is appended to the name
+ * @param[out] handle the workqueue handle
+ *
+ * @note works may run in parallel and out of order, use
+ * tal_workqueue_schedule_affinity() for works that must run one by one. Without
+ * ENABLE_WORKQ_POOL this is the same as tal_workqueue_create().
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_create_pool(const uint16_t queue_len, const uint8_t worker_num, THREAD_CFG_T *thread_cfg,
+                                      WORKQUEUE_HANDLE *handle);
+
 /**
  * @brief put work task in workqueue
  *
@@ -76,6 +106,20 @@ OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, voi
  */
 OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data);
 
+/**
+ * @brief put work task in workqueue, works with the same tag run one by one
+ * in order, even on a workqueue with several workers
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] tag the affinity tag, 0 means no affinity
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_affinity(WORKQUEUE_HANDLE handle, uint32_t tag, WORKQUEUE_CB cb, void *data);
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -124,10 +168,33 @@ OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle);
  *
  * @param[in] handle the workqueue handle
  *
- * @return thread handle
+ * @return thread handle, the first worker of a workqueue with several workers
  */
 THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle);
 
+/**
+ * @brief get the thread handles of all workers of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[out] threads the thread handles
+ * @param[in] num the size of threads
+ *
+ * @return the number of handles written
+ */
+uint8_t tal_workqueue_get_threads(WORKQUEUE_HANDLE handle, THREAD_HANDLE *threads, uint8_t num);
+
+/**
+ * @brief get the load statistic of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[out] stat the statistic, wait is the time from schedule to the start
+ * of the callback, run is the time spent in the callback
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_get_stat(WORKQUEUE_HANDLE handle, WORKQUEUE_STAT_T *stat);
+
 typedef void *DELAYED_WORK_HANDLE;
 
 /**
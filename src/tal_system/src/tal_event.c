@@ -19,7 +19,8 @@
  * - Event node creation and initialization
  * - Subscription management (addition, deletion, retrieval)
  * - Event dispatching to subscribed listeners
- * - Thread-safe operations through mutex locking
+ * - Interned event id and hashed event name lookup
+ * - Lock-free publish through copy-on-write subscriber snapshots
  * - Debugging utilities for event and subscription dumping
  *
  * This implementation leverages the Tuya IoT SDK's infrastructure, including
@@ -36,6 +37,56 @@
 
 static EVENT_MANAGE_T g_event_manager = {0};
 
+// publish never takes the manage mutex: it reads a copy-on-write snapshot of the
+// subscriber list, subscribe/unsubscribe replace the snapshot under the mutex and
+// the replaced objects are freed once no publish is in progress.
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2) &&                                      \
+    defined(__GCC_ATOMIC_POINTER_LOCK_FREE) && (__GCC_ATOMIC_POINTER_LOCK_FREE == 2)
+#define EVENT_ATOMIC_ADD(ptr, val)   __atomic_add_fetch((ptr), (val), __ATOMIC_SEQ_CST)
+#define EVENT_ATOMIC_XCHG(ptr, val)  __atomic_exchange_n((ptr), (val), __ATOMIC_SEQ_CST)
+#define EVENT_ATOMIC_LOAD(ptr)       __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define EVENT_ATOMIC_STORE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_SEQ_CST)
+#else
+// no native atomic instruction, protect the counters by a short critical section
+static MUTEX_HANDLE s_event_atomic_mutex = NULL;
+
+static int _event_atomic_add(int *ptr, int val)
+{
+    int ret = 0;
+    tal_mutex_lock(s_event_atomic_mutex);
+    *ptr += val;
+    ret = *ptr;
+    tal_mutex_unlock(s_event_atomic_mutex);
+    return ret;
+}
+
+static int _event_atomic_xchg(int *ptr, int val)
+{
+    int ret = 0;
+    tal_mutex_lock(s_event_atomic_mutex);
+    ret = *ptr;
+    *ptr = val;
+    tal_mutex_unlock(s_event_atomic_mutex);
+    return ret;
+}
+
+#define EVENT_ATOMIC_ADD(ptr, val)   _event_atomic_add((ptr), (val))
+#define EVENT_ATOMIC_XCHG(ptr, val)  _event_atomic_xchg((ptr), (val))
+#define EVENT_ATOMIC_LOAD(ptr)       (*(ptr))
+#define EVENT_ATOMIC_STORE(ptr, val) (*(ptr) = (val))
+#endif
+
+static uint32_t _event_name_hash(const char *name)
+{
+    uint32_t hash = 5381;
+
+    while (*name) {
+        hash = ((hash << 5) + hash) + (uint8_t)(*name++);
+    }
+
+    return hash & (EVENT_HASH_SIZE - 1);
+}
+
 BOOL_T _event_name_is_valid(const char *name)
 {
     if (!name) {
@@ -62,20 +113,100 @@ BOOL_T _event_desc_is_valid(const char *desc)
     return TRUE;
 }
 
+/**
+ * @brief free the retired subscribers and snapshots if no publish is in progress,
+ * should be called in manage mutex
+ */
+void _event_reclaim(void)
+{
+    if (EVENT_ATOMIC_LOAD(&g_event_manager.publishing) != 0) {
+        return;
+    }
+
+    SUBSCRIBE_NODE_T *subscribe = NULL;
+    while (!tuya_list_empty(&g_event_manager.retire_subscribe_root)) {
+        subscribe = tuya_list_entry(g_event_manager.retire_subscribe_root.next, SUBSCRIBE_NODE_T, node);
+        tuya_list_del(&subscribe->node);
+        tal_free(subscribe);
+    }
+
+    SUBSCRIBE_SNAPSHOT_T *snapshot = NULL;
+    while (!tuya_list_empty(&g_event_manager.retire_snapshot_root)) {
+        snapshot = tuya_list_entry(g_event_manager.retire_snapshot_root.next, SUBSCRIBE_SNAPSHOT_T, node);
+        tuya_list_del(&snapshot->node);
+        tal_free(snapshot);
+    }
+}
+
+/**
+ * @brief rebuild the snapshot from the subscribe list, should be called in manage mutex
+ */
+OPERATE_RET _event_node_snapshot_update(EVENT_NODE_T *event)
+{
+    int cnt = 0;
+    struct tuya_list_head *pos = NULL;
+    tuya_list_for_each(pos, &event->subscribe_root)
+    {
+        cnt++;
+    }
+
+    SUBSCRIBE_SNAPSHOT_T *snapshot =
+        (SUBSCRIBE_SNAPSHOT_T *)tal_malloc(sizeof(SUBSCRIBE_SNAPSHOT_T) + cnt * sizeof(SUBSCRIBE_NODE_T *));
+    TUYA_CHECK_NULL_RETURN(snapshot, OPRT_MALLOC_FAILED);
+
+    snapshot->cnt = 0;
+    tuya_list_for_each(pos, &event->subscribe_root)
+    {
+        snapshot->sub[snapshot->cnt++] = tuya_list_entry(pos, SUBSCRIBE_NODE_T, node);
+    }
+
+    // the old one maybe used by publisher, retire it
+    SUBSCRIBE_SNAPSHOT_T *old = event->snapshot;
+    EVENT_ATOMIC_STORE(&event->snapshot, snapshot);
+    if (old) {
+        tuya_list_add_tail(&old->node, &g_event_manager.retire_snapshot_root);
+    }
+
+    return OPRT_OK;
+}
+
+EVENT_NODE_T *_event_node_get(const char *name)
+{
+    // event node is never removed, so lookup the hash table without lock
+    EVENT_NODE_T *entry = EVENT_ATOMIC_LOAD(&g_event_manager.hash_tbl[_event_name_hash(name)]);
+    while (entry) {
+        if (0 == strcmp(entry->name, name)) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+
+    return NULL;
+}
+
 EVENT_NODE_T *_event_node_create_init(const char *name)
 {
+    tal_mutex_lock(g_event_manager.mutex);
+
+    // maybe created by other thread before we got the lock
+    EVENT_NODE_T *event = _event_node_get(name);
+    if (event) {
+        tal_mutex_unlock(g_event_manager.mutex);
+        return event;
+    }
+
     // allocate memory
-    EVENT_NODE_T *event = tal_malloc(sizeof(EVENT_NODE_T));
-    TUYA_CHECK_NULL_RETURN(event, NULL);
+    event = tal_malloc(sizeof(EVENT_NODE_T));
+    if (NULL == event) {
+        tal_mutex_unlock(g_event_manager.mutex);
+        return NULL;
+    }
     memset(event, 0, sizeof(EVENT_NODE_T));
 
     // initialze the event node
     memcpy(event->name, name, strlen(name));
     event->name[strlen(name)] = '\0';
     INIT_LIST_HEAD(&event->subscribe_root);
-    tal_mutex_create_init(&event->mutex);
-
-    tal_mutex_lock(g_event_manager.mutex);
 
     // need check if there have free subscriber which subscribe this event
     struct tuya_list_head *free_pos = NULL;
@@ -98,7 +229,28 @@ EVENT_NODE_T *_event_node_create_init(const char *name)
         }
     }
 
-    // at last, need add this event to event manage root
+    if (OPRT_OK != _event_node_snapshot_update(event)) {
+        // give the subscribers back to the free list
+        while (!tuya_list_empty(&event->subscribe_root)) {
+            free_entry = tuya_list_entry(event->subscribe_root.next, SUBSCRIBE_NODE_T, node);
+            tuya_list_del(&free_entry->node);
+            tuya_list_add_tail(&free_entry->node, &g_event_manager.free_subscribe_root);
+        }
+        tal_free(event);
+        tal_mutex_unlock(g_event_manager.mutex);
+        return NULL;
+    }
+
+    // intern the event if id table is not full, id 0 is invalid
+    if (g_event_manager.event_cnt + 1 < EVENT_ID_MAX_NUM) {
+        event->id = g_event_manager.event_cnt + 1;
+        g_event_manager.id_tbl[event->id] = event;
+    }
+
+    // at last, need add this event to event manage root and hash table
+    uint32_t hash = _event_name_hash(name);
+    event->hash_next = g_event_manager.hash_tbl[hash];
+    EVENT_ATOMIC_STORE(&g_event_manager.hash_tbl[hash], event);
     tuya_list_add_tail(&event->node, &g_event_manager.event_root);
     g_event_manager.event_cnt++;
 
@@ -107,23 +259,6 @@ EVENT_NODE_T *_event_node_create_init(const char *name)
     return event;
 }
 
-EVENT_NODE_T *_event_node_get(const char *name)
-{
-    // try to get event from event root
-    EVENT_NODE_T *entry = NULL;
-    struct tuya_list_head *pos = NULL;
-    tuya_list_for_each(pos, &g_event_manager.event_root)
-    {
-        // find by name
-        entry = tuya_list_entry(pos, EVENT_NODE_T, node);
-        if (0 == strcmp(entry->name, name)) {
-            return entry;
-        }
-    }
-
-    return NULL;
-}
-
 SUBSCRIBE_NODE_T *_event_node_get_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
 {
     struct tuya_list_head *pos = NULL;
@@ -157,28 +292,84 @@ SUBSCRIBE_NODE_T *_event_node_get_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_
     return NULL;
 }
 
-OPERATE_RET _event_node_dispatch(EVENT_NODE_T *event, void *data)
+/**
+ * @brief remove the dispatched one-time subscribers, should be called in manage mutex
+ */
+void _event_node_del_onetime_subscribe(EVENT_NODE_T *event)
 {
-    OPERATE_RET rt = OPRT_OK;
-
-    // dispatch in order
     struct tuya_list_head *p = NULL;
     struct tuya_list_head *n = NULL;
+    struct tuya_list_head *prev = NULL;
     SUBSCRIBE_NODE_T *entry = NULL;
+    LIST_HEAD(fired_root);
+
     tuya_list_for_each_safe(p, n, &event->subscribe_root)
     {
-        // find and call cb one by one
         entry = tuya_list_entry(p, SUBSCRIBE_NODE_T, node);
+        if (entry->type == SUBSCRIBE_TYPE_ONETIME && entry->fired) {
+            tuya_list_del(&entry->node);
+            tuya_list_add_tail(&entry->node, &fired_root);
+        }
+    }
+
+    if (tuya_list_empty(&fired_root)) {
+        return;
+    }
+
+    if (OPRT_OK != _event_node_snapshot_update(event)) {
+        // keep them in the list, fired flag prevents dispatching again
+        tuya_list_for_each_safe(p, n, &fired_root)
+        {
+            prev = event->subscribe_root.prev;
+            tuya_list_del(p);
+            tuya_list_add(p, prev);
+        }
+        return;
+    }
+
+    tuya_list_splice(&fired_root, &g_event_manager.retire_subscribe_root);
+}
+
+OPERATE_RET _event_node_dispatch(EVENT_NODE_T *event, void *data)
+{
+    OPERATE_RET rt = OPRT_OK;
+    BOOL_T onetime_fired = FALSE;
+
+    // dispatch in order, without any lock
+    EVENT_ATOMIC_ADD(&g_event_manager.publishing, 1);
+
+    SUBSCRIBE_SNAPSHOT_T *snapshot = EVENT_ATOMIC_LOAD(&event->snapshot);
+    SUBSCRIBE_NODE_T *entry = NULL;
+    int i = 0;
+    for (i = 0; snapshot && i < snapshot->cnt; i++) {
+        // find and call cb one by one
+        entry = snapshot->sub[i];
+
+        // one-time event should be dispatched only once
+        if (entry->type == SUBSCRIBE_TYPE_ONETIME) {
+            if (EVENT_ATOMIC_XCHG(&entry->fired, 1)) {
+                continue;
+            }
+            onetime_fired = TRUE;
+        }
+
         if (entry->cb) {
             TUYA_CALL_ERR_LOG(entry->cb(data));
         }
+    }
 
-        // one-time event should be removed after dispatch
-        if (entry->type == SUBSCRIBE_TYPE_ONETIME) {
-            tuya_list_del(&entry->node);
-            tal_free(entry);
-            entry = NULL;
+    EVENT_ATOMIC_ADD(&g_event_manager.publishing, -1);
+
+    // one-time event should be removed after dispatch, and the retired nodes
+    // should be freed by the last publisher
+    if (onetime_fired || !tuya_list_empty(&g_event_manager.retire_subscribe_root) ||
+        !tuya_list_empty(&g_event_manager.retire_snapshot_root)) {
+        tal_mutex_lock(g_event_manager.mutex);
+        if (onetime_fired) {
+            _event_node_del_onetime_subscribe(event);
         }
+        _event_reclaim();
+        tal_mutex_unlock(g_event_manager.mutex);
     }
 
     return rt;
@@ -225,6 +416,13 @@ OPERATE_RET _event_node_add_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *sub
         tuya_list_add_tail(&new_entry->node, &event->subscribe_root);
     }
 
+    // publish the new subscriber list
+    rt = _event_node_snapshot_update(event);
+    if (OPRT_OK != rt) {
+        tuya_list_del(&new_entry->node);
+        tal_free(new_entry);
+    }
+
     return rt;
 }
 
@@ -255,10 +453,18 @@ OPERATE_RET _event_node_del_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *sub
         return OPRT_OK;
     }
 
-    // dont forget remove and free
+    // remove and publish the new subscriber list, put it back if failed
+    struct tuya_list_head *prev = new_entry->node.prev;
     tuya_list_del(&new_entry->node);
-    tal_free(new_entry);
-    new_entry = NULL;
+    rt = _event_node_snapshot_update(event);
+    if (OPRT_OK != rt) {
+        tuya_list_add(&new_entry->node, prev);
+        return rt;
+    }
+
+    // maybe used by publisher, dont forget retire and free
+    tuya_list_add_tail(&new_entry->node, &g_event_manager.retire_subscribe_root);
+    _event_reclaim();
     return rt;
 }
 
@@ -337,7 +543,13 @@ OPERATE_RET tal_event_init(void)
 
     INIT_LIST_HEAD(&g_event_manager.event_root);
     INIT_LIST_HEAD(&g_event_manager.free_subscribe_root);
+    INIT_LIST_HEAD(&g_event_manager.retire_subscribe_root);
+    INIT_LIST_HEAD(&g_event_manager.retire_snapshot_root);
     tal_mutex_create_init(&g_event_manager.mutex);
+#if !(defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2) &&                                     \
+      defined(__GCC_ATOMIC_POINTER_LOCK_FREE) && (__GCC_ATOMIC_POINTER_LOCK_FREE == 2))
+    tal_mutex_create_init(&s_event_atomic_mutex);
+#endif
     g_event_manager.event_cnt = 0;
     g_event_manager.inited = TRUE;
 
@@ -382,14 +594,76 @@ OPERATE_RET tal_event_publish(const char *name, void *data)
         TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
     }
 
-    // to keep the consistency, dispatch will done in mutex lock
-    tal_mutex_lock(event->mutex);
     // try to dispatch event to all subscribe
     // if one of the subscribe failed, it will continue but will return failed
     // to record the execute status
     TUYA_CALL_ERR_LOG(_event_node_dispatch(event, data));
 
-    tal_mutex_unlock(event->mutex);
+    return rt;
+}
+
+/**
+ * @brief Interns an event name and returns its id.
+ *
+ * This function gets the event node by name, creates it if not existed, and
+ * returns the interned id. Publishing by id skips the name validation and the
+ * name lookup.
+ *
+ * @param[in] name The name of the event to intern.
+ * @param[out] id The interned event id.
+ * @return The operation result. Returns OPRT_OK on success,
+ * OPRT_EXCEED_UPPER_LIMIT if the id table is full, or an error code on failure.
+ */
+OPERATE_RET tal_event_register_id(const char *name, EVENT_ID *id)
+{
+    if (g_event_manager.inited != TRUE) {
+        tal_event_init();
+    }
+
+    if (!_event_name_is_valid(name)) {
+        return OPRT_BASE_EVENT_INVALID_EVENT_NAME;
+    }
+    TUYA_CHECK_NULL_RETURN(id, OPRT_INVALID_PARM);
+
+    EVENT_NODE_T *event = _event_node_get(name);
+    if (!event) {
+        event = _event_node_create_init(name);
+        TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
+    }
+
+    if (event->id == EVENT_ID_INVALID) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    *id = event->id;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Publishes an event by the interned id.
+ *
+ * The event node is got from the id table directly, then dispatched to all
+ * subscribers without any lock, same as tal_event_publish.
+ *
+ * @param[in] id The event id got from tal_event_register_id.
+ * @param[in] data The data associated with the event.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_publish_id(EVENT_ID id, void *data)
+{
+    if (id == EVENT_ID_INVALID || id >= EVENT_ID_MAX_NUM) {
+        return OPRT_INVALID_PARM;
+    }
+
+    EVENT_NODE_T *event = g_event_manager.id_tbl[id];
+    if (!event) {
+        return OPRT_NOT_FOUND;
+    }
+
+    OPERATE_RET rt = OPRT_OK;
+    TUYA_CALL_ERR_LOG(_event_node_dispatch(event, data));
 
     return rt;
 }
@@ -432,18 +706,17 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
     memcpy(subscribe.desc, desc, strlen(desc));
     subscribe.desc[strlen(desc)] = '\0';
 
+    // lookup in lock, the event maybe created by publisher at the same time
+    tal_mutex_lock(g_event_manager.mutex);
     EVENT_NODE_T *event = _event_node_get(name);
     if (!event) {
         // if not found the event, add to the free list
-        tal_mutex_lock(g_event_manager.mutex);
         TUYA_CALL_ERR_LOG(_event_node_add_free_subscribe(&subscribe));
-        tal_mutex_unlock(g_event_manager.mutex);
     } else {
         // if found the event, add to the subscribe list
-        tal_mutex_lock(event->mutex);
         TUYA_CALL_ERR_LOG(_event_node_add_subscribe(event, &subscribe));
-        tal_mutex_unlock(event->mutex);
     }
+    tal_mutex_unlock(g_event_manager.mutex);
 
     return rt;
 }
@@ -487,18 +760,17 @@ OPERATE_RET tal_event_unsubscribe(const char *name, const char *desc, EVENT_SUBS
     memcpy(subscribe.desc, desc, strlen(desc));
     subscribe.desc[strlen(desc)] = '\0';
 
+    // lookup in lock, the event maybe created by publisher at the same time
+    tal_mutex_lock(g_event_manager.mutex);
     EVENT_NODE_T *event = _event_node_get(name);
     if (!event) {
         // if not found the event, del from the free list
-        tal_mutex_lock(g_event_manager.mutex);
         TUYA_CALL_ERR_LOG(_event_node_del_free_subscribe(&subscribe));
-        tal_mutex_unlock(g_event_manager.mutex);
     } else {
         // if found the event, del from the subscribe list
-        tal_mutex_lock(event->mutex);
         TUYA_CALL_ERR_LOG(_event_node_del_subscribe(event, &subscribe));
-        tal_mutex_unlock(event->mutex);
     }
+    tal_mutex_unlock(g_event_manager.mutex);
 
     return rt;
 }
@@ -20,6 +20,18 @@
  * mutexes for thread safety and memory management for dynamic allocation of log
  * nodes.
  *
+ * With ENABLE_LOG_ASYNC the caller only formats the message into a record of a
+ * bounded multi-producer ring and returns; a dedicated thread adds the time
+ * prefix and feeds the output terminals, so a slow UART no longer serializes
+ * every thread that logs. Records are dropped, never waited for, when the ring
+ * is full.
+ *
+ * With ENABLE_LOG_BINARY a log line is not formatted on the device at all: the
+ * address of the format string, the address of the file name, the time and the
+ * raw arguments are packed into a record and sent as one base64 line starting
+ * with "#B". tools/log_decoder/log_decoder.py turns these lines back into text
+ * with the help of the firmware ELF, which holds the format strings.
+ *
  * @note This file is part of the Tuya IoT Development Platform and is intended
  * for use in Tuya-based applications. It is subject to the platform's license
  * and copyright terms.
@@ -37,6 +49,10 @@
 #include "tal_system.h"
 #include "tal_time_service.h"
 #include "tal_memory.h"
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+#include "tal_semaphore.h"
+#include "tal_thread.h"
+#endif
 
 /***********************************************************
 *************************micro define***********************
@@ -44,6 +60,132 @@
 #define LOG_LEVEL_MIN 0
 #define LOG_LEVEL_MAX 5
 
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+#ifndef LOG_ASYNC_REC_NUM
+#define LOG_ASYNC_REC_NUM 16
+#endif
+
+#ifndef LOG_ASYNC_REC_SIZE
+#define LOG_ASYNC_REC_SIZE 256
+#endif
+
+#ifndef STACK_SIZE_LOG_ASYNC
+#define STACK_SIZE_LOG_ASYNC 3072
+#endif
+
+#if (LOG_ASYNC_REC_NUM & (LOG_ASYNC_REC_NUM - 1)) != 0
+#error "LOG_ASYNC_REC_NUM must be a power of 2"
+#endif
+
+// record printed as is, without time/level prefix
+#define LOG_ASYNC_LEVEL_RAW 0xFF
+// record holds a binary log record, see __log_bin_encode
+#define LOG_ASYNC_LEVEL_BIN 0xFE
+
+typedef struct {
+    // == position when free, position + 1 when published
+    uint32_t seq;
+    uint8_t level;
+    uint16_t len;
+    int line;
+    // kept by pointer, callers pass __FILE__
+    const char *file;
+    SYS_TICK_T time_ms;
+    char buf[LOG_ASYNC_REC_SIZE];
+} LOG_ASYNC_REC_S;
+
+typedef struct {
+    LOG_ASYNC_REC_S rec[LOG_ASYNC_REC_NUM];
+    uint32_t enq_pos;
+    uint32_t deq_pos;
+    uint32_t dropped;
+    uint32_t truncated;
+    uint32_t dropped_reported;
+    SEM_HANDLE sem;
+    THREAD_HANDLE thread;
+    uint32_t stop;
+    uint32_t exited;
+} LOG_ASYNC_S;
+
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define LOG_ATOMIC_LOAD(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define LOG_ATOMIC_STORE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define LOG_ATOMIC_ADD(ptr, val)   __atomic_add_fetch((ptr), (val), __ATOMIC_RELAXED)
+#define LOG_ATOMIC_CAS(ptr, exp, val)                                                                                  \
+    __atomic_compare_exchange_n((ptr), (exp), (val), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+// no native atomic instruction, protect the ring positions by a short critical section
+static MUTEX_HANDLE s_log_atomic_mutex = NULL;
+
+static uint32_t __log_atomic_load(uint32_t *ptr)
+{
+    uint32_t ret = 0;
+    tal_mutex_lock(s_log_atomic_mutex);
+    ret = *ptr;
+    tal_mutex_unlock(s_log_atomic_mutex);
+    return ret;
+}
+
+static void __log_atomic_store(uint32_t *ptr, uint32_t val)
+{
+    tal_mutex_lock(s_log_atomic_mutex);
+    *ptr = val;
+    tal_mutex_unlock(s_log_atomic_mutex);
+}
+
+static uint32_t __log_atomic_add(uint32_t *ptr, uint32_t val)
+{
+    uint32_t ret = 0;
+    tal_mutex_lock(s_log_atomic_mutex);
+    *ptr += val;
+    ret = *ptr;
+    tal_mutex_unlock(s_log_atomic_mutex);
+    return ret;
+}
+
+static BOOL_T __log_atomic_cas(uint32_t *ptr, uint32_t *exp, uint32_t val)
+{
+    BOOL_T ret = FALSE;
+    tal_mutex_lock(s_log_atomic_mutex);
+    if (*ptr == *exp) {
+        *ptr = val;
+        ret = TRUE;
+    } else {
+        *exp = *ptr;
+    }
+    tal_mutex_unlock(s_log_atomic_mutex);
+    return ret;
+}
+
+#define LOG_ATOMIC_LOAD(ptr)          __log_atomic_load(ptr)
+#define LOG_ATOMIC_STORE(ptr, val)    __log_atomic_store((ptr), (val))
+#define LOG_ATOMIC_ADD(ptr, val)      __log_atomic_add((ptr), (val))
+#define LOG_ATOMIC_CAS(ptr, exp, val) __log_atomic_cas((ptr), (exp), (val))
+#endif
+#endif
+
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+#ifndef LOG_BIN_REC_SIZE
+#define LOG_BIN_REC_SIZE 128
+#endif
+
+// record version, in the high nibble of the first byte
+#define LOG_BIN_VERSION 0x10
+// set when some arguments did not fit into the record
+#define LOG_BIN_TRUNC 0x08
+// line prefix of a base64 record
+#define LOG_BIN_PREFIX "#B"
+// line prefix of the anchor, which lets the decoder find the load address
+#define LOG_BIN_ANCHOR_PREFIX "#BI "
+
+typedef struct {
+    uint8_t *buf;
+    int size;
+    int len;
+    BOOL_T trunc;
+} LOG_BIN_OUT_S;
+#endif
+
 typedef struct {
     LIST_HEAD node;
     char *name;
@@ -72,6 +214,17 @@ typedef struct {
     int log_buf_len;
     BOOL_T ms_level;
     char *log_buf;
+
+    // local time of tm_sec_base, reused while the time stays in the same minute
+    TIME_T tm_sec_base;
+    POSIX_TM_S tm_base;
+
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    LOG_ASYNC_S *async;
+#endif
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+    uint8_t bin_buf[LOG_BIN_REC_SIZE];
+#endif
 } LOG_MANAGE, *P_LOG_MANAGE;
 
 #define DEF_OUTPUT_NAME "def_output"
@@ -82,6 +235,11 @@ typedef struct {
 const char *sLevelStr[] = {"E", "W", "N", "I", "D", "T"};
 P_LOG_MANAGE pLogManage = NULL;
 
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+// the decoder looks this string up in the ELF to learn the address offset
+const char sLogBinAnchor[] = "tal_log binary v1";
+#endif
+
 const LOG_TEXT_STYLE_S sDefaultStyle[LOG_LEVEL_MAX + 1] = {
     {TAL_LOG_DISPLAY_MODE_DEFAULT, TAL_LOG_FONT_COLOR_RED, TAL_LOG_BACKGROUND_COLOR_DEFAULT},
     {TAL_LOG_DISPLAY_MODE_DEFAULT, TAL_LOG_FONT_COLOR_YELLOW, TAL_LOG_BACKGROUND_COLOR_DEFAULT},
@@ -93,6 +251,13 @@ const LOG_TEXT_STYLE_S sDefaultStyle[LOG_LEVEL_MAX + 1] = {
 /***********************************************************
 *************************function define********************
 ***********************************************************/
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+static OPERATE_RET __log_async_start(void);
+#endif
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+static void __log_bin_anchor(void);
+#endif
+
 /**
  * @brief Initializes the TAL log system.
  *
@@ -122,6 +287,7 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
         if (!tmp_log_mng) {
             return OPRT_MALLOC_FAILED;
         }
+        memset(tmp_log_mng, 0, sizeof(LOG_MANAGE));
         tmp_log_mng->log_buf_len = buf_len;
         tmp_log_mng->log_buf = (char *)(tmp_log_mng + 1);
         op_ret = tal_mutex_create_init(&tmp_log_mng->mutex);
@@ -143,8 +309,17 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
         if (OPRT_OK != op_ret) {
             tal_mutex_release(tmp_log_mng->mutex);
             tal_free(tmp_log_mng);
+            pLogManage = NULL;
             return op_ret;
         }
+
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+        __log_bin_anchor();
+#endif
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+        // keep logging synchronously if the drain thread can not be started
+        __log_async_start();
+#endif
     } else {
         pLogManage->curLogLevel = level;
     }
@@ -152,7 +327,7 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
     return OPRT_OK;
 }
 
-void __output_logManage_buf(void)
+static void __output_logManage_str(const char *str)
 {
     P_LIST_HEAD pPos;
     LOG_OUT_NODE_S *output_node;
@@ -160,11 +335,600 @@ void __output_logManage_buf(void)
     {
         output_node = tuya_list_entry(pPos, LOG_OUT_NODE_S, node);
         if (output_node->out_term) {
-            output_node->out_term(pLogManage->log_buf);
+            output_node->out_term(str);
         }
     }
 }
 
+void __output_logManage_buf(void)
+{
+    __output_logManage_str(pLogManage->log_buf);
+}
+
+static void __log_local_time(TIME_T sec, POSIX_TM_S *tm)
+{
+    // the time zone and summer time lookup only runs once a minute
+    if (pLogManage->tm_sec_base && sec >= pLogManage->tm_sec_base &&
+        pLogManage->tm_base.tm_sec + (sec - pLogManage->tm_sec_base) < 60) {
+        *tm = pLogManage->tm_base;
+        tm->tm_sec += (int)(sec - pLogManage->tm_sec_base);
+        return;
+    }
+
+    memset(tm, 0, sizeof(POSIX_TM_S));
+    if (OPRT_OK == tal_time_get_local_time_custom(sec, tm)) {
+        pLogManage->tm_sec_base = sec;
+        pLogManage->tm_base = *tm;
+    }
+}
+
+static int __log_format_prefix(char *buf, int buf_len, LOG_LEVEL level, const char *file, int line,
+                               SYS_TICK_T time_ms)
+{
+    int len = 0;
+    int cnt = 0;
+    POSIX_TM_S tm;
+
+    // color prefix
+    if (pLogManage->log_color.enable_color) {
+        cnt = snprintf(buf, buf_len, "\033[%d;%d;%dm", pLogManage->log_color.style[level].display_mode,
+                       pLogManage->log_color.style[level].font_color,
+                       pLogManage->log_color.style[level].background_color);
+        if (cnt <= 0) {
+            return -1;
+        }
+        len += cnt;
+    }
+
+    __log_local_time((TIME_T)(time_ms / 1000), &tm);
+    if (pLogManage->ms_level == FALSE) {
+        cnt = snprintf(buf + len, buf_len - len, "[%02d-%02d %02d:%02d:%02d ty %s][%s:%d] ", tm.tm_mon + 1,
+                       tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, sLevelStr[level], file, line);
+    } else {
+        cnt = snprintf(buf + len, buf_len - len, "[%02d-%02d %02d:%02d:%02d:%d ty %s][%s:%d] ", tm.tm_mon + 1,
+                       tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(time_ms % 1000), sLevelStr[level], file,
+                       line);
+    }
+    if (cnt <= 0) {
+        return -1;
+    }
+
+    return len + cnt;
+}
+
+static int __log_format_suffix(char *buf, int buf_len, int len)
+{
+    int cnt = 0;
+
+    char *p_suffix = (pLogManage->log_color.enable_color) ? "\033[0m\r\n" : "\r\n";
+    if (len > (int)(buf_len - strlen(p_suffix) - 1)) { // 1 -> "\0"
+        len = buf_len - strlen(p_suffix) - 1;
+    }
+    cnt = snprintf(buf + len, buf_len - len, "%s", p_suffix);
+    if (cnt <= 0) {
+        return -1;
+    }
+    len += cnt;
+    buf[len] = '\0';
+
+    return len;
+}
+
+static int __log_format_hex_row(char *buf, int buf_len, uint16_t offset, uint8_t width, const uint8_t *data,
+                                uint16_t size)
+{
+    int len = 0;
+    uint16_t j = 0;
+
+    len += snprintf(buf + len, buf_len - len, "%04X | ", offset);
+    for (j = offset; j < offset + width && len < buf_len; j++) {
+        if (j < size) {
+            len += snprintf(buf + len, buf_len - len, "%02X ", data[j]);
+        } else {
+            len += snprintf(buf + len, buf_len - len, "   ");
+        }
+    }
+    if (len < buf_len) {
+        len += snprintf(buf + len, buf_len - len, "| ");
+    }
+    for (j = offset; j < offset + width && j < size && len < buf_len - 1; j++) {
+        buf[len++] = isprint(data[j]) ? data[j] : '.';
+    }
+    if (len < buf_len) {
+        len += snprintf(buf + len, buf_len - len, "\r\n");
+    }
+    if (len >= buf_len) {
+        len = buf_len - 1;
+    }
+    buf[len] = '\0';
+
+    return len;
+}
+
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+static void __log_bin_put(LOG_BIN_OUT_S *out, const void *data, int len)
+{
+    if (out->trunc || out->len + len > out->size) {
+        out->trunc = TRUE;
+        return;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+// LEB128, small values take one byte
+static void __log_bin_put_var(LOG_BIN_OUT_S *out, unsigned long long v)
+{
+    uint8_t tmp[10];
+    int len = 0;
+
+    do {
+        tmp[len] = v & 0x7F;
+        v >>= 7;
+        if (v) {
+            tmp[len] |= 0x80;
+        }
+        len++;
+    } while (v);
+    __log_bin_put(out, tmp, len);
+}
+
+static void __log_bin_put_int(LOG_BIN_OUT_S *out, long long v, BOOL_T is_signed)
+{
+    if (is_signed) {
+        // zigzag, so small negative values stay short
+        __log_bin_put_var(out, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+    } else {
+        __log_bin_put_var(out, (unsigned long long)v);
+    }
+}
+
+static void __log_bin_put_str(LOG_BIN_OUT_S *out, const char *str, int prec)
+{
+    uint8_t len = 0;
+
+    if (NULL == str) {
+        str = "(null)";
+    }
+    while ((prec < 0 || len < prec) && len < 0xFF && str[len]) {
+        len++;
+    }
+    // a cut string still decodes, only arguments that do not fit at all
+    // mark the record truncated
+    if (out->len + 1 + len > out->size) {
+        len = (out->size - out->len > 1) ? out->size - out->len - 1 : 0;
+    }
+    __log_bin_put(out, &len, 1);
+    __log_bin_put(out, str, len);
+}
+
+/**
+ * record layout, native byte order and pointer size:
+ *   u8 version | trunc | level, var line, u32 sec, u16 ms, fmt ptr, file ptr
+ * followed by the arguments in format order:
+ *   '*' width/precision: zigzag var
+ *   d i: zigzag var, o u x X c: var, of the type given by the length modifier
+ *   p: pointer
+ *   s: u8 len + bytes, no terminator
+ *   a e f g (any case): double
+ */
+static int __log_bin_encode(uint8_t *buf, int size, LOG_LEVEL level, const char *file, int line, SYS_TICK_T time_ms,
+                            const char *fmt, va_list ap)
+{
+    LOG_BIN_OUT_S out = {.buf = buf, .size = size, .len = 1, .trunc = FALSE};
+    const char *p = fmt;
+    uint32_t sec = (uint32_t)(time_ms / 1000);
+    uint16_t ms = (uint16_t)(time_ms % 1000);
+
+    __log_bin_put_var(&out, (uint32_t)line);
+    __log_bin_put(&out, &sec, sizeof(sec));
+    __log_bin_put(&out, &ms, sizeof(ms));
+    __log_bin_put(&out, &fmt, sizeof(fmt));
+    __log_bin_put(&out, &file, sizeof(file));
+
+    while (*p && !out.trunc) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        while (*p && strchr("-+ #0'", *p)) {
+            p++;
+        }
+        if (*p == '*') {
+            __log_bin_put_int(&out, va_arg(ap, int), TRUE);
+            p++;
+        } else {
+            while (isdigit((unsigned char)*p)) {
+                p++;
+            }
+        }
+
+        int prec = -1;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                prec = va_arg(ap, int);
+                __log_bin_put_int(&out, prec, TRUE);
+                p++;
+            } else {
+                prec = 0;
+                while (isdigit((unsigned char)*p)) {
+                    prec = prec * 10 + (*p++ - '0');
+                }
+            }
+        }
+
+        char lmod = 0;
+        if (*p == 'h') {
+            p += (p[1] == 'h') ? 2 : 1;
+        } else if (*p == 'l') {
+            lmod = (p[1] == 'l') ? 'q' : 'l';
+            p += (p[1] == 'l') ? 2 : 1;
+        } else if (*p == 'z' || *p == 't' || *p == 'j' || *p == 'L' || *p == 'q') {
+            lmod = (*p == 't') ? 'z' : *p;
+            p++;
+        }
+
+        char conv = *p;
+        if (conv) {
+            p++;
+        }
+        switch (conv) {
+        case 'd':
+        case 'i':
+            if ('l' == lmod) {
+                __log_bin_put_int(&out, va_arg(ap, long), TRUE);
+            } else if ('q' == lmod || 'j' == lmod || 'L' == lmod) {
+                __log_bin_put_int(&out, va_arg(ap, long long), TRUE);
+            } else if ('z' == lmod) {
+                __log_bin_put_int(&out, (long long)va_arg(ap, size_t), TRUE);
+            } else {
+                __log_bin_put_int(&out, va_arg(ap, int), TRUE);
+            }
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c':
+            if ('l' == lmod) {
+                __log_bin_put_int(&out, va_arg(ap, unsigned long), FALSE);
+            } else if ('q' == lmod || 'j' == lmod || 'L' == lmod) {
+                __log_bin_put_int(&out, va_arg(ap, unsigned long long), FALSE);
+            } else if ('z' == lmod) {
+                __log_bin_put_int(&out, va_arg(ap, size_t), FALSE);
+            } else {
+                __log_bin_put_int(&out, va_arg(ap, unsigned int), FALSE);
+            }
+            break;
+        case 'p': {
+            void *v = va_arg(ap, void *);
+            __log_bin_put(&out, &v, sizeof(v));
+        } break;
+        case 's':
+            __log_bin_put_str(&out, va_arg(ap, const char *), prec);
+            break;
+        case 'a':
+        case 'A':
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G': {
+            double v = ('L' == lmod) ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            __log_bin_put(&out, &v, sizeof(v));
+        } break;
+        case 'n':
+            (void)va_arg(ap, void *);
+            break;
+        default:
+            // unknown conversion, the following arguments can not be located
+            out.trunc = TRUE;
+            break;
+        }
+    }
+
+    buf[0] = LOG_BIN_VERSION | (out.trunc ? LOG_BIN_TRUNC : 0) | (level & 0x07);
+
+    return out.len;
+}
+
+static int __log_bin_to_line(const uint8_t *bin, int bin_len, char *buf, int buf_len)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int len = 0;
+    int i = 0;
+
+    if (buf_len < (int)sizeof(LOG_BIN_PREFIX) + (bin_len + 2) / 3 * 4 + 2) {
+        return -1;
+    }
+
+    memcpy(buf, LOG_BIN_PREFIX, sizeof(LOG_BIN_PREFIX) - 1);
+    len = sizeof(LOG_BIN_PREFIX) - 1;
+    for (i = 0; i + 2 < bin_len; i += 3) {
+        uint32_t v = (bin[i] << 16) | (bin[i + 1] << 8) | bin[i + 2];
+        buf[len++] = b64[(v >> 18) & 0x3F];
+        buf[len++] = b64[(v >> 12) & 0x3F];
+        buf[len++] = b64[(v >> 6) & 0x3F];
+        buf[len++] = b64[v & 0x3F];
+    }
+    if (i < bin_len) {
+        uint32_t v = bin[i] << 16;
+        if (i + 1 < bin_len) {
+            v |= bin[i + 1] << 8;
+        }
+        buf[len++] = b64[(v >> 18) & 0x3F];
+        buf[len++] = b64[(v >> 12) & 0x3F];
+        buf[len++] = (i + 1 < bin_len) ? b64[(v >> 6) & 0x3F] : '=';
+        buf[len++] = '=';
+    }
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    buf[len] = '\0';
+
+    return len;
+}
+
+static void __log_bin_anchor(void)
+{
+    tal_mutex_lock(pLogManage->mutex);
+    snprintf(pLogManage->log_buf, pLogManage->log_buf_len, LOG_BIN_ANCHOR_PREFIX "%p\r\n", (void *)sLogBinAnchor);
+    __output_logManage_buf();
+    tal_mutex_unlock(pLogManage->mutex);
+}
+
+static OPERATE_RET __log_bin_printv(LOG_LEVEL level, const char *file, int line, const char *pFmt, va_list ap)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    SYS_TICK_T time_ms = tal_time_get_posix_ms();
+
+    tal_mutex_lock(pLogManage->mutex);
+    int bin_len = __log_bin_encode(pLogManage->bin_buf, LOG_BIN_REC_SIZE, level, file, line, time_ms, pFmt, ap);
+    if (__log_bin_to_line(pLogManage->bin_buf, bin_len, pLogManage->log_buf, pLogManage->log_buf_len) < 0) {
+        op_ret = OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+    } else {
+        __output_logManage_buf();
+    }
+    tal_mutex_unlock(pLogManage->mutex);
+
+    return op_ret;
+}
+#endif
+
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+static LOG_ASYNC_REC_S *__log_async_claim(LOG_ASYNC_S *async)
+{
+    LOG_ASYNC_REC_S *rec = NULL;
+    uint32_t pos = LOG_ATOMIC_LOAD(&async->enq_pos);
+
+    for (;;) {
+        rec = &async->rec[pos & (LOG_ASYNC_REC_NUM - 1)];
+        int32_t diff = (int32_t)(LOG_ATOMIC_LOAD(&rec->seq) - pos);
+        if (0 == diff) {
+            if (LOG_ATOMIC_CAS(&async->enq_pos, &pos, pos + 1)) {
+                return rec;
+            }
+        } else if (diff < 0) {
+            // the drain thread has not released this record yet, ring full
+            LOG_ATOMIC_ADD(&async->dropped, 1);
+            return NULL;
+        } else {
+            pos = LOG_ATOMIC_LOAD(&async->enq_pos);
+        }
+    }
+}
+
+static void __log_async_commit(LOG_ASYNC_S *async, LOG_ASYNC_REC_S *rec, int len)
+{
+    if (len < 0) {
+        len = 0;
+    } else if (len >= LOG_ASYNC_REC_SIZE) {
+        LOG_ATOMIC_ADD(&async->truncated, 1);
+        len = LOG_ASYNC_REC_SIZE - 1;
+    }
+    rec->buf[len] = '\0';
+    rec->len = len;
+
+    // the record is owned by the claimer until here, nobody else changes seq
+    LOG_ATOMIC_STORE(&rec->seq, rec->seq + 1);
+    tal_semaphore_post(async->sem);
+}
+
+static void __log_async_output(LOG_ASYNC_REC_S *rec)
+{
+    int len = 0;
+    int cnt = 0;
+
+    if (LOG_ASYNC_LEVEL_RAW == rec->level) {
+        __output_logManage_str(rec->buf);
+        return;
+    }
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+    if (LOG_ASYNC_LEVEL_BIN == rec->level) {
+        if (__log_bin_to_line((uint8_t *)rec->buf, rec->len, pLogManage->log_buf, pLogManage->log_buf_len) >= 0) {
+            __output_logManage_buf();
+        }
+        return;
+    }
+#endif
+
+    len = __log_format_prefix(pLogManage->log_buf, pLogManage->log_buf_len, rec->level, rec->file, rec->line,
+                              rec->time_ms);
+    if (len < 0) {
+        return;
+    }
+    cnt = rec->len;
+    if (cnt > pLogManage->log_buf_len - len - 1) {
+        cnt = pLogManage->log_buf_len - len - 1;
+    }
+    memcpy(pLogManage->log_buf + len, rec->buf, cnt);
+    len = __log_format_suffix(pLogManage->log_buf, pLogManage->log_buf_len, len + cnt);
+    if (len < 0) {
+        return;
+    }
+    __output_logManage_buf();
+}
+
+static void __log_async_drain(LOG_ASYNC_S *async)
+{
+    LOG_ASYNC_REC_S *rec = NULL;
+
+    // the manage mutex only guards the output terminals and log_buf here,
+    // producers never take it in async mode
+    tal_mutex_lock(pLogManage->mutex);
+    for (;;) {
+        rec = &async->rec[async->deq_pos & (LOG_ASYNC_REC_NUM - 1)];
+        if (LOG_ATOMIC_LOAD(&rec->seq) != async->deq_pos + 1) {
+            break;
+        }
+        __log_async_output(rec);
+        LOG_ATOMIC_STORE(&rec->seq, async->deq_pos + LOG_ASYNC_REC_NUM);
+        async->deq_pos++;
+    }
+
+    uint32_t dropped = LOG_ATOMIC_LOAD(&async->dropped);
+    if (dropped != async->dropped_reported) {
+        snprintf(pLogManage->log_buf, pLogManage->log_buf_len, "[log] %u lines dropped\r\n",
+                 (unsigned int)(dropped - async->dropped_reported));
+        __output_logManage_buf();
+        async->dropped_reported = dropped;
+    }
+    tal_mutex_unlock(pLogManage->mutex);
+}
+
+static void __log_async_task(void *args)
+{
+    LOG_ASYNC_S *async = (LOG_ASYNC_S *)args;
+
+    while (!LOG_ATOMIC_LOAD(&async->stop)) {
+        tal_semaphore_wait(async->sem, SEM_WAIT_FOREVER);
+        __log_async_drain(async);
+    }
+
+    // async may be freed as soon as exited is set
+    tal_thread_delete(async->thread);
+    LOG_ATOMIC_STORE(&async->exited, 1);
+}
+
+static void __log_async_free(LOG_ASYNC_S *async)
+{
+    if (async->sem) {
+        tal_semaphore_release(async->sem);
+    }
+#if !(defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2))
+    if (s_log_atomic_mutex) {
+        tal_mutex_release(s_log_atomic_mutex);
+        s_log_atomic_mutex = NULL;
+    }
+#endif
+    tal_free(async);
+}
+
+static OPERATE_RET __log_async_start(void)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    uint32_t i = 0;
+
+    LOG_ASYNC_S *async = (LOG_ASYNC_S *)tal_malloc(sizeof(LOG_ASYNC_S));
+    if (NULL == async) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(async, 0, sizeof(LOG_ASYNC_S));
+    for (i = 0; i < LOG_ASYNC_REC_NUM; i++) {
+        async->rec[i].seq = i;
+    }
+
+#if !(defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2))
+    op_ret = tal_mutex_create_init(&s_log_atomic_mutex);
+    if (OPRT_OK != op_ret) {
+        goto __ERR;
+    }
+#endif
+    op_ret = tal_semaphore_create_init(&async->sem, 0, LOG_ASYNC_REC_NUM);
+    if (OPRT_OK != op_ret) {
+        goto __ERR;
+    }
+
+    THREAD_CFG_T thrd_param = {.priority = THREAD_PRIO_6, .stackDepth = STACK_SIZE_LOG_ASYNC, .thrdname = "log_async"};
+    op_ret = tal_thread_create_and_start(&async->thread, NULL, NULL, __log_async_task, async, &thrd_param);
+    if (OPRT_OK != op_ret) {
+        goto __ERR;
+    }
+    pLogManage->async = async;
+
+    return OPRT_OK;
+
+__ERR:
+    __log_async_free(async);
+    return op_ret;
+}
+
+static void __log_async_stop(void)
+{
+    LOG_ASYNC_S *async = pLogManage->async;
+    uint32_t wait_ms = 0;
+
+    if (NULL == async) {
+        return;
+    }
+
+    // new lines go out synchronously, the thread flushes what is queued
+    pLogManage->async = NULL;
+    LOG_ATOMIC_STORE(&async->stop, 1);
+    tal_semaphore_post(async->sem);
+    while (!LOG_ATOMIC_LOAD(&async->exited) && wait_ms < 1000) {
+        tal_system_sleep(10);
+        wait_ms += 10;
+    }
+    if (LOG_ATOMIC_LOAD(&async->exited)) {
+        __log_async_free(async);
+    }
+}
+
+static OPERATE_RET __log_async_printv(LOG_ASYNC_S *async, LOG_LEVEL level, const char *file, int line,
+                                      const char *pFmt, va_list ap)
+{
+    LOG_ASYNC_REC_S *rec = __log_async_claim(async);
+    if (NULL == rec) {
+        return OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+    }
+
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+    // the record is packed here and only base64 encoded by the log thread
+    rec->level = LOG_ASYNC_LEVEL_BIN;
+    __log_async_commit(async, rec,
+                       __log_bin_encode((uint8_t *)rec->buf, LOG_ASYNC_REC_SIZE - 1, level, file, line,
+                                        tal_time_get_posix_ms(), pFmt, ap));
+#else
+    rec->level = level;
+    rec->file = file;
+    rec->line = line;
+    rec->time_ms = tal_time_get_posix_ms();
+    __log_async_commit(async, rec, vsnprintf(rec->buf, LOG_ASYNC_REC_SIZE, pFmt, ap));
+#endif
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET __log_async_raw_printv(LOG_ASYNC_S *async, const char *pFmt, va_list ap)
+{
+    LOG_ASYNC_REC_S *rec = __log_async_claim(async);
+    if (NULL == rec) {
+        return OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+    }
+
+    rec->level = LOG_ASYNC_LEVEL_RAW;
+    __log_async_commit(async, rec, vsnprintf(rec->buf, LOG_ASYNC_REC_SIZE, pFmt, ap));
+
+    return OPRT_OK;
+}
+#endif
+
 OPERATE_RET __find_out_term_node(const char *name, LOG_OUT_NODE_S **node)
 {
     P_LIST_HEAD pPos;
@@ -203,24 +967,29 @@ OPERATE_RET tal_log_add_output_term(const char *name, const TAL_LOG_OUTPUT_CB te
     }
 
     LOG_OUT_NODE_S *output_node;
+    tal_mutex_lock(pLogManage->mutex);
     OPERATE_RET ret = __find_out_term_node(name, &output_node);
     if (ret == OPRT_OK) {
         output_node->out_term = term;
+        tal_mutex_unlock(pLogManage->mutex);
         return OPRT_OK;
     }
 
     NEW_LIST_NODE(LOG_OUT_NODE_S, output_node);
     if (!output_node) {
+        tal_mutex_unlock(pLogManage->mutex);
         return OPRT_MALLOC_FAILED;
     }
     output_node->name = tal_malloc(strlen(name) + 1);
     if (!output_node->name) {
         tal_free(output_node);
+        tal_mutex_unlock(pLogManage->mutex);
         return OPRT_MALLOC_FAILED;
     }
     strcpy(output_node->name, name);
     output_node->out_term = term;
     tuya_list_add(&(output_node->node), &(pLogManage->log_list));
+    tal_mutex_unlock(pLogManage->mutex);
 
     return OPRT_OK;
 }
@@ -377,7 +1146,6 @@ OPERATE_RET PrintLogV(LOG_LEVEL logLevel, char *pFile, uint32_t line, char *pFmt
     if (logLevel > tmpLogLevel) {
         return OPRT_BASE_LOG_MNG_PRINT_LOG_LEVEL_HIGHER;
     }
-    const char *pTmpModuleName = "ty";
     const char *pTmpFilename = NULL;
 
     if (NULL == pFile) {
@@ -395,57 +1163,38 @@ OPERATE_RET PrintLogV(LOG_LEVEL logLevel, char *pFile, uint32_t line, char *pFmt
             pTmpFilename = pFile + pos + 1;
         }
     }
-    tal_mutex_lock(pLogManage->mutex);
-
-    // color prefix
-    if (pLogManage->log_color.enable_color) {
-        cnt = snprintf(pLogManage->log_buf, pLogManage->log_buf_len, "\033[%d;%d;%dm",
-                       pLogManage->log_color.style[logLevel].display_mode,
-                       pLogManage->log_color.style[logLevel].font_color,
-                       pLogManage->log_color.style[logLevel].background_color);
-        if (cnt <= 0) {
-            goto ERR_EXIT;
-        }
-        len += cnt;
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    if (pLogManage->async) {
+        return __log_async_printv(pLogManage->async, logLevel, pTmpFilename, line, pFmt, ap);
     }
+#endif
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+    return __log_bin_printv(logLevel, pTmpFilename, line, pFmt, ap);
+#endif
 
-    POSIX_TM_S tm;
-    memset(&tm, 0, sizeof(tm));
-
+    SYS_TICK_T time_ms = 0;
     if (pLogManage->ms_level == FALSE) {
-        tal_time_get_local_time_custom(0, &tm);
-        cnt = snprintf(pLogManage->log_buf + len, pLogManage->log_buf_len - len,
-                       "[%02d-%02d %02d:%02d:%02d %s %s][%s:%d] ", tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
-                       tm.tm_sec, pTmpModuleName, sLevelStr[logLevel], pTmpFilename, line);
+        time_ms = (SYS_TICK_T)tal_time_get_posix() * 1000;
     } else {
-        SYS_TICK_T time_ms = tal_time_get_posix_ms();
-        TIME_T sec = (TIME_T)(time_ms / 1000);
-        uint32_t ms = (uint32_t)(time_ms % 1000);
-        tal_time_get_local_time_custom(sec, &tm);
-        cnt = snprintf(pLogManage->log_buf + len, pLogManage->log_buf_len + len,
-                       "[%02d-%02d %02d:%02d:%02d:%d %s %s][%s:%d] ", tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
-                       tm.tm_sec, ms, pTmpModuleName, sLevelStr[logLevel], pTmpFilename, line);
+        time_ms = tal_time_get_posix_ms();
     }
-    if (cnt <= 0) {
+
+    tal_mutex_lock(pLogManage->mutex);
+
+    len = __log_format_prefix(pLogManage->log_buf, pLogManage->log_buf_len, logLevel, pTmpFilename, line, time_ms);
+    if (len < 0) {
         goto ERR_EXIT;
     }
-    len += cnt;
     cnt = vsnprintf(pLogManage->log_buf + len, pLogManage->log_buf_len - len, pFmt, ap);
     if (cnt <= 0) {
         goto ERR_EXIT;
     }
     len += cnt;
 
-    char *p_suffix = (pLogManage->log_color.enable_color) ? "\033[0m\r\n" : "\r\n";
-    if (len > (int)(pLogManage->log_buf_len - strlen(p_suffix) - 1)) { // 1 -> "\0"
-        len = pLogManage->log_buf_len - strlen(p_suffix) - 1;
-    }
-    cnt = snprintf(pLogManage->log_buf + len, pLogManage->log_buf_len - len, "%s", p_suffix);
-    if (cnt <= 0) {
+    len = __log_format_suffix(pLogManage->log_buf, pLogManage->log_buf_len, len);
+    if (len < 0) {
         goto ERR_EXIT;
     }
-    len += cnt;
-    pLogManage->log_buf[len] = '\0';
 
     __output_logManage_buf();
     tal_mutex_unlock(pLogManage->mutex);
@@ -521,6 +1270,15 @@ OPERATE_RET tal_log_print_raw(const char *pFmt, ...)
     OPERATE_RET opRet = 0;
     va_list ap;
 
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    if (pLogManage->async) {
+        va_start(ap, pFmt);
+        opRet = __log_async_raw_printv(pLogManage->async, pFmt, ap);
+        va_end(ap);
+        return opRet;
+    }
+#endif
+
     tal_mutex_lock(pLogManage->mutex);
     va_start(ap, pFmt);
     opRet = __PrintLogVRaw(pFmt, ap);
@@ -544,15 +1302,20 @@ void tal_log_release(void)
         return;
     }
 
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    __log_async_stop();
+#endif
+
     while (!tuya_list_empty(&(pLogManage->log_list))) {
         LOG_OUT_NODE_S *log_out_nd = NULL;
-        log_out_nd = tuya_list_entry(&(pLogManage->log_list.next), LOG_OUT_NODE_S, node);
+        log_out_nd = tuya_list_entry(pLogManage->log_list.next, LOG_OUT_NODE_S, node);
         tuya_list_del(&(log_out_nd->node));
         if (log_out_nd->name) {
             tal_free(log_out_nd->name);
         }
         tal_free(log_out_nd);
     }
+    tal_mutex_release(pLogManage->mutex);
     tal_free(pLogManage);
     pLogManage = NULL;
 }
@@ -583,7 +1346,7 @@ void tal_log_release(void)
 void tal_log_hex_dump(const TAL_LOG_LEVEL_E level, const char *file, const int line, const char *title, uint8_t width,
                       uint8_t *buf, uint16_t size)
 {
-    uint16_t i = 0, j = 0;
+    uint16_t i = 0;
 
     if (!pLogManage || level > pLogManage->curLogLevel) {
         return;
@@ -591,31 +1354,28 @@ void tal_log_hex_dump(const TAL_LOG_LEVEL_E level, const char *file, const int l
 
     if (width >= 64) {
         width = 64;
+    } else if (0 == width) {
+        width = 16;
     }
     tal_log_print(level, file, line, "%s %d <%p>", title, size, buf);
 
+    // one output per row, not one per byte
     for (i = 0; i < size; i += width) {
-        tal_log_print_raw("%04lX | ", i);
-
-        for (j = i; j < i + width; j++) {
-            if (j < size) {
-                tal_log_print_raw("%02X ", buf[j]);
-            } else {
-                tal_log_print_raw("   ");
-            }
-        }
-
-        tal_log_print_raw("| ");
-
-        for (j = i; j < i + width && j < size; j++) {
-            if (isprint(buf[j])) {
-                tal_log_print_raw("%c", buf[j]);
-            } else {
-                tal_log_print_raw(".");
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+        LOG_ASYNC_S *async = pLogManage->async;
+        if (async) {
+            LOG_ASYNC_REC_S *rec = __log_async_claim(async);
+            if (rec) {
+                rec->level = LOG_ASYNC_LEVEL_RAW;
+                __log_async_commit(async, rec, __log_format_hex_row(rec->buf, LOG_ASYNC_REC_SIZE, i, width, buf, size));
             }
+            continue;
         }
-
-        tal_log_print_raw("\r\n");
+#endif
+        tal_mutex_lock(pLogManage->mutex);
+        __log_format_hex_row(pLogManage->log_buf, pLogManage->log_buf_len, i, width, buf, size);
+        __output_logManage_buf();
+        tal_mutex_unlock(pLogManage->mutex);
     }
     tal_log_print_raw("\r\n");
 }
@@ -693,6 +1453,33 @@ OPERATE_RET tal_log_color_print_raw(TAL_LOG_DISPLAY_MODE_E display_mode, TAL_LOG
         return OPRT_INVALID_PARM;
     }
 
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    LOG_ASYNC_S *async = pLogManage->async;
+    if (async) {
+        LOG_ASYNC_REC_S *rec = __log_async_claim(async);
+        if (NULL == rec) {
+            return OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+        }
+        rec->level = LOG_ASYNC_LEVEL_RAW;
+        if (pLogManage->log_color.enable_color) {
+            len = snprintf(rec->buf, LOG_ASYNC_REC_SIZE, "\033[%d;%d;%dm", display_mode, font_color,
+                           background_color);
+        }
+        va_start(ap, pFmt);
+        cnt = vsnprintf(rec->buf + len, LOG_ASYNC_REC_SIZE - len, pFmt, ap);
+        va_end(ap);
+        len += (cnt > 0) ? cnt : 0;
+        if (pLogManage->log_color.enable_color) {
+            if (len > LOG_ASYNC_REC_SIZE - 4 - 1) { // 4 -> "\033[0m" 1 -> "\0"
+                len = LOG_ASYNC_REC_SIZE - 4 - 1;
+            }
+            len += snprintf(rec->buf + len, LOG_ASYNC_REC_SIZE - len, "\033[0m");
+        }
+        __log_async_commit(async, rec, len);
+        return OPRT_OK;
+    }
+#endif
+
     tal_mutex_lock(pLogManage->mutex);
     va_start(ap, pFmt);
     if (pLogManage->log_color.enable_color) {
@@ -734,3 +1521,30 @@ __EXIT:
 
     return opRet;
 }
+
+/**
+ * @brief Gets the counters of the asynchronous log ring.
+ *
+ * @param[out] dropped Number of lines dropped because the ring was full.
+ * @param[out] truncated Number of lines cut to LOG_ASYNC_REC_SIZE.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED if the log is not running in
+ * asynchronous mode.
+ */
+OPERATE_RET tal_log_async_stat(uint32_t *dropped, uint32_t *truncated)
+{
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+    if (NULL == pLogManage || NULL == pLogManage->async) {
+        return OPRT_NOT_SUPPORTED;
+    }
+    if (dropped) {
+        *dropped = LOG_ATOMIC_LOAD(&pLogManage->async->dropped);
+    }
+    if (truncated) {
+        *truncated = LOG_ATOMIC_LOAD(&pLogManage->async->truncated);
+    }
+    return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
+}
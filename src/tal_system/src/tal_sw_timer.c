@@ -12,6 +12,22 @@
 #define STACK_SIZE_TIMERQ (4 * 1024)
 #endif
 
+#if defined(ENABLE_SW_TIMER_WHEEL) && (ENABLE_SW_TIMER_WHEEL == 1)
+#define TIMER_WHEEL_ENABLE 1
+#else
+#define TIMER_WHEEL_ENABLE 0
+#endif
+
+#if TIMER_WHEEL_ENABLE
+// 4 wheels of 64 slots with 1ms tick, covers 2^24ms (~4.6h) before a timer
+// has to be re-scheduled from the top wheel
+#define TIMER_WHEEL_BIT      6
+#define TIMER_WHEEL_NUM      4
+#define TIMER_WHEEL_LEN      (1U << TIMER_WHEEL_BIT)
+#define TIMER_WHEEL_MASK     (TIMER_WHEEL_LEN - 1)
+#define TIMER_WHEEL_MAX_SPAN ((1ULL << (TIMER_WHEEL_BIT * TIMER_WHEEL_NUM)) - 1)
+#endif
+
 typedef struct {
     LIST_HEAD node;
 
@@ -23,11 +39,19 @@ typedef struct {
     BOOL_T is_running;
     TIMER_ID timer_id;
     TIMER_TYPE type;
+#if TIMER_WHEEL_ENABLE
+    LIST_HEAD *slot; // wheel slot or expired list the timer is linked in
+#endif
 } TIMER_T;
 
 typedef struct {
-    LIST_HEAD list_active;
+    LIST_HEAD list_active; // sorted by expire time, or expired timers in wheel mode
     LIST_HEAD list_standby;
+#if TIMER_WHEEL_ENABLE
+    LIST_HEAD wheel[TIMER_WHEEL_NUM][TIMER_WHEEL_LEN];
+    uint64_t pending[TIMER_WHEEL_NUM]; // bitmap of non-empty slots per wheel
+    uint64_t curtime;                  // ms, the time wheels have been advanced to
+#endif
     MUTEX_HANDLE mutex;
     uint16_t total_cnt;
     uint16_t running_cnt;
@@ -40,6 +64,178 @@ typedef struct {
 
 static SW_TIMER_MGR_T s_timer_mgr;
 
+#if TIMER_WHEEL_ENABLE
+static inline int __wheel_ctz(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline int __wheel_fls(uint64_t v)
+{
+#if defined(__GNUC__)
+    return 64 - __builtin_clzll(v);
+#else
+    int n = 0;
+    while (v) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline uint64_t __wheel_rotl(uint64_t v, int c)
+{
+    c &= 63;
+    return c ? ((v << c) | (v >> (64 - c))) : v;
+}
+
+static inline uint64_t __wheel_rotr(uint64_t v, int c)
+{
+    c &= 63;
+    return c ? ((v >> c) | (v << (64 - c))) : v;
+}
+
+static void __timer_detach(TIMER_T *timer)
+{
+    tuya_list_del(&(timer->node));
+
+    // clear the pending bit once the wheel slot becomes empty
+    if (timer->slot && timer->slot != &(s_timer_mgr.list_active) && tuya_list_empty(timer->slot)) {
+        uint32_t idx = timer->slot - &(s_timer_mgr.wheel[0][0]);
+        s_timer_mgr.pending[idx / TIMER_WHEEL_LEN] &= ~(1ULL << (idx % TIMER_WHEEL_LEN));
+    }
+    timer->slot = NULL;
+}
+
+static void __timer_place(TIMER_T *timer)
+{
+    if (timer->expire_time > s_timer_mgr.curtime) {
+        uint64_t rem = timer->expire_time - s_timer_mgr.curtime;
+        int wheel = (__wheel_fls(rem < TIMER_WHEEL_MAX_SPAN ? rem : TIMER_WHEEL_MAX_SPAN) - 1) / TIMER_WHEEL_BIT;
+        int slot = TIMER_WHEEL_MASK & ((timer->expire_time >> (wheel * TIMER_WHEEL_BIT)) - !!wheel);
+
+        timer->slot = &(s_timer_mgr.wheel[wheel][slot]);
+        s_timer_mgr.pending[wheel] |= 1ULL << slot;
+    } else {
+        timer->slot = &(s_timer_mgr.list_active);
+    }
+
+    tuya_list_add_tail(&(timer->node), timer->slot);
+}
+
+static void __timer_attach(TIMER_T *timer)
+{
+    __timer_detach(timer);
+    __timer_place(timer);
+}
+
+/**
+ * @brief advance the wheels to now, expired timers are moved to list_active
+ * and the others cascade down to lower wheels
+ */
+static void __timer_wheel_update(uint64_t now)
+{
+    uint64_t elapsed = 0;
+    uint64_t pending = 0;
+    int wheel = 0;
+    LIST_HEAD todo;
+    TIMER_T *timer = NULL;
+
+    if (now <= s_timer_mgr.curtime) {
+        return;
+    }
+
+    INIT_LIST_HEAD(&todo);
+    elapsed = now - s_timer_mgr.curtime;
+
+    for (wheel = 0; wheel < TIMER_WHEEL_NUM; wheel++) {
+        // mark every slot between the last processed one and now
+        if ((elapsed >> (wheel * TIMER_WHEEL_BIT)) > TIMER_WHEEL_MASK) {
+            pending = ~0ULL;
+        } else {
+            int elapsed_slot = TIMER_WHEEL_MASK & (elapsed >> (wheel * TIMER_WHEEL_BIT));
+            int oslot = TIMER_WHEEL_MASK & (s_timer_mgr.curtime >> (wheel * TIMER_WHEEL_BIT));
+            int nslot = TIMER_WHEEL_MASK & (now >> (wheel * TIMER_WHEEL_BIT));
+
+            pending = __wheel_rotl(((1ULL << elapsed_slot) - 1), oslot);
+            pending |= __wheel_rotr(__wheel_rotl(((1ULL << elapsed_slot) - 1), nslot), elapsed_slot);
+            pending |= 1ULL << nslot;
+        }
+
+        while (pending & s_timer_mgr.pending[wheel]) {
+            int slot = __wheel_ctz(pending & s_timer_mgr.pending[wheel]);
+            tuya_list_splice(&(s_timer_mgr.wheel[wheel][slot]), &todo);
+            INIT_LIST_HEAD(&(s_timer_mgr.wheel[wheel][slot]));
+            s_timer_mgr.pending[wheel] &= ~(1ULL << slot);
+        }
+
+        // the upper wheel only ticks when this one wraps around
+        if (!(pending & 0x01)) {
+            break;
+        }
+
+        if (elapsed < ((uint64_t)TIMER_WHEEL_LEN << (wheel * TIMER_WHEEL_BIT))) {
+            elapsed = (uint64_t)TIMER_WHEEL_LEN << (wheel * TIMER_WHEEL_BIT);
+        }
+    }
+
+    s_timer_mgr.curtime = now;
+
+    while (!tuya_list_empty(&todo)) {
+        timer = tuya_list_entry(todo.next, TIMER_T, node);
+        tuya_list_del(&(timer->node));
+        timer->slot = NULL;
+        __timer_place(timer);
+    }
+}
+
+/**
+ * @brief get the time to the next wheel slot which holds timers
+ *
+ * @return ms relative to curtime, SEM_WAIT_FOREVER if no timer is pending
+ */
+static SYS_TIME_T __timer_wheel_next(void)
+{
+    uint64_t timeout = SEM_WAIT_FOREVER;
+    uint64_t tmp = 0;
+    uint64_t relmask = 0;
+    int wheel = 0;
+    int slot = 0;
+
+    for (wheel = 0; wheel < TIMER_WHEEL_NUM; wheel++) {
+        if (s_timer_mgr.pending[wheel]) {
+            slot = TIMER_WHEEL_MASK & (s_timer_mgr.curtime >> (wheel * TIMER_WHEEL_BIT));
+            // timers on upper wheels are one rotation ahead, see __timer_place
+            tmp = (uint64_t)(__wheel_ctz(__wheel_rotr(s_timer_mgr.pending[wheel], slot)) + !!wheel)
+                  << (wheel * TIMER_WHEEL_BIT);
+            tmp -= relmask & s_timer_mgr.curtime;
+            if (tmp < timeout) {
+                timeout = tmp;
+            }
+        }
+
+        relmask <<= TIMER_WHEEL_BIT;
+        relmask |= TIMER_WHEEL_MASK;
+    }
+
+    return (SYS_TIME_T)timeout;
+}
+#else
+static void __timer_detach(TIMER_T *timer)
+{
+    tuya_list_del(&(timer->node));
+}
+
 static void __timer_attach(TIMER_T *timer)
 {
     tuya_list_del(&(timer->node));
@@ -64,14 +260,31 @@ static void __timer_attach(TIMER_T *timer)
         }
     }
 }
+#endif
 
-static void __timer_dump(void)
+static void __timer_dump_list(LIST_HEAD *list)
 {
     struct tuya_list_head *p = NULL;
     TIMER_T *timer = NULL;
     TAL_TIMER_CB *cb = NULL;
     TIMER_ID *timer_id = NULL;
 
+    tuya_list_for_each(p, list)
+    {
+        timer = tuya_list_entry(p, TIMER_T, node);
+        cb = &(timer->cb);
+        if (timer->data) {
+            timer_id = timer->data;
+            if (*timer_id == timer->timer_id) {
+                cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
+            }
+        }
+        PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
+    }
+}
+
+static void __timer_dump(void)
+{
     TIME_S nowSecTime = 0;
     TIME_MS nowMsTime = 0;
 
@@ -86,36 +299,71 @@ static void __timer_dump(void)
     tal_mutex_lock(s_timer_mgr.mutex);
 
     PR_NOTICE("running timers count:%d", s_timer_mgr.running_cnt);
-    tuya_list_for_each(p, &(s_timer_mgr.list_active))
-    {
-        timer = tuya_list_entry(p, TIMER_T, node);
-        cb = &(timer->cb);
-        if (timer->data) {
-            timer_id = timer->data;
-            if (*timer_id == timer->timer_id) {
-                cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
-            }
+    __timer_dump_list(&(s_timer_mgr.list_active));
+#if TIMER_WHEEL_ENABLE
+    int wheel = 0, slot = 0;
+    for (wheel = 0; wheel < TIMER_WHEEL_NUM; wheel++) {
+        for (slot = 0; slot < TIMER_WHEEL_LEN; slot++) {
+            __timer_dump_list(&(s_timer_mgr.wheel[wheel][slot]));
         }
-        PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
     }
+#endif
 
     PR_NOTICE("standby timers count:%d", s_timer_mgr.total_cnt - s_timer_mgr.running_cnt);
-    tuya_list_for_each(p, &(s_timer_mgr.list_standby))
-    {
-        timer = tuya_list_entry(p, TIMER_T, node);
-        cb = &(timer->cb);
-        if (timer->data) {
-            timer_id = timer->data;
-            if (*timer_id == timer->timer_id) {
-                cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
-            }
-        }
-        PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
-    }
+    __timer_dump_list(&(s_timer_mgr.list_standby));
 
     tal_mutex_unlock(s_timer_mgr.mutex);
 }
 
+#if TIMER_WHEEL_ENABLE
+static void __timer_dispatch(SYS_TIME_T *next_expired)
+{
+    TIME_S nowSecTime = 0;
+    TIME_MS nowMsTime = 0;
+    uint64_t nowMS = 0;
+    TIMER_T *timer = NULL;
+    TAL_TIMER_CB timer_cb = NULL;
+
+    *next_expired = SEM_WAIT_FOREVER;
+
+    for (;;) {
+        tal_time_get_system_time(&nowSecTime, &nowMsTime);
+        nowMS = (uint64_t)nowSecTime * 1000 + (uint64_t)nowMsTime;
+
+        tal_mutex_lock(s_timer_mgr.mutex);
+
+        __timer_wheel_update(nowMS);
+
+        timer_cb = NULL;
+        if (tuya_list_empty(&(s_timer_mgr.list_active))) {
+            *next_expired = __timer_wheel_next();
+        } else {
+            timer = tuya_list_entry(s_timer_mgr.list_active.next, TIMER_T, node);
+            timer_cb = timer->cb;
+
+            if (TAL_TIMER_ONCE == timer->type) {
+                timer->is_running = FALSE;
+                s_timer_mgr.running_cnt--;
+                __timer_detach(timer);
+                tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
+            } else {
+                timer->expire_time = nowMS + timer->interval;
+                __timer_attach(timer);
+            }
+        }
+
+        tal_mutex_unlock(s_timer_mgr.mutex);
+
+        if (NULL == timer_cb) {
+            break;
+        }
+
+        s_timer_mgr.last_cb = timer_cb;
+        timer_cb(timer->timer_id, timer->data);
+        s_timer_mgr.last_cb = NULL;
+    }
+}
+#else
 static void __timer_dispatch(SYS_TIME_T *next_expired)
 {
     TIME_S nowSecTime = 0;
@@ -168,6 +416,7 @@ static void __timer_dispatch(SYS_TIME_T *next_expired)
         }
     } while (p != &(s_timer_mgr.list_active));
 }
+#endif
 
 static void __timer_thread_cb(void *data)
 {
@@ -204,6 +453,20 @@ OPERATE_RET tal_sw_timer_init(void)
     INIT_LIST_HEAD(&(s_timer_mgr.list_active));
     INIT_LIST_HEAD(&(s_timer_mgr.list_standby));
 
+#if TIMER_WHEEL_ENABLE
+    int wheel = 0, slot = 0;
+    for (wheel = 0; wheel < TIMER_WHEEL_NUM; wheel++) {
+        for (slot = 0; slot < TIMER_WHEEL_LEN; slot++) {
+            INIT_LIST_HEAD(&(s_timer_mgr.wheel[wheel][slot]));
+        }
+    }
+
+    TIME_S secTime = 0;
+    TIME_MS msTime = 0;
+    tal_time_get_system_time(&secTime, &msTime);
+    s_timer_mgr.curtime = (uint64_t)secTime * 1000 + (uint64_t)msTime;
+#endif
+
     THREAD_CFG_T thread_cfg = {.stackDepth = STACK_SIZE_TIMERQ, .priority = THREAD_PRIO_0, .thrdname = "sys_timer"};
 
     op_ret = tal_thread_create_and_start(&s_timer_mgr.thread, NULL, NULL, __timer_thread_cb, NULL, &thread_cfg);
@@ -270,7 +533,7 @@ OPERATE_RET tal_sw_timer_delete(TIMER_ID timer_id)
     TIMER_T *timer = (TIMER_T *)timer_id;
 
     tal_mutex_lock(s_timer_mgr.mutex);
-    tuya_list_del(&(timer->node));
+    __timer_detach(timer);
     s_timer_mgr.total_cnt--;
     if (timer->is_running) {
         s_timer_mgr.running_cnt--;
@@ -305,7 +568,7 @@ OPERATE_RET tal_sw_timer_stop(TIMER_ID timer_id)
         timer->is_running = FALSE;
 
         s_timer_mgr.running_cnt--;
-        tuya_list_del(&(timer->node));
+        __timer_detach(timer);
         tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
@@ -442,8 +705,7 @@ OPERATE_RET tal_sw_timer_trigger(TIMER_ID timer_id)
     tal_mutex_lock(s_timer_mgr.mutex);
     timer->expire_time = 0;
     if (timer->is_running) {
-        tuya_list_del(&(timer->node));
-        tuya_list_add(&(timer->node), &(s_timer_mgr.list_active));
+        __timer_attach(timer);
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
     tal_semaphore_post(s_timer_mgr.sem);
@@ -493,3 +755,90 @@ void tal_sw_timer_dump(void)
     __timer_dump();
     PR_NOTICE("---------timer queue dump end---------");
 }
+
+#if defined(SW_TIMER_BENCHMARK) && (SW_TIMER_BENCHMARK == 1)
+typedef struct {
+    TIMER_ID timer_id;
+    SYS_TIME_T due_ms;
+} SW_TIMER_BENCH_T;
+
+static volatile uint32_t s_bench_fired = 0;
+static volatile uint32_t s_bench_late_max = 0;
+
+static void __timer_bench_cb(TIMER_ID timer_id, void *arg)
+{
+    SW_TIMER_BENCH_T *bench = (SW_TIMER_BENCH_T *)arg;
+    SYS_TIME_T now = tal_system_get_millisecond();
+    uint32_t late = (now > bench->due_ms) ? (uint32_t)(now - bench->due_ms) : 0;
+
+    if (late > s_bench_late_max) {
+        s_bench_late_max = late;
+    }
+    s_bench_fired++;
+}
+
+OPERATE_RET tal_sw_timer_benchmark(uint32_t num)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t i = 0, created = 0;
+    SYS_TIME_T t0, t_start, t_stop, t_fire;
+
+    if (!s_timer_mgr.inited || num == 0) {
+        return OPRT_INVALID_PARM;
+    }
+
+    SW_TIMER_BENCH_T *bench = tal_malloc(num * sizeof(SW_TIMER_BENCH_T));
+    if (NULL == bench) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    for (created = 0; created < num; created++) {
+        rt = tal_sw_timer_create(__timer_bench_cb, &bench[created], &bench[created].timer_id);
+        if (OPRT_OK != rt) {
+            goto __exit;
+        }
+    }
+
+    /* start and stop with spread out intervals, none of them fires */
+    t0 = tal_system_get_millisecond();
+    for (i = 0; i < num; i++) {
+        tal_sw_timer_start(bench[i].timer_id, 60 * 1000 + (i * 7919) % (3600 * 1000), TAL_TIMER_ONCE);
+    }
+    t_start = tal_system_get_millisecond() - t0;
+
+    t0 = tal_system_get_millisecond();
+    for (i = 0; i < num; i++) {
+        tal_sw_timer_stop(bench[i].timer_id);
+    }
+    t_stop = tal_system_get_millisecond() - t0;
+
+    /* fire them all within the next second */
+    s_bench_fired = 0;
+    s_bench_late_max = 0;
+    t0 = tal_system_get_millisecond();
+    for (i = 0; i < num; i++) {
+        TIME_MS interval = 1 + (i * 7919) % 1000;
+        bench[i].due_ms = t0 + interval;
+        tal_sw_timer_start(bench[i].timer_id, interval, TAL_TIMER_ONCE);
+    }
+    while (s_bench_fired < num && tal_system_get_millisecond() - t0 < 10 * 1000) {
+        tal_system_sleep(10);
+    }
+    t_fire = tal_system_get_millisecond() - t0;
+
+    PR_NOTICE("sw timer x%u start:%ums stop:%ums", num, (uint32_t)t_start, (uint32_t)t_stop);
+    PR_NOTICE("sw timer fired %u/%u in %ums, max late:%ums", s_bench_fired, num, (uint32_t)t_fire,
+              s_bench_late_max);
+    if (s_bench_fired != num) {
+        rt = OPRT_COM_ERROR;
+    }
+
+__exit:
+    for (i = 0; i < created; i++) {
+        tal_sw_timer_delete(bench[i].timer_id);
+    }
+    tal_free(bench);
+
+    return rt;
+}
+#endif
@@ -49,6 +49,10 @@
 #define STACK_SIZE_MSG_QUEUE (4 * 1024)
 #endif
 
+#ifndef WORKQ_POOL_WORKER_NUM
+#define WORKQ_POOL_WORKER_NUM 4
+#endif
+
 static WORKQUEUE_HANDLE wq_system;
 static WORKQUEUE_HANDLE wq_highpri;
 
@@ -73,7 +77,12 @@ OPERATE_RET tal_workq_init(void)
     thread_cfg.stackDepth += 1024;
 #endif
     thread_cfg.thrdname = "wq_system";
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    TUYA_CALL_ERR_GOTO(
+        tal_workqueue_create_pool(MAX_NODE_NUM_WORK_QUEUE, WORKQ_POOL_WORKER_NUM, &thread_cfg, &wq_system), ERR_EXIT);
+#else
     TUYA_CALL_ERR_GOTO(tal_workqueue_create(MAX_NODE_NUM_WORK_QUEUE, &thread_cfg, &wq_system), ERR_EXIT);
+#endif
 
     thread_cfg.priority = THREAD_PRIO_1;
     thread_cfg.stackDepth = STACK_SIZE_MSG_QUEUE;
@@ -151,6 +160,23 @@ OPERATE_RET tal_workq_schedule_instant(WORKQ_SERVICE_E service, WORKQUEUE_CB cb,
     return tal_workqueue_schedule_instant(tal_workq_get_handle(service), cb, data);
 }
 
+/**
+ * @brief put work task in workqueue, works with the same tag run one by one
+ * in order, even when the service has several workers
+ *
+ * @param[in] service the workqueue service
+ * @param[in] tag the affinity tag, 0 means no affinity
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_affinity(WORKQ_SERVICE_E service, uint32_t tag, WORKQUEUE_CB cb, void *data)
+{
+    return tal_workqueue_schedule_affinity(tal_workq_get_handle(service), tag, cb, data);
+}
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -189,9 +215,22 @@ static BOOL_T _dump_cb(WORK_ITEM_T *item, void *ctx)
 
 void tal_workq_dump(WORKQ_SERVICE_E service)
 {
+    WORKQUEUE_STAT_T stat;
+    THREAD_HANDLE threads[16];
+    uint8_t i = 0, num = 0;
+
     PR_NOTICE("---------workq-%d dump begin---------", service);
+    if (OPRT_OK == tal_workqueue_get_stat(tal_workq_get_handle(service), &stat)) {
+        PR_NOTICE("workers:%d depth:%d max:%d exec:%u", stat.worker_num, stat.depth, stat.depth_max, stat.exec_cnt);
+        PR_NOTICE("wait avg:%ums max:%ums, run max:%ums cb:%p", stat.wait_avg_ms, stat.wait_max_ms, stat.run_max_ms,
+                  stat.run_max_cb);
+    }
     tal_workqueue_traverse(tal_workq_get_handle(service), _dump_cb, NULL);
-    tal_thread_diagnose(tal_workqueue_get_thread(tal_workq_get_handle(service)));
+    // every worker of a pooled queue, any of them may be the blocked one
+    num = tal_workqueue_get_threads(tal_workq_get_handle(service), threads, sizeof(threads) / sizeof(threads[0]));
+    for (i = 0; i < num; i++) {
+        tal_thread_diagnose(threads[i]);
+    }
     PR_NOTICE("---------workq-%d dump end---------", service);
 }
 
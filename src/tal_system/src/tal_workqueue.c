@@ -31,6 +31,8 @@
  *
  */
 
+#include <stdio.h>
+
 #include "tuya_queue.h"
 #include "tal_log.h"
 #include "tal_memory.h"
@@ -40,18 +42,163 @@
 #include "tal_workqueue.h"
 #include "tal_sw_timer.h"
 
+#include "tal_mutex.h"
+
+#if defined(ENABLE_WORK_QUEUE_PREALLOC) && (ENABLE_WORK_QUEUE_PREALLOC == 1)
+/*
+ * The work items live in a preallocated lock-free ring. The worker drains the
+ * ring before it sleeps, and marks itself idle so that schedule only posts the
+ * semaphore when the worker is really waiting on it.
+ */
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define WORKQ_IDLE_SET(wq)  __atomic_store_n(&(wq)->idle, 1, __ATOMIC_SEQ_CST)
+#define WORKQ_IDLE_CLR(wq)  __atomic_store_n(&(wq)->idle, 0, __ATOMIC_SEQ_CST)
+#define WORKQ_IDLE_TAKE(wq) __atomic_exchange_n(&(wq)->idle, 0, __ATOMIC_SEQ_CST)
+#else
+#define WORKQ_IDLE_SET(wq)
+#define WORKQ_IDLE_CLR(wq)
+#define WORKQ_IDLE_TAKE(wq) 1
+#endif
+#endif
+
+// depth of the single thread queue without the queue lock, the counter may
+// read one high while a schedule is in progress
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define WORKQ_DEPTH_INC(wq)  __atomic_add_fetch(&(wq)->depth, 1, __ATOMIC_RELAXED)
+#define WORKQ_DEPTH_DEC(wq)  __atomic_sub_fetch(&(wq)->depth, 1, __ATOMIC_RELAXED)
+#define WORKQ_DEPTH_TAKE(wq) __atomic_fetch_sub(&(wq)->depth, 1, __ATOMIC_RELAXED)
+#else
+#define WORKQ_DEPTH_INC(wq)
+#define WORKQ_DEPTH_DEC(wq)
+#define WORKQ_DEPTH_TAKE(wq) (tuya_queue_get_used_num((wq)->queue) + 1)
+#endif
+
+// the wait/run time statistic costs 3 clock reads per work, only for the pool
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+#define WORKQ_STAT_TIME 1
+#else
+#define WORKQ_STAT_TIME 0
+#endif
+
+typedef struct {
+    WORK_ITEM_T work; // keep first, traverse callbacks get a WORK_ITEM_T
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    uint32_t tag;    // affinity tag, 0: any worker
+    uint32_t enq_ms; // time of schedule
+#endif
+} WORKQ_ITEM_T;
+
+typedef struct {
+    uint32_t exec_cnt;
+    uint32_t depth_max;
+    uint32_t wait_max;
+    uint64_t wait_sum;
+    uint32_t run_max;
+    WORKQUEUE_CB run_max_cb;
+} WORKQ_STAT_T;
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+typedef struct {
+    void *workqueue;
+    THREAD_HANDLE thread;
+    MUTEX_HANDLE mutex;
+    SEM_HANDLE sem;
+    WORKQUEUE_CB last_cb;
+    BOOL_T idle;         // waiting on sem, protected by mutex
+    uint16_t head;       // deque of queue_len items, protected by mutex
+    uint16_t num;
+    WORKQ_ITEM_T *items;
+    WORKQ_STAT_T stat;
+    char name[16];
+} WORKQ_WORKER_T;
+#endif
+
 typedef struct {
     TUYA_QUEUE_HANDLE queue;
     THREAD_HANDLE thread;
     SEM_HANDLE sem;
     WORKQUEUE_CB last_cb; // used to debug which cb is blocked
+#if defined(ENABLE_WORK_QUEUE_PREALLOC) && (ENABLE_WORK_QUEUE_PREALLOC == 1)
+    uint32_t idle; // the worker waits on sem
+#endif
+    uint32_t depth; // items scheduled and not yet taken
+    WORKQ_STAT_T stat;
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    uint16_t queue_len;
+    uint8_t worker_num;  // 0: single thread queue
+    WORKQ_WORKER_T *workers;
+#endif
 } TAL_WORKQUEUE_T;
 
+static void __work_run(WORKQ_STAT_T *stat, WORKQUEUE_CB *last_cb, WORKQ_ITEM_T *item, uint32_t depth)
+{
+    if (NULL == item->work.cb) {
+        return; // canceled
+    }
+
+    if (depth > stat->depth_max) {
+        stat->depth_max = depth;
+    }
+
+#if WORKQ_STAT_TIME
+    uint32_t start = (uint32_t)tal_system_get_millisecond();
+    uint32_t wait = start - item->enq_ms;
+
+    stat->wait_sum += wait;
+    if (wait > stat->wait_max) {
+        stat->wait_max = wait;
+    }
+#endif
+
+    *last_cb = item->work.cb;
+    item->work.cb(item->work.data);
+    *last_cb = NULL;
+
+#if WORKQ_STAT_TIME
+    uint32_t run = (uint32_t)tal_system_get_millisecond() - start;
+    if (run > stat->run_max) {
+        stat->run_max = run;
+        stat->run_max_cb = item->work.cb;
+    }
+#endif
+    stat->exec_cnt++;
+}
+
+#if defined(ENABLE_WORK_QUEUE_PREALLOC) && (ENABLE_WORK_QUEUE_PREALLOC == 1)
+static void __work_thread_cb(void *data)
+{
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)data;
+    WORKQ_ITEM_T work_item = {0};
+
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(workqueue->thread)) {
+        if (OPRT_OK != tuya_queue_output(workqueue->queue, &work_item)) {
+            WORKQ_IDLE_SET(workqueue);
+            // check again, schedule may have missed the idle flag
+            if (OPRT_OK != tuya_queue_output(workqueue->queue, &work_item)) {
+                tal_semaphore_wait(workqueue->sem, SEM_WAIT_FOREVER);
+                continue;
+            }
+            WORKQ_IDLE_CLR(workqueue);
+        }
+
+        __work_run(&workqueue->stat, &workqueue->last_cb, &work_item, WORKQ_DEPTH_TAKE(workqueue));
+    }
+}
+
+static OPERATE_RET __work_wakeup(TAL_WORKQUEUE_T *workqueue)
+{
+    if (WORKQ_IDLE_TAKE(workqueue)) {
+        return tal_semaphore_post(workqueue->sem);
+    }
+
+    return OPRT_OK;
+}
+#else
 static void __work_thread_cb(void *data)
 {
     OPERATE_RET op_ret = OPRT_OK;
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)data;
-    WORK_ITEM_T work_item = {0};
+    WORKQ_ITEM_T work_item = {0};
 
     while (THREAD_STATE_RUNNING == tal_thread_get_state(workqueue->thread)) {
         op_ret = tal_semaphore_wait(workqueue->sem, SEM_WAIT_FOREVER);
@@ -66,12 +213,268 @@ static void __work_thread_cb(void *data)
             continue;
         }
 
-        if (work_item.cb) {
-            workqueue->last_cb = work_item.cb;
-            work_item.cb(work_item.data);
-            workqueue->last_cb = NULL;
+        __work_run(&workqueue->stat, &workqueue->last_cb, &work_item, WORKQ_DEPTH_TAKE(workqueue));
+    }
+}
+
+static OPERATE_RET __work_wakeup(TAL_WORKQUEUE_T *workqueue)
+{
+    return tal_semaphore_post(workqueue->sem);
+}
+#endif
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+/*
+ * Work queue with several workers. Every worker owns a deque, schedule puts the
+ * item on a sleeping worker or on the shortest deque. A worker runs its own
+ * deque in order and, when it is empty, steals the oldest untagged item of the
+ * other workers, so one slow callback only blocks the items of its own tag.
+ * Items with an affinity tag always go to worker tag % worker_num and are never
+ * stolen, so works of the same tag still run one by one in order.
+ */
+static BOOL_T __pool_pop(TAL_WORKQUEUE_T *workqueue, WORKQ_WORKER_T *worker, WORKQ_ITEM_T *item, uint32_t *depth)
+{
+    BOOL_T found = FALSE;
+
+    tal_mutex_lock(worker->mutex);
+    if (worker->num > 0) {
+        *item = worker->items[worker->head];
+        *depth = worker->num;
+        worker->head = (worker->head + 1) % workqueue->queue_len;
+        worker->num--;
+        found = TRUE;
+    }
+    tal_mutex_unlock(worker->mutex);
+
+    return found;
+}
+
+static BOOL_T __pool_steal(TAL_WORKQUEUE_T *workqueue, WORKQ_WORKER_T *thief, WORKQ_ITEM_T *item, uint32_t *depth)
+{
+    uint16_t len = workqueue->queue_len;
+    uint8_t i = 0;
+    uint16_t j = 0;
+
+    for (i = 1; i < workqueue->worker_num; i++) {
+        WORKQ_WORKER_T *victim = &workqueue->workers[((thief - workqueue->workers) + i) % workqueue->worker_num];
+
+        tal_mutex_lock(victim->mutex);
+        for (j = 0; j < victim->num; j++) {
+            if (0 == victim->items[(victim->head + j) % len].tag) {
+                break;
+            }
+        }
+        if (j < victim->num) {
+            *item = victim->items[(victim->head + j) % len];
+            *depth = victim->num;
+            // close the gap with the tagged items in front of it
+            for (; j > 0; j--) {
+                victim->items[(victim->head + j) % len] = victim->items[(victim->head + j - 1) % len];
+            }
+            victim->head = (victim->head + 1) % len;
+            victim->num--;
+            tal_mutex_unlock(victim->mutex);
+            return TRUE;
+        }
+        tal_mutex_unlock(victim->mutex);
+    }
+
+    return FALSE;
+}
+
+static void __pool_worker_cb(void *data)
+{
+    WORKQ_WORKER_T *worker = (WORKQ_WORKER_T *)data;
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)worker->workqueue;
+    WORKQ_ITEM_T work_item = {0};
+    uint32_t depth = 0;
+
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(worker->thread)) {
+        if (!__pool_pop(workqueue, worker, &work_item, &depth) &&
+            !__pool_steal(workqueue, worker, &work_item, &depth)) {
+            tal_mutex_lock(worker->mutex);
+            worker->idle = TRUE;
+            tal_mutex_unlock(worker->mutex);
+
+            // check again, a work may be put on a busy worker before idle is seen
+            if (!__pool_pop(workqueue, worker, &work_item, &depth) &&
+                !__pool_steal(workqueue, worker, &work_item, &depth)) {
+                tal_semaphore_wait(worker->sem, SEM_WAIT_FOREVER);
+                continue;
+            }
+
+            tal_mutex_lock(worker->mutex);
+            worker->idle = FALSE;
+            tal_mutex_unlock(worker->mutex);
         }
+
+        __work_run(&worker->stat, &worker->last_cb, &work_item, depth);
+    }
+}
+
+static void __pool_kick(TAL_WORKQUEUE_T *workqueue, WORKQ_WORKER_T *busy)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+        if ((worker == busy) || !worker->idle) {
+            continue;
+        }
+
+        tal_mutex_lock(worker->mutex);
+        if (worker->idle) {
+            worker->idle = FALSE;
+            tal_semaphore_post(worker->sem);
+            tal_mutex_unlock(worker->mutex);
+            return;
+        }
+        tal_mutex_unlock(worker->mutex);
+    }
+}
+
+static OPERATE_RET __pool_push(TAL_WORKQUEUE_T *workqueue, WORKQ_ITEM_T *item, BOOL_T front)
+{
+    WORKQ_WORKER_T *worker = NULL;
+    BOOL_T busy = FALSE;
+    uint8_t i = 0;
+
+    if (item->tag) {
+        worker = &workqueue->workers[item->tag % workqueue->worker_num];
+    } else {
+        // unlocked reads, only a hint, stealing fixes a bad choice
+        worker = &workqueue->workers[0];
+        for (i = 0; i < workqueue->worker_num; i++) {
+            if (workqueue->workers[i].idle) {
+                worker = &workqueue->workers[i];
+                break;
+            }
+            if (workqueue->workers[i].num < worker->num) {
+                worker = &workqueue->workers[i];
+            }
+        }
+    }
+
+    tal_mutex_lock(worker->mutex);
+    if (worker->num >= workqueue->queue_len) {
+        tal_mutex_unlock(worker->mutex);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    if (front) {
+        worker->head = (worker->head + workqueue->queue_len - 1) % workqueue->queue_len;
+        worker->items[worker->head] = *item;
+    } else {
+        worker->items[(worker->head + worker->num) % workqueue->queue_len] = *item;
+    }
+    worker->num++;
+
+    if (worker->idle) {
+        worker->idle = FALSE;
+        tal_semaphore_post(worker->sem);
+    } else {
+        busy = TRUE;
+    }
+    tal_mutex_unlock(worker->mutex);
+
+    // the owner is running a callback, wake a sleeping worker to steal it
+    if (busy && (0 == item->tag)) {
+        __pool_kick(workqueue, worker);
+    }
+
+    return OPRT_OK;
+}
+
+static void __pool_release(TAL_WORKQUEUE_T *workqueue)
+{
+    uint8_t i = 0;
+    uint32_t count = 1;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+        if (worker->thread) {
+            tal_thread_delete(worker->thread);
+            tal_semaphore_post(worker->sem);
+        }
+    }
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+        while (worker->thread && (THREAD_STATE_DELETE != tal_thread_get_state(worker->thread))) {
+            tal_system_sleep(10);
+            if ((count++) % 500 == 0) {
+                PR_NOTICE("%p still running", worker->thread);
+            }
+        }
+
+        if (worker->sem) {
+            tal_semaphore_release(worker->sem);
+        }
+        if (worker->mutex) {
+            tal_mutex_release(worker->mutex);
+        }
+        if (worker->items) {
+            tal_free(worker->items);
+        }
+    }
+
+    tal_free(workqueue->workers);
+    tal_free(workqueue);
+}
+
+static OPERATE_RET __pool_traverse(TAL_WORKQUEUE_T *workqueue, TRAVERSE_CB cb, void *ctx)
+{
+    uint8_t i = 0;
+    uint16_t j = 0;
+    BOOL_T go_on = TRUE;
+
+    for (i = 0; (i < workqueue->worker_num) && go_on; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+
+        tal_mutex_lock(worker->mutex);
+        for (j = 0; (j < worker->num) && go_on; j++) {
+            go_on = cb(&worker->items[(worker->head + j) % workqueue->queue_len].work, ctx);
+        }
+        tal_mutex_unlock(worker->mutex);
+    }
+
+    return OPRT_OK;
+}
+#endif
+
+static OPERATE_RET __work_schedule(WORKQUEUE_HANDLE handle, uint32_t tag, WORKQUEUE_CB cb, void *data, BOOL_T instant)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+
+    if ((NULL == handle) || (NULL == cb)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    WORKQ_ITEM_T work_item = {.work = {.cb = cb, .data = data}};
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    work_item.tag = tag;
+    work_item.enq_ms = (uint32_t)tal_system_get_millisecond();
+    if (workqueue->workers) {
+        return __pool_push(workqueue, &work_item, instant);
+    }
+#endif
+
+    // count first, so the worker never takes an item that is not counted yet
+    WORKQ_DEPTH_INC(workqueue);
+    if (instant) {
+        op_ret = tuya_queue_input_instant(workqueue->queue, &work_item);
+    } else {
+        op_ret = tuya_queue_input(workqueue->queue, &work_item);
     }
+    if (OPRT_OK == op_ret) {
+        op_ret = __work_wakeup(workqueue);
+    } else {
+        WORKQ_DEPTH_DEC(workqueue);
+    }
+
+    return op_ret;
 }
 
 static BOOL_T __work_cancel_traverse(void *item, void *ctx)
@@ -122,7 +525,11 @@ OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_
         return OPRT_MALLOC_FAILED;
     }
 
-    op_ret = tuya_queue_create(queue_len, sizeof(WORK_ITEM_T), &workqueue->queue);
+#if defined(ENABLE_WORK_QUEUE_PREALLOC) && (ENABLE_WORK_QUEUE_PREALLOC == 1)
+    op_ret = tuya_queue_create_prealloc(queue_len, sizeof(WORKQ_ITEM_T), &workqueue->queue);
+#else
+    op_ret = tuya_queue_create(queue_len, sizeof(WORKQ_ITEM_T), &workqueue->queue);
+#endif
     if (OPRT_OK != op_ret) {
         tal_free(workqueue);
         return op_ret;
@@ -148,32 +555,98 @@ OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_
 }
 
 /**
- * @brief put work task in workqueue
+ * @brief create a workqueue served by several threads
  *
- * @param[in] handle the workqueue handle
- * @param[in] cb the work callback
- * @param[in] data the work data
+ * @param[in] queue_len the maximum number of items of each worker
+ * @param[in] worker_num the number of worker threads
+ * @param[in] thread_cfg thread param, the worker index is appended to the name
+ * @param[out] handle the workqueue handle
+ *
+ * @note works may run in parallel and out of order, use
+ * tal_workqueue_schedule_affinity() for works that must run one by one. Without
+ * ENABLE_WORKQ_POOL this is the same as tal_workqueue_create().
  *
  * @return OPRT_OK on success. Others on error, please refer to
  * tuya_error_code.h
  */
-OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
+OPERATE_RET tal_workqueue_create_pool(const uint16_t queue_len, const uint8_t worker_num, THREAD_CFG_T *thread_cfg,
+                                      WORKQUEUE_HANDLE *handle)
 {
-    OPERATE_RET op_ret = OPRT_OK;
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    OPERATE_RET rt = OPRT_OK;
+    TAL_WORKQUEUE_T *workqueue = NULL;
+    THREAD_CFG_T cfg;
+    uint8_t i = 0;
 
-    if ((NULL == handle) || (NULL == cb)) {
+    if ((0 == queue_len) || (0 == worker_num) || (NULL == thread_cfg) || (NULL == handle)) {
         return OPRT_INVALID_PARM;
     }
 
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
-    WORK_ITEM_T work_item = {.cb = cb, .data = data};
+    if (1 == worker_num) {
+        return tal_workqueue_create(queue_len, thread_cfg, handle);
+    }
 
-    op_ret = tuya_queue_input(workqueue->queue, &work_item);
-    if (OPRT_OK == op_ret) {
-        op_ret = tal_semaphore_post(workqueue->sem);
+    workqueue = (TAL_WORKQUEUE_T *)tal_calloc(1, sizeof(TAL_WORKQUEUE_T));
+    if (NULL == workqueue) {
+        return OPRT_MALLOC_FAILED;
     }
 
-    return op_ret;
+    workqueue->workers = (WORKQ_WORKER_T *)tal_calloc(worker_num, sizeof(WORKQ_WORKER_T));
+    if (NULL == workqueue->workers) {
+        tal_free(workqueue);
+        return OPRT_MALLOC_FAILED;
+    }
+    workqueue->queue_len = queue_len;
+    workqueue->worker_num = worker_num;
+
+    for (i = 0; i < worker_num; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+
+        worker->workqueue = workqueue;
+        worker->items = (WORKQ_ITEM_T *)tal_calloc(queue_len, sizeof(WORKQ_ITEM_T));
+        if (NULL == worker->items) {
+            rt = OPRT_MALLOC_FAILED;
+            goto __EXIT;
+        }
+        TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&worker->mutex), __EXIT);
+        TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&worker->sem, 0, queue_len), __EXIT);
+    }
+
+    // start the threads once all workers can be stolen from
+    cfg = *thread_cfg;
+    for (i = 0; i < worker_num; i++) {
+        WORKQ_WORKER_T *worker = &workqueue->workers[i];
+
+        snprintf(worker->name, sizeof(worker->name), "%.12s%d", thread_cfg->thrdname ? thread_cfg->thrdname : "wq", i);
+        cfg.thrdname = worker->name;
+        TUYA_CALL_ERR_GOTO(
+            tal_thread_create_and_start(&worker->thread, NULL, NULL, __pool_worker_cb, worker, &cfg), __EXIT);
+    }
+
+    *handle = workqueue;
+    return OPRT_OK;
+
+__EXIT:
+    __pool_release(workqueue);
+    return rt;
+#else
+    return tal_workqueue_create(queue_len, thread_cfg, handle);
+#endif
+}
+
+/**
+ * @brief put work task in workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
+{
+    return __work_schedule(handle, 0, cb, data, FALSE);
 }
 
 /**
@@ -188,21 +661,24 @@ OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, voi
  */
 OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
 {
-    OPERATE_RET op_ret = OPRT_OK;
-
-    if ((NULL == handle) || (NULL == cb)) {
-        return OPRT_INVALID_PARM;
-    }
-
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
-    WORK_ITEM_T work_item = {.cb = cb, .data = data};
-
-    op_ret = tuya_queue_input_instant(workqueue->queue, &work_item);
-    if (OPRT_OK == op_ret) {
-        op_ret = tal_semaphore_post(workqueue->sem);
-    }
+    return __work_schedule(handle, 0, cb, data, TRUE);
+}
 
-    return op_ret;
+/**
+ * @brief put work task in workqueue, works with the same tag run one by one
+ * in order, even on a workqueue with several workers
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] tag the affinity tag, 0 means no affinity
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_affinity(WORKQUEUE_HANDLE handle, uint32_t tag, WORKQUEUE_CB cb, void *data)
+{
+    return __work_schedule(handle, tag, cb, data, FALSE);
 }
 
 /**
@@ -224,6 +700,12 @@ OPERATE_RET tal_workqueue_cancel(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        return __pool_traverse(workqueue, __work_cancel_traverse, &work_item);
+    }
+#endif
+
     return tuya_queue_traverse(workqueue->queue, __work_cancel_traverse, &work_item);
 }
 
@@ -244,6 +726,13 @@ OPERATE_RET tal_workqueue_traverse(WORKQUEUE_HANDLE handle, WORKQUEUE_TRAVERSE_C
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        return __pool_traverse(workqueue, (TRAVERSE_CB)cb, ctx);
+    }
+#endif
+
     return tuya_queue_traverse(workqueue->queue, (TRAVERSE_CB)cb, ctx);
 }
 
@@ -262,6 +751,20 @@ uint16_t tal_workqueue_get_num(WORKQUEUE_HANDLE handle)
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
 
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        uint16_t num = 0;
+        uint8_t i = 0;
+        for (i = 0; i < workqueue->worker_num; i++) {
+            if (workqueue->workers[i].last_cb) {
+                PR_NOTICE("%p:last_cb %p", workqueue->workers[i].thread, workqueue->workers[i].last_cb);
+            }
+            num += workqueue->workers[i].num;
+        }
+        return num;
+    }
+#endif
+
     if (workqueue->last_cb) {
         PR_NOTICE("%p:last_cb %p", workqueue->thread, workqueue->last_cb);
     }
@@ -287,6 +790,13 @@ OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle)
     uint32_t count = 1;
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
 
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        __pool_release(workqueue);
+        return OPRT_OK;
+    }
+#endif
+
     op_ret = tal_thread_delete(workqueue->thread);
     if (OPRT_OK != op_ret) {
         return op_ret;
@@ -322,9 +832,106 @@ THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle)
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        return workqueue->workers[0].thread;
+    }
+#endif
+
     return workqueue->thread;
 }
 
+/**
+ * @brief get the thread handles of all workers of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[out] threads the thread handles
+ * @param[in] num the size of threads
+ *
+ * @return the number of handles written
+ */
+uint8_t tal_workqueue_get_threads(WORKQUEUE_HANDLE handle, THREAD_HANDLE *threads, uint8_t num)
+{
+    if ((NULL == handle) || (NULL == threads) || (0 == num)) {
+        return 0;
+    }
+
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        uint8_t i = 0;
+        for (i = 0; (i < workqueue->worker_num) && (i < num); i++) {
+            threads[i] = workqueue->workers[i].thread;
+        }
+        return i;
+    }
+#endif
+
+    threads[0] = workqueue->thread;
+    return 1;
+}
+
+static void __work_stat_add(WORKQUEUE_STAT_T *stat, WORKQ_STAT_T *src, uint64_t *wait_sum)
+{
+    stat->exec_cnt += src->exec_cnt;
+    *wait_sum += src->wait_sum;
+    if (src->depth_max > stat->depth_max) {
+        stat->depth_max = src->depth_max;
+    }
+    if (src->wait_max > stat->wait_max_ms) {
+        stat->wait_max_ms = src->wait_max;
+    }
+    if (src->run_max > stat->run_max_ms) {
+        stat->run_max_ms = src->run_max;
+        stat->run_max_cb = src->run_max_cb;
+    }
+}
+
+/**
+ * @brief get the load statistic of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[out] stat the statistic, wait is the time from schedule to the start
+ * of the callback, run is the time spent in the callback
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_get_stat(WORKQUEUE_HANDLE handle, WORKQUEUE_STAT_T *stat)
+{
+    if ((NULL == handle) || (NULL == stat)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    uint64_t wait_sum = 0;
+
+    memset(stat, 0, sizeof(WORKQUEUE_STAT_T));
+    stat->worker_num = 1;
+    stat->depth = tal_workqueue_get_num(handle);
+
+#if defined(ENABLE_WORKQ_POOL) && (ENABLE_WORKQ_POOL == 1)
+    if (workqueue->workers) {
+        uint8_t i = 0;
+        stat->worker_num = workqueue->worker_num;
+        for (i = 0; i < workqueue->worker_num; i++) {
+            __work_stat_add(stat, &workqueue->workers[i].stat, &wait_sum);
+        }
+    } else
+#endif
+    {
+        __work_stat_add(stat, &workqueue->stat, &wait_sum);
+    }
+
+    if (stat->exec_cnt) {
+        stat->wait_avg_ms = (uint32_t)(wait_sum / stat->exec_cnt);
+    }
+
+    return OPRT_OK;
+}
+
 typedef struct {
     TIMER_ID timer;
     WORKQUEUE_CB cb;
@@ -25,10 +25,10 @@
 #include "http_client_interface.h"
 #include "cJSON.h"
 #include "tal_security.h"
-#include "mbedtls/base64.h"
 #include "tal_memory.h"
 #include "cipher_wrapper.h"
 #include "uni_random.h"
+#include "uni_codec.h"
 
 #define MD5SUM_LENGTH               (16)
 #define POST_DATA_PREFIX            (5) // 'data='
@@ -62,9 +62,7 @@ static int atop_url_params_sign(const char *key, url_param_t *params, int param_
     tal_free(buffer);
 
     // make digest hex
-    for (i = 0; i < MD5SUM_LENGTH; i++) {
-        *olen += sprintf((char *)out + i * 2, "%02x", digest[i]);
-    }
+    *olen += uni_hex_encode(digest, MD5SUM_LENGTH, (char *)out, false);
     return rt;
 }
 
@@ -101,7 +99,6 @@ static int atop_request_data_encode(const char *key, const uint8_t *input, int i
 
     int ret = 0;
     int printlen = 0;
-    int i;
 
     /* Encode buffer */
     size_t encrypt_olen = 0;
@@ -112,7 +109,12 @@ static int atop_request_data_encode(const char *key, const uint8_t *input, int i
     }
 
     /* Nonce */
-    uni_random_string((char *)encrypted_buffer, AES_GCM128_NONCE_LEN);
+    ret = uni_random_string((char *)encrypted_buffer, AES_GCM128_NONCE_LEN);
+    if (ret != OPRT_OK) {
+        PR_ERR("uni_random_string:0x%x", -ret);
+        tal_free(encrypted_buffer);
+        return OPRT_COM_ERROR;
+    }
 
     /* AES128-GCM */
     ret = mbedtls_cipher_auth_encrypt_wrapper(&(const cipher_params_t){.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
@@ -133,9 +135,7 @@ static int atop_request_data_encode(const char *key, const uint8_t *input, int i
 
     // output the hex data
     printlen = sprintf((char *)output, "%s", "data=");
-    for (i = 0; i < (int)buflen; i++) {
-        printlen += sprintf((char *)output + printlen, "%02X", (uint8_t)(encrypted_buffer[i]));
-    }
+    printlen += uni_hex_encode(encrypted_buffer, buflen, (char *)output + printlen, true);
 
     tal_free(encrypted_buffer);
     *olen = printlen;
@@ -193,12 +193,16 @@ static int atop_response_data_decode(const char *key, const uint8_t *input, size
     PR_TRACE("base64 encode result:\r\n%.*s", value_length, value);
 
     // base64 decode buffer
-    size_t b64buffer_len = value_length * 3 / 4;
+    size_t b64buffer_len = UNI_BASE64_DECODE_LEN(value_length);
     uint8_t *b64buffer = tal_malloc(b64buffer_len);
     size_t b64buffer_olen = 0;
+    if (NULL == b64buffer) {
+        cJSON_Delete(root);
+        return OPRT_MALLOC_FAILED;
+    }
 
     // base64 decode
-    rt = mbedtls_base64_decode(b64buffer, b64buffer_len, &b64buffer_olen, (const uint8_t *)value, value_length);
+    rt = uni_base64_decode(value, value_length, b64buffer, b64buffer_len, &b64buffer_olen);
     if (rt != OPRT_OK) {
         PR_ERR("base64 decode error:%d", rt);
         tal_free(b64buffer);
@@ -406,7 +410,8 @@ int atop_base_request(const atop_base_request_t *request, atop_base_response_t *
                                                                      .headers_count = headers_count,
                                                                      .body = body_buffer,
                                                                      .body_length = body_length,
-                                                                     .timeout_ms = HTTP_TIMEOUT_MS_DEFAULT},
+                                                                     .timeout_ms = HTTP_TIMEOUT_MS_DEFAULT,
+                                                                     .keep_alive = true},
                                       &http_response);
 
     /* Release http buffer */
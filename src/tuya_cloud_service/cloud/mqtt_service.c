@@ -32,10 +32,12 @@
 #include "mqtt_service.h"
 #include "tal_security.h"
 #include "crc32i.h"
+#include "uni_codec.h"
 #include "tal_api.h"
 #include "tuya_protocol.h"
 
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata);
+static void __publish_inflight_requeue(tuya_mqtt_context_t *context);
 
 typedef struct {
     uint32_t sequence;
@@ -52,7 +54,6 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
     }
 
     // clear
-    int i;
     uint8_t digest[16] = {0};
     memset(signout, 0, sizeof(tuya_mqtt_access_t));
 
@@ -62,9 +63,7 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
         sprintf(signout->clientid, "%s", input->devid);
         sprintf(signout->username, "%s", input->devid);
         tal_md5_ret((const uint8_t *)input->seckey, strlen(input->seckey), digest);
-        for (i = 0; i < 8; ++i) {
-            sprintf(&signout->password[i * 2], "%02x", (unsigned char)digest[i + 4]);
-        }
+        uni_hex_encode(digest + 4, 8, signout->password, false);
 
         // IO topic
         sprintf(signout->topic_in, "smart/device/in/%s", input->devid);
@@ -76,9 +75,7 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
         sprintf(signout->clientid, "acon_%s", input->uuid);
         sprintf(signout->username, "acon_%s|pv=%s", input->uuid, TUYA_PV23);
         tal_md5_ret((const uint8_t *)input->authkey, strlen(input->authkey), digest);
-        for (i = 0; i < 8; ++i) {
-            sprintf(&signout->password[i * 2], "%02x", (unsigned char)digest[i + 4]);
-        }
+        uni_hex_encode(digest + 4, 8, signout->password, false);
 
         // IO topic
         sprintf(signout->topic_in, "d/ai/%s", input->uuid);
@@ -309,6 +306,11 @@ static void mqtt_client_disconnected_cb(void *client, void *userdata)
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
     PR_INFO("mqtt client disconnected!");
     context->is_connected = false;
+
+    /* resend whatever was in flight once the connection is back */
+    tal_mutex_lock(context->publish_mutex);
+    __publish_inflight_requeue(context);
+    tal_mutex_unlock(context->publish_mutex);
     if (context->on_disconnect) {
         context->on_disconnect(context, context->user_data);
     }
@@ -331,26 +333,227 @@ static void mqtt_client_subscribed_cb(void *client, uint16_t msgid, void *userda
     PR_DEBUG("Subscribe successed ID:%d", msgid);
 }
 
-static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
+/*
+ * Acknowledged publish bookkeeping.
+ *
+ * Every handle sits in publish_heap, ordered by timeout, so expiry only looks
+ * at the top. A handle with msgid 0 has not been sent yet and waits in the
+ * publish_list FIFO; once sent it moves to the publish_inflight table, where
+ * the PUBACK finds it by msgid. At most MQTT_PUBLISH_INFLIGHT_NUM handles are
+ * in flight, which also bounds the coreMQTT state records in use. A handle
+ * that times out in flight is completed, but its msgid stays in publish_stale
+ * and keeps its slot until the PUBACK comes or the session is reset, as
+ * coreMQTT keeps the record that long.
+ *
+ * All of it is guarded by publish_mutex. Completion callbacks run after the
+ * lock is released, so they may publish again.
+ */
+#define PUBLISH_TIME_BEFORE(a, b)    ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+#define PUBLISH_INFLIGHT_SLOT(msgid) ((msgid) % MQTT_PUBLISH_INFLIGHT_NUM)
+
+static void __publish_heap_up(tuya_mqtt_context_t *context, uint16_t idx)
 {
-    client = client;
-    tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
-    PR_DEBUG("PUBACK ID:%d", msgid);
+    mqtt_publish_handle_t **heap = context->publish_heap;
+    mqtt_publish_handle_t *entry = heap[idx];
 
-    /* LOCK */
-    /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
+    while (idx > 0) {
+        uint16_t parent = (idx - 1) / 2;
+        if (!PUBLISH_TIME_BEFORE(entry->timeout, heap[parent]->timeout)) {
+            break;
+        }
+        heap[idx] = heap[parent];
+        heap[idx]->heap_idx = idx;
+        idx = parent;
+    }
+    heap[idx] = entry;
+    entry->heap_idx = idx;
+}
+
+static void __publish_heap_down(tuya_mqtt_context_t *context, uint16_t idx)
+{
+    mqtt_publish_handle_t **heap = context->publish_heap;
+    mqtt_publish_handle_t *entry = heap[idx];
+
+    for (;;) {
+        uint16_t child = 2 * idx + 1;
+        if (child >= context->publish_num) {
+            break;
+        }
+        if (child + 1 < context->publish_num && PUBLISH_TIME_BEFORE(heap[child + 1]->timeout, heap[child]->timeout)) {
+            child++;
+        }
+        if (!PUBLISH_TIME_BEFORE(heap[child]->timeout, entry->timeout)) {
+            break;
+        }
+        heap[idx] = heap[child];
+        heap[idx]->heap_idx = idx;
+        idx = child;
+    }
+    heap[idx] = entry;
+    entry->heap_idx = idx;
+}
+
+static void __publish_heap_remove(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    uint16_t idx = handle->heap_idx;
+    mqtt_publish_handle_t *last = context->publish_heap[--context->publish_num];
+
+    if (last == handle) {
+        return;
+    }
+
+    context->publish_heap[idx] = last;
+    last->heap_idx = idx;
+    __publish_heap_up(context, idx);
+    __publish_heap_down(context, last->heap_idx);
+}
+
+static mqtt_publish_handle_t *__publish_inflight_take(tuya_mqtt_context_t *context, uint16_t msgid)
+{
+    mqtt_publish_handle_t **next_handle = &context->publish_inflight[PUBLISH_INFLIGHT_SLOT(msgid)];
     for (; *next_handle; next_handle = &(*next_handle)->next) {
         mqtt_publish_handle_t *entry = *next_handle;
         if (msgid == entry->msgid) {
-            entry->cb(OPRT_OK, entry->user_data);
             *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
+            context->inflight_num--;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Completes a handle that timed out in flight, its slot stays taken */
+static void __publish_inflight_expire(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    if (__publish_inflight_take(context, handle->msgid)) {
+        context->publish_stale[context->stale_num++] = handle->msgid;
+        context->inflight_num++;
+    }
+}
+
+/* Frees the slot of a stale msgid once its PUBACK arrives late */
+static void __publish_stale_take(tuya_mqtt_context_t *context, uint16_t msgid)
+{
+    uint16_t i;
+    for (i = 0; i < context->stale_num; i++) {
+        if (context->publish_stale[i] == msgid) {
+            context->publish_stale[i] = context->publish_stale[--context->stale_num];
+            context->inflight_num--;
+            return;
+        }
+    }
+}
+
+/* Unlinks a handle that timed out before it was sent, usually the oldest one */
+static void __publish_pending_remove(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    mqtt_publish_handle_t *prev = NULL;
+    mqtt_publish_handle_t **next_handle = &context->publish_list;
+    for (; *next_handle; prev = *next_handle, next_handle = &(*next_handle)->next) {
+        if (*next_handle == handle) {
+            *next_handle = handle->next;
+            if (context->publish_tail == handle) {
+                context->publish_tail = prev;
+            }
+            return;
+        }
+    }
+}
+
+/* Sends a handle and moves it in flight, false if the window is full or the send failed */
+static bool __publish_send(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    if (context->inflight_num >= MQTT_PUBLISH_INFLIGHT_NUM) {
+        return false;
+    }
+
+    handle->msgid =
+        mqtt_client_publish(context->mqtt_client, handle->topic, handle->payload, handle->payload_length, MQTT_QOS_1);
+    if (handle->msgid == 0) {
+        return false;
+    }
+
+    uint16_t slot = PUBLISH_INFLIGHT_SLOT(handle->msgid);
+    handle->next = context->publish_inflight[slot];
+    context->publish_inflight[slot] = handle;
+    context->inflight_num++;
+    return true;
+}
+
+/*
+ * Puts the in-flight handles back at the head of the FIFO in send order. The
+ * session is clean, so their PUBACKs will never come after a reconnect.
+ */
+static void __publish_inflight_requeue(tuya_mqtt_context_t *context)
+{
+    mqtt_publish_handle_t *requeue = NULL;
+    uint16_t i;
+
+    for (i = 0; i < MQTT_PUBLISH_INFLIGHT_NUM; i++) {
+        mqtt_publish_handle_t *entry = context->publish_inflight[i];
+        context->publish_inflight[i] = NULL;
+        while (entry) {
+            mqtt_publish_handle_t *next = entry->next;
+            /* insert sorted on msgid, which grows (and wraps) in send order */
+            mqtt_publish_handle_t **pos = &requeue;
+            while (*pos && (int16_t)((*pos)->msgid - entry->msgid) < 0) {
+                pos = &(*pos)->next;
+            }
+            entry->next = *pos;
+            *pos = entry;
+            entry = next;
+        }
+    }
+    /* the new session starts without coreMQTT records */
+    context->inflight_num = 0;
+    context->stale_num = 0;
+
+    if (requeue == NULL) {
+        return;
+    }
+
+    mqtt_publish_handle_t *last = requeue;
+    for (;;) {
+        last->msgid = 0;
+        if (last->next == NULL) {
             break;
         }
+        last = last->next;
+    }
+    last->next = context->publish_list;
+    context->publish_list = requeue;
+    if (context->publish_tail == NULL) {
+        context->publish_tail = last;
+    }
+}
+
+/* Called without publish_mutex, the handle must already be out of the heap */
+static void __publish_notify(mqtt_publish_handle_t *handle, int result)
+{
+    handle->cb(result, handle->user_data);
+    tal_free(handle->payload);
+    tal_free(handle);
+}
+
+static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
+{
+    client = client;
+    tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
+    PR_DEBUG("PUBACK ID:%d", msgid);
+
+    /* publish async process */
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *entry = __publish_inflight_take(context, msgid);
+    if (entry) {
+        __publish_heap_remove(context, entry);
+    } else {
+        __publish_stale_take(context, msgid);
+    }
+    tal_mutex_unlock(context->publish_mutex);
+
+    if (entry) {
+        __publish_notify(entry, OPRT_OK);
     }
-    /* UNLOCK */
 }
 
 /**
@@ -392,6 +595,32 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
         return rt;
     }
 
+    /* Publish tracking, in-flight table followed by the timeout heap and the stale msgids */
+    context->publish_inflight =
+        tal_calloc(1, (MQTT_PUBLISH_INFLIGHT_NUM + MQTT_PUBLISH_QUEUE_MAX) * sizeof(mqtt_publish_handle_t *) +
+                          MQTT_PUBLISH_INFLIGHT_NUM * sizeof(uint16_t));
+    if (context->publish_inflight == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    context->publish_heap = context->publish_inflight + MQTT_PUBLISH_INFLIGHT_NUM;
+    context->publish_stale = (uint16_t *)(context->publish_heap + MQTT_PUBLISH_QUEUE_MAX);
+
+    rt = tal_mutex_create_init(&context->publish_mutex);
+    if (OPRT_OK != rt) {
+        tal_free(context->publish_inflight);
+        context->publish_inflight = NULL;
+        return rt;
+    }
+
+    rt = tal_semaphore_create_init(&context->wakeup, 0, 1);
+    if (OPRT_OK != rt) {
+        tal_mutex_release(context->publish_mutex);
+        context->publish_mutex = NULL;
+        tal_free(context->publish_inflight);
+        context->publish_inflight = NULL;
+        return rt;
+    }
+
     /* MQTT Client object new */
     context->mqtt_client = mqtt_client_new();
     if (context->mqtt_client == NULL) {
@@ -479,7 +708,7 @@ int tuya_mqtt_start(tuya_mqtt_context_t *context)
             PR_WARN("Connection to the MQTT server failed. Retrying "
                     "connection after %hu ms backoff.",
                     (unsigned short)nextRetryBackOff);
-            tal_system_sleep(nextRetryBackOff + 10000);
+            tal_semaphore_wait(context->wakeup, nextRetryBackOff + 10000);
         }
         return OPRT_COM_ERROR;
     }
@@ -623,6 +852,65 @@ int tuya_mqtt_protocol_unregister_all(tuya_mqtt_context_t *context)
     return OPRT_OK;
 }
 
+/**
+ * Queues an acknowledged publish whose payload is already heap allocated.
+ *
+ * The publish handle takes ownership of payload, which is released with the
+ * handle once the publish completes or times out, or right away on failure.
+ */
+static int __mqtt_client_publish_owned(tuya_mqtt_context_t *context, const char *topic, uint8_t *payload,
+                                       size_t payload_length, mqtt_publish_notify_cb_t cb, void *user_data,
+                                       int timeout_ms, bool async)
+{
+    if (context->publish_heap == NULL) {
+        tal_free(payload);
+        return OPRT_COM_ERROR;
+    }
+
+    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t));
+    if (handle == NULL) {
+        tal_free(payload);
+        return OPRT_MALLOC_FAILED;
+    }
+    handle->next = NULL;
+    handle->msgid = 0;
+    handle->topic = (char *)topic;
+    handle->timeout = (uint32_t)tal_system_get_millisecond() + timeout_ms;
+    handle->cb = cb;
+    handle->user_data = user_data;
+    handle->payload_length = payload_length;
+    handle->payload = payload;
+
+    tal_mutex_lock(context->publish_mutex);
+    if (context->publish_num >= MQTT_PUBLISH_QUEUE_MAX) {
+        tal_mutex_unlock(context->publish_mutex);
+        PR_WARN("mqtt publish queue full:%d", MQTT_PUBLISH_QUEUE_MAX);
+        tal_free(payload);
+        tal_free(handle);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    context->publish_heap[context->publish_num] = handle;
+    __publish_heap_up(context, context->publish_num++);
+
+    /* Keep the order, only send right away when nothing is waiting */
+    if (async == false && context->is_connected && context->publish_list == NULL &&
+        __publish_send(context, handle)) {
+        tal_mutex_unlock(context->publish_mutex);
+        return OPRT_OK;
+    }
+
+    if (context->publish_tail) {
+        context->publish_tail->next = handle;
+    } else {
+        context->publish_list = handle;
+    }
+    context->publish_tail = handle;
+    tal_mutex_unlock(context->publish_mutex);
+
+    return OPRT_OK;
+}
+
 /**
  * Publishes a message to an MQTT topic using the Tuya MQTT client.
  *
@@ -654,38 +942,11 @@ int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *to
         return OPRT_OK;
     }
 
-    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t));
-    TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
-    handle->next = NULL;
-    handle->msgid = 0;
-    handle->topic = (char *)topic;
-    handle->timeout = tal_time_get_posix() + timeout_ms;
-    handle->cb = cb;
-    handle->user_data = user_data;
-    handle->payload_length = payload_length;
-    handle->payload = tal_malloc(payload_length);
-    if (handle->payload == NULL) {
-        return OPRT_MALLOC_FAILED;
-    }
-    memcpy(handle->payload, payload, payload_length);
-
-    if (async == false) {
-        handle->msgid = mqtt_client_publish(context->mqtt_client, handle->topic, handle->payload,
-                                            handle->payload_length, MQTT_QOS_1);
-    }
-
-    if (context->publish_list == NULL) {
-        context->publish_list = handle;
-        return OPRT_OK;
-    }
-
-    mqtt_publish_handle_t *last = context->publish_list;
-    while (last->next != NULL) {
-        last = last->next;
-    }
-    last->next = handle;
+    uint8_t *copy = tal_malloc(payload_length);
+    TUYA_CHECK_NULL_RETURN(copy, OPRT_MALLOC_FAILED);
+    memcpy(copy, payload, payload_length);
 
-    return OPRT_OK;
+    return __mqtt_client_publish_owned(context, topic, copy, payload_length, cb, user_data, timeout_ms, async);
 }
 
 /**
@@ -730,7 +991,12 @@ int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *conte
         return ret;
     }
 
-    /* mqtt client publish */
+    /* mqtt client publish, acknowledged publishes keep the packed buffer */
+    if (cb != NULL && topic != NULL) {
+        return __mqtt_client_publish_owned(context, (const char *)topic, (uint8_t *)buffer, buffer_len, cb, user_data,
+                                           timeout_ms, async);
+    }
+
     ret = tuya_mqtt_client_publish_common(context, (const char *)topic, (const uint8_t *)buffer, buffer_len, cb,
                                           user_data, timeout_ms, async);
     tal_free(buffer);
@@ -805,6 +1071,21 @@ int tuya_mqtt_protocol_data_publish(tuya_mqtt_context_t *context, uint16_t proto
     return tuya_mqtt_protocol_data_publish_with_topic(context, context->signature.topic_out, protocol_id, data, length);
 }
 
+/**
+ * @brief Ends a reconnect back-off of the MQTT service early.
+ *
+ * @param context Pointer to the MQTT context.
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int tuya_mqtt_wakeup(tuya_mqtt_context_t *context)
+{
+    if (context == NULL || context->wakeup == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    return tal_semaphore_post(context->wakeup);
+}
+
 /**
  * @brief Executes the MQTT event loop for the Tuya MQTT service.
  *
@@ -844,33 +1125,56 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
                 PR_WARN("Connection to the MQTT server failed. Retrying "
                         "connection after %hu ms backoff.",
                         (unsigned short)nextRetryBackOff);
-                tal_system_sleep(nextRetryBackOff);
+                tal_semaphore_wait(context->wakeup, nextRetryBackOff);
                 return rt;
             }
         }
         return rt;
     }
 
-    /* LOCK */
-    /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
-    for (; *next_handle; next_handle = &(*next_handle)->next) {
-        mqtt_publish_handle_t *entry = *next_handle;
-
-        if (entry->timeout <= tal_time_get_posix()) {
-            entry->cb(OPRT_TIMEOUT, entry->user_data);
-            *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
-            continue;
+    /* publish timeout, oldest deadline first, notified once unlocked */
+    mqtt_publish_handle_t *expired = NULL;
+    uint32_t now = (uint32_t)tal_system_get_millisecond();
+    tal_mutex_lock(context->publish_mutex);
+    while (context->publish_num > 0 && !PUBLISH_TIME_BEFORE(now, context->publish_heap[0]->timeout)) {
+        mqtt_publish_handle_t *entry = context->publish_heap[0];
+        if (entry->msgid == 0) {
+            __publish_pending_remove(context, entry);
+        } else {
+            __publish_inflight_expire(context, entry);
         }
+        __publish_heap_remove(context, entry);
+        entry->next = expired;
+        expired = entry;
+    }
 
-        if (entry->msgid <= 0) {
-            entry->msgid =
-                mqtt_client_publish(context->mqtt_client, entry->topic, entry->payload, entry->payload_length, 1);
+    /* publish async process, fill the in-flight window */
+    while (context->publish_list) {
+        mqtt_publish_handle_t *entry = context->publish_list;
+        mqtt_publish_handle_t *next = entry->next;
+        if (!__publish_send(context, entry)) {
+            break;
+        }
+        context->publish_list = next;
+        if (next == NULL) {
+            context->publish_tail = NULL;
         }
     }
-    /* UNLOCK */
+    /* every slot waits for a PUBACK that is not coming, start a new session */
+    bool stalled = context->stale_num >= MQTT_PUBLISH_INFLIGHT_NUM;
+    tal_mutex_unlock(context->publish_mutex);
+
+    while (expired) {
+        mqtt_publish_handle_t *next = expired->next;
+        __publish_notify(expired, OPRT_TIMEOUT);
+        expired = next;
+    }
+
+    if (stalled) {
+        PR_WARN("mqtt publish window stalled, %d PUBACK lost, reconnect", MQTT_PUBLISH_INFLIGHT_NUM);
+        mqtt_client_disconnect(context->mqtt_client);
+        return rt;
+    }
 
     /* yield */
     mqtt_client_yield(context->mqtt_client);
@@ -894,6 +1198,30 @@ int tuya_mqtt_destory(tuya_mqtt_context_t *context)
     }
 
     tuya_mqtt_protocol_unregister_all(context);
+
+    /* Drop publishes that never completed */
+    tal_mutex_lock(context->publish_mutex);
+    while (context->publish_num > 0) {
+        mqtt_publish_handle_t *entry = context->publish_heap[--context->publish_num];
+        tal_free(entry->payload);
+        tal_free(entry);
+    }
+    tal_free(context->publish_inflight);
+    context->publish_inflight = NULL;
+    context->publish_heap = NULL;
+    context->publish_stale = NULL;
+    context->stale_num = 0;
+    tal_mutex_unlock(context->publish_mutex);
+    tal_mutex_release(context->publish_mutex);
+    context->publish_mutex = NULL;
+    if (context->wakeup) {
+        tal_semaphore_release(context->wakeup);
+        context->wakeup = NULL;
+    }
+    context->publish_list = NULL;
+    context->publish_tail = NULL;
+    context->inflight_num = 0;
+
     if (context->mqtt_client) {
         mqtt_client_status_t mqtt_status = mqtt_client_deinit(context->mqtt_client);
         mqtt_client_free(context->mqtt_client);
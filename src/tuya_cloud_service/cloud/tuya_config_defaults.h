@@ -97,4 +97,19 @@
 #define MATOP_TIMEOUT_MS_DEFAULT (8000U)
 #endif
 
+/**
+ * @brief Acknowledged publishes sent and waiting for PUBACK at a time.
+ */
+#ifndef MQTT_PUBLISH_INFLIGHT_NUM
+#define MQTT_PUBLISH_INFLIGHT_NUM (10U)
+#endif
+
+/**
+ * @brief Acknowledged publishes queued or in flight, further publishes
+ * fail with OPRT_EXCEED_UPPER_LIMIT until some complete.
+ */
+#ifndef MQTT_PUBLISH_QUEUE_MAX
+#define MQTT_PUBLISH_QUEUE_MAX (32U)
+#endif
+
 #endif /* ifndef TUYA_CONFIG_DEFAULTS_H_ */
@@ -23,6 +23,9 @@
 #include "tal_api.h"
 
 #include "tal_kv.h"
+#include "http_client_interface.h"
+#include "tuya_tls.h"
+#include "cipher_wrapper.h"
 
 extern int iotdns_cloud_endpoint_get(const char *region, const char *env, tuya_endpoint_t *endpoint);
 
@@ -41,17 +44,26 @@ static int tuya_region_regist_key_write(const char *region, const char *regist_k
         return OPRT_INVALID_PARM;
     }
 
-    /* Write kv storage */
+    /* Write kv storage in one commit */
     int ret = 0;
+    tal_kv_txn_begin();
     ret = tal_kv_set("region", (const uint8_t *)region, strlen(region));
     if (ret != OPRT_OK) {
         PR_ERR("tal_kv_set region, error:0x%02x", ret);
+        tal_kv_txn_commit();
         return OPRT_KVS_WR_FAIL;
     }
 
     ret = tal_kv_set("regist_key", (const uint8_t *)regist_key, strlen(regist_key));
     if (ret != OPRT_OK) {
         PR_ERR("tal_kv_set regist_key, error:0x%02x", ret);
+        tal_kv_txn_commit();
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    ret = tal_kv_txn_commit();
+    if (ret != OPRT_OK) {
+        PR_ERR("tal_kv_txn_commit, error:0x%02x", ret);
         return OPRT_KVS_WR_FAIL;
     }
 
@@ -245,10 +257,17 @@ int tuya_endpoint_region_regist_set(const char *region, const char *regist_key)
  */
 int tuya_endpoint_remove(void)
 {
+    tal_kv_txn_begin();
     tal_kv_del("region");
     tal_kv_del("regist_key");
     tal_kv_del("endpoint.cert");
     tal_kv_del("endpoint.domain");
+    tal_kv_txn_commit();
+
+    http_client_keepalive_flush();
+    tuya_tls_session_cache_clear();
+    tuya_tls_profile_cache_clear();
+    cipher_aead_cache_clear(NULL, 0);
 
     return OPRT_OK;
 }
@@ -293,6 +312,9 @@ int tuya_endpoint_update(void)
 {
     int ret;
 
+    /* Pooled ATOP connections were set up against the old host and cert */
+    http_client_keepalive_flush();
+
     /* If iotdns has already been called,
      * the allocated certificate memory needs to be released. */
     if (endpoint_mgr.endpoint.cert != NULL) {
@@ -319,6 +341,9 @@ int tuya_endpoint_update_auto_region(void)
 {
     int ret;
 
+    /* Pooled ATOP connections were set up against the old host and cert */
+    http_client_keepalive_flush();
+
     /* If iotdns has already been called,
      * the allocated certificate memory needs to be released. */
     if (endpoint_mgr.endpoint.cert != NULL) {
@@ -27,6 +27,7 @@
 #include "tuya_iot_dp.h"
 #include "tuya_register_center.h"
 #include "tuya_tls.h"
+#include "http_client_interface.h"
 #include "netmgr.h"
 #include "tuya_health.h"
 typedef enum {
@@ -180,10 +181,12 @@ static int activate_response_parse(atop_base_response_t *response)
     // cJSON object to string save
     char *schemaId = cJSON_GetObjectItem(result_root, "schemaId")->valuestring;
     cJSON *schema_obj = cJSON_DetachItemFromObject(result_root, "schema");
+    tal_kv_txn_begin();
     ret = tal_kv_set(schemaId, (const uint8_t *)schema_obj->valuestring, strlen(schema_obj->valuestring));
     cJSON_Delete(schema_obj);
     if (ret != OPRT_OK) {
         PR_ERR("activate data save error:%d", ret);
+        tal_kv_txn_commit();
         return OPRT_KVS_WR_FAIL;
     }
 
@@ -193,6 +196,7 @@ static int activate_response_parse(atop_base_response_t *response)
     PR_DEBUG("result len %d :%s", (int)strlen(result_string), result_string);
     ret = tal_kv_set(activate_data_key, (const uint8_t *)result_string, strlen(result_string));
     tal_free(result_string);
+    ret |= tal_kv_txn_commit();
     if (ret != OPRT_OK) {
         PR_ERR("activate data save error:%d", ret);
         return OPRT_KVS_WR_FAIL;
@@ -531,6 +535,23 @@ static int run_state_reset(tuya_iot_client_t *client)
     return tuya_iot_activated_data_remove(client);
 }
 
+/* Waits for tuya_iot_wakeup, at most timeout_ms */
+static void iot_wait(tuya_iot_client_t *client, uint32_t timeout_ms)
+{
+    tal_semaphore_wait(client->wakeup, timeout_ms);
+}
+
+static int tuya_iot_link_status_evt(void *data)
+{
+    tuya_iot_client_t *client = tuya_iot_client_get();
+
+    if (client) {
+        tuya_iot_wakeup(client);
+    }
+
+    return OPRT_OK;
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                Tuya IoT API                                */
 /* -------------------------------------------------------------------------- */
@@ -572,6 +593,8 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     PR_DEBUG("authkey:%s", client->config.authkey);
 
     tal_semaphore_create_init(&client->token_get.sem, 0, 1);
+    tal_semaphore_create_init(&client->wakeup, 0, 1);
+    tal_event_subscribe(EVENT_LINK_STATUS_CHG, "iot", tuya_iot_link_status_evt, SUBSCRIBE_TYPE_NORMAL);
 
     /* Default storage namespace */
     if (client->config.storage_namespace == NULL) {
@@ -579,6 +602,7 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     }
     /* Software timer Init */
     tuya_tls_init();
+    http_client_init();
     tuya_register_center_init();
     /* Load Tuya cloud endpoint config */
     tuya_endpoint_init();
@@ -600,6 +624,11 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
 
     tuya_health_monitor_init();
 
+    ret = tuya_iot_dp_init(client);
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+
     /* Auto check upgrade timer init */
     ret = tal_sw_timer_create(check_auto_upgrade_timeout_on, client, &client->check_upgrade_timer);
     if (OPRT_OK != ret) {
@@ -629,6 +658,7 @@ int tuya_iot_start(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_START;
+    tuya_iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -643,6 +673,7 @@ int tuya_iot_start(tuya_iot_client_t *client)
 int tuya_iot_stop(tuya_iot_client_t *client)
 {
     client->nextstate = STATE_STOP;
+    tuya_iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -663,6 +694,7 @@ int tuya_iot_reconnect(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_MQTT_RECONNECT;
+    tuya_iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -702,6 +734,7 @@ int tuya_iot_reset(tuya_iot_client_t *client)
         client->token_get.result = OPRT_COM_ERROR;
         tal_semaphore_post(client->token_get.sem);
     }
+    tuya_iot_wakeup(client);
 
     return ret;
 }
@@ -753,6 +786,26 @@ int tuya_iot_token_get_pending(tuya_iot_client_t *client)
     return client->token_get.result;
 }
 
+/**
+ * @brief Wakes up tuya_iot_yield when it waits for the network or a retry.
+ *
+ * @param client Pointer to the Tuya IoT client structure.
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int tuya_iot_wakeup(tuya_iot_client_t *client)
+{
+    if (client == NULL || client->wakeup == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    /* MQTT reconnect back-off */
+    if (client->mqctx.is_inited) {
+        tuya_mqtt_wakeup(&client->mqctx);
+    }
+
+    return tal_semaphore_post(client->wakeup);
+}
+
 /**
  * @brief Yields control to the Tuya IoT client for processing incoming messages
  * and events.
@@ -781,7 +834,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
         break;
 
     case STATE_IDLE:
-        tal_system_sleep(500);
+        iot_wait(client, SEM_WAIT_FOREVER);
         break;
 
     case STATE_START:
@@ -848,7 +901,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
             client->status = TUYA_STATUS_WIFI_CONNECTED;
             client->nextstate = client->is_activated ? STATE_ENDPOINT_GET : STATE_ENDPOINT_UPDATE;
         } else {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
         }
         break;
 
@@ -866,12 +919,14 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_ENDPOINT_UPDATE:
         ret = tuya_endpoint_update();
         if (ret != OPRT_OK) {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
             break;
         }
         if (client->is_activated) {
+            tal_kv_txn_begin();
             ret = tuya_endpoint_cert_set((tuya_endpoint_t *)tuya_endpoint_get());
             ret |= tuya_endpoint_domain_set((tuya_endpoint_t *)tuya_endpoint_get());
+            ret |= tal_kv_txn_commit();
             if (OPRT_OK != ret) {
                 PR_WARN("tuya endpoint set error %d; need restart update", ret);
             }
@@ -884,7 +939,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_ACTIVATING:
         ret = client_activate_process(client, client->binding->token);
         if (ret != OPRT_OK) {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
             break;
         }
 
@@ -900,8 +955,10 @@ int tuya_iot_yield(tuya_iot_client_t *client)
             client->nextstate = STATE_RESET;
             break;
         }
+        tal_kv_txn_begin();
         ret = tuya_endpoint_cert_set((tuya_endpoint_t *)tuya_endpoint_get());
         ret |= tuya_endpoint_domain_set((tuya_endpoint_t *)tuya_endpoint_get());
+        ret |= tal_kv_txn_commit();
         if (OPRT_OK != ret) {
             PR_WARN("tuya endpoint set error %d; need restart update", ret);
         }
@@ -956,7 +1013,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
             client->status = TUYA_STATUS_WIFI_CONNECTED;
             client->nextstate = STATE_MQTT_CONNECT_START;
         } else {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
         }
         break;
 
@@ -1018,9 +1075,11 @@ int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
 
     /* Clean client local data */
     dp_schema_delete(client->activate.devid);
+    tal_kv_txn_begin();
     tal_kv_del((const char *)(client->activate.schemaId));
     tal_kv_del((const char *)(client->config.storage_namespace));
     tuya_endpoint_remove();
+    tal_kv_txn_commit();
     client->is_activated = false;
     PR_INFO("Activated data remove successed");
 
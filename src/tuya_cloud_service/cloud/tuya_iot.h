@@ -223,6 +223,7 @@ struct tuya_iot_client_handle {
     matop_context_t matop;
     tuya_event_msg_t event;
     tuya_token_get_t token_get;
+    SEM_HANDLE wakeup;
     tuya_binding_info_t *binding;
     TIMER_ID check_upgrade_timer;
     uint8_t status;
@@ -293,11 +294,25 @@ int tuya_iot_destroy(tuya_iot_client_t *client);
 /**
  * @brief Loop called to yield the current thread to the underlying Tuya client.
  *
+ * Blocks while there is nothing to do: on the MQTT socket once connected, or
+ * until tuya_iot_wakeup, a link status change or a retry timeout otherwise.
+ *
  * @param client - The Tuya client context.
  * @return int - OPRT_OK successful or error code.
  */
 int tuya_iot_yield(tuya_iot_client_t *client);
 
+/**
+ * @brief Wake up a tuya_iot_yield waiting for the network or a retry.
+ *
+ * tuya_iot_start, tuya_iot_stop, tuya_iot_reset, tuya_iot_reconnect and link
+ * status changes already do this.
+ *
+ * @param client - The Tuya client context.
+ * @return int - OPRT_OK successful or error code.
+ */
+int tuya_iot_wakeup(tuya_iot_client_t *client);
+
 /**
  * @brief Report Tuya data point(DP) services to the cloud.
  *
@@ -20,6 +20,18 @@
 #include "tuya_endpoint.h"
 #include "iotdns.h"
 #include "mix_method.h"
+#include "uni_codec.h"
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+#include "tal_kv.h"
+#include "mbedtls/sha256.h"
+
+#define OTA_RESUME_KEY      "ota_dl"
+#define OTA_RESUME_HASH_KEY "ota_dl_sha"
+#endif
+
+#ifndef OTA_WRITE_STACK_SIZE
+#define OTA_WRITE_STACK_SIZE (4096)
+#endif
 
 typedef struct {
     tuya_ota_config_t config;
@@ -28,14 +40,277 @@ typedef struct {
     uint8_t channel;
     uint8_t progress_percent;
     THREAD_HANDLE upgrade_thrd;
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+    THREAD_HANDLE write_thrd;
+    SEM_HANDLE write_sem;
+    SEM_HANDLE free_sem;
+    SEM_HANDLE exit_sem;
+    //! the buffer the download thread swaps in next
+    uint8_t *spare;
+    //! the buffer being written to flash, NULL stops the writer
+    uint8_t *write_buf;
+    size_t write_offset;
+    size_t write_len;
+    //! bytes the OTA port left, written again in front of the next buffer
+    uint8_t *carry;
+    uint32_t carry_len;
+    int write_rt;
+#endif
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+    //! a plain context, its state is saved with the download progress
+    mbedtls_sha256_context sha256;
+#else
     TKL_HASH_HANDLE sha256;
+#endif
 } tuya_ota_t;
 
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+typedef struct {
+    char fw_hmac[FW_HMAC_LEN + 1];
+    uint32_t offset;
+    mbedtls_sha256_context sha256;
+} tuya_ota_resume_t;
+#endif
+
 int tuya_ota_upgrade_status_report(tuya_ota_t *handle, int status);
 int tuya_ota_upgrade_progress_report(tuya_ota_t *handle, int percent);
 
 static tuya_ota_t *s_ota_ctx;
 
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+static void ota_sha256_start(tuya_ota_t *ota)
+{
+    mbedtls_sha256_init(&ota->sha256);
+    mbedtls_sha256_starts(&ota->sha256, 0);
+}
+
+static void ota_sha256_update(tuya_ota_t *ota, const uint8_t *data, size_t len)
+{
+    mbedtls_sha256_update(&ota->sha256, data, len);
+}
+
+static void ota_sha256_finish(tuya_ota_t *ota, uint8_t output[32])
+{
+    mbedtls_sha256_finish(&ota->sha256, output);
+    mbedtls_sha256_free(&ota->sha256);
+}
+
+static void ota_resume_save(tuya_ota_t *ota, size_t offset)
+{
+    tuya_ota_resume_t *resume = tal_malloc(sizeof(tuya_ota_resume_t));
+    if (NULL == resume) {
+        return;
+    }
+    memset(resume, 0, sizeof(tuya_ota_resume_t));
+    strcpy(resume->fw_hmac, ota->msg.fw_hmac);
+    resume->offset = offset;
+    memcpy(&resume->sha256, &ota->sha256, sizeof(mbedtls_sha256_context));
+    tal_kv_set(OTA_RESUME_HASH_KEY, (const uint8_t *)resume, sizeof(tuya_ota_resume_t));
+    tal_free(resume);
+}
+
+//! the hash of the data before offset must be the saved one of the same firmware
+static bool ota_resume_load(tuya_ota_t *ota, size_t offset)
+{
+    tuya_ota_resume_t *resume = NULL;
+    size_t length = 0;
+    bool ok = false;
+
+    if (0 != ota->channel) {
+        return false;
+    }
+    if (OPRT_OK != tal_kv_get(OTA_RESUME_HASH_KEY, (uint8_t **)&resume, &length)) {
+        return false;
+    }
+    if (length == sizeof(tuya_ota_resume_t) && resume->offset == offset &&
+        0 == strcmp(resume->fw_hmac, ota->msg.fw_hmac)) {
+        memcpy(&ota->sha256, &resume->sha256, sizeof(mbedtls_sha256_context));
+        ok = true;
+    }
+    tal_kv_free((uint8_t *)resume);
+
+    return ok;
+}
+#else
+static void ota_sha256_start(tuya_ota_t *ota)
+{
+    tal_sha256_create_init(&ota->sha256);
+    tal_sha256_starts_ret(ota->sha256, 0);
+}
+
+static void ota_sha256_update(tuya_ota_t *ota, const uint8_t *data, size_t len)
+{
+    tal_sha256_update_ret(ota->sha256, data, len);
+}
+
+static void ota_sha256_finish(tuya_ota_t *ota, uint8_t output[32])
+{
+    tal_sha256_finish_ret(ota->sha256, output);
+    tal_sha256_free(ota->sha256);
+}
+#endif
+
+//! hand data to the OTA port and hash what it takes, returns what it leaves
+static uint32_t ota_data_write(tuya_ota_t *ota, uint8_t *data, size_t offset, size_t len, uint32_t remain_len)
+{
+    TUYA_OTA_DATA_T ota_pack;
+
+    ota_pack.total_len = ota->event.file_size;
+    ota_pack.offset = offset;
+    ota_pack.data = data;
+    ota_pack.len = len;
+    ota_pack.pri_data = NULL;
+    tal_ota_data_process(&ota_pack, &remain_len);
+    if (remain_len > len) {
+        remain_len = len;
+    }
+    ota_sha256_update(ota, data, len - remain_len);
+
+    return remain_len;
+}
+
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+static void ota_write_buffer(tuya_ota_t *ota)
+{
+    uint8_t *data = ota->write_buf;
+    size_t offset = ota->write_offset;
+    size_t len = ota->write_len;
+    uint32_t remain_len = 0;
+
+    if (ota->carry_len) {
+        memcpy(ota->carry + ota->carry_len, data, len);
+        data = ota->carry;
+        offset -= ota->carry_len;
+        len += ota->carry_len;
+    }
+
+    remain_len = ota_data_write(ota, data, offset, len, ota->carry_len);
+    ota->carry_len = 0;
+    if (0 == remain_len) {
+        return;
+    }
+
+    //! rare, most ports take all, so the carry buffer is only made on demand
+    if (NULL == ota->carry) {
+        ota->carry = tal_malloc(ota->config.range_size * 2 + 1);
+    }
+    if (NULL == ota->carry || remain_len > ota->config.range_size) {
+        PR_ERR("ota left %d bytes, can't keep them", remain_len);
+        ota->write_rt = OPRT_EXCEED_UPPER_LIMIT;
+        return;
+    }
+    memmove(ota->carry, data + len - remain_len, remain_len);
+    ota->carry_len = remain_len;
+}
+
+static void ota_write_thread_func(void *arg)
+{
+    tuya_ota_t *ota = (tuya_ota_t *)arg;
+
+    for (;;) {
+        tal_semaphore_wait(ota->write_sem, SEM_WAIT_FOREVER);
+        if (NULL == ota->write_buf) {
+            break;
+        }
+        if (OPRT_OK == ota->write_rt) {
+            ota_write_buffer(ota);
+        }
+        ota->spare = ota->write_buf;
+        ota->write_buf = NULL;
+        tal_semaphore_post(ota->free_sem);
+    }
+
+    tal_semaphore_post(ota->exit_sem);
+}
+
+static void ota_write_stop(tuya_ota_t *ota)
+{
+    if (ota->write_thrd) {
+        //! let the last buffer be written, then stop the writer
+        tal_semaphore_wait(ota->free_sem, SEM_WAIT_FOREVER);
+        ota->write_buf = NULL;
+        tal_semaphore_post(ota->write_sem);
+        tal_semaphore_wait(ota->exit_sem, SEM_WAIT_FOREVER);
+        //! the thread wrapper waits for the delete after the function returns
+        tal_thread_delete(ota->write_thrd);
+        ota->write_thrd = NULL;
+    }
+    if (ota->write_sem) {
+        tal_semaphore_release(ota->write_sem);
+        ota->write_sem = NULL;
+    }
+    if (ota->free_sem) {
+        tal_semaphore_release(ota->free_sem);
+        ota->free_sem = NULL;
+    }
+    if (ota->exit_sem) {
+        tal_semaphore_release(ota->exit_sem);
+        ota->exit_sem = NULL;
+    }
+    if (ota->spare) {
+        tal_free(ota->spare);
+        ota->spare = NULL;
+    }
+    if (ota->carry) {
+        tal_free(ota->carry);
+        ota->carry = NULL;
+    }
+    ota->carry_len = 0;
+}
+
+static int ota_write_start(tuya_ota_t *ota)
+{
+    int rt = OPRT_OK;
+    THREAD_CFG_T thrd_param;
+
+    ota->write_rt = OPRT_OK;
+    ota->carry_len = 0;
+    ota->spare = tal_malloc(ota->config.range_size + 1);
+    TUYA_CHECK_NULL_GOTO(ota->spare, __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ota->write_sem, 0, 1), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ota->free_sem, 1, 1), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ota->exit_sem, 0, 1), __exit);
+
+    thrd_param.priority = THREAD_PRIO_3;
+    thrd_param.stackDepth = OTA_WRITE_STACK_SIZE;
+    thrd_param.thrdname = "tuya_ota_write";
+    TUYA_CALL_ERR_GOTO(
+        tal_thread_create_and_start(&ota->write_thrd, NULL, NULL, ota_write_thread_func, ota, &thrd_param), __exit);
+
+    return OPRT_OK;
+
+__exit:
+    ota->write_thrd = NULL;
+    ota_write_stop(ota);
+    return (OPRT_OK == rt) ? OPRT_MALLOC_FAILED : rt;
+}
+
+/**
+ * @brief Keep the full download buffer for the writer and give the download
+ * its other buffer, after the writer is done with that one.
+ */
+static void ota_write_swap(tuya_ota_t *ota, http_download_event_t *event)
+{
+    tal_semaphore_wait(ota->free_sem, SEM_WAIT_FOREVER);
+    ota->write_buf = event->data;
+    ota->write_offset = event->offset;
+    ota->write_len = event->data_len;
+    event->data = ota->spare;
+    event->remain_len = 0;
+    ota->spare = NULL;
+    tal_semaphore_post(ota->write_sem);
+}
+
+//! wait until all data given to the writer is on flash and in the hash
+static void ota_write_flush(tuya_ota_t *ota)
+{
+    if (ota->write_thrd) {
+        tal_semaphore_wait(ota->free_sem, SEM_WAIT_FOREVER);
+        tal_semaphore_post(ota->free_sem);
+    }
+}
+#endif
+
 static void file_download_event_cb(http_download_event_id_t id, http_download_event_t *event)
 {
     tuya_ota_t *ota = (tuya_ota_t *)event->user_data;
@@ -49,17 +324,21 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
     case DL_EVENT_START:
         PR_DEBUG("DL_EVENT_START");
         tuya_ota_upgrade_status_report(ota, TUS_UPGRDING);
-        tal_sha256_create_init(&ota->sha256);
-        tal_sha256_starts_ret(ota->sha256, 0);
+        ota_sha256_start(ota);
         break;
 
     case DL_EVENT_ON_FILESIZE:
         PR_DEBUG("DL_EVENT_ON_FILESIZE");
+        ota->event.file_size = event->file_size;
         if (0 == ota->channel) {
             tal_ota_start_notify(event->file_size, TUYA_OTA_FULL, TUYA_OTA_PATH_AIR);
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+            if (OPRT_OK != ota_write_start(ota)) {
+                PR_WARN("ota writer start fail, write in download thread");
+            }
+#endif
         } else if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_START;
-            ota->event.file_size = event->file_size;
             ota->event.user_data = ota->config.user_data;
             event_cb(&ota->msg, &ota->event);
         }
@@ -69,18 +348,14 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
         PR_DEBUG("DL_EVENT_ON_DATA:%d", event->data_len);
         PR_DEBUG("event->file_size %d, offset:%d, last remain %d", event->file_size, event->offset, event->remain_len);
         if (0 == ota->channel) {
-            TUYA_OTA_DATA_T ota_pack;
-
-            ota_pack.total_len = event->file_size;
-            ota_pack.offset = event->offset;
-            ota_pack.data = event->data;
-            ota_pack.len = event->data_len;
-            ota_pack.pri_data = NULL;
-            tal_ota_data_process(&ota_pack, (uint32_t *)&event->remain_len);
-            if (event->remain_len) {
-                tal_sha256_update_ret(ota->sha256, event->data, event->data_len - event->remain_len);
-            } else {
-                tal_sha256_update_ret(ota->sha256, event->data, event->data_len);
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+            if (ota->write_thrd) {
+                ota_write_swap(ota, event);
+            } else
+#endif
+            {
+                event->remain_len =
+                    ota_data_write(ota, event->data, event->offset, event->data_len, event->remain_len);
             }
         } else if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_ON_DATA;
@@ -101,13 +376,23 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
     case DL_EVENT_FINISH:
         PR_DEBUG("DL_EVENT_FINISH");
         PR_DEBUG("File Download Percent: %d%%", 100);
-        tal_sha256_finish_ret(ota->sha256, file_hmac);
-        tal_sha256_free(ota->sha256);
-        hex2str((uint8_t *)file_sha256, file_hmac, 32);
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+        ota_write_stop(ota);
+        if (OPRT_OK != ota->write_rt) {
+            PR_ERR("ota write fail:%d", ota->write_rt);
+            tuya_ota_upgrade_status_report(ota, TUS_UPGRD_EXEC);
+            ota_sha256_finish(ota, file_hmac);
+            break;
+        }
+#endif
+        ota_sha256_finish(ota, file_hmac);
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+        tal_kv_del(OTA_RESUME_HASH_KEY);
+#endif
+        uni_hex_encode(file_hmac, 32, (char *)file_sha256, true);
         tal_sha256_mac((const uint8_t *)client->activate.seckey, strlen(client->activate.seckey), file_sha256, 32 * 2,
                        file_hmac);
-        ascs2hex(self_hmac, (uint8_t *)(ota->msg.fw_hmac), FW_HMAC_LEN);
-        if ((memcmp(self_hmac, file_hmac, 32) == 0)) {
+        if (uni_hex_decode(ota->msg.fw_hmac, FW_HMAC_LEN, self_hmac) == 32 && memcmp(self_hmac, file_hmac, 32) == 0) {
             PR_DEBUG("file hmac check success");
             tuya_ota_upgrade_progress_report(ota, 100);
             tuya_ota_upgrade_status_report(ota, TUS_UPGRD_FINI);
@@ -120,8 +405,31 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
         }
         break;
 
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+    case DL_EVENT_ON_RESUME:
+        if (!ota_resume_load(ota, event->offset)) {
+            event->offset = 0;
+            break;
+        }
+        PR_NOTICE("ota resume at %d", (int32_t)event->offset);
+        ota->progress_percent = event->offset * 100 / event->file_size;
+        break;
+
+    case DL_EVENT_CHECKPOINT:
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+        //! bytes still carried are not in the hash, they are downloaded again on resume
+        ota_write_flush(ota);
+        event->offset -= ota->carry_len;
+#endif
+        ota_resume_save(ota, event->offset);
+        break;
+#endif
+
     case DL_EVENT_FAULT:
         PR_DEBUG("DL_EVENT_FAULT");
+#if defined(ENABLE_OTA_DOUBLE_BUFFER) && (ENABLE_OTA_DOUBLE_BUFFER == 1)
+        ota_write_stop(ota);
+#endif
         tuya_ota_upgrade_status_report(ota, TUS_UPGRD_EXEC);
         if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_FAULT;
@@ -170,7 +478,12 @@ static void ota_process_thread_func(void *arg)
     tuya_iotdns_query_domain_certs(ota->msg.fw_url, &cert, &cert_len);
 
     http_download_config_t download_cfg;
+    memset(&download_cfg, 0, sizeof(http_download_config_t));
     download_cfg.file_size = ota->msg.file_size;
+    //! a known size, buffers of it are swapped with the download
+    if (0 == ota->config.range_size) {
+        ota->config.range_size = HTTP_DOWNLOAD_RANGE_LENGTH_DEFAULT;
+    }
     download_cfg.range_length = ota->config.range_size;
     download_cfg.timeout_ms = ota->config.timeout_ms;
     download_cfg.cacert = cert;
@@ -178,6 +491,9 @@ static void ota_process_thread_func(void *arg)
     download_cfg.url = ota->msg.fw_url;
     download_cfg.event_handler = file_download_event_cb;
     download_cfg.user_data = ota;
+#if defined(ENABLE_HTTP_DOWNLOAD_RESUME) && (ENABLE_HTTP_DOWNLOAD_RESUME == 1)
+    download_cfg.resume_key = OTA_RESUME_KEY;
+#endif
 
     http_file_download(&download_cfg);
     tal_free(cert);
@@ -12,6 +12,11 @@
  * handling and socket event detection are integral parts of the loop to ensure
  * robust operation.
  *
+ * The monitored fd set is kept across iterations and only changes when a
+ * reader is added or removed. Registration requests travel through a queue and
+ * are followed by one byte sent to a loopback UDP wakeup socket that is part of
+ * the set, so select returns at once instead of at the next timeout.
+ *
  * Additionally, the file includes utility functions for setting up the
  * environment for socket event handling, including initializing and
  * deinitializing resources, managing the socket readers list, and processing
@@ -37,9 +42,16 @@ typedef struct LAN_SLOOP_S {
     int max_sock;
     THREAD_HANDLE thread;
     int cnt;
+    uint32_t reader_num;
     sloop_sock_t *readers;
     BOOL_T terminate;
     QUEUE_HANDLE queue;
+    TUYA_FD_SET_T *fds;
+    int wake_fd;
+    int wake_tx_fd;
+    uint16_t wake_port;
+    volatile BOOL_T wake_pending;
+    MUTEX_HANDLE wake_mutex;
 } LAN_SLOOP_S, *P_LAN_SLOOP_S;
 #pragma pack()
 
@@ -50,26 +62,121 @@ static P_LAN_SLOOP_S g_sloop = NULL;
 #define STACK_SIZE_LAN (4 * 1024)
 #endif
 
+// select timeout, also the period of the pre_select handlers
+#ifndef LAN_SOCK_SELECT_TIMEOUT_MS
+#define LAN_SOCK_SELECT_TIMEOUT_MS (1000)
+#endif
+
+// first loopback port tried for the wakeup socket
+#ifndef LAN_SOCK_WAKEUP_PORT
+#define LAN_SOCK_WAKEUP_PORT (6670)
+#endif
+
+#ifndef LAN_SOCK_WAKEUP_PORT_NUM
+#define LAN_SOCK_WAKEUP_PORT_NUM (8)
+#endif
+
 static uint32_t __ty_sock_get_reader_num(void)
 {
     return (LAN_UDP_READER_CNT + tuya_lan_get_client_num());
 }
 
-static void __sock_table_set_fds(TUYA_FD_SET_T *rfds, TUYA_FD_SET_T *efds)
+static void __ty_sock_update_max(void)
 {
-    int idx;
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-        if (g_sloop->readers[idx].sock >= 0) {
-            tal_net_fd_set(g_sloop->readers[idx].sock, rfds);
-            tal_net_fd_set(g_sloop->readers[idx].sock, efds);
+    uint32_t idx;
+
+    g_sloop->max_sock = g_sloop->wake_fd;
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
+        if (g_sloop->readers[idx].sock > g_sloop->max_sock) {
+            g_sloop->max_sock = g_sloop->readers[idx].sock;
+        }
+    }
+}
+
+static void __ty_sock_wakeup_deinit(void)
+{
+    if (g_sloop->wake_fd >= 0) {
+        tal_net_close(g_sloop->wake_fd);
+        g_sloop->wake_fd = -1;
+    }
+    if (g_sloop->wake_tx_fd >= 0) {
+        tal_net_close(g_sloop->wake_tx_fd);
+        g_sloop->wake_tx_fd = -1;
+    }
+    if (g_sloop->wake_mutex) {
+        tal_mutex_release(g_sloop->wake_mutex);
+        g_sloop->wake_mutex = NULL;
+    }
+}
+
+static OPERATE_RET __ty_sock_wakeup_init(void)
+{
+    uint16_t i;
+
+    if (OPRT_OK != tal_mutex_create_init(&g_sloop->wake_mutex)) {
+        return OPRT_COM_ERROR;
+    }
+
+    g_sloop->wake_fd = tal_net_socket_create(PROTOCOL_UDP);
+    g_sloop->wake_tx_fd = tal_net_socket_create(PROTOCOL_UDP);
+    if (g_sloop->wake_fd < 0 || g_sloop->wake_tx_fd < 0) {
+        goto __err;
+    }
+
+    for (i = 0; i < LAN_SOCK_WAKEUP_PORT_NUM; i++) {
+        if (OPRT_OK == tal_net_bind(g_sloop->wake_fd, TY_IPADDR_LOOPBACK, LAN_SOCK_WAKEUP_PORT + i)) {
+            g_sloop->wake_port = LAN_SOCK_WAKEUP_PORT + i;
+            break;
         }
     }
+    if (0 == g_sloop->wake_port) {
+        goto __err;
+    }
+    tal_net_set_block(g_sloop->wake_fd, FALSE);
+    tal_net_set_block(g_sloop->wake_tx_fd, FALSE);
+
+    tal_net_fd_set(g_sloop->wake_fd, g_sloop->fds);
+    PR_DEBUG("sock loop wakeup port %d", g_sloop->wake_port);
+    return OPRT_OK;
+
+__err:
+    __ty_sock_wakeup_deinit();
+    return OPRT_SOCK_ERR;
+}
+
+static void __ty_sock_wakeup(void)
+{
+    char c = 0;
+
+    if (g_sloop->wake_tx_fd < 0) {
+        return;
+    }
+
+    tal_mutex_lock(g_sloop->wake_mutex);
+    if (!g_sloop->wake_pending) {
+        g_sloop->wake_pending = TRUE;
+        tal_net_send_to(g_sloop->wake_tx_fd, &c, 1, TY_IPADDR_LOOPBACK, g_sloop->wake_port);
+    }
+    tal_mutex_unlock(g_sloop->wake_mutex);
+}
+
+static void __ty_sock_wakeup_drain(void)
+{
+    char buf[8];
+
+    // drain and clear under the lock that __ty_sock_wakeup() tests the flag with,
+    // so the next wakeup always sends a fresh byte
+    tal_mutex_lock(g_sloop->wake_mutex);
+    while (tal_net_recv(g_sloop->wake_fd, buf, sizeof(buf)) > 0) {
+    }
+    g_sloop->wake_pending = FALSE;
+    tal_mutex_unlock(g_sloop->wake_mutex);
 }
 
 static void __sock_select_err_handle()
 {
     int idx;
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         if (g_sloop->readers[idx].sock >= 0) {
             if (g_sloop->readers[idx].err) {
                 g_sloop->readers[idx].err(g_sloop->readers[idx].sock);
@@ -87,7 +194,7 @@ void __ty_sock_loop_deinit(void)
 
     uint8_t idx = 0;
     if (g_sloop->readers) {
-        for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+        for (idx = 0; idx < g_sloop->reader_num; idx++) {
             if (g_sloop->readers[idx].sock != -1) {
                 PR_DEBUG("deinit lan sock %d and close it", g_sloop->readers[idx].sock);
                 tal_net_close(g_sloop->readers[idx].sock);
@@ -102,6 +209,10 @@ void __ty_sock_loop_deinit(void)
         tal_free(g_sloop->readers);
         g_sloop->readers = NULL;
     }
+    __ty_sock_wakeup_deinit();
+    if (g_sloop->fds) {
+        tal_free(g_sloop->fds);
+    }
     if (g_sloop->queue) {
         tal_queue_free(g_sloop->queue);
     }
@@ -116,12 +227,8 @@ void __ty_sock_loop_deinit(void)
 
 void __ty_add_sock_reader(sloop_sock_t sock_info)
 {
-    if (sock_info.sock > g_sloop->max_sock) {
-        g_sloop->max_sock = sock_info.sock;
-    }
-
     uint8_t idx = 0;
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         if ((sock_info.sock == g_sloop->readers[idx].sock) && (g_sloop->readers[idx].read == sock_info.read)) {
             PR_DEBUG("update lan sock %d,read:%p", sock_info.sock, sock_info.read);
             memset(&g_sloop->readers[idx], 0, sizeof(sloop_sock_t));
@@ -130,8 +237,8 @@ void __ty_add_sock_reader(sloop_sock_t sock_info)
         }
     }
 
-    if (idx == __ty_sock_get_reader_num()) {
-        for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    if (idx == g_sloop->reader_num) {
+        for (idx = 0; idx < g_sloop->reader_num; idx++) {
             if (-1 == g_sloop->readers[idx].sock) {
                 PR_DEBUG("reg lan sock %d,read:%p", sock_info.sock, sock_info.read);
                 memset(&g_sloop->readers[idx], 0, sizeof(sloop_sock_t));
@@ -142,20 +249,26 @@ void __ty_add_sock_reader(sloop_sock_t sock_info)
         }
     }
 
-    if (idx == __ty_sock_get_reader_num()) {
+    if (idx == g_sloop->reader_num) {
         PR_ERR("out of range");
         return;
     }
 
+    tal_net_fd_set(sock_info.sock, g_sloop->fds);
+    if (sock_info.sock > g_sloop->max_sock) {
+        g_sloop->max_sock = sock_info.sock;
+    }
+
     return;
 }
 
 void __ty_del_sock_reader(int sock)
 {
     uint8_t idx = 0;
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         if (g_sloop->readers[idx].sock == sock) {
             PR_DEBUG("unreg lan sock %d and close it", sock);
+            tal_net_fd_clear(sock, g_sloop->fds);
             tal_net_close(g_sloop->readers[idx].sock);
             g_sloop->readers[idx].sock = -1;
             // g_sloop->readers[idx].pre_select = NULL;
@@ -167,20 +280,40 @@ void __ty_del_sock_reader(int sock)
         }
     }
 
-    if (idx == __ty_sock_get_reader_num()) {
+    if (idx == g_sloop->reader_num) {
         PR_ERR("unreg not found");
         return;
     }
 
+    if (sock == g_sloop->max_sock) {
+        __ty_sock_update_max();
+    }
+
     return;
 }
 
+static void __ty_sock_handle_queue(uint32_t timeout)
+{
+    sloop_sock_t queue_data;
+
+    // apply every pending request, not one per loop iteration
+    memset(&queue_data, 0, sizeof(sloop_sock_t));
+    while (OPRT_OK == tal_queue_fetch(g_sloop->queue, &queue_data, timeout)) {
+        if (queue_data.read) {
+            __ty_add_sock_reader(queue_data);
+        } else {
+            __ty_del_sock_reader(queue_data.sock);
+        }
+        memset(&queue_data, 0, sizeof(sloop_sock_t));
+        timeout = 0;
+    }
+}
+
 void tuya_sock_loop_run(void *data)
 {
     int actv_cnt = 0;
     int idx = 0;
     TUYA_FD_SET_T *rfds, *efds;
-    sloop_sock_t queue_data = {0};
 
     rfds = tal_malloc(sizeof(TUYA_FD_SET_T));
     efds = tal_malloc(sizeof(TUYA_FD_SET_T));
@@ -194,28 +327,21 @@ void tuya_sock_loop_run(void *data)
     // while (tuya_get_sock_loop_terminate() &&
     // tal_thread_get_state(g_sloop->thread) == THREAD_STATE_RUNNING) {
     while (tuya_get_sock_loop_terminate()) {
-        memset(&queue_data, 0, sizeof(sloop_sock_t));
-        if (tal_queue_fetch(g_sloop->queue, &queue_data, 0) == 0) {
-            if (queue_data.read) {
-                __ty_add_sock_reader(queue_data);
-            } else {
-                __ty_del_sock_reader(queue_data.sock);
-            }
-        }
-        for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+        __ty_sock_handle_queue(0);
+        for (idx = 0; idx < g_sloop->reader_num; idx++) {
             if (g_sloop->readers[idx].pre_select) {
                 g_sloop->readers[idx].pre_select();
             }
         }
         if (g_sloop->cnt == 0) {
-            tal_system_sleep(2000);
+            // nothing to select on, block on the queue so a registration is picked up at once
+            __ty_sock_handle_queue(LAN_SOCK_SELECT_TIMEOUT_MS);
             continue;
         }
 
-        tal_net_fd_zero(rfds);
-        tal_net_fd_zero(efds);
-        __sock_table_set_fds(rfds, efds);
-        actv_cnt = tal_net_select(g_sloop->max_sock + 1, rfds, NULL, efds, 1 * 1000);
+        memcpy(rfds, g_sloop->fds, sizeof(TUYA_FD_SET_T));
+        memcpy(efds, g_sloop->fds, sizeof(TUYA_FD_SET_T));
+        actv_cnt = tal_net_select(g_sloop->max_sock + 1, rfds, NULL, efds, LAN_SOCK_SELECT_TIMEOUT_MS);
         if (actv_cnt < 0) {
             PR_ERR("errno:%d", tal_net_get_errno());
             __sock_select_err_handle();
@@ -223,44 +349,37 @@ void tuya_sock_loop_run(void *data)
             continue;
         } else if (actv_cnt == 0) {
             continue;
-        } else {
-            for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-                if (g_sloop->readers[idx].sock >= 0) {
-                    if (0 == tal_net_fd_isset(g_sloop->readers[idx].sock, efds)) {
-                        continue;
-                    }
-                    if (g_sloop->readers[idx].err) {
-                        PR_ERR("socket err:%d, sock:%d, idx:%d", tal_net_get_errno(), g_sloop->readers[idx].sock, idx);
-                        g_sloop->readers[idx].err(g_sloop->readers[idx].sock);
-                    }
-                    actv_cnt--;
-                    if (0 == actv_cnt) {
-                        break;
-                    }
-                }
-            }
         }
 
-        if (0 == actv_cnt) {
-            continue;
+        // the queue is applied at the top of the next iteration, after the
+        // readers were served from the set they were selected with
+        if (g_sloop->wake_fd >= 0 && tal_net_fd_isset(g_sloop->wake_fd, rfds)) {
+            __ty_sock_wakeup_drain();
+            actv_cnt--;
         }
 
-        for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-            if (g_sloop->readers[idx].sock >= 0) {
-                if (tal_net_fd_isset(g_sloop->readers[idx].sock, rfds)) {
-                    if (g_sloop->readers[idx].read) {
-                        g_sloop->readers[idx].read(g_sloop->readers[idx].sock);
-                        actv_cnt--;
-                        if (0 == actv_cnt) {
-                            break;
-                        }
-                    }
+        for (idx = 0; idx < g_sloop->reader_num && actv_cnt > 0; idx++) {
+            int sock = g_sloop->readers[idx].sock;
+            if (sock < 0) {
+                continue;
+            }
+            if (tal_net_fd_isset(sock, efds)) {
+                actv_cnt--;
+                if (g_sloop->readers[idx].err) {
+                    PR_ERR("socket err:%d, sock:%d, idx:%d", tal_net_get_errno(), sock, idx);
+                    g_sloop->readers[idx].err(sock);
+                }
+            }
+            if (tal_net_fd_isset(sock, rfds)) {
+                actv_cnt--;
+                if (g_sloop->readers[idx].read) {
+                    g_sloop->readers[idx].read(sock);
                 }
             }
         }
     }
 
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         if (g_sloop->readers[idx].quit) {
             g_sloop->readers[idx].quit();
         }
@@ -306,6 +425,9 @@ OPERATE_RET tuya_sock_loop_init(void)
     }
     memset(g_sloop, 0, sizeof(LAN_SLOOP_S));
     g_sloop->terminate = TRUE;
+    g_sloop->max_sock = -1;
+    g_sloop->wake_fd = -1;
+    g_sloop->wake_tx_fd = -1;
 
     op_ret = tal_queue_create_init(&g_sloop->queue, sizeof(sloop_sock_t), LAN_QUEUE_NUM);
     if (OPRT_OK != op_ret) {
@@ -313,16 +435,27 @@ OPERATE_RET tuya_sock_loop_init(void)
         goto Err;
     }
 
-    uint32_t readers_len = __ty_sock_get_reader_num() * sizeof(sloop_sock_t);
+    g_sloop->reader_num = __ty_sock_get_reader_num();
+    uint32_t readers_len = g_sloop->reader_num * sizeof(sloop_sock_t);
     g_sloop->readers = tal_malloc(readers_len);
-    if (NULL == g_sloop->readers) {
+    g_sloop->fds = tal_malloc(sizeof(TUYA_FD_SET_T));
+    if (NULL == g_sloop->readers || NULL == g_sloop->fds) {
         PR_ERR("tal_malloc err");
+        op_ret = OPRT_MALLOC_FAILED;
         goto Err;
     }
     memset(g_sloop->readers, 0, readers_len);
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         g_sloop->readers[idx].sock = -1;
     }
+    memset(g_sloop->fds, 0, sizeof(TUYA_FD_SET_T));
+    tal_net_fd_zero(g_sloop->fds);
+
+    if (OPRT_OK != __ty_sock_wakeup_init()) {
+        // still works, registrations are then seen at the next select timeout
+        PR_WARN("sock loop wakeup unavailable");
+    }
+    g_sloop->max_sock = g_sloop->wake_fd;
     THREAD_CFG_T thread_cfg = {.priority = THREAD_PRIO_2, .stackDepth = STACK_SIZE_LAN, .thrdname = "lan_sock_loop"};
 
     op_ret = tal_thread_create_and_start(&g_sloop->thread, NULL, NULL, tuya_sock_loop_run, NULL, &thread_cfg);
@@ -360,6 +493,7 @@ OPERATE_RET tuya_reg_lan_sock(sloop_sock_t sock_info)
         PR_ERR("queue post err");
         return op_ret;
     }
+    __ty_sock_wakeup();
     PR_DEBUG("reg post queue %d", sock_info.sock);
     return OPRT_OK;
 }
@@ -385,6 +519,7 @@ OPERATE_RET tuya_unreg_lan_sock(int sock)
         PR_ERR("queue post err");
         return op_ret;
     }
+    __ty_sock_wakeup();
     PR_DEBUG("unreg post queue %d", sock);
     return OPRT_OK;
 }
@@ -435,11 +570,12 @@ void tuya_dump_lan_sock_reader(void)
         return;
     }
     PR_DEBUG("**************lan sock reader info dump begin**************");
-    PR_DEBUG("support readers:%d", __ty_sock_get_reader_num());
+    PR_DEBUG("support readers:%d", g_sloop->reader_num);
     PR_DEBUG("sock cnt:%d", g_sloop->cnt);
     PR_DEBUG("terminate:%d", g_sloop->terminate);
     PR_DEBUG("max_sock:%d", g_sloop->max_sock);
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
+    PR_DEBUG("wakeup sock:%d port:%d", g_sloop->wake_fd, g_sloop->wake_port);
+    for (idx = 0; idx < g_sloop->reader_num; idx++) {
         if (g_sloop->readers[idx].read) {
             PR_DEBUG("***** sock:%d *****", g_sloop->readers[idx].sock);
             PR_DEBUG("read:%p", g_sloop->readers[idx].read);
@@ -113,6 +113,7 @@ static lan_mgr_t *lan_mgr_get(void)
 
 static void lan_session_free(lan_session_t *session)
 {
+    cipher_aead_cache_clear(session->secret_key, SESSIONKEY_LEN);
     memset(session, 0, sizeof(lan_session_t));
     session->fd = -1;
 }
@@ -743,7 +744,10 @@ static void lan_protocol_process(lan_mgr_t *lan, lan_session_t *session, lpv35_f
         tal_sha256_mac((const uint8_t *)s_lan_mgr->iot_client->activate.localkey,
                        strlen(s_lan_mgr->iot_client->activate.localkey), session->randA, RAND_LEN, session->hmac);
         // make randB
-        uni_random_string((char *)(session->randB), RAND_LEN);
+        if (uni_random_string((char *)(session->randB), RAND_LEN) != OPRT_OK) {
+            PR_ERR("make randB fail");
+            break;
+        }
         // make frame buffer
         uint8_t *frame_buffer = tal_malloc(RAND_LEN + HMAC_LEN);
         if (NULL == frame_buffer) {
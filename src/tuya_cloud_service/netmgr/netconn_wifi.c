@@ -24,6 +24,9 @@
 #include "tuya_ble_service.h"
 #endif
 
+// connect and disconnect must run one by one in order, also on a pooled WORKQ_SYSTEM
+#define NETCONN_WIFI_WORKQ_TAG 0x5746
+
 typedef enum {
     NETCONN_WIFI_MSG_CONNECT,
     NETCONN_WIFI_MSG_DISCONNECT,
@@ -88,7 +91,7 @@ OPERATE_RET __netconn_wifi_connect(void)
     }
     wifi_msg->type = NETCONN_WIFI_MSG_CONNECT;
     wifi_msg->handle = wifi;
-    return tal_workq_schedule(WORKQ_SYSTEM, __netconn_wifi_connect_process, wifi_msg);
+    return tal_workq_schedule_affinity(WORKQ_SYSTEM, NETCONN_WIFI_WORKQ_TAG, __netconn_wifi_connect_process, wifi_msg);
 }
 
 OPERATE_RET __netconn_wifi_disconnect(void)
@@ -107,7 +110,7 @@ OPERATE_RET __netconn_wifi_disconnect(void)
     wifi_msg->type = NETCONN_WIFI_MSG_DISCONNECT;
     wifi_msg->handle = wifi;
 
-    return tal_workq_schedule(WORKQ_SYSTEM, __netconn_wifi_connect_process, wifi_msg);
+    return tal_workq_schedule_affinity(WORKQ_SYSTEM, NETCONN_WIFI_WORKQ_TAG, __netconn_wifi_connect_process, wifi_msg);
 }
 
 static void __netconn_wifi_event(WF_EVENT_E event, void *arg)
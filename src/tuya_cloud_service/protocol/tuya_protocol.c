@@ -51,6 +51,9 @@
 #define PV23_AD_DATA_LEN     (12)
 #define PV23_EXCEPT_DATA_LEN (PV23_AD_DATA_LEN + PV23_NONCE_LEN + PV23_TAG_LEN)
 
+// {"protocol":%d,"t":%d,"data":} with the widest integers, rounded up
+#define PROTOCOL_ENVELOPE_LEN (60)
+
 /**
  * @brief Generates a serial number for the Tuya protocol packet.
  *
@@ -217,36 +220,35 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
     return op_ret;
 }
 
-static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
-                                             const uint32_t pro, const uint32_t num, const uint8_t *key,
-                                             uint8_t **pack_out, uint32_t *out_len)
+/**
+ * @brief Writes the JSON envelope around the payload.
+ *
+ * The envelope is `{"protocol":<pro>,"t":<posix>,"data":<src>}`, written
+ * directly into the frame buffer so the payload is copied exactly once.
+ * The caller must reserve PROTOCOL_ENVELOPE_LEN bytes beyond src_len.
+ *
+ * @return The number of envelope bytes written, without a terminator.
+ */
+static uint32_t __pack_envelope(char *out, const char *src, const uint32_t src_len, const uint32_t pro)
 {
-    OPERATE_RET op_ret = OPRT_OK;
-    char *out = NULL;
-    int offset = 0;
-
-    PR_TRACE("To:%d src:%s pro:%d num:%d", cmd, src, pro, num);
-    // make json data
-    int len = strlen(src) + 60;
-    out = tal_malloc(len);
-    if (NULL == out) {
-        PR_ERR("tal_malloc Fails %d", len);
-        return OPRT_MALLOC_FAILED;
-    }
+    uint32_t offset = 0;
 
-    offset += sprintf(out + offset, "{\"protocol\":%d,\"t\":%d,\"data\":%s", pro, (uint32_t)tal_time_get_posix(), src);
+    offset += sprintf(out + offset, "{\"protocol\":%d,\"t\":%d,\"data\":", pro, (uint32_t)tal_time_get_posix());
+    memcpy(out + offset, src, src_len);
+    offset += src_len;
     out[offset++] = '}';
-    out[offset] = 0;
 
-    PR_TRACE("After Pack:%s offset:%d", out, offset);
+    return offset;
+}
 
-    // make pack data
-    uint8_t *buf = tal_malloc(offset + PV23_EXCEPT_DATA_LEN);
-    if (buf == NULL) {
-        tal_free(out);
-        return OPRT_MALLOC_FAILED;
-    }
-    memset(buf, 0, offset + PV23_EXCEPT_DATA_LEN);
+static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
+                                             const uint32_t src_len, const uint32_t pro, const uint32_t num,
+                                             const uint8_t *key, uint8_t *buf, uint32_t *out_len)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    uint32_t offset = 0;
+
+    PR_TRACE("To:%d src:%.*s pro:%d num:%d", cmd, src_len, src, pro, num);
 
     // make head data
     // version
@@ -266,7 +268,12 @@ static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char
     // nonce
     uni_random_string((char *)(buf + PV23_NONCE_OFFSET), PV23_NONCE_LEN);
 
-    // AES GCM encrypt
+    // make json data in place, right where the ciphertext goes
+    offset = __pack_envelope((char *)(buf + PV23_DATA_OFFSET), src, src_len, pro);
+
+    PR_TRACE("After Pack:%.*s offset:%d", offset, buf + PV23_DATA_OFFSET, offset);
+
+    // AES GCM encrypt in place, tag follows the ciphertext
     size_t encrypt_olen = 0;
     op_ret = mbedtls_cipher_auth_encrypt_wrapper(&(const cipher_params_t){.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
                                                                           .key = (unsigned char *)key,
@@ -275,59 +282,34 @@ static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char
                                                                           .nonce_len = PV23_NONCE_LEN,
                                                                           .ad = buf,
                                                                           .ad_len = PV23_AD_DATA_LEN,
-                                                                          .data = (unsigned char *)out,
-                                                                          .data_len = strlen(out)},
+                                                                          .data = buf + PV23_DATA_OFFSET,
+                                                                          .data_len = offset},
                                                  buf + PV23_DATA_OFFSET, &encrypt_olen, buf + PV23_DATA_OFFSET + offset,
                                                  PV23_TAG_LEN);
-    tal_free(out);
     if (op_ret != OPRT_OK) {
         PR_ERR("mbedtls_cipher_auth_encrypt_wrapper:0x%x", -op_ret);
-        tal_free(buf);
         return op_ret;
     }
 
-    *pack_out = buf;
     *out_len = PV23_EXCEPT_DATA_LEN + encrypt_olen;
 
     return OPRT_OK;
 }
 
 static OPERATE_RET __pack_data_with_cmd_lpv35(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
-                                              const uint32_t pro, const uint32_t num, const uint8_t *key,
-                                              uint8_t **pack_out, uint32_t *out_len)
+                                              const uint32_t src_len, const uint32_t pro, const uint32_t num,
+                                              const uint8_t *key, uint8_t *buf, uint32_t *out_len)
 {
-    char *out = NULL;
-    int offset = 0;
-
-    PR_TRACE("To:%d src:%s pro:%d num:%d", cmd, src, pro, num);
+    uint32_t offset = 0;
 
-    // make json data
-    int len = strlen(src) + 60;
-    out = tal_malloc(len);
-    if (NULL == out) {
-        PR_ERR("tal_malloc Fails %d", len);
-        return OPRT_MALLOC_FAILED;
-    }
+    PR_TRACE("To:%d src:%.*s pro:%d num:%d", cmd, src_len, src, pro, num);
 
-    offset += sprintf(out + offset, "{\"protocol\":%d,\"t\":%d,\"data\":%s", pro, (uint32_t)tal_time_get_posix(), src);
-    out[offset++] = '}';
-    out[offset] = 0;
+    // make json data, not aes data
+    offset = __pack_envelope((char *)(buf + DATA_OFFSET_22_32), src, src_len, pro);
+    buf[DATA_OFFSET_22_32 + offset] = 0;
 
-    PR_TRACE("After Pack:%s offset:%d", out, offset);
+    PR_TRACE("After Pack:%s offset:%d", buf + DATA_OFFSET_22_32, offset);
 
-    // make pack data
-    uint8_t *buf = tal_malloc(DATA_OFFSET_22_32 + offset + 16);
-    if (buf == NULL) {
-        tal_free(out);
-        return OPRT_MALLOC_FAILED;
-    }
-    memset(buf, 0, DATA_OFFSET_22_32 + offset + 16);
-
-    // not aes data
-    memcpy(buf + DATA_OFFSET_22_32, out, offset);
-    tal_free(out);
-
-    *pack_out = buf;
     *out_len = (DATA_OFFSET_22_32 + offset);
 
     // make head data
@@ -345,6 +327,79 @@ static OPERATE_RET __pack_data_with_cmd_lpv35(const DP_CMD_TYPE_E cmd, const cha
     return OPRT_OK;
 }
 
+/**
+ * @brief Returns the buffer size tuya_pack_protocol_data_to() needs.
+ *
+ * The result covers the frame head, the JSON envelope, the payload and,
+ * for MQTT, the GCM nonce and tag. It is an upper bound: the envelope
+ * digits are only known at pack time.
+ *
+ * @param cmd The command type.
+ * @param src_len The payload length in bytes.
+ *
+ * @return The required size in bytes, 0 if the command is not supported.
+ */
+uint32_t tuya_pack_protocol_data_size(const DP_CMD_TYPE_E cmd, const uint32_t src_len)
+{
+    if (DP_CMD_LAN == cmd) {
+        return DATA_OFFSET_22_32 + PROTOCOL_ENVELOPE_LEN + src_len + 1;
+    } else if (DP_CMD_MQ == cmd) {
+        return PV23_EXCEPT_DATA_LEN + PROTOCOL_ENVELOPE_LEN + src_len;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Packs the protocol data into a caller supplied buffer.
+ *
+ * Head, JSON envelope and payload are written straight into buf and, for
+ * MQTT, encrypted in place, so no intermediate buffer is allocated.
+ *
+ * @param cmd The command type.
+ * @param src The payload, does not need to be NUL terminated.
+ * @param src_len The payload length in bytes.
+ * @param pro The protocol number.
+ * @param key The encryption key.
+ * @param buf The output buffer.
+ * @param size The output buffer size, see tuya_pack_protocol_data_size().
+ * @param out_len Pointer to the length of the packed data.
+ *
+ * @return The operation result status.
+ *     - OPRT_OK: Operation successful.
+ *     - OPRT_BUFFER_NOT_ENOUGH: buf is smaller than required.
+ *     - Other error codes: Operation failed.
+ */
+OPERATE_RET tuya_pack_protocol_data_to(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t src_len,
+                                       const uint32_t pro, const uint8_t *key, uint8_t *buf, const uint32_t size,
+                                       uint32_t *out_len)
+{
+    if ((NULL == src) || (NULL == buf) || (NULL == out_len)) {
+        PR_ERR("Invalid Param");
+        return OPRT_INVALID_PARM;
+    }
+
+    uint32_t need = tuya_pack_protocol_data_size(cmd, src_len);
+    if (0 == need) {
+        PR_ERR("Invlaid Cmd:%d", cmd);
+        return OPRT_COM_ERROR;
+    }
+    if (size < need) {
+        PR_ERR("pack buffer too small %d < %d", size, need);
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    uint32_t num = tuya_pack_protocol_serial_no();
+
+    if (DP_CMD_LAN == cmd) {
+        PR_TRACE("Data To LAN AND V=3.5");
+        return __pack_data_with_cmd_lpv35(cmd, TUYA_LPV35, src, src_len, pro, num, key, buf, out_len);
+    }
+
+    PR_TRACE("Data To MQTT AND V=2.3");
+    return __pack_data_with_cmd_pv23(cmd, TUYA_PV23, src, src_len, pro, num, key, buf, out_len);
+}
+
 /**
  * @brief Packs the protocol data for Tuya Cloud service.
  *
@@ -370,39 +425,28 @@ OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, co
         return OPRT_INVALID_PARM;
     }
 
-    OPERATE_RET op_ret = OPRT_OK;
-
-    char *pv = NULL;
+    uint32_t src_len = strlen(src);
+    uint32_t size = tuya_pack_protocol_data_size(cmd, src_len);
+    if (0 == size) {
+        PR_ERR("Invlaid Cmd:%d", cmd);
+        return OPRT_COM_ERROR;
+    }
 
-    if (DP_CMD_LAN == cmd) {
-        pv = TUYA_LPV35;
-    } else if (DP_CMD_MQ == cmd) {
-        pv = TUYA_PV23;
+    uint8_t *buf = tal_malloc(size);
+    if (NULL == buf) {
+        PR_ERR("tal_malloc Fails %d", size);
+        return OPRT_MALLOC_FAILED;
     }
-    uint32_t num = tuya_pack_protocol_serial_no();
 
-    if (DP_CMD_LAN == cmd) {
-        if (0 == strcmp(pv, "3.5")) {
-            PR_TRACE("Data To LAN AND V=3.5");
-            op_ret = __pack_data_with_cmd_lpv35(cmd, pv, src, pro, num, (uint8_t *)key, (uint8_t **)out, out_len);
-        } else {
-            PR_ERR("Data To LAN But No Match Parse %s", pv);
-            return OPRT_COM_ERROR;
-        }
-    } else if (DP_CMD_MQ == cmd) {
-        if (0 == strcmp(pv, "2.3")) {
-            PR_TRACE("Data To MQTT AND V=2.3");
-            op_ret = __pack_data_with_cmd_pv23(cmd, pv, src, pro, num, key, (uint8_t **)out, out_len);
-        } else {
-            PR_ERR("Data To MQTT But No Match Parse %s", pv);
-            return OPRT_COM_ERROR;
-        }
-    } else {
-        PR_ERR("Invlaid Cmd:%d", cmd);
-        return OPRT_COM_ERROR;
+    OPERATE_RET op_ret = tuya_pack_protocol_data_to(cmd, src, src_len, pro, key, buf, size, out_len);
+    if (OPRT_OK != op_ret) {
+        tal_free(buf);
+        return op_ret;
     }
 
-    return op_ret;
+    *out = (char *)buf;
+
+    return OPRT_OK;
 }
 
 /**
@@ -459,19 +503,16 @@ OPERATE_RET lpv35_frame_serialize(const uint8_t *key, int key_len, const lpv35_f
     memcpy(output + offset, (uint8_t *)&ad, sizeof(lpv35_additional_data_t));
     offset += sizeof(lpv35_additional_data_t);
 
-    //  tmp nonce
-    uint8_t i = 0;
-    uint8_t nonce[LPV35_FRAME_NONCE_SIZE];
-    for (i = 0; i < LPV35_FRAME_NONCE_SIZE; i++) {
-        nonce[i] = uni_random_range(0xFF);
+    // nonce
+    uint8_t *nonce = output + offset;
+    op_ret = uni_random_bytes(nonce, LPV35_FRAME_NONCE_SIZE);
+    if (op_ret != OPRT_OK) {
+        PR_ERR("uni_random_bytes:0x%x", -op_ret);
+        return OPRT_COM_ERROR;
     }
-    memcpy(output + offset, &(nonce[0]), LPV35_FRAME_NONCE_SIZE);
     offset += LPV35_FRAME_NONCE_SIZE;
 
-    // TAG buffer
-    uint8_t tag[LPV35_FRAME_TAG_SIZE] = {0};
-
-    // AES GCM encrypt
+    // AES GCM encrypt, tag right after the ciphertext
     size_t encrypt_olen = 0;
     op_ret = mbedtls_cipher_auth_encrypt_wrapper(&(const cipher_params_t){.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
                                                                           .key = (unsigned char *)key,
@@ -482,16 +523,13 @@ OPERATE_RET lpv35_frame_serialize(const uint8_t *key, int key_len, const lpv35_f
                                                                           .ad_len = sizeof(lpv35_additional_data_t),
                                                                           .data = input->data,
                                                                           .data_len = input->data_len},
-                                                 output + offset, &encrypt_olen, tag, LPV35_FRAME_TAG_SIZE);
+                                                 output + offset, &encrypt_olen, output + offset + input->data_len,
+                                                 LPV35_FRAME_TAG_SIZE);
     if (op_ret != OPRT_OK) {
         PR_ERR("mbedtls_cipher_auth_encrypt_wrapper:0x%x", -op_ret);
         return op_ret;
     }
-    offset += encrypt_olen;
-
-    // TAG
-    memcpy(output + offset, tag, LPV35_FRAME_TAG_SIZE);
-    offset += LPV35_FRAME_TAG_SIZE;
+    offset += encrypt_olen + LPV35_FRAME_TAG_SIZE;
 
     // TAIL
     memcpy(output + offset, LPV35_FRAME_TAIL, LPV35_FRAME_TAIL_SIZE);
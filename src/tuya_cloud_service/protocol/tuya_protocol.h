@@ -129,6 +129,39 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
  */
 OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t pro, uint8_t *key,
                                     char **out, uint32_t *out_len);
+
+/**
+ * @brief get the buffer size needed by tuya_pack_protocol_data_to
+ *
+ * @param[in] cmd refer to DP_CMD_TYPE_E
+ * @param[in] src_len payload length
+ *
+ * @return required size in bytes, 0 if cmd is not supported
+ */
+uint32_t tuya_pack_protocol_data_size(const DP_CMD_TYPE_E cmd, const uint32_t src_len);
+
+/**
+ * @brief pack protocol data into a caller supplied buffer
+ *
+ * Head, envelope and payload are written straight into buf, MQTT frames are
+ * encrypted in place. No memory is allocated.
+ *
+ * @param[in] cmd refer to DP_CMD_TYPE_E
+ * @param[in] src payload, no NUL terminator needed
+ * @param[in] src_len payload length
+ * @param[in] pro pro
+ * @param[in] key pack key
+ * @param[in] buf output buffer
+ * @param[in] size output buffer size
+ * @param[out] out_len pack out length
+ *
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if size is smaller than
+ * tuya_pack_protocol_data_size(). Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tuya_pack_protocol_data_to(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t src_len,
+                                       const uint32_t pro, const uint8_t *key, uint8_t *buf, const uint32_t size,
+                                       uint32_t *out_len);
 /**
  * @brief add head and tail in lpv35 frame
  *
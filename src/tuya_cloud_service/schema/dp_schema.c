@@ -22,18 +22,36 @@
 
 #define MAX_TRANS_TYPE_NUM (DTT_SCT_SCENE + 1)
 
+#ifndef DP_SCHEMA_NUM_MAX
 #define DP_SCHEMA_NUM_MAX 1
+#endif
+
+// bucket number of devid hash, must be power of 2
+#ifndef DP_SCHEMA_HASH_SIZE
+#define DP_SCHEMA_HASH_SIZE 8
+#endif
 
 typedef struct {
     // DELAYED_WORK_HANDLE tmm_dp_sync;
     uint16_t serial_no;
     MUTEX_HANDLE mutex;
     uint8_t schema_num;
-    dp_schema_t *schema_list[DP_SCHEMA_NUM_MAX];
+    dp_schema_t *schema_hash[DP_SCHEMA_HASH_SIZE];
 } dp_schema_mgr_t;
 
 static dp_schema_mgr_t s_dsmgr = {0};
 
+static uint32_t dp_schema_hash(const char *devid)
+{
+    uint32_t hash = 5381;
+
+    while (*devid) {
+        hash = ((hash << 5) + hash) + (uint8_t)(*devid++);
+    }
+
+    return hash;
+}
+
 /**
  * @brief Appends a JSON string to the given data with the specified time, type,
  * and repetition sequence.
@@ -117,16 +135,11 @@ __err_exit:
  */
 dp_node_t *dp_node_find(dp_schema_t *schema, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
+    if (id < 0 || id >= (int)sizeof(schema->index) || 0 == schema->index[id]) {
+        return NULL;
     }
-    return dpnode;
+
+    return &schema->node[schema->index[id] - 1];
 }
 
 /**
@@ -137,19 +150,14 @@ dp_node_t *dp_node_find(dp_schema_t *schema, int id)
  */
 dp_schema_t *dp_schema_find(const char *devid)
 {
-    int i = 0;
+    dp_schema_t *schema = NULL;
+    uint32_t hash = dp_schema_hash(devid);
 
     PR_TRACE("try to find schema devid %s", devid);
-    dp_schema_mgr_t *dsmgr = &s_dsmgr;
-    for (i = 0; i < DP_SCHEMA_NUM_MAX; i++) {
-        if (NULL == dsmgr->schema_list[i]) {
-            continue;
+    for (schema = s_dsmgr.schema_hash[hash & (DP_SCHEMA_HASH_SIZE - 1)]; schema; schema = schema->next) {
+        if (schema->hash == hash && 0 == strcmp(devid, schema->devid)) {
+            return schema;
         }
-        if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
-            return dsmgr->schema_list[i];
-        }
-
-        PR_TRACE("find schema devid %s, not match!", dsmgr->schema_list[i]->devid);
     }
 
     return NULL;
@@ -167,20 +175,12 @@ dp_schema_t *dp_schema_find(const char *devid)
  */
 dp_node_t *dp_node_find_by_devid(char *devid, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
     dp_schema_t *schema = dp_schema_find(devid);
     if (NULL == schema) {
         return NULL;
     }
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
-    }
-    return dpnode;
+
+    return dp_node_find(schema, id);
 }
 
 static OPERATE_RET dp_obj_equal_resp(dp_schema_t *schema, uint8_t *dpid, uint8_t num, dp_cmd_type_t cmd_tp)
@@ -819,52 +819,128 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
 }
 
 /**
- * @brief Outputs the JSON representation of a device property (DP) schema.
- *
- * This function takes a DP schema, input data, validation information, and
- * output data as parameters. It generates the JSON representation of the DP
- * schema based on the provided input data and validation information, and
- * stores the result in the output data structure.
- *
- * @param schema Pointer to the DP schema structure.
- * @param dpin Pointer to the input data structure.
- * @param dpvalid Pointer to the validation information structure.
- * @param dpout Pointer to the output data structure.
- * @return Integer value indicating the success or failure of the operation.
+ * @brief JSON writer on a fixed buffer, keeps counting the bytes after the
+ * buffer is full, so the caller knows the exact size to retry with.
  */
-int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+typedef struct {
+    char *buf;
+    uint32_t size;
+    uint32_t len;
+} dp_json_writer_t;
+
+static void dp_json_putn(dp_json_writer_t *w, const char *s, uint32_t n)
 {
-    uint16_t i, j;
-    uint16_t offset = 0;
-    uint16_t time_offset = 0;
-    OPERATE_RET op_ret = OPRT_OK;
-    char *dpstr = NULL;
-    char *dptimestr = NULL;
-    bool is_need_time = false;
+    if (w->len + n <= w->size) {
+        memcpy(w->buf + w->len, s, n);
+    }
+    w->len += n;
+}
 
-    dpstr = (char *)tal_malloc(dpvalid->len);
-    if (NULL == dpstr) {
-        PR_ERR("malloc err:%d", dpvalid->len);
-        return OPRT_MALLOC_FAILED;
+static void dp_json_putc(dp_json_writer_t *w, char c)
+{
+    if (w->len < w->size) {
+        w->buf[w->len] = c;
     }
-    // STAT type DP needs to assemble a timestamp
-    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
-        dptimestr = (char *)tal_malloc(dpvalid->timelen);
-        if (NULL == dptimestr) {
-            PR_ERR("malloc err:%d", dpvalid->timelen);
-            op_ret = OPRT_MALLOC_FAILED;
-            goto __err_exit;
+    w->len++;
+}
+
+static void dp_json_put_uint(dp_json_writer_t *w, uint32_t v, bool neg)
+{
+    char tmp[11];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (neg) {
+        tmp[--i] = '-';
+    }
+    dp_json_putn(w, tmp + i, sizeof(tmp) - i);
+}
+
+static void dp_json_put_int(dp_json_writer_t *w, int v)
+{
+    dp_json_put_uint(w, (v < 0) ? (0u - (uint32_t)v) : (uint32_t)v, v < 0);
+}
+
+// escape the same characters as cJSON_PrintUnformatted
+static void dp_json_put_str(dp_json_writer_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+    uint8_t c;
+
+    dp_json_putc(w, '"');
+    for (; *s; s++) {
+        c = (uint8_t)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        dp_json_putn(w, run, s - run);
+        run = s + 1;
+        dp_json_putc(w, '\\');
+        switch (c) {
+        case '"':
+        case '\\':
+            dp_json_putc(w, c);
+            break;
+        case '\b':
+            dp_json_putc(w, 'b');
+            break;
+        case '\f':
+            dp_json_putc(w, 'f');
+            break;
+        case '\n':
+            dp_json_putc(w, 'n');
+            break;
+        case '\r':
+            dp_json_putc(w, 'r');
+            break;
+        case '\t':
+            dp_json_putc(w, 't');
+            break;
+        default:
+            dp_json_putn(w, "u00", 3);
+            dp_json_putc(w, hex[c >> 4]);
+            dp_json_putc(w, hex[c & 0x0f]);
+            break;
         }
-        is_need_time = true;
     }
-    dpstr[offset++] = '{';
-    if (is_need_time) {
-        dptimestr[time_offset++] = '{';
+    dp_json_putn(w, run, s - run);
+    dp_json_putc(w, '"');
+}
+
+// "id":
+static void dp_json_put_key(dp_json_writer_t *w, uint8_t id, bool first)
+{
+    if (!first) {
+        dp_json_putc(w, ',');
     }
+    dp_json_putc(w, '"');
+    dp_json_put_uint(w, id, false);
+    dp_json_putn(w, "\":", 2);
+}
 
-    for (i = 0; i < dpvalid->num; i++) {
+/**
+ * @brief Writes the valid dps, and the time stamps if timew is not NULL, in one
+ * pass without any allocation.
+ */
+static int dp_rept_json_stream(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid,
+                               dp_json_writer_t *dpsw, dp_json_writer_t *timew)
+{
+    uint16_t i, j, k;
+    bool first_time = true;
+
+    dp_json_putc(dpsw, '{');
+    if (timew) {
+        dp_json_putc(timew, '{');
+    }
+
+    // dpvalid->dpid keeps the order of dpin->dps, so the search goes on from the last match
+    for (i = 0, j = 0; i < dpvalid->num; i++) {
         dp_obj_t *dp = NULL;
-        for (j = 0; j < dpin->dpscnt; j++) {
+        for (k = 0; k < dpin->dpscnt; k++, j = (j + 1 < dpin->dpscnt) ? j + 1 : 0) {
             if (dpvalid->dpid[i] == dpin->dps[j].id) {
                 dp = &dpin->dps[j];
                 break;
@@ -872,84 +948,167 @@ int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
         }
         if (NULL == dp) {
             PR_DEBUG("dp not found");
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
-        // dp_obj_t  *dp     = &dpin->dps[dpvalid->dpid[i]];
         dp_node_t *dpnode = dp_node_find(schema, dp->id);
         if (NULL == dpnode) {
             PR_DEBUG("dp->id = %d not found", dp->id);
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
 
         if (dp->type != dpnode->desc.prop_tp) {
-            op_ret = OPRT_SVC_DP_TP_NOT_MATCH;
-            goto __err_exit;
+            return OPRT_SVC_DP_TP_NOT_MATCH;
         }
 
+        dp_json_put_key(dpsw, dp->id, 0 == i);
         switch (dp->type) {
         case PROP_BOOL: {
             if (TRUE == dp->value.dp_bool) {
-                offset += sprintf(dpstr + offset, "\"%d\":true,", dp->id);
+                dp_json_putn(dpsw, "true", 4);
             } else {
-                offset += sprintf(dpstr + offset, "\"%d\":false,", dp->id);
+                dp_json_putn(dpsw, "false", 5);
             }
             break;
         }
 
         case PROP_VALUE: {
-            offset += sprintf(dpstr + offset, "\"%d\":%d,", dp->id, dp->value.dp_value);
+            dp_json_put_int(dpsw, dp->value.dp_value);
             break;
         }
 
         case PROP_BITMAP: {
-            offset += sprintf(dpstr + offset, "\"%d\":%d,", dp->id, dp->value.dp_bitmap);
+            dp_json_put_uint(dpsw, dp->value.dp_bitmap, false);
             break;
         }
 
         case PROP_STR: {
-            cJSON *temp_str = cJSON_CreateString(dp->value.dp_str);
-            char *tmp_data = cJSON_PrintUnformatted(temp_str);
-            if (tmp_data) {
-                offset += sprintf(dpstr + offset, "\"%d\":%s,", dp->id, tmp_data);
-            }
-            tal_free(tmp_data);
-            cJSON_Delete(temp_str);
+            dp_json_put_str(dpsw, dp->value.dp_str);
             break;
         }
 
         case PROP_ENUM: {
-            offset +=
-                sprintf(dpstr + offset, "\"%d\":\"%s\",", dp->id, dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum]);
+            dp_json_put_str(dpsw, dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum]);
         } break;
         }
 
-        if (is_need_time && dp->time_stamp) {
-            time_offset += sprintf(dptimestr + time_offset, "\"%d\":%u,", dp->id, dp->time_stamp);
+        if (timew && dp->time_stamp) {
+            dp_json_put_key(timew, dp->id, first_time);
+            dp_json_put_uint(timew, dp->time_stamp, false);
+            first_time = false;
         }
     }
 
-    dpstr[offset - 1] = '}';
-    dpstr[offset] = 0;
+    dp_json_putc(dpsw, '}');
+    dp_json_putc(dpsw, '\0');
+    if (timew) {
+        dp_json_putc(timew, '}');
+        dp_json_putc(timew, '\0');
+    }
 
-    dpout->dpsjson = dpstr;
+    return OPRT_OK;
+}
 
-    PR_DEBUG("dp rept out: %s", dpstr);
+/**
+ * @brief Writes the JSON of the valid dps to the buffer provided by caller.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpin Pointer to the input data structure.
+ * @param dpvalid Pointer to the validation information structure.
+ * @param buf The output buffer.
+ * @param size The size of the output buffer.
+ * @param len The string length written, or the buffer size needed (including
+ * the '\0') if OPRT_BUFFER_NOT_ENOUGH is returned.
+ * @return Integer value indicating the success or failure of the operation.
+ */
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, char *buf, uint32_t size,
+                       uint32_t *len)
+{
+    dp_json_writer_t dpsw = {buf, size, 0};
+
+    if (NULL == schema || NULL == dpin || NULL == dpvalid || NULL == len) {
+        return OPRT_INVALID_PARM;
+    }
+
+    int op_ret = dp_rept_json_stream(schema, dpin, dpvalid, &dpsw, NULL);
+    if (OPRT_OK != op_ret) {
+        return op_ret;
+    }
+    if (dpsw.len > size) {
+        *len = dpsw.len;
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    *len = dpsw.len - 1;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Outputs the JSON representation of a device property (DP) schema.
+ *
+ * This function takes a DP schema, input data, validation information, and
+ * output data as parameters. It generates the JSON representation of the DP
+ * schema based on the provided input data and validation information, and
+ * stores the result in the output data structure.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpin Pointer to the input data structure.
+ * @param dpvalid Pointer to the validation information structure.
+ * @param dpout Pointer to the output data structure.
+ * @return Integer value indicating the success or failure of the operation.
+ */
+int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    dp_json_writer_t dpsw = {NULL, dpvalid->len, 0};
+    dp_json_writer_t timew = {NULL, dpvalid->timelen, 0};
+    bool is_need_time = false;
+
+    // STAT type DP needs to assemble a timestamp
+    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
+        is_need_time = true;
+    }
+
+    // dpvalid->len is an estimate, write again with the exact size if it is short
+    do {
+        if (dpsw.len > dpsw.size || timew.len > timew.size) {
+            PR_DEBUG("dp rept json resize %d/%d %d/%d", dpsw.len, dpsw.size, timew.len, timew.size);
+            dpsw.size = (dpsw.len > dpsw.size) ? dpsw.len : dpsw.size;
+            timew.size = (timew.len > timew.size) ? timew.len : timew.size;
+            tal_free(dpsw.buf);
+            tal_free(timew.buf);
+        }
+        dpsw.len = 0;
+        timew.len = 0;
+        dpsw.buf = (char *)tal_malloc(dpsw.size);
+        timew.buf = is_need_time ? (char *)tal_malloc(timew.size) : NULL;
+        if (NULL == dpsw.buf || (is_need_time && NULL == timew.buf)) {
+            PR_ERR("malloc err:%d %d", dpsw.size, timew.size);
+            op_ret = OPRT_MALLOC_FAILED;
+            goto __err_exit;
+        }
+        op_ret = dp_rept_json_stream(schema, dpin, dpvalid, &dpsw, is_need_time ? &timew : NULL);
+        if (OPRT_OK != op_ret) {
+            goto __err_exit;
+        }
+    } while (dpsw.len > dpsw.size || timew.len > timew.size);
+
+    dpout->dpsjson = dpsw.buf;
+
+    PR_DEBUG("dp rept out: %s", dpsw.buf);
 
     if (is_need_time) {
-        dptimestr[time_offset - 1] = '}';
-        dptimestr[time_offset] = 0;
-        PR_DEBUG("dptimestr:%s", dptimestr);
-        dpout->timejson = dptimestr;
+        PR_DEBUG("dptimestr:%s", timew.buf);
+        dpout->timejson = timew.buf;
     }
 
     return OPRT_OK;
 
 __err_exit:
-    tal_free(dpstr);
-    if (is_need_time) {
-        tal_free(dptimestr);
+    if (dpsw.buf) {
+        tal_free(dpsw.buf);
+    }
+    if (timew.buf) {
+        tal_free(timew.buf);
     }
 
     return op_ret;
@@ -1563,11 +1722,20 @@ int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out
     dp_schema->actv.preprocess = other_attr.preprocess;
     dp_schema->actv.attach_dp_if = TRUE;
     strncpy(dp_schema->devid, devid, DEV_ID_LEN);
+    // the first one wins if the id is duplicated, as the linear search did
+    int i;
+    for (i = nodenum - 1; i >= 0; i--) {
+        dp_schema->index[dp_schema->node[i].desc.id] = i + 1;
+    }
     if (dp_schema_out) {
         *dp_schema_out = dp_schema;
     }
     if (s_dsmgr.schema_num < DP_SCHEMA_NUM_MAX) {
-        s_dsmgr.schema_list[s_dsmgr.schema_num] = dp_schema;
+        dp_schema_t **bucket = NULL;
+        dp_schema->hash = dp_schema_hash(dp_schema->devid);
+        bucket = &s_dsmgr.schema_hash[dp_schema->hash & (DP_SCHEMA_HASH_SIZE - 1)];
+        dp_schema->next = *bucket;
+        *bucket = dp_schema;
         s_dsmgr.schema_num++;
     }
     PR_DEBUG("create dp_schema Success ");
@@ -1594,23 +1762,129 @@ __exit:
  */
 int dp_schema_delete(char *devid)
 {
-    int i = 0;
+    dp_schema_t **pp = NULL;
+    dp_schema_t *schema = NULL;
+    uint32_t hash = dp_schema_hash(devid);
 
     PR_TRACE("try to delete schema devid %s", devid);
     dp_schema_mgr_t *dsmgr = &s_dsmgr;
-    for (i = 0; i < DP_SCHEMA_NUM_MAX; i++) {
-        if (NULL == dsmgr->schema_list[i]) {
-            continue;
-        }
-
-        if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
-            tal_mutex_release(dsmgr->schema_list[i]->mutex);
-            tal_free(dsmgr->schema_list[i]);
-            dsmgr->schema_list[i] = NULL;
+    for (pp = &dsmgr->schema_hash[hash & (DP_SCHEMA_HASH_SIZE - 1)]; *pp; pp = &(*pp)->next) {
+        schema = *pp;
+        if (schema->hash == hash && 0 == strcmp(devid, schema->devid)) {
+            *pp = schema->next;
+            tal_mutex_release(schema->mutex);
+            tal_free(schema);
             dsmgr->schema_num--;
             return OPRT_OK;
         }
     }
 
     return OPRT_OK;
-}
\ No newline at end of file
+}
+
+#if defined(DP_SCHEMA_BENCHMARK) && (DP_SCHEMA_BENCHMARK == 1)
+#define DP_BENCH_NUM 100
+
+int dp_rept_json_benchmark(uint32_t rounds)
+{
+    static char *enum_range[] = {"low", "middle", "high"};
+    static char str_value[DP_BENCH_NUM][32];
+    static char buf[4096];
+    int rt = OPRT_OK;
+    uint32_t i = 0, r = 0, len = 0;
+    SYS_TIME_T t0, t_output, t_write;
+
+    if (0 == rounds) {
+        return OPRT_INVALID_PARM;
+    }
+
+    /* a bare schema, not registered, with the five dp types in turn */
+    dp_schema_t *schema = tal_malloc(sizeof(dp_schema_t) + DP_BENCH_NUM * sizeof(dp_node_t));
+    dp_obj_t *dps = tal_malloc(DP_BENCH_NUM * sizeof(dp_obj_t));
+    dp_rept_valid_t *dpvalid = tal_malloc(sizeof(dp_rept_valid_t) + DP_BENCH_NUM);
+    if (NULL == schema || NULL == dps || NULL == dpvalid) {
+        rt = OPRT_MALLOC_FAILED;
+        goto __exit;
+    }
+    memset(schema, 0, sizeof(dp_schema_t) + DP_BENCH_NUM * sizeof(dp_node_t));
+    rt = tal_mutex_create_init(&schema->mutex);
+    if (OPRT_OK != rt) {
+        goto __exit;
+    }
+    schema->num = DP_BENCH_NUM;
+
+    for (i = 0; i < DP_BENCH_NUM; i++) {
+        dp_node_t *node = &schema->node[i];
+        dp_obj_t *dp = &dps[i];
+        node->desc.id = i + 1;
+        node->desc.prop_tp = i % 5;
+        schema->index[i + 1] = i + 1;
+        dp->id = i + 1;
+        dp->type = node->desc.prop_tp;
+        dp->time_stamp = 0;
+        switch (dp->type) {
+        case PROP_BOOL:
+            dp->value.dp_bool = i & 1;
+            break;
+        case PROP_VALUE:
+            dp->value.dp_value = (int)(i * 7919) - 300000;
+            break;
+        case PROP_STR:
+            /* quotes, a newline and a control byte to escape */
+            snprintf(str_value[i], sizeof(str_value[i]), "str \"%u\"\n\x01 tail", i);
+            dp->value.dp_str = str_value[i];
+            break;
+        case PROP_ENUM:
+            node->prop.prop_enum.pp_enum = enum_range;
+            node->prop.prop_enum.cnt = CNTSOF(enum_range);
+            dp->value.dp_enum = i % CNTSOF(enum_range);
+            break;
+        default:
+            dp->value.dp_bitmap = i * 3;
+            break;
+        }
+    }
+
+    /* retransmission skips the flow control, so every round reports all */
+    dp_rept_in_t dpin = {.rept_type = T_RE_TRANS_REPT, .dpscnt = DP_BENCH_NUM, .dps = dps};
+
+    int heap = tal_system_get_free_heap_size();
+    t0 = tal_system_get_millisecond();
+    for (r = 0; r < rounds && OPRT_OK == rt; r++) {
+        dp_rept_out_t dpout = {NULL, NULL};
+        memset(dpvalid, 0, sizeof(dp_rept_valid_t));
+        rt = dp_rept_valid_check(schema, &dpin, dpvalid);
+        if (OPRT_OK == rt) {
+            rt = dp_rept_json_output(schema, &dpin, dpvalid, &dpout);
+        }
+        tal_free(dpout.dpsjson);
+        tal_free(dpout.timejson);
+    }
+    t_output = tal_system_get_millisecond() - t0;
+
+    t0 = tal_system_get_millisecond();
+    for (r = 0; r < rounds && OPRT_OK == rt; r++) {
+        rt = dp_rept_json_write(schema, &dpin, dpvalid, buf, sizeof(buf), &len);
+    }
+    t_write = tal_system_get_millisecond() - t0;
+    heap -= tal_system_get_free_heap_size();
+
+    if (OPRT_OK == rt) {
+        PR_NOTICE("dp report %d dps x%u, %u bytes json", DP_BENCH_NUM, rounds, len);
+        PR_NOTICE("valid check + json output:%ums, json write:%ums, heap lost:%d", (uint32_t)t_output,
+                  (uint32_t)t_write, heap);
+    }
+
+__exit:
+    if (schema && schema->mutex) {
+        tal_mutex_release(schema->mutex);
+    }
+    tal_free(schema);
+    tal_free(dps);
+    tal_free(dpvalid);
+    if (OPRT_OK != rt) {
+        PR_ERR("dp report benchmark failed %d", rt);
+    }
+    return rt;
+}
+#endif
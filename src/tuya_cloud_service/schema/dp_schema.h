@@ -321,13 +321,19 @@ typedef struct {
 
 // typedef struct dev_cntl_n_s {
 
-typedef struct {
+typedef struct dp_schema {
     /** virtual id */
     char devid[DEV_ID_LEN + 1];
     /** device attribute, see DEV_ACTV_ATTR_S */
     dp_prop_actv_t actv;
     /** exclusive access to dp */
     MUTEX_HANDLE mutex;
+    /** next schema in the same devid hash bucket */
+    struct dp_schema *next;
+    /** hash of devid */
+    uint32_t hash;
+    /** dp id to (index in node + 1), 0 means not exist */
+    uint8_t index[256];
     /** count of dp */
     uint8_t num;
     /** dp info */
@@ -484,6 +490,24 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
  */
 int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout);
 
+/**
+ * @brief Writes the JSON of the valid dps to the buffer provided by caller.
+ *
+ * Same output as dp_rept_json_output, but nothing is allocated, suits for the
+ * caller reporting at high frequency with a reused buffer.
+ *
+ * @param schema The DP schema structure.
+ * @param dpin The input data for the DP report.
+ * @param dpvalid The validation information for the DP report.
+ * @param buf The output buffer.
+ * @param size The size of the output buffer.
+ * @param len The string length written, or the buffer size needed if
+ * OPRT_BUFFER_NOT_ENOUGH is returned.
+ * @return Returns OPRT_OK on success, or an error code on failure.
+ */
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, char *buf, uint32_t size,
+                       uint32_t *len);
+
 /**
  * Appends a JSON string to the given data point schema.
  *
@@ -558,6 +582,19 @@ char *dp_obj_dump_all_json(char *devid, int flags);
  */
 int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char **outjson, int flags);
 
+#if defined(DP_SCHEMA_BENCHMARK) && (DP_SCHEMA_BENCHMARK == 1)
+/**
+ * @brief Reports 100 dps of all types rounds times through
+ * dp_rept_valid_check and dp_rept_json_output, then through
+ * dp_rept_json_write with a reused buffer, and logs the time of each and the
+ * heap not given back.
+ *
+ * @param rounds The number of reports of each kind.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int dp_rept_json_benchmark(uint32_t rounds);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
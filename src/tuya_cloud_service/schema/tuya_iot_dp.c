@@ -34,6 +34,67 @@ static DELAYED_WORK_HANDLE s_tmm_dp_sync = NULL;
 
 int tuya_iot_dp_sync_start(tuya_iot_client_t *client, uint32_t timeout_s);
 
+#if defined(ENABLE_DP_REPT_BATCH) && (ENABLE_DP_REPT_BATCH == 1)
+#ifndef DP_REPT_BATCH_WINDOW_MS
+#define DP_REPT_BATCH_WINDOW_MS (50)
+#endif
+
+#ifndef DP_REPT_BATCH_MAX_DP
+#define DP_REPT_BATCH_MAX_DP (16)
+#endif
+
+/**
+ * @brief dps of one device waiting to go out in one frame, a later value of a
+ * dp replaces the earlier one in place
+ */
+typedef struct dp_rept_batch {
+    struct dp_rept_batch *next;
+    dp_schema_t *schema;
+    uint16_t len;
+    uint8_t num;
+    dp_obj_t dps[DP_REPT_BATCH_MAX_DP];
+} dp_rept_batch_t;
+
+static MUTEX_HANDLE s_dp_batch_mutex = NULL;
+static DELAYED_WORK_HANDLE s_tmm_dp_batch = NULL;
+static dp_rept_batch_t *s_dp_batch_list = NULL;
+static tuya_iot_dp_batch_stat_t s_dp_batch_stat;
+#endif
+
+static void dp_sync_cb(int result, void *user_data);
+
+/**
+ * @brief Sends the json of reported dps on the LAN or MQTT channel, dpvalid is
+ * released here or by the MQTT notify
+ */
+static int dp_rept_json_send(tuya_iot_client_t *client, dp_schema_t *schema, char *dpsjson, dp_rept_valid_t *dpvalid)
+{
+    int ret = OPRT_OK;
+
+    if (tuya_lan_is_connected()) {
+        char *out = NULL;
+        PR_DEBUG("lan channel report");
+        dp_rept_json_append(schema, dpsjson, NULL, NULL, 0, &out);
+        ret = tuya_lan_dp_report(out);
+        tal_free(out);
+        tal_free(dpvalid);
+        tuya_iot_dp_sync_start(client, 5);
+    } else if (tuya_iot_is_connected()) {
+        PR_DEBUG("mqtt channel report");
+        ret = tuya_iot_dp_report_json_with_notify(client, dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+        if (OPRT_OK != ret) {
+            // not queued, dp_sync_cb will not run
+            tal_free(dpvalid);
+            tuya_iot_dp_sync_start(client, 5);
+        }
+    } else {
+        PR_ERR("no channel for connect");
+        tal_free(dpvalid);
+    }
+
+    return ret;
+}
+
 static void dp_sync_cb(int result, void *user_data)
 {
     dp_rept_valid_t *dpvalid = (dp_rept_valid_t *)user_data;
@@ -198,6 +259,300 @@ int tuya_iot_dp_parse(tuya_iot_client_t *client, dp_cmd_type_t cmd_tp, cJSON *cm
     return tal_workq_schedule(WORKQ_HIGHTPRI, tuya_iot_dp_parse_on_worq, msg);
 }
 
+#if defined(ENABLE_DP_REPT_BATCH) && (ENABLE_DP_REPT_BATCH == 1)
+static void dp_batch_free(dp_rept_batch_t *batch)
+{
+    for (int i = 0; i < batch->num; i++) {
+        if (PROP_STR == batch->dps[i].type) {
+            tal_free(batch->dps[i].value.dp_str);
+        }
+    }
+    tal_free(batch);
+}
+
+static void dp_batch_flush(tuya_iot_client_t *client, dp_rept_batch_t *batch)
+{
+    int ret = OPRT_OK;
+    dp_rept_valid_t *dpvalid = tal_malloc(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * batch->num);
+    if (NULL == dpvalid) {
+        dp_batch_free(batch);
+        tuya_iot_dp_sync_start(client, 5);
+        return;
+    }
+    memset(dpvalid, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * batch->num);
+    dpvalid->schema = batch->schema;
+    dpvalid->len = batch->len;
+    for (dpvalid->num = 0; dpvalid->num < batch->num; dpvalid->num++) {
+        dpvalid->dpid[dpvalid->num] = batch->dps[dpvalid->num].id;
+    }
+
+    dp_rept_in_t dpin;
+    dp_rept_out_t dpout;
+
+    dpin.dps = batch->dps;
+    dpin.dpscnt = batch->num;
+    dpin.flags = 0;
+    dpin.rept_type = T_OBJ_REPT;
+    memset(&dpout, 0, sizeof(dpout));
+
+    ret = dp_rept_json_output(batch->schema, &dpin, dpvalid, &dpout);
+    if (OPRT_OK != ret) {
+        PR_ERR("dp batch json output error %d", ret);
+        tal_free(dpvalid);
+        dp_batch_free(batch);
+        tuya_iot_dp_sync_start(client, 5);
+        return;
+    }
+
+    ret = dp_rept_json_send(client, batch->schema, dpout.dpsjson, dpvalid);
+    if (OPRT_OK != ret) {
+        PR_ERR("dp batch report error %d", ret);
+    }
+
+    tal_mutex_lock(s_dp_batch_mutex);
+    uint32_t frame_cnt = ++s_dp_batch_stat.frame_cnt;
+    uint32_t rept_cnt = s_dp_batch_stat.rept_cnt;
+    tal_mutex_unlock(s_dp_batch_mutex);
+    PR_DEBUG("dp batch: %d dps, reports %u, frames %u", batch->num, rept_cnt, frame_cnt);
+
+    tal_free(dpout.dpsjson);
+    dp_batch_free(batch);
+}
+
+/* Takes the batch of a device, or all batches if schema is NULL, off the list */
+static dp_rept_batch_t *dp_batch_detach(dp_schema_t *schema)
+{
+    dp_rept_batch_t **next_batch = &s_dp_batch_list;
+    dp_rept_batch_t *batch = NULL;
+
+    if (NULL == schema) {
+        batch = s_dp_batch_list;
+        s_dp_batch_list = NULL;
+        return batch;
+    }
+
+    for (; *next_batch; next_batch = &(*next_batch)->next) {
+        if ((*next_batch)->schema == schema) {
+            batch = *next_batch;
+            *next_batch = batch->next;
+            batch->next = NULL;
+            break;
+        }
+    }
+
+    return batch;
+}
+
+static void dp_batch_flush_all(tuya_iot_client_t *client, dp_rept_batch_t *batch)
+{
+    while (batch) {
+        dp_rept_batch_t *next = batch->next;
+        dp_batch_flush(client, batch);
+        batch = next;
+    }
+}
+
+static void dp_batch_window_cb(void *data)
+{
+    tal_mutex_lock(s_dp_batch_mutex);
+    dp_rept_batch_t *batch = dp_batch_detach(NULL);
+    tal_mutex_unlock(s_dp_batch_mutex);
+
+    dp_batch_flush_all((tuya_iot_client_t *)data, batch);
+}
+
+/**
+ * @brief Puts the valid dps of a report into the pending frame of the device.
+ *
+ * The frame is sent DP_REPT_BATCH_WINDOW_MS after its first dp, or right away
+ * once it holds DP_REPT_BATCH_MAX_DP dps. A report with more valid dps than
+ * that is sent on its own, after the pending frame of the device.
+ *
+ * @return OPRT_OK if the dps were queued, OPRT_EXCEED_UPPER_LIMIT if the
+ * report has to be sent directly
+ */
+static int dp_batch_add(tuya_iot_client_t *client, dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid)
+{
+    OPERATE_RET rt = OPRT_OK;
+    dp_rept_batch_t *flush = NULL;
+    dp_obj_t dps[DP_REPT_BATCH_MAX_DP];
+    int i, j;
+
+    // not initialized, send directly
+    if (NULL == s_tmm_dp_batch) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    if (dpvalid->num > DP_REPT_BATCH_MAX_DP) {
+        tal_mutex_lock(s_dp_batch_mutex);
+        flush = dp_batch_detach(schema);
+        tal_mutex_unlock(s_dp_batch_mutex);
+        dp_batch_flush_all(client, flush);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    // copy the valid dps, the caller owns the strings. dpvalid->dpid keeps the
+    // order of dpin->dps, so the search goes on from the last match
+    for (i = 0, j = 0; i < dpvalid->num; i++) {
+        while (dpin->dps[j].id != dpvalid->dpid[i]) {
+            j = (j + 1 < dpin->dpscnt) ? j + 1 : 0;
+        }
+        dps[i] = dpin->dps[j];
+        if (PROP_STR == dps[i].type) {
+            dps[i].value.dp_str = tal_malloc(strlen(dpin->dps[j].value.dp_str) + 1);
+            if (NULL == dps[i].value.dp_str) {
+                dps[i].type = PROP_BOOL;
+                rt = OPRT_MALLOC_FAILED;
+                break;
+            }
+            strcpy(dps[i].value.dp_str, dpin->dps[j].value.dp_str);
+        }
+    }
+    if (OPRT_OK != rt) {
+        while (i-- > 0) {
+            if (PROP_STR == dps[i].type) {
+                tal_free(dps[i].value.dp_str);
+            }
+        }
+        return rt;
+    }
+
+    tal_mutex_lock(s_dp_batch_mutex);
+
+    dp_rept_batch_t *batch = NULL;
+    dp_rept_batch_t **next_batch = &s_dp_batch_list;
+    for (; *next_batch; next_batch = &(*next_batch)->next) {
+        if ((*next_batch)->schema == schema) {
+            batch = *next_batch;
+            break;
+        }
+    }
+
+    // no room for the new dps, send what is pending first so the order holds
+    if (batch && batch->num + dpvalid->num > DP_REPT_BATCH_MAX_DP) {
+        int fresh = 0;
+        for (i = 0; i < dpvalid->num; i++) {
+            for (j = 0; j < batch->num && batch->dps[j].id != dps[i].id; j++) {
+            }
+            fresh += (j == batch->num);
+        }
+        if (batch->num + fresh > DP_REPT_BATCH_MAX_DP) {
+            flush = dp_batch_detach(schema);
+            next_batch = &s_dp_batch_list;
+            while (*next_batch) {
+                next_batch = &(*next_batch)->next;
+            }
+            batch = NULL;
+        }
+    }
+
+    if (NULL == batch) {
+        bool start = (NULL == s_dp_batch_list);
+        batch = tal_calloc(1, sizeof(dp_rept_batch_t));
+        if (NULL == batch) {
+            tal_mutex_unlock(s_dp_batch_mutex);
+            for (i = 0; i < dpvalid->num; i++) {
+                if (PROP_STR == dps[i].type) {
+                    tal_free(dps[i].value.dp_str);
+                }
+            }
+            dp_batch_flush_all(client, flush);
+            return OPRT_MALLOC_FAILED;
+        }
+        batch->schema = schema;
+        *next_batch = batch;
+        if (start) {
+            tal_workq_start_delayed(s_tmm_dp_batch, DP_REPT_BATCH_WINDOW_MS, LOOP_ONCE);
+        }
+    }
+
+    // last value wins
+    for (i = 0; i < dpvalid->num; i++) {
+        for (j = 0; j < batch->num && batch->dps[j].id != dps[i].id; j++) {
+        }
+        if (j < batch->num) {
+            if (PROP_STR == batch->dps[j].type) {
+                tal_free(batch->dps[j].value.dp_str);
+            }
+            s_dp_batch_stat.dp_merged++;
+        } else {
+            batch->num++;
+        }
+        batch->dps[j] = dps[i];
+    }
+    batch->len += dpvalid->len;
+    s_dp_batch_stat.rept_cnt++;
+    s_dp_batch_stat.dp_cnt += dpvalid->num;
+
+    if (batch->num == DP_REPT_BATCH_MAX_DP) {
+        dp_rept_batch_t *full = dp_batch_detach(schema);
+        full->next = flush;
+        flush = full;
+    }
+
+    tal_mutex_unlock(s_dp_batch_mutex);
+
+    dp_batch_flush_all(client, flush);
+
+    return OPRT_OK;
+}
+#endif
+
+/**
+ * @brief Initializes the dp report of the client, the batching mutex and
+ * window work are created here once, before any report.
+ *
+ * @param client The IoT client
+ *
+ * @return OPRT_OK on success, or an error code on failure
+ */
+int tuya_iot_dp_init(tuya_iot_client_t *client)
+{
+#if defined(ENABLE_DP_REPT_BATCH) && (ENABLE_DP_REPT_BATCH == 1)
+    OPERATE_RET rt = OPRT_OK;
+
+    if (s_tmm_dp_batch) {
+        return OPRT_OK;
+    }
+
+    TUYA_CALL_ERR_RETURN(tal_mutex_create_init(&s_dp_batch_mutex));
+    rt = tal_workq_init_delayed(WORKQ_HIGHTPRI, dp_batch_window_cb, client, &s_tmm_dp_batch);
+    if (OPRT_OK != rt) {
+        tal_mutex_release(s_dp_batch_mutex);
+        s_dp_batch_mutex = NULL;
+        return rt;
+    }
+#endif
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Returns the counters of the dp report batching
+ *
+ * @param stat The counters, the merge ratio is rept_cnt / frame_cnt
+ *
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED without ENABLE_DP_REPT_BATCH
+ */
+int tuya_iot_dp_batch_stat_get(tuya_iot_dp_batch_stat_t *stat)
+{
+#if defined(ENABLE_DP_REPT_BATCH) && (ENABLE_DP_REPT_BATCH == 1)
+    if (NULL == stat) {
+        return OPRT_INVALID_PARM;
+    }
+    if (s_dp_batch_mutex) {
+        tal_mutex_lock(s_dp_batch_mutex);
+    }
+    *stat = s_dp_batch_stat;
+    if (s_dp_batch_mutex) {
+        tal_mutex_unlock(s_dp_batch_mutex);
+    }
+    return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
+}
+
 /**
  * @brief Reports device object data to the Tuya IoT cloud service.
  *
@@ -234,7 +589,7 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     if (NULL == dpvalid) {
         return OPRT_MALLOC_FAILED;
     }
-    memset(dpvalid, 0, sizeof(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt));
+    memset(dpvalid, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt);
 
     PR_DEBUG("dp report: devid %s, dps 0x%08x, dpscnt %d, flags %d", devid ? devid : "null", dps, dpscnt, flags);
 
@@ -285,6 +640,14 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     }
 #endif
 
+#if defined(ENABLE_DP_REPT_BATCH) && (ENABLE_DP_REPT_BATCH == 1)
+    ret = dp_batch_add(client, schema, &dpin, dpvalid);
+    if (OPRT_EXCEED_UPPER_LIMIT != ret) {
+        tal_free(dpvalid);
+        return ret;
+    }
+#endif
+
     dp_rept_out_t dpout;
 
     memset(&dpout, 0, sizeof(dpout));
@@ -292,23 +655,11 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     ret = dp_rept_json_output(schema, &dpin, dpvalid, &dpout);
     if (OPRT_OK != ret) {
         PR_DEBUG("dp rept json output error %d", ret);
+        tal_free(dpvalid);
         return ret;
     }
 
-    if (tuya_lan_is_connected()) {
-        char *out = NULL;
-        PR_DEBUG("lan channel report");
-        dp_rept_json_append(schema, dpout.dpsjson, NULL, NULL, 0, &out);
-        ret = tuya_lan_dp_report(out);
-        tal_free(out);
-        tal_free(dpvalid);
-        tuya_iot_dp_sync_start(client, 5);
-    } else if (tuya_iot_is_connected()) {
-        PR_DEBUG("mqtt channel report");
-        ret = tuya_iot_dp_report_json_with_notify(client, dpout.dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
-    } else {
-        PR_ERR("no channel for connect");
-    }
+    ret = dp_rept_json_send(client, schema, dpout.dpsjson, dpvalid);
 
     if (dpout.dpsjson) {
         tal_free(dpout.dpsjson);
@@ -23,6 +23,28 @@ extern "C" {
 
 #include "tuya_iot.h"
 
+/**
+ * @brief Counters of the dp report batching (ENABLE_DP_REPT_BATCH)
+ */
+typedef struct {
+    /** tuya_iot_dp_obj_report calls put into a batch */
+    uint32_t rept_cnt;
+    /** dps put into a batch */
+    uint32_t dp_cnt;
+    /** dps replaced by a later value before they were sent */
+    uint32_t dp_merged;
+    /** frames sent for the batches */
+    uint32_t frame_cnt;
+} tuya_iot_dp_batch_stat_t;
+
+/**
+ * @brief Initializes the dp report of the client, called by tuya_iot_init
+ *
+ * @param client
+ * @return int
+ */
+int tuya_iot_dp_init(tuya_iot_client_t *client);
+
 /**
  * @brief
  *
@@ -76,6 +98,15 @@ int tuya_iot_dp_raw_report(tuya_iot_client_t *client, const char *devid, dp_raw_
  */
 char *tuya_iot_dp_obj_dump(tuya_iot_client_t *client, char *devid, int flags);
 
+/**
+ * @brief Gets the counters of the dp report batching, the merge ratio is
+ * rept_cnt / frame_cnt
+ *
+ * @param stat
+ * @return int OPRT_NOT_SUPPORTED without ENABLE_DP_REPT_BATCH
+ */
+int tuya_iot_dp_batch_stat_get(tuya_iot_dp_batch_stat_t *stat);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,8 @@
 #include "tal_api.h"
 #include "tal_kv.h"
 #include "tal_network.h"
+#include "uni_random.h"
+#include "cipher_wrapper.h"
 #include "mbedtls/error.h"
 #include "mbedtls/debug.h"
 #include "mbedtls/net_sockets.h"
@@ -38,24 +40,86 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/hkdf.h"
 #include "mbedtls/aes.h"
+#include "mbedtls/sha256.h"
 
 #define TLS_URL_LEN (128 + 16)
 
+/*
+ * The ssl config of a connection, with the CA chain and client cert it points
+ * to. Connections with the same psk or certs share one, it is read only once
+ * built. The cached ones outlive their connections so that a reconnect skips
+ * the parsing, the others are freed with their connection.
+ *
+ * A client key is the exception: signing updates its blinding state and
+ * MBEDTLS_THREADING_C is off, so a profile holding one serves a single
+ * connection at a time, the others get a private copy.
+ */
 typedef struct {
-    tuya_tls_config_t config;
-    mbedtls_ssl_context ssl_ctx;
-    mbedtls_ssl_config conf_ctx;
+    uint8_t id[32];
+    uint32_t refcnt;
+    bool cached;
+    bool exclusive;
+    SYS_TIME_T used_ms;
+    mbedtls_ssl_config conf;
     mbedtls_x509_crt cacert;
     mbedtls_x509_crt client_cert;
     mbedtls_pk_context client_pkey;
+} tls_profile_t;
+
+typedef struct {
+    tuya_tls_config_t config;
+    mbedtls_ssl_context ssl_ctx;
+    tls_profile_t *profile;
     int socket_fd;
     int overtime_s;
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
     MUTEX_HANDLE mutex;
     MUTEX_HANDLE read_mutex;
 } tuya_mbedtls_context_t;
 
 #define TLS_HANDSHAKE_TIMEOUT (18) // s
 
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+#ifndef TLS_SESSION_CACHE_NUM
+#define TLS_SESSION_CACHE_NUM (4)
+#endif
+
+#ifndef TLS_SESSION_CACHE_LIFETIME_S
+#define TLS_SESSION_CACHE_LIFETIME_S (2 * 60 * 60)
+#endif
+
+#define TLS_SESSION_KV_KEY "tls_sess%d"
+
+/*
+ * A session is only resumed by a connection of the same profile: resumption
+ * skips the certificate exchange, so the CA and client cert that verified it
+ * must be the ones the new connection asks for.
+ */
+typedef struct {
+    char host[TLS_URL_LEN];
+    uint16_t port;
+    uint8_t profile_id[32];
+    SYS_TIME_T saved_ms;
+    mbedtls_ssl_session session;
+} tls_session_entry_t;
+
+static tls_session_entry_t s_session_cache[TLS_SESSION_CACHE_NUM];
+static MUTEX_HANDLE s_session_mutex = NULL;
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+static bool s_session_loaded = false;
+#endif
+#endif
+
+#if defined(ENABLE_TLS_PROFILE_CACHE) && (ENABLE_TLS_PROFILE_CACHE == 1)
+#ifndef TLS_PROFILE_CACHE_NUM
+#define TLS_PROFILE_CACHE_NUM (2)
+#endif
+
+static tls_profile_t *s_profile_cache[TLS_PROFILE_CACHE_NUM];
+#endif
+static MUTEX_HANDLE s_profile_mutex = NULL;
+
 static tuya_tls_pre_conn_cb s_pre_conn_cb = NULL;
 static mbedtls_entropy_context ty_entropy;
 static mbedtls_ctr_drbg_context ty_ctr_drbg;
@@ -281,6 +345,10 @@ static int __tuya_tls_socket_send_cb(void *ctx, const unsigned char *buf, size_t
         }
     }
 
+    if (send_len > 0) {
+        tls_context->tx_bytes += send_len;
+    }
+
     return send_len;
 }
 
@@ -307,92 +375,559 @@ static int __tuya_tls_socket_recv_cb(void *ctx, unsigned char *buf, size_t len)
     int rv = tal_net_recv(tls_context->socket_fd, buf, len);
     tal_net_set_block(tls_context->socket_fd, 1 - non_block);
 
+    if (rv > 0) {
+        tls_context->rx_bytes += rv;
+    }
+
     return rv;
 }
 
 static int tuya_tls_ciphersuite_list_PSK[] = {MBEDTLS_TLS_ECDHE_PSK_WITH_AES_128_CBC_SHA256, 0};
 
-static void mbedtls_cert_pkey_free(tuya_tls_hander p_tls_handler)
+static int tuya_tls_ciphersuite_list[] = {MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+                                          MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+                                          MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256, 0};
+
+/* -------------------------------------------------------------------------- */
+/*                               TLS Profiles                                 */
+/* -------------------------------------------------------------------------- */
+
+static bool __tls_config_is_psk(const tuya_tls_config_t *config)
 {
-    tuya_mbedtls_context_t *tls_context = (tuya_mbedtls_context_t *)p_tls_handler;
-    tuya_tls_config_t *config = &tls_context->config;
+    return config->psk_key_size > 0 && config->psk_id_size > 0;
+}
 
-    PR_DEBUG("mbedtls_cert_pkey_free.");
+static void __tls_profile_id_update(mbedtls_sha256_context *sha, const void *data, uint32_t len)
+{
+    uint8_t len_be[4] = {len >> 24, len >> 16, len >> 8, len};
 
-    if (config->ca_cert) {
-        mbedtls_x509_crt_free(&tls_context->cacert);
-    } else if (config->client_cert && config->client_pkey) {
-        mbedtls_x509_crt_free(&tls_context->cacert);
-        mbedtls_x509_crt_free(&tls_context->client_cert);
-        mbedtls_pk_free(&tls_context->client_pkey);
+    mbedtls_sha256_update(sha, len_be, sizeof(len_be));
+    if (data && len) {
+        mbedtls_sha256_update(sha, data, len);
     }
 }
 
-static OPERATE_RET mbedtls_cert_pkey_parse(tuya_tls_hander p_tls_handler)
+/**
+ * @brief Digest of everything the ssl config of config is built from,
+ * connections with the same digest can share one.
+ */
+static void __tls_profile_id(const tuya_tls_config_t *config, uint8_t id[32])
+{
+    mbedtls_sha256_context sha;
+    uint8_t kind = __tls_config_is_psk(config) ? 0 : (config->verify ? 2 : 1);
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, &kind, 1);
+    if (__tls_config_is_psk(config)) {
+        __tls_profile_id_update(&sha, config->psk_key, config->psk_key_size);
+        __tls_profile_id_update(&sha, config->psk_id, config->psk_id_size);
+    } else {
+        __tls_profile_id_update(&sha, config->ca_cert, config->ca_cert ? config->ca_cert_size : 0);
+        if (config->client_cert && config->client_pkey) {
+            __tls_profile_id_update(&sha, config->client_cert, config->client_cert_size);
+            __tls_profile_id_update(&sha, config->client_pkey, config->client_pkey_size);
+        }
+    }
+    mbedtls_sha256_finish(&sha, id);
+    mbedtls_sha256_free(&sha);
+}
+
+static void __tls_profile_certs_free(tls_profile_t *profile)
+{
+    mbedtls_x509_crt_free(&profile->cacert);
+    mbedtls_x509_crt_free(&profile->client_cert);
+    mbedtls_pk_free(&profile->client_pkey);
+}
+
+static void __tls_profile_free(tls_profile_t *profile)
+{
+    PR_DEBUG("tls profile free.");
+    mbedtls_ssl_config_free(&profile->conf);
+    __tls_profile_certs_free(profile);
+    tal_free(profile);
+}
+
+static OPERATE_RET __tls_profile_certs_parse(tls_profile_t *profile, const tuya_tls_config_t *config)
 {
     OPERATE_RET op_ret;
-    tuya_mbedtls_context_t *tls_context = (tuya_mbedtls_context_t *)p_tls_handler;
-    tuya_tls_config_t *config = &tls_context->config;
 
     if (config->verify) {
         PR_DEBUG("mbedtls authmode: MBEDTLS_SSL_VERIFY_REQUIRED");
-        mbedtls_ssl_conf_authmode(&(tls_context->conf_ctx), MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_authmode(&profile->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
     } else {
 
         PR_DEBUG("mbedtls authmode: MBEDTLS_SSL_VERIFY_NONE");
-        mbedtls_ssl_conf_authmode(&(tls_context->conf_ctx), MBEDTLS_SSL_VERIFY_NONE);
+        mbedtls_ssl_conf_authmode(&profile->conf, MBEDTLS_SSL_VERIFY_NONE);
     }
 
-    mbedtls_x509_crt *p_cert_ctx = &(tls_context->cacert);
-    mbedtls_x509_crt_init(p_cert_ctx);
-
     // parse ca cert
     if (config->ca_cert) {
         PR_DEBUG("load root ca cert.");
-        op_ret = mbedtls_x509_crt_parse(p_cert_ctx, (const unsigned char *)config->ca_cert, config->ca_cert_size);
+        op_ret = mbedtls_x509_crt_parse(&profile->cacert, (const unsigned char *)config->ca_cert, config->ca_cert_size);
         if (op_ret != OPRT_OK) {
             PR_ERR("mbedtls_x509_crt_parse Fail. 0x%x %d", -op_ret, op_ret);
             return op_ret;
         }
-        mbedtls_ssl_conf_ca_chain(&(tls_context->conf_ctx), p_cert_ctx, NULL);
+        mbedtls_ssl_conf_ca_chain(&profile->conf, &profile->cacert, NULL);
     }
 
     /* parse client own cert */
-    mbedtls_x509_crt *client_cert = NULL;
-    mbedtls_pk_context *client_pkey = NULL;
-
     if (config->client_cert && config->client_pkey) {
         PR_DEBUG("Loading the client cert. and key...");
-        client_cert = &(tls_context->client_cert);
-        mbedtls_x509_crt_init(client_cert);
-        op_ret = mbedtls_x509_crt_parse(client_cert, (const unsigned char *)tls_context->config.client_cert,
-                                        tls_context->config.client_cert_size);
+        op_ret = mbedtls_x509_crt_parse(&profile->client_cert, (const unsigned char *)config->client_cert,
+                                        config->client_cert_size);
         if (op_ret != OPRT_OK) {
             PR_ERR("client cert parse fail. ret: 0x%x", -op_ret);
             return op_ret;
         }
-        client_pkey = &(tls_context->client_pkey);
-        mbedtls_pk_init(client_pkey);
-        op_ret = mbedtls_pk_parse_key(client_pkey, (const unsigned char *)tls_context->config.client_pkey,
-                                      tls_context->config.client_pkey_size, NULL, 0, NULL, 0);
+        op_ret = mbedtls_pk_parse_key(&profile->client_pkey, (const unsigned char *)config->client_pkey,
+                                      config->client_pkey_size, NULL, 0, NULL, 0);
         if (op_ret != 0) {
             PR_ERR("client pkey parse fail. ret: %d", op_ret);
             return op_ret;
         }
 
-        op_ret = mbedtls_ssl_conf_own_cert(&(tls_context->conf_ctx), client_cert, client_pkey);
+        op_ret = mbedtls_ssl_conf_own_cert(&profile->conf, &profile->client_cert, &profile->client_pkey);
         if (op_ret != 0) {
             PR_ERR("set client cert && pkey fail ret: %d", op_ret);
             return op_ret;
         }
+        profile->exclusive = true;
     }
 
     return OPRT_OK;
 }
 
-static int tuya_tls_ciphersuite_list[] = {MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
-                                          MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
-                                          MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256, 0};
+static OPERATE_RET __tls_profile_build(const tuya_tls_config_t *config, const uint8_t id[32], tls_profile_t **out)
+{
+    OPERATE_RET op_ret;
+    tls_profile_t *profile = tal_malloc(sizeof(tls_profile_t));
+    if (NULL == profile) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(profile, 0, sizeof(tls_profile_t));
+    memcpy(profile->id, id, sizeof(profile->id));
+    mbedtls_ssl_config_init(&profile->conf);
+    mbedtls_x509_crt_init(&profile->cacert);
+    mbedtls_x509_crt_init(&profile->client_cert);
+    mbedtls_pk_init(&profile->client_pkey);
+
+    mbedtls_ssl_conf_dbg(&profile->conf, __tuya_tls_log, NULL);
+    mbedtls_ssl_conf_rng(&profile->conf, __tuya_tls_random, NULL);
+
+    op_ret = mbedtls_ssl_config_defaults(&profile->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                         MBEDTLS_SSL_PRESET_DEFAULT);
+    if (op_ret != 0) {
+        PR_ERR("mbedtls_ssl_config_defaults Fail. %x %d", op_ret, op_ret);
+        goto __err_exit;
+    }
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+#if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 4096)
+    mbedtls_ssl_conf_max_frag_len(&profile->conf, MBEDTLS_SSL_MAX_FRAG_LEN_4096);
+#else
+    mbedtls_ssl_conf_max_frag_len(&profile->conf, MBEDTLS_SSL_MAX_FRAG_LEN_1024);
+#endif
+#endif
+    if (__tls_config_is_psk(config)) {
+        op_ret = mbedtls_ssl_conf_psk(&profile->conf, (const unsigned char *)config->psk_key, config->psk_key_size,
+                                      (const unsigned char *)config->psk_id, config->psk_id_size);
+        if (op_ret != 0) {
+            PR_ERR("mbedtls_ssl_conf_psk Fail. 0x%x", -op_ret);
+            goto __err_exit;
+        }
+        mbedtls_ssl_conf_ciphersuites(&profile->conf, tuya_tls_ciphersuite_list_PSK);
+    } else {
+        op_ret = __tls_profile_certs_parse(profile, config);
+        if (op_ret != 0) {
+            PR_ERR("mbedtls_cert_parse_process Fail. 0x%x %d", -op_ret, op_ret);
+            goto __err_exit;
+        }
+        mbedtls_ssl_conf_ciphersuites(&profile->conf, tuya_tls_ciphersuite_list);
+    }
+
+    profile->refcnt = 1;
+    *out = profile;
+    return OPRT_OK;
+
+__err_exit:
+    __tls_profile_free(profile);
+    return op_ret;
+}
+
+/**
+ * @brief Takes a reference on the profile matching config, parsing the certs
+ * only when no cached profile matches.
+ */
+static OPERATE_RET __tls_profile_acquire(const tuya_tls_config_t *config, tls_profile_t **out)
+{
+    OPERATE_RET op_ret;
+    uint8_t id[32];
+
+    __tls_profile_id(config, id);
+
+    if (NULL == s_profile_mutex) {
+        return __tls_profile_build(config, id, out);
+    }
+
+    /* built under the lock, connections started together parse once */
+    tal_mutex_lock(s_profile_mutex);
+#if defined(ENABLE_TLS_PROFILE_CACHE) && (ENABLE_TLS_PROFILE_CACHE == 1)
+    int i;
+    bool busy = false;
+    tls_profile_t **slot = NULL;
+    for (i = 0; i < TLS_PROFILE_CACHE_NUM; i++) {
+        tls_profile_t *it = s_profile_cache[i];
+        if (it && 0 == memcmp(it->id, id, sizeof(id))) {
+            if (it->exclusive && it->refcnt > 0) {
+                busy = true;
+                continue;
+            }
+            it->refcnt++;
+            it->used_ms = tal_system_get_millisecond();
+            *out = it;
+            tal_mutex_unlock(s_profile_mutex);
+            PR_DEBUG("tls profile reused");
+            return OPRT_OK;
+        }
+        /* a free slot, or else the least recently used idle one */
+        if (NULL == it) {
+            if (NULL == slot || NULL != *slot) {
+                slot = &s_profile_cache[i];
+            }
+        } else if (0 == it->refcnt && (NULL == slot || (*slot && it->used_ms < (*slot)->used_ms))) {
+            slot = &s_profile_cache[i];
+        }
+    }
+    /* the cached one stays cached, the copy goes with its connection */
+    if (busy) {
+        slot = NULL;
+    }
+#endif
+
+    op_ret = __tls_profile_build(config, id, out);
+
+#if defined(ENABLE_TLS_PROFILE_CACHE) && (ENABLE_TLS_PROFILE_CACHE == 1)
+    if (OPRT_OK == op_ret && slot) {
+        if (*slot) {
+            __tls_profile_free(*slot);
+        }
+        (*out)->cached = true;
+        (*out)->used_ms = tal_system_get_millisecond();
+        *slot = *out;
+    }
+#endif
+    tal_mutex_unlock(s_profile_mutex);
+
+    return op_ret;
+}
+
+static void __tls_profile_release(tls_profile_t *profile)
+{
+    if (NULL == profile) {
+        return;
+    }
+
+    if (s_profile_mutex) {
+        tal_mutex_lock(s_profile_mutex);
+    }
+    if (--profile->refcnt == 0 && !profile->cached) {
+        __tls_profile_free(profile);
+    }
+    if (s_profile_mutex) {
+        tal_mutex_unlock(s_profile_mutex);
+    }
+}
+
+/**
+ * @brief Frees the idle cached TLS profiles, the ones in use are freed by
+ * their last connection.
+ *
+ * @return OPRT_OK
+ */
+OPERATE_RET tuya_tls_profile_cache_clear(void)
+{
+#if defined(ENABLE_TLS_PROFILE_CACHE) && (ENABLE_TLS_PROFILE_CACHE == 1)
+    int i;
+
+    if (NULL == s_profile_mutex) {
+        return OPRT_OK;
+    }
+
+    tal_mutex_lock(s_profile_mutex);
+    for (i = 0; i < TLS_PROFILE_CACHE_NUM; i++) {
+        tls_profile_t *it = s_profile_cache[i];
+        if (NULL == it) {
+            continue;
+        }
+        it->cached = false;
+        if (0 == it->refcnt) {
+            __tls_profile_free(it);
+        }
+        s_profile_cache[i] = NULL;
+    }
+    tal_mutex_unlock(s_profile_mutex);
+#endif
+
+    return OPRT_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                            TLS Session Cache                               */
+/* -------------------------------------------------------------------------- */
+
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+static void __tls_session_entry_clear(tls_session_entry_t *entry)
+{
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    entry->host[0] = 0;
+    entry->port = 0;
+    memset(entry->profile_id, 0, sizeof(entry->profile_id));
+}
+
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+/*
+ * kv record: port(2, big endian) | host_len(1) | host | profile id(32) | mbedtls_ssl_session_save() blob
+ */
+static void __tls_session_persist(int idx)
+{
+    char key[16];
+    tls_session_entry_t *entry = &s_session_cache[idx];
+
+    snprintf(key, sizeof(key), TLS_SESSION_KV_KEY, idx);
+    if (0 == entry->host[0]) {
+        tal_kv_del(key);
+        return;
+    }
+
+    size_t host_len = strlen(entry->host);
+    size_t blob_len = 0;
+    mbedtls_ssl_session_save(&entry->session, NULL, 0, &blob_len);
+    if (0 == blob_len) {
+        return;
+    }
+
+    size_t head_len = 3 + host_len + sizeof(entry->profile_id);
+    uint8_t *buf = tal_malloc(head_len + blob_len);
+    if (NULL == buf) {
+        return;
+    }
+    buf[0] = entry->port >> 8;
+    buf[1] = entry->port & 0xFF;
+    buf[2] = host_len;
+    memcpy(buf + 3, entry->host, host_len);
+    memcpy(buf + 3 + host_len, entry->profile_id, sizeof(entry->profile_id));
+    if (0 == mbedtls_ssl_session_save(&entry->session, buf + head_len, blob_len, &blob_len)) {
+        tal_kv_set(key, buf, head_len + blob_len);
+    }
+    tal_free(buf);
+}
+
+static void __tls_session_restore(void)
+{
+    int i;
+    char key[16];
+    uint8_t *buf = NULL;
+    size_t len = 0;
+
+    for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+        snprintf(key, sizeof(key), TLS_SESSION_KV_KEY, i);
+        if (OPRT_OK != tal_kv_get(key, &buf, &len)) {
+            continue;
+        }
+
+        tls_session_entry_t *entry = &s_session_cache[i];
+        size_t host_len = (len >= 3) ? buf[2] : 0;
+        size_t head_len = 3 + host_len + sizeof(entry->profile_id);
+        if (host_len > 0 && host_len < TLS_URL_LEN && len > head_len &&
+            0 == mbedtls_ssl_session_load(&entry->session, buf + head_len, len - head_len)) {
+            entry->port = (buf[0] << 8) | buf[1];
+            memcpy(entry->host, buf + 3, host_len);
+            entry->host[host_len] = 0;
+            memcpy(entry->profile_id, buf + 3 + host_len, sizeof(entry->profile_id));
+            entry->saved_ms = tal_system_get_millisecond();
+        } else {
+            /* saved by another mbedtls build or record layout, or corrupted */
+            __tls_session_entry_clear(entry);
+            tal_kv_del(key);
+        }
+        tal_kv_free(buf);
+    }
+}
+#endif
+
+static tls_session_entry_t *__tls_session_find(const char *hostname, int port_num, const uint8_t profile_id[32])
+{
+    int i;
+
+    for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+        if (s_session_cache[i].port == port_num && 0 == strcmp(s_session_cache[i].host, hostname) &&
+            0 == memcmp(s_session_cache[i].profile_id, profile_id, sizeof(s_session_cache[i].profile_id))) {
+            return &s_session_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Offers the cached session of hostname:port_num set up under the same
+ * profile for resumption.
+ *
+ * The server falls back to a full handshake if it no longer knows the
+ * session, so a stale entry only costs the few bytes of the offer.
+ *
+ * @return true if a session was offered
+ */
+static bool __tls_session_offer(mbedtls_ssl_context *p_ssl_ctx, const char *hostname, int port_num,
+                                const uint8_t profile_id[32])
+{
+    bool offered = false;
+
+    if (NULL == hostname || NULL == s_session_mutex) {
+        return false;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+    if (!s_session_loaded) {
+        s_session_loaded = true;
+        __tls_session_restore();
+    }
+#endif
+    tls_session_entry_t *entry = __tls_session_find(hostname, port_num, profile_id);
+    if (entry) {
+        if (tal_system_get_millisecond() - entry->saved_ms >= TLS_SESSION_CACHE_LIFETIME_S * 1000ULL) {
+            __tls_session_entry_clear(entry);
+        } else if (0 == mbedtls_ssl_set_session(p_ssl_ctx, &entry->session)) {
+            offered = true;
+        }
+    }
+    tal_mutex_unlock(s_session_mutex);
+
+    return offered;
+}
+
+/**
+ * @brief Checks whether the handshake resumed the offered session.
+ *
+ * A resumed session keeps its master secret, a full handshake derives a
+ * new one. The session id does not tell, with tickets the client makes up
+ * a random one (RFC 5077 3.4).
+ */
+static bool __tls_session_resumed(mbedtls_ssl_context *p_ssl_ctx, const char *hostname, int port_num,
+                                  const uint8_t profile_id[32])
+{
+    bool resumed = false;
+
+    tal_mutex_lock(s_session_mutex);
+    tls_session_entry_t *entry = __tls_session_find(hostname, port_num, profile_id);
+    const mbedtls_ssl_session *cur = p_ssl_ctx->MBEDTLS_PRIVATE(session);
+    if (entry && cur &&
+        0 == memcmp(cur->MBEDTLS_PRIVATE(master), entry->session.MBEDTLS_PRIVATE(master),
+                    sizeof(cur->MBEDTLS_PRIVATE(master)))) {
+        resumed = true;
+    }
+    tal_mutex_unlock(s_session_mutex);
+
+    return resumed;
+}
+
+/**
+ * @brief Saves the session negotiated by a completed handshake.
+ *
+ * The entry of hostname:port_num is replaced, otherwise a free or the
+ * oldest entry is taken.
+ *
+ * @param persist also write the entry to kv, if ENABLE_TLS_SESSION_PERSIST
+ */
+static void __tls_session_save(mbedtls_ssl_context *p_ssl_ctx, const char *hostname, int port_num,
+                               const uint8_t profile_id[32], bool persist)
+{
+    int i;
+
+    if (NULL == hostname || strlen(hostname) >= TLS_URL_LEN || NULL == s_session_mutex) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    tls_session_entry_t *entry = __tls_session_find(hostname, port_num, profile_id);
+    if (NULL == entry) {
+        entry = &s_session_cache[0];
+        for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+            if (0 == s_session_cache[i].host[0]) {
+                entry = &s_session_cache[i];
+                break;
+            }
+            if (s_session_cache[i].saved_ms < entry->saved_ms) {
+                entry = &s_session_cache[i];
+            }
+        }
+    }
+
+    __tls_session_entry_clear(entry);
+    if (0 == mbedtls_ssl_get_session(p_ssl_ctx, &entry->session)) {
+        strcpy(entry->host, hostname);
+        entry->port = port_num;
+        memcpy(entry->profile_id, profile_id, sizeof(entry->profile_id));
+        entry->saved_ms = tal_system_get_millisecond();
+    } else {
+        __tls_session_entry_clear(entry);
+    }
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+    if (persist) {
+        __tls_session_persist(entry - s_session_cache);
+    }
+#endif
+    tal_mutex_unlock(s_session_mutex);
+}
+
+static void __tls_session_drop(const char *hostname, int port_num, const uint8_t profile_id[32])
+{
+    if (NULL == hostname || NULL == s_session_mutex) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    tls_session_entry_t *entry = __tls_session_find(hostname, port_num, profile_id);
+    if (entry) {
+        __tls_session_entry_clear(entry);
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+        __tls_session_persist(entry - s_session_cache);
+#endif
+    }
+    tal_mutex_unlock(s_session_mutex);
+}
+#endif
+
+/**
+ * @brief Forgets all cached TLS sessions, including persisted ones.
+ *
+ * @return OPRT_OK
+ */
+OPERATE_RET tuya_tls_session_cache_clear(void)
+{
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    int i;
+
+    if (NULL == s_session_mutex) {
+        return OPRT_OK;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+        __tls_session_entry_clear(&s_session_cache[i]);
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+        __tls_session_persist(i);
+#endif
+    }
+    tal_mutex_unlock(s_session_mutex);
+#endif
+
+    return OPRT_OK;
+}
 
 /**
  * @brief Initializes the Tuya TLS module.
@@ -426,6 +961,33 @@ OPERATE_RET tuya_tls_init(void)
     }
     mbedtls_ctr_drbg_set_prediction_resistance(&ty_ctr_drbg, MBEDTLS_CTR_DRBG_PR_OFF);
 
+    /* the random pool must be locked before any thread draws from it */
+    op_ret = uni_random_init();
+    if (op_ret != OPRT_OK) {
+        PR_ERR("uni_random_init fail. %d", op_ret);
+        goto exit;
+    }
+
+    op_ret = cipher_aead_cache_init();
+    if (op_ret != OPRT_OK) {
+        PR_ERR("cipher_aead_cache_init fail. %d", op_ret);
+        goto exit;
+    }
+
+    if (NULL == s_profile_mutex) {
+        tal_mutex_create_init(&s_profile_mutex);
+    }
+
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    if (NULL == s_session_mutex) {
+        int i;
+        for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+            mbedtls_ssl_session_init(&s_session_cache[i].session);
+        }
+        tal_mutex_create_init(&s_session_mutex);
+    }
+#endif
+
     PR_NOTICE("tuya_tls_init ok!");
 
     return OPRT_OK;
@@ -551,6 +1113,9 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
 {
     OPERATE_RET op_ret;
     tuya_mbedtls_context_t *tls_context = (tuya_mbedtls_context_t *)p_tls_handler;
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    bool session_offered = false;
+#endif
 
     if (NULL == p_tls_handler || socket_fd < 0) {
         PR_ERR("INPUT INVALID PARM");
@@ -570,77 +1135,64 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
     PR_DEBUG("TUYA_TLS Begin Connect %s:%d", (hostname ? hostname : ""), port_num);
 
     mbedtls_ssl_context *p_ssl_ctx = &(tls_context->ssl_ctx);
-    mbedtls_ssl_config *p_conf_ctx = &(tls_context->conf_ctx);
 
-    mbedtls_ssl_init(p_ssl_ctx);
-    mbedtls_ssl_config_init(p_conf_ctx);
+    /* a connection that was never disconnected */
+    __tls_profile_release(tls_context->profile);
+    tls_context->profile = NULL;
 
-    mbedtls_ssl_conf_dbg(p_conf_ctx, __tuya_tls_log, NULL);
-    mbedtls_ssl_conf_rng(p_conf_ctx, __tuya_tls_random, NULL);
+    mbedtls_ssl_init(p_ssl_ctx);
 
 #if defined(ENABLE_MBEDTLS_DEBUG) && (ENABLE_MBEDTLS_DEBUG == 1)
     mbedtls_debug_set_threshold(3);
     mbedtls_ssl_set_export_keys_cb(p_ssl_ctx, __tuya_tls_export_keys, NULL);
 #endif
 
-    op_ret = mbedtls_ssl_config_defaults(p_conf_ctx, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
-                                         MBEDTLS_SSL_PRESET_DEFAULT);
-    if (op_ret != 0) {
-        PR_ERR("mbedtls_ssl_config_defaults Fail. %x %d", op_ret, op_ret);
-        goto tuya_tls_connect_EXIT;
-    }
-
-#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
-#if (MBEDTLS_SSL_MAX_CONTENT_LEN >= 4096)
-    mbedtls_ssl_conf_max_frag_len(p_conf_ctx, MBEDTLS_SSL_MAX_FRAG_LEN_4096);
-#else
-    mbedtls_ssl_conf_max_frag_len(p_conf_ctx, MBEDTLS_SSL_MAX_FRAG_LEN_1024);
-#endif
-#endif
     if (s_pre_conn_cb) {
         PR_DEBUG("s_pre_conn_cb  %08x", s_pre_conn_cb);
         s_pre_conn_cb(hostname, (tuya_tls_hander *)tls_context);
     }
-    if (tls_context->config.psk_key_size > 0 && tls_context->config.psk_id_size > 0) {
-        mbedtls_ssl_conf_psk(p_conf_ctx, (const unsigned char *)tls_context->config.psk_key,
-                             tls_context->config.psk_key_size, (const unsigned char *)tls_context->config.psk_id,
-                             tls_context->config.psk_id_size);
-        mbedtls_ssl_conf_ciphersuites(p_conf_ctx, tuya_tls_ciphersuite_list_PSK);
-    } else {
-        op_ret = mbedtls_cert_pkey_parse(p_tls_handler);
+
+    /* the shared ssl config, only the ssl context is per connection */
+    op_ret = __tls_profile_acquire(&tls_context->config, &tls_context->profile);
+    if (op_ret != OPRT_OK) {
+        PR_ERR("tls profile acquire Fail. 0x%x %d", -op_ret, op_ret);
+        return op_ret;
+    }
+    if (!__tls_config_is_psk(&tls_context->config) && hostname) {
+        op_ret = mbedtls_ssl_set_hostname(p_ssl_ctx, hostname);
         if (op_ret != 0) {
-            PR_ERR("mbedtls_cert_parse_process Fail. 0x%x %d", -op_ret, op_ret);
-            mbedtls_cert_pkey_free(p_tls_handler);
+            PR_ERR("mbedtls_ssl_set_hostname Fail. 0x%x", -op_ret);
+            mbedtls_ssl_free(p_ssl_ctx);
+            __tls_profile_release(tls_context->profile);
+            tls_context->profile = NULL;
             return op_ret;
         }
-        if (hostname) {
-            op_ret = mbedtls_ssl_set_hostname(p_ssl_ctx, hostname);
-            if (op_ret != 0) {
-                PR_ERR("mbedtls_ssl_set_hostname Fail. 0x%x", -op_ret);
-                mbedtls_cert_pkey_free(p_tls_handler);
-                return op_ret;
-            }
-        }
-        mbedtls_ssl_conf_ciphersuites(p_conf_ctx, tuya_tls_ciphersuite_list);
     }
     /* Setup */
-    op_ret = mbedtls_ssl_setup(p_ssl_ctx, p_conf_ctx);
+    op_ret = mbedtls_ssl_setup(p_ssl_ctx, &tls_context->profile->conf);
     if (op_ret != 0) {
         PR_ERR("mbedtls_ssl_setup Fail. 0x%x", op_ret);
-        if (tls_context->config.mode != TUYA_TLS_PSK_MODE) {
-            mbedtls_cert_pkey_free(p_tls_handler);
-        }
         goto tuya_tls_connect_EXIT;
     }
 
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    /* PSK handshakes skip the certificate exchange already */
+    if (tls_context->config.mode != TUYA_TLS_PSK_MODE) {
+        session_offered = __tls_session_offer(p_ssl_ctx, hostname, port_num, tls_context->profile->id);
+    }
+#endif
+
     /* BIO default config */
     tls_context->socket_fd = socket_fd;
     tls_context->overtime_s = overtime_s;
+    tls_context->tx_bytes = 0;
+    tls_context->rx_bytes = 0;
     tal_net_set_timeout(tls_context->socket_fd, overtime_s * 1000, TRANS_SEND);
     mbedtls_ssl_set_bio(p_ssl_ctx, tls_context, __tuya_tls_socket_send_cb, __tuya_tls_socket_recv_cb, NULL);
     PR_DEBUG("socket fd is set. set to inner send/recv to handshake");
 
     TIME_T cur_time = tal_time_get_posix();
+    SYS_TIME_T handshake_start = tal_system_get_millisecond();
 
     while ((op_ret = mbedtls_ssl_handshake(p_ssl_ctx)) != 0) {
         if (op_ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
@@ -664,9 +1216,12 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
         }
     }
 
-    if (tls_context->config.mode != TUYA_TLS_PSK_MODE) {
-        mbedtls_cert_pkey_free(p_tls_handler);
+    if (!tls_context->profile->cached) {
+        /* nobody else uses it, the certs are not needed after the handshake */
+        __tls_profile_certs_free(tls_context->profile);
+    }
 
+    if (tls_context->config.mode != TUYA_TLS_PSK_MODE) {
         uint32_t handshake_flags = 0;
         /* In real life, we probably want to bail out when ret != 0 */
         if ((handshake_flags = mbedtls_ssl_get_verify_result(p_ssl_ctx)) != 0) {
@@ -679,6 +1234,20 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
         goto tuya_tls_connect_EXIT;
     }
 
+    bool resumed = false;
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    if (session_offered) {
+        resumed = __tls_session_resumed(p_ssl_ctx, hostname, port_num, tls_context->profile->id);
+    }
+    if (tls_context->config.mode != TUYA_TLS_PSK_MODE) {
+        /* a resumed session may come with a fresh ticket, keep it in RAM */
+        __tls_session_save(p_ssl_ctx, hostname, port_num, tls_context->profile->id, !resumed);
+    }
+#endif
+    PR_DEBUG("handshake %s %u ms, tx %u rx %u bytes", resumed ? "resumed" : "full",
+             (uint32_t)(tal_system_get_millisecond() - handshake_start), tls_context->tx_bytes,
+             tls_context->rx_bytes);
+
     PR_DEBUG("handshake finish for %s. set send/recv to user set", (hostname ? hostname : ""));
     if (tls_context->config.f_send && tls_context->config.f_recv) {
         mbedtls_ssl_set_bio(p_ssl_ctx, tls_context->config.user_data, tls_context->config.f_send,
@@ -692,6 +1261,12 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
 
 tuya_tls_connect_EXIT:
 
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1)
+    /* never offer a session again that ended in a failed handshake */
+    if (session_offered) {
+        __tls_session_drop(hostname, port_num, tls_context->profile->id);
+    }
+#endif
     PR_ERR("TUYA_TLS faild Connect %s:%d", (hostname ? hostname : ""), port_num);
 
     return op_ret;
@@ -811,10 +1386,10 @@ OPERATE_RET tuya_tls_disconnect(tuya_tls_hander tls_handler)
     }
 
     mbedtls_ssl_context *p_ssl_ctx = &(tls_context->ssl_ctx);
-    mbedtls_ssl_config *p_conf_ctx = &(tls_context->conf_ctx);
 
     mbedtls_ssl_free(p_ssl_ctx);
-    mbedtls_ssl_config_free(p_conf_ctx);
+    __tls_profile_release(tls_context->profile);
+    tls_context->profile = NULL;
 
     mu_ret = tal_mutex_unlock(tls_context->read_mutex);
     if (OPRT_OK != mu_ret) {
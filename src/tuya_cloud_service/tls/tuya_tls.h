@@ -221,6 +221,23 @@ OPERATE_RET tuya_tls_disconnect(tuya_tls_hander tls_handler);
  */
 const tuya_tls_config_t *tuya_tls_psk_mode_config_get(void);
 
+/**
+ * @brief forget all cached TLS sessions, persisted ones included
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tuya_tls_session_cache_clear(void);
+
+/**
+ * @brief free the cached CA chains and ssl configs that no connection uses,
+ * the ones in use are freed with their last connection
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tuya_tls_profile_cache_clear(void);
+
 /**
  * Retrieves the callback function for Tuya TLS events.
  *
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+##
+# @file log_decoder.py
+# @brief Decode binary log lines of tal_log (ENABLE_LOG_BINARY) back to text
+# @version 1.0.0
+# @date 2026-10-16
+#
+# A binary record only carries the addresses of the format string and of the
+# file name, so the ELF of the firmware that produced the log is needed.
+# Lines that are not binary records are printed unchanged.
+#
+# usage:
+#   log_decoder.py -e app.elf capture.log
+#   miniterm.py /dev/ttyUSB0 115200 | log_decoder.py -e app.elf
+
+import argparse
+import base64
+import datetime
+import re
+import struct
+import sys
+
+LOG_BIN_VERSION = 0x10
+LOG_BIN_TRUNC = 0x08
+LOG_BIN_ANCHOR = b"tal_log binary v1\0"
+LEVEL_STR = ["E", "W", "N", "I", "D", "T", "?", "?"]
+
+RE_ANCHOR = re.compile(r"#BI (0x)?([0-9a-fA-F]+)")
+RE_RECORD = re.compile(r"#B([A-Za-z0-9+/]+={0,2})")
+RE_CONV = re.compile(r"%([-+ #0']*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|q|j|z|t|L)?([diouxXcpsaAeEfFgGn%])")
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class Elf(object):
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+
+        self.is64 = data[4] == 2
+        self.end = "<" if data[5] == 1 else ">"
+        self.ptr_size = 8 if self.is64 else 4
+        self.long_size = 8 if self.is64 else 4
+        self.sections = []
+
+        if self.is64:
+            shoff, = struct.unpack_from(self.end + "Q", data, 0x28)
+            shentsize, shnum = struct.unpack_from(self.end + "HH", data, 0x3A)
+            sh_fmt = self.end + "IIQQQQ"
+        else:
+            shoff, = struct.unpack_from(self.end + "I", data, 0x20)
+            shentsize, shnum = struct.unpack_from(self.end + "HH", data, 0x2E)
+            sh_fmt = self.end + "IIIIII"
+
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from(sh_fmt, data, shoff + i * shentsize)
+            if (flags & SHF_ALLOC) and sh_type != SHT_NOBITS and addr and size:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def find(self, pattern):
+        for addr, body in self.sections:
+            pos = body.find(pattern)
+            if pos >= 0:
+                return addr + pos
+        return None
+
+    def string(self, addr):
+        for base, body in self.sections:
+            if base <= addr < base + len(body):
+                off = addr - base
+                stop = body.find(b"\0", off)
+                if stop < 0:
+                    return None
+                return body[off:stop].decode("utf-8", "replace")
+        return None
+
+
+class Decoder(object):
+    def __init__(self, elf, utc_offset, show_ms):
+        self.elf = elf
+        self.slide = 0
+        self.utc_offset = utc_offset
+        self.show_ms = show_ms
+        self.anchor = elf.find(LOG_BIN_ANCHOR)
+
+    def set_anchor(self, addr):
+        if self.anchor is None:
+            sys.stderr.write("log_decoder: anchor string not found in ELF, assuming no offset\n")
+            return
+        self.slide = addr - self.anchor
+
+    def _take(self, rec, pos, fmt):
+        size = struct.calcsize(fmt)
+        if pos + size > len(rec):
+            raise IndexError
+        return struct.unpack_from(self.elf.end + fmt, rec, pos)[0], pos + size
+
+    def _var(self, rec, pos):
+        v = 0
+        shift = 0
+        while True:
+            if pos >= len(rec):
+                raise IndexError
+            b = rec[pos]
+            pos += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v, pos
+
+    def _int(self, rec, pos, signed):
+        v, pos = self._var(rec, pos)
+        if signed:
+            v = (v >> 1) ^ -(v & 1)
+        return v, pos
+
+    def _int_bits(self, lmod):
+        if lmod == "l":
+            return self.elf.long_size * 8
+        if lmod in ("ll", "q", "j", "L"):
+            return 64
+        if lmod in ("z", "t"):
+            return self.elf.ptr_size * 8
+        return 32
+
+    def _expand(self, fmt, rec, pos):
+        out = []
+        last = 0
+        for m in RE_CONV.finditer(fmt):
+            out.append(fmt[last:m.start()])
+            last = m.end()
+            flags, width, prec, lmod, conv = m.groups()
+            if conv == "%":
+                out.append("%")
+                continue
+
+            flags = flags.replace("'", "")
+            if width == "*":
+                width, pos = self._int(rec, pos, True)
+            if prec == "*":
+                prec, pos = self._int(rec, pos, True)
+            spec = "%" + flags + (str(width) if width is not None else "")
+            if prec is not None:
+                spec += "." + str(prec if prec != "" else 0)
+
+            if conv in "di":
+                v, pos = self._int(rec, pos, True)
+                out.append((spec + "d") % v)
+            elif conv in "ouxX":
+                v, pos = self._int(rec, pos, False)
+                v &= (1 << self._int_bits(lmod)) - 1
+                out.append((spec + ("d" if conv == "u" else conv)) % v)
+            elif conv == "c":
+                v, pos = self._int(rec, pos, False)
+                out.append((spec + "c") % chr(v & 0xFF))
+            elif conv == "p":
+                v, pos = self._take(rec, pos, "Q" if self.elf.ptr_size == 8 else "I")
+                out.append("0x%x" % v)
+            elif conv == "s":
+                n, pos = self._take(rec, pos, "B")
+                if pos + n > len(rec):
+                    raise IndexError
+                out.append((spec + "s") % rec[pos:pos + n].decode("utf-8", "replace"))
+                pos += n
+            elif conv in "aA":
+                v, pos = self._take(rec, pos, "d")
+                out.append(float.hex(v))
+            elif conv in "eEfFgG":
+                v, pos = self._take(rec, pos, "d")
+                out.append((spec + conv) % v)
+        out.append(fmt[last:])
+        return "".join(out)
+
+    def decode(self, rec):
+        head = rec[0]
+        if head & 0xF0 != LOG_BIN_VERSION:
+            return "<unknown log record version 0x%02x>" % head
+        level = head & 0x07
+        ptr = "Q" if self.elf.ptr_size == 8 else "I"
+
+        pos = 1
+        line, pos = self._var(rec, pos)
+        sec, pos = self._take(rec, pos, "I")
+        ms, pos = self._take(rec, pos, "H")
+        fmt_addr, pos = self._take(rec, pos, ptr)
+        file_addr, pos = self._take(rec, pos, ptr)
+
+        fmt = self.elf.string(fmt_addr - self.slide)
+        file = self.elf.string(file_addr - self.slide) or "?"
+        if fmt is None:
+            msg = "<format 0x%x not in ELF>" % fmt_addr
+        else:
+            try:
+                msg = self._expand(fmt, rec, pos)
+            except IndexError:
+                msg = fmt + " <args missing>"
+            if head & LOG_BIN_TRUNC:
+                msg += " <truncated>"
+
+        tm = datetime.datetime.fromtimestamp(sec + self.utc_offset * 3600, datetime.timezone.utc)
+        stamp = tm.strftime("%m-%d %H:%M:%S")
+        if self.show_ms:
+            stamp += ":%d" % ms
+        return "[%s ty %s][%s:%d] %s" % (stamp, LEVEL_STR[level], file, line, msg)
+
+    def line(self, text):
+        m = RE_ANCHOR.search(text)
+        if m:
+            self.set_anchor(int(m.group(2), 16))
+            return None
+        m = RE_RECORD.search(text)
+        if not m:
+            return text
+        try:
+            rec = base64.b64decode(m.group(1))
+        except ValueError:
+            return text
+        try:
+            return text[:m.start()] + self.decode(rec)
+        except IndexError:
+            return text[:m.start()] + "<short log record>"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="decode tal_log binary log lines")
+    parser.add_argument("-e", "--elf", required=True, help="ELF of the firmware that wrote the log")
+    parser.add_argument("-z", "--utc-offset", type=float, default=0, help="time zone of the output in hours")
+    parser.add_argument("-m", "--ms", action="store_true", help="show milliseconds")
+    parser.add_argument("log", nargs="?", help="captured log, stdin if omitted")
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf), args.utc_offset, args.ms)
+    src = open(args.log, "r", encoding="utf-8", errors="replace") if args.log else sys.stdin
+    for text in src:
+        out = decoder.line(text.rstrip("\r\n"))
+        if out is not None:
+            print(out)
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
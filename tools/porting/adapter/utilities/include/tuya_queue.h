@@ -32,6 +32,20 @@ typedef BOOL_T (*TRAVERSE_CB)(void *item, void *ctx);
  */
 OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle);
 
+/**
+ * @brief create a queue (FIFO) whose item slots are allocated at creation
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[out] handle the queue handle
+ *
+ * @note input and output never allocate and run without the mutex, they are safe
+ * from any number of threads. The slots are rounded up to a power of 2.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_prealloc(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle);
+
 /**
  * @brief enqueue, append to the tail
  *
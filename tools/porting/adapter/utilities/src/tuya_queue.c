@@ -28,6 +28,35 @@
 #define QUEUE_UNLOCK(queue)       tkl_mutex_unlock(queue->mutex)
 #endif
 
+/*
+ * The preallocated queue is a ring of fixed slots, each slot carries a sequence
+ * number telling whether it is free for the producer of position pos
+ * (seq == pos) or filled for the consumer (seq == pos + 1). Input and output
+ * only claim a position with a CAS, so any number of producers and consumers
+ * run without the mutex. Rare operations that walk or reorder the items
+ * (input_instant, peek, traverse, clear...) take the mutex and set exclusive,
+ * then wait for the running input/output to leave before touching the slots.
+ */
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM) && defined(__GCC_ATOMIC_INT_LOCK_FREE) &&       \
+    (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define QUEUE_RING_LOCK_FREE          1
+#define QUEUE_ATOMIC_LOAD(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define QUEUE_ATOMIC_STORE(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define QUEUE_ATOMIC_ADD(ptr, val)    __atomic_add_fetch((ptr), (val), __ATOMIC_SEQ_CST)
+#define QUEUE_ATOMIC_CAS(ptr, exp, val)                                                                                \
+    __atomic_compare_exchange_n((ptr), (exp), (val), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+// no native atomic instruction, every ring operation runs under the queue lock
+#define QUEUE_RING_LOCK_FREE          0
+#define QUEUE_ATOMIC_LOAD(ptr)        (*(ptr))
+#define QUEUE_ATOMIC_STORE(ptr, val)  (*(ptr) = (val))
+#define QUEUE_ATOMIC_ADD(ptr, val)    (*(ptr) += (val))
+#define QUEUE_ATOMIC_CAS(ptr, exp, val)                                                                                \
+    ((*(ptr) == *(exp)) ? (*(ptr) = (val), TRUE) : (*(exp) = *(ptr), FALSE))
+#endif
+
+#define QUEUE_ALIGN(size) (((size) + 7) & ~7)
+
 typedef enum { POLICY_SEND_TO_BACK, POLICY_SEND_TO_FRONT, POLICY_MAX } ENQUEUE_POLICY_E;
 
 typedef struct {
@@ -35,6 +64,12 @@ typedef struct {
     uint8_t data[];
 } QUEUE_ITEM_T;
 
+typedef struct {
+    uint32_t seq;
+    uint32_t reserved; // keep data 8 bytes aligned
+    uint8_t data[];
+} QUEUE_SLOT_T;
+
 typedef struct {
 #if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
     TKL_MUTEX_HANDLE mutex;
@@ -45,8 +80,153 @@ typedef struct {
     uint32_t queue_free;
 
     LIST_HEAD head;
+
+    // preallocated ring, NULL for the list queue
+    uint8_t *ring;
+    uint32_t ring_mask;
+    uint32_t slot_size;
+    uint32_t enq_pos;
+    uint32_t deq_pos;
+    uint32_t active;    // input/output running without the lock
+    uint32_t exclusive; // an operation holding the lock owns the slots
 } TUYA_QUEUE_T;
 
+static QUEUE_SLOT_T *__ring_slot(TUYA_QUEUE_T *queue, uint32_t pos)
+{
+    return (QUEUE_SLOT_T *)(queue->ring + (pos & queue->ring_mask) * queue->slot_size);
+}
+
+#if QUEUE_RING_LOCK_FREE
+static void __ring_enter(TUYA_QUEUE_T *queue)
+{
+    for (;;) {
+        QUEUE_ATOMIC_ADD(&queue->active, 1);
+        if (0 == __atomic_load_n(&queue->exclusive, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+        QUEUE_ATOMIC_ADD(&queue->active, (uint32_t)-1);
+
+        // wait for the exclusive operation to release the lock
+        QUEUE_LOCK(queue);
+        QUEUE_UNLOCK(queue);
+    }
+}
+
+static void __ring_lock(TUYA_QUEUE_T *queue)
+{
+    QUEUE_LOCK(queue);
+    __atomic_store_n(&queue->exclusive, 1, __ATOMIC_SEQ_CST);
+    while (0 != __atomic_load_n(&queue->active, __ATOMIC_SEQ_CST)) {
+        tkl_system_sleep(1);
+    }
+}
+
+#define RING_ENTER(queue)  __ring_enter(queue)
+#define RING_LEAVE(queue)  QUEUE_ATOMIC_ADD(&(queue)->active, (uint32_t)-1)
+#define RING_LOCK(queue)   __ring_lock(queue)
+#define RING_UNLOCK(queue)                                                                                             \
+    do {                                                                                                               \
+        QUEUE_ATOMIC_STORE(&(queue)->exclusive, 0);                                                                    \
+        QUEUE_UNLOCK(queue);                                                                                           \
+    } while (0)
+#else
+#define RING_ENTER(queue)  QUEUE_LOCK(queue)
+#define RING_LEAVE(queue)  QUEUE_UNLOCK(queue)
+#define RING_LOCK(queue)   QUEUE_LOCK(queue)
+#define RING_UNLOCK(queue) QUEUE_UNLOCK(queue)
+#endif
+
+static OPERATE_RET __ring_push(TUYA_QUEUE_T *queue, const void *item)
+{
+    OPERATE_RET op_ret = OPRT_EXCEED_UPPER_LIMIT;
+    uint32_t pos = 0;
+    QUEUE_SLOT_T *slot = NULL;
+
+    RING_ENTER(queue);
+    pos = QUEUE_ATOMIC_LOAD(&queue->enq_pos);
+    for (;;) {
+        // the ring is rounded up to a power of 2, queue_len is the real limit
+        if ((int32_t)(pos - QUEUE_ATOMIC_LOAD(&queue->deq_pos)) >= (int32_t)queue->queue_len) {
+            break;
+        }
+
+        slot = __ring_slot(queue, pos);
+        int32_t diff = (int32_t)(QUEUE_ATOMIC_LOAD(&slot->seq) - pos);
+        if (0 == diff) {
+            if (QUEUE_ATOMIC_CAS(&queue->enq_pos, &pos, pos + 1)) {
+                memcpy(slot->data, item, queue->item_size);
+                QUEUE_ATOMIC_STORE(&slot->seq, pos + 1);
+                op_ret = OPRT_OK;
+                break;
+            }
+        } else if (diff < 0) {
+            break; // slot still being read by a consumer
+        } else {
+            pos = QUEUE_ATOMIC_LOAD(&queue->enq_pos);
+        }
+    }
+    RING_LEAVE(queue);
+
+    return op_ret;
+}
+
+static OPERATE_RET __ring_pop(TUYA_QUEUE_T *queue, void *item)
+{
+    OPERATE_RET op_ret = OPRT_NOT_FOUND;
+    uint32_t pos = 0;
+    QUEUE_SLOT_T *slot = NULL;
+
+    RING_ENTER(queue);
+    pos = QUEUE_ATOMIC_LOAD(&queue->deq_pos);
+    for (;;) {
+        slot = __ring_slot(queue, pos);
+        int32_t diff = (int32_t)(QUEUE_ATOMIC_LOAD(&slot->seq) - (pos + 1));
+        if (0 == diff) {
+            if (QUEUE_ATOMIC_CAS(&queue->deq_pos, &pos, pos + 1)) {
+                if (item) {
+                    memcpy(item, slot->data, queue->item_size);
+                }
+                QUEUE_ATOMIC_STORE(&slot->seq, pos + queue->ring_mask + 1);
+                op_ret = OPRT_OK;
+                break;
+            }
+        } else if (diff < 0) {
+            break; // empty, or the producer has not finished the copy
+        } else {
+            pos = QUEUE_ATOMIC_LOAD(&queue->deq_pos);
+        }
+    }
+    RING_LEAVE(queue);
+
+    return op_ret;
+}
+
+// called with RING_LOCK held, no input/output is running
+static OPERATE_RET __ring_push_front(TUYA_QUEUE_T *queue, const void *item)
+{
+    uint32_t pos = queue->deq_pos - 1;
+
+    if (queue->enq_pos - queue->deq_pos >= queue->queue_len) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    QUEUE_SLOT_T *slot = __ring_slot(queue, pos);
+    memcpy(slot->data, item, queue->item_size);
+    QUEUE_ATOMIC_STORE(&slot->seq, pos + 1);
+    QUEUE_ATOMIC_STORE(&queue->deq_pos, pos);
+
+    return OPRT_OK;
+}
+
+static uint32_t __ring_used(TUYA_QUEUE_T *queue)
+{
+    // deq first: it never passes enq, a stale deq only makes used larger
+    uint32_t deq = QUEUE_ATOMIC_LOAD(&queue->deq_pos);
+    uint32_t used = QUEUE_ATOMIC_LOAD(&queue->enq_pos) - deq;
+
+    return (used > queue->queue_len) ? queue->queue_len : used;
+}
+
 static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE_POLICY_E policy)
 {
     OPERATE_RET op_ret = OPRT_OK;
@@ -57,6 +237,16 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
+    if (queue->ring) {
+        if (POLICY_SEND_TO_BACK == policy) {
+            return __ring_push(queue, item);
+        }
+        RING_LOCK(queue);
+        op_ret = __ring_push_front(queue, item);
+        RING_UNLOCK(queue);
+        return op_ret;
+    }
+
     QUEUE_ITEM_T *queue_item = (QUEUE_ITEM_T *)tkl_system_malloc(sizeof(QUEUE_ITEM_T) + queue->item_size);
     if (NULL == queue_item) {
         return OPRT_MALLOC_FAILED;
@@ -106,6 +296,7 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
     if (!queue) {
         return OPRT_MALLOC_FAILED;
     }
+    memset(queue, 0, sizeof(TUYA_QUEUE_T));
 
     op_ret = QUEUE_CREATE_LOCK(queue);
     if (OPRT_OK != op_ret) {
@@ -123,6 +314,63 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
     return OPRT_OK;
 }
 
+/**
+ * @brief create a queue (FIFO) whose item slots are allocated at creation
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[out] handle the queue handle
+ *
+ * @note input and output never allocate and run without the mutex, they are safe
+ * from any number of threads. The slots are rounded up to a power of 2.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_prealloc(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    TUYA_QUEUE_T *queue = NULL;
+    uint32_t ring_num = 1;
+    uint32_t slot_size = QUEUE_ALIGN(sizeof(QUEUE_SLOT_T) + item_size);
+    uint32_t i = 0;
+
+    if ((NULL == handle) || (0 == queue_len) || (queue_len > 0x8000000) || (0 == item_size)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    while (ring_num < queue_len) {
+        ring_num <<= 1;
+    }
+
+    queue = (TUYA_QUEUE_T *)tkl_system_malloc(QUEUE_ALIGN(sizeof(TUYA_QUEUE_T)) + ring_num * slot_size);
+    if (!queue) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(queue, 0, sizeof(TUYA_QUEUE_T));
+
+    op_ret = QUEUE_CREATE_LOCK(queue);
+    if (OPRT_OK != op_ret) {
+        tkl_system_free(queue);
+        return OPRT_COM_ERROR;
+    }
+
+    queue->item_size = item_size;
+    queue->queue_len = queue_len;
+    queue->queue_free = queue_len;
+    INIT_LIST_HEAD(&(queue->head));
+
+    queue->ring = (uint8_t *)queue + QUEUE_ALIGN(sizeof(TUYA_QUEUE_T));
+    queue->ring_mask = ring_num - 1;
+    queue->slot_size = slot_size;
+    for (i = 0; i < ring_num; i++) {
+        __ring_slot(queue, i)->seq = i;
+    }
+
+    *handle = (TUYA_QUEUE_HANDLE)queue;
+
+    return OPRT_OK;
+}
+
 /**
  * @brief enqueue
  *
@@ -167,6 +415,10 @@ OPERATE_RET tuya_queue_output(TUYA_QUEUE_HANDLE handle, const void *item)
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
+    if (queue->ring) {
+        return __ring_pop(queue, (void *)item);
+    }
+
     QUEUE_LOCK(queue);
     if (queue->queue_free < queue->queue_len) {
         QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
@@ -202,6 +454,17 @@ OPERATE_RET tuya_queue_peek(TUYA_QUEUE_HANDLE handle, const void *item)
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
+    if (queue->ring) {
+        RING_LOCK(queue);
+        if (queue->enq_pos != queue->deq_pos) {
+            memcpy((void *)item, __ring_slot(queue, queue->deq_pos)->data, queue->item_size);
+        } else {
+            op_ret = OPRT_NOT_FOUND;
+        }
+        RING_UNLOCK(queue);
+        return op_ret;
+    }
+
     QUEUE_LOCK(queue);
     if (queue->queue_free < queue->queue_len) {
         QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
@@ -231,6 +494,18 @@ OPERATE_RET tuya_queue_traverse(TUYA_QUEUE_HANDLE handle, TRAVERSE_CB cb, void *
     struct tuya_list_head *p = NULL;
     QUEUE_ITEM_T *queue_item = NULL;
 
+    if (queue->ring) {
+        uint32_t pos = 0;
+        RING_LOCK(queue);
+        for (pos = queue->deq_pos; pos != queue->enq_pos; pos++) {
+            if (!cb(__ring_slot(queue, pos)->data, ctx)) {
+                break;
+            }
+        }
+        RING_UNLOCK(queue);
+        return OPRT_OK;
+    }
+
     QUEUE_LOCK(queue);
     tuya_list_for_each(p, &(queue->head))
     {
@@ -262,6 +537,17 @@ OPERATE_RET tuya_queue_clear(TUYA_QUEUE_HANDLE handle)
     struct tuya_list_head *n = NULL;
     QUEUE_ITEM_T *queue_item = NULL;
 
+    if (queue->ring) {
+        uint32_t pos = 0;
+        RING_LOCK(queue);
+        for (pos = queue->deq_pos; pos != queue->enq_pos; pos++) {
+            QUEUE_ATOMIC_STORE(&__ring_slot(queue, pos)->seq, pos + queue->ring_mask + 1);
+        }
+        QUEUE_ATOMIC_STORE(&queue->deq_pos, queue->enq_pos);
+        RING_UNLOCK(queue);
+        return OPRT_OK;
+    }
+
     QUEUE_LOCK(queue);
     tuya_list_for_each_safe(p, n, &(queue->head))
     {
@@ -297,6 +583,21 @@ OPERATE_RET tuya_queue_get_batch(TUYA_QUEUE_HANDLE handle, const uint32_t start,
     uint32_t index = 0;
     uint32_t count = 0;
 
+    if (queue->ring) {
+        uint32_t pos = 0;
+        RING_LOCK(queue);
+        for (pos = queue->deq_pos; (pos != queue->enq_pos) && (count < num); pos++) {
+            if (index < start) {
+                index++;
+                continue;
+            }
+            memcpy((uint8_t *)items + count * queue->item_size, __ring_slot(queue, pos)->data, queue->item_size);
+            count++;
+        }
+        RING_UNLOCK(queue);
+        return (index != start || count != num) ? OPRT_NOT_FOUND : OPRT_OK;
+    }
+
     QUEUE_LOCK(queue);
     tuya_list_for_each(p, &(queue->head))
     {
@@ -361,6 +662,10 @@ uint32_t tuya_queue_get_free_num(TUYA_QUEUE_HANDLE handle)
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
+    if (queue->ring) {
+        return queue->queue_len - __ring_used(queue);
+    }
+
     return queue->queue_free;
 }
 
@@ -380,6 +685,10 @@ uint32_t tuya_queue_get_used_num(TUYA_QUEUE_HANDLE handle)
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
     uint32_t used_num = 0;
 
+    if (queue->ring) {
+        return __ring_used(queue);
+    }
+
     QUEUE_LOCK(queue);
     used_num = queue->queue_len - queue->queue_free;
     QUEUE_UNLOCK(queue);
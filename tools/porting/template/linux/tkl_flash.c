@@ -117,6 +117,28 @@ OPERATE_RET tkl_flash_write(uint32_t addr, const uint8_t *src, uint32_t size)
  */
 OPERATE_RET tkl_flash_erase(uint32_t addr, uint32_t size)
 {
+    static uint8_t erased[PARTITION_SIZE];
+    uint32_t n = 0;
+
+    if (!s_flash_file) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    // erase like NOR flash does, so the file behaves as the block device
+    memset(erased, 0xff, sizeof(erased));
+    if (0 != tkl_fseek(s_flash_file, addr, SEEK_SET)) {
+        return OPRT_FILE_OPEN_FAILED;
+    }
+    for (; size > 0; size -= n) {
+        n = (size < PARTITION_SIZE) ? size : PARTITION_SIZE;
+        if (n != tkl_fwrite(erased, n, s_flash_file)) {
+            return OPRT_FILE_WRITE_FAILED;
+        }
+    }
+
+    tkl_fflush(s_flash_file);
+    tkl_fsync(tkl_fileno(s_flash_file));
+
     return OPRT_OK;
 }
 